@@ -31,6 +31,7 @@
 #include <osgEarth/MapNode>
 #include <osgEarth/OGRFeatureSource>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/HeightFieldUtils>
 
 #include <osg/ArgumentParser>
 #include <osg/Timer>
@@ -39,6 +40,7 @@
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
+#include <map>
 
 using namespace osgEarth;
 
@@ -59,13 +61,34 @@ int usage(char** argv)
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
         << "\n    --no-overwrite                      : skip tiles that already exist in the destination"
         << "\n    --threads [int]                     : go faster by using [n] working threads"
+        << "\n    --bottom-up                         : read only the max level from the source and build"
+        << "\n                                          each lower level by downsampling its children"
         << std::endl;
 
     return 0;
 }
 
+// Tile handler that can also build a pyramid from the bottom up: tiles at the
+// max level come from the source, and every other tile is derived from its
+// four children. Tiles are passed around in memory as osg::Objects.
+struct PyramidTileHandler : public TileHandler
+{
+    //! Tile for the key from the source layer, or NULL
+    virtual osg::ref_ptr<const osg::Object> createTile(const TileKey& key) = 0;
+
+    //! Tile for the key made by downsampling its children (indexed by
+    //! child quadrant; any may be NULL), or NULL
+    virtual osg::ref_ptr<const osg::Object> createParentTile(const TileKey& key, const osg::ref_ptr<const osg::Object>* children) = 0;
+
+    //! Existing destination tile to reuse instead of building one, or NULL
+    virtual osg::ref_ptr<const osg::Object> getExistingTile(const TileKey& key) = 0;
+
+    //! Writes the tile to the destination
+    virtual bool writeTile(const TileKey& key, const osg::Object* tile) = 0;
+};
+
 // Visitor that converts image tiles
-struct ImageLayerTileCopy : public TileHandler
+struct ImageLayerTileCopy : public PyramidTileHandler
 {
     ImageLayerTileCopy(ImageLayer* source, ImageLayer* dest, bool overwrite, bool compress)
         : _source(source), _dest(dest), _overwrite(overwrite), _compress(compress)
@@ -75,39 +98,133 @@ struct ImageLayerTileCopy : public TileHandler
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
     {
-        bool ok = false;
-
         // if overwriting is disabled, check to see whether the destination
         // already has data for the key
+        if (getExistingTile(key).valid())
+        {
+            return true;
+        }
+
+        osg::ref_ptr<const osg::Object> tile = createTile(key);
+        return tile.valid() && writeTile(key, tile.get());
+    }
+
+    bool hasData(const TileKey& key) const
+    {
+        return _source->mayHaveData(key);
+    }
+
+    osg::ref_ptr<const osg::Object> createTile(const TileKey& key)
+    {
+        GeoImage image = _source->createImage(key);
+        return image.valid() ? image.getImage() : 0L;
+    }
+
+    osg::ref_ptr<const osg::Object> getExistingTile(const TileKey& key)
+    {
         if (_overwrite == false)
         {
-            if (_dest->createImage(key).valid())
+            GeoImage image = _dest->createImage(key);
+            if (image.valid())
+                return image.getImage();
+        }
+        return 0L;
+    }
+
+    osg::ref_ptr<const osg::Object> createParentTile(const TileKey& key, const osg::ref_ptr<const osg::Object>* children)
+    {
+        // readable copies of the children, all the size of the first one:
+        osg::ref_ptr<const osg::Image> images[4];
+        const osg::Image* first = 0L;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            images[i] = dynamic_cast<const osg::Image*>(children[i].get());
+            if (!images[i].valid())
+                continue;
+
+            if (!ImageUtils::PixelReader::supports(images[i].get()))
+                images[i] = ImageUtils::convertToRGBA8(images[i].get());
+
+            if (first == 0L)
+            {
+                first = images[i].get();
+            }
+            else if (images[i]->s() != first->s() || images[i]->t() != first->t())
             {
-                return true;
+                osg::ref_ptr<osg::Image> resized;
+                if (ImageUtils::resizeImage(images[i].get(), first->s(), first->t(), resized))
+                    images[i] = resized.get();
+                else
+                    images[i] = 0L;
             }
         }
 
-        GeoImage image = _source->createImage(key);
-        if (image.valid())
+        if (first == 0L)
+            return 0L;
+
+        int s = first->s(), t = first->t();
+
+        osg::ref_ptr<osg::Image> parent = new osg::Image();
+        parent->allocateImage(s, t, 1, first->getPixelFormat(), first->getDataType());
+        parent->setInternalTextureFormat(first->getInternalTextureFormat());
+        if (!ImageUtils::PixelWriter::supports(parent.get()))
+        {
+            parent = ImageUtils::convertToRGBA8(parent.get());
+        }
+
+        ImageUtils::PixelWriter write(parent.get());
+        write.assign(osg::Vec4(0, 0, 0, 0));
+
+        ImageUtils::PixelReader read;
+        osg::Vec4f a, b, c, d;
+
+        for (unsigned i = 0; i < 4; ++i)
         {
-            osg::ref_ptr<const osg::Image> imageToWrite = image.getImage();
-            if (_compress)
-                imageToWrite = ImageUtils::compressImage(image.getImage(), "cpu");
+            if (!images[i].valid())
+                continue;
+
+            read.setImage(images[i].get());
 
-            Status status = _dest->writeImage(key, imageToWrite.get(), 0L);
-            ok = status.isOK();
-            if (!ok)
+            // quadrant 0 is the north-west child; image row 0 is the south edge.
+            int s0 = (i == 1 || i == 3) ? s / 2 : 0;
+            int t0 = (i == 0 || i == 1) ? t / 2 : 0;
+            int s1 = s0 == 0 ? s / 2 : s;
+            int t1 = t0 == 0 ? t / 2 : t;
+
+            // 2x2 box filter
+            for (int pt = t0; pt < t1; ++pt)
             {
-                OE_WARN << key.str() << ": " << status.message() << std::endl;
+                int ct = osg::minimum(2 * (pt - t0), t - 1), ct1 = osg::minimum(ct + 1, t - 1);
+                for (int ps = s0; ps < s1; ++ps)
+                {
+                    int cs = osg::minimum(2 * (ps - s0), s - 1), cs1 = osg::minimum(cs + 1, s - 1);
+                    read(a, cs, ct);
+                    read(b, cs1, ct);
+                    read(c, cs, ct1);
+                    read(d, cs1, ct1);
+                    write((a + b + c + d) * 0.25f, ps, pt);
+                }
             }
         }
 
-        return ok;
+        return parent.get();
     }
 
-    bool hasData(const TileKey& key) const
+    bool writeTile(const TileKey& key, const osg::Object* tile)
     {
-        return _source->mayHaveData(key);
+        osg::ref_ptr<const osg::Image> imageToWrite = dynamic_cast<const osg::Image*>(tile);
+        if (!imageToWrite.valid())
+            return false;
+
+        if (_compress)
+            imageToWrite = ImageUtils::compressImage(imageToWrite.get(), "cpu");
+
+        Status status = _dest->writeImage(key, imageToWrite.get(), 0L);
+        if (!status.isOK())
+        {
+            OE_WARN << key.str() << ": " << status.message() << std::endl;
+        }
+        return status.isOK();
     }
 
     osg::ref_ptr<ImageLayer> _source;
@@ -117,7 +234,7 @@ struct ImageLayerTileCopy : public TileHandler
 };
 
 // Visitor that converts elevation tiles
-struct ElevationLayerTileCopy : public TileHandler
+struct ElevationLayerTileCopy : public PyramidTileHandler
 {
     ElevationLayerTileCopy(ElevationLayer* source, ElevationLayer* dest, bool overwrite)
         : _source(source), _dest(dest), _overwrite(overwrite)
@@ -127,43 +244,286 @@ struct ElevationLayerTileCopy : public TileHandler
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
     {
-        bool ok = false;
-
         // if overwriting is disabled, check to see whether the destination
         // already has data for the key
+        if (getExistingTile(key).valid())
+        {
+            return true;
+        }
+
+        osg::ref_ptr<const osg::Object> tile = createTile(key);
+        return tile.valid() && writeTile(key, tile.get());
+    }
+
+    bool hasData(const TileKey& key) const
+    {
+        return _source->mayHaveData(key);
+    }
+
+    osg::ref_ptr<const osg::Object> createTile(const TileKey& key)
+    {
+        GeoHeightField hf = _source->createHeightField(key, 0L);
+        return hf.valid() ? hf.getHeightField() : 0L;
+    }
+
+    osg::ref_ptr<const osg::Object> getExistingTile(const TileKey& key)
+    {
         if (_overwrite == false)
         {
-            if (_dest->createHeightField(key).valid())
+            GeoHeightField hf = _dest->createHeightField(key);
+            if (hf.valid())
+                return hf.getHeightField();
+        }
+        return 0L;
+    }
+
+    osg::ref_ptr<const osg::Object> createParentTile(const TileKey& key, const osg::ref_ptr<const osg::Object>* children)
+    {
+        const osg::HeightField* hfs[4];
+        const osg::HeightField* first = 0L;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            hfs[i] = dynamic_cast<const osg::HeightField*>(children[i].get());
+            if (hfs[i] && first == 0L)
+                first = hfs[i];
+        }
+
+        if (first == 0L)
+            return 0L;
+
+        unsigned cols = first->getNumColumns(), rows = first->getNumRows();
+        const GeoExtent& ex = key.getExtent();
+
+        osg::ref_ptr<osg::HeightField> parent = new osg::HeightField();
+        parent->allocate(cols, rows);
+        parent->setOrigin(osg::Vec3d(ex.xMin(), ex.yMin(), 0.0));
+        parent->setXInterval(ex.width() / (double)(cols - 1));
+        parent->setYInterval(ex.height() / (double)(rows - 1));
+
+        // Adjacent tiles share edge posts, so point-sample the children rather than
+        // filtering; with an odd post count every parent post lands on a child post.
+        for (unsigned row = 0; row < rows; ++row)
+        {
+            double v = (double)row / (double)(rows - 1);
+            bool north = v > 0.5;
+            double cv = north ? 2.0*v - 1.0 : 2.0*v;
+
+            for (unsigned col = 0; col < cols; ++col)
             {
-                return true;
+                double u = (double)col / (double)(cols - 1);
+                bool east = u > 0.5;
+                double cu = east ? 2.0*u - 1.0 : 2.0*u;
+
+                const osg::HeightField* child = hfs[(north ? 0 : 2) + (east ? 1 : 0)];
+                parent->setHeight(col, row, child ?
+                    HeightFieldUtils::getHeightAtNormalizedLocation(child, cu, cv, INTERP_BILINEAR) :
+                    NO_DATA_VALUE);
             }
         }
 
-        GeoHeightField hf = _source->createHeightField(key, 0L);
-        if ( hf.valid() )
+        return parent.get();
+    }
+
+    bool writeTile(const TileKey& key, const osg::Object* tile)
+    {
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(tile);
+        if (!hf)
+            return false;
+
+        Status s = _dest->writeHeightField(key, hf, 0L);
+        if (!s.isOK())
         {
-            Status s = _dest->writeHeightField(key, hf.getHeightField(), 0L);
-            ok = s.isOK();
-            if (!ok)
+            OE_WARN << key.str() << ": " << s.message() << std::endl;
+        }
+        return s.isOK();
+    }
+
+    osg::ref_ptr<ElevationLayer> _source;
+    osg::ref_ptr<ElevationLayer> _dest;
+    bool _overwrite;
+};
+
+
+// Visitor that builds the output pyramid from the bottom up. Only the max
+// level is read from the source; every other tile is created by downsampling
+// its four children while they are still in memory. The traversal is
+// depth-first so only one path of siblings per thread is held at a time.
+// With an existing destination tile (--no-overwrite) the tile is reused and
+// its subtree is skipped, which lets an interrupted run resume.
+class BottomUpTileVisitor : public TileVisitor
+{
+public:
+    BottomUpTileVisitor(PyramidTileHandler* handler) :
+        TileVisitor(handler),
+        _handler(handler),
+        _numThreads(1u),
+        _splitLevel(~0u),
+        _useSplitTiles(false)
+    {
+        //nop
+    }
+
+    void setNumThreads(unsigned numThreads) { _numThreads = osg::maximum(numThreads, 1u); }
+
+    virtual void run(const Profile* mapProfile)
+    {
+        _profile = mapProfile;
+
+        resetProgress();
+
+        estimate();
+
+        // With multiple threads, build independent subtrees in parallel starting
+        // at the first level with enough tiles to keep the threads busy, then
+        // finish the levels above them from the results.
+        _splitLevel = ~0u;
+        _useSplitTiles = false;
+        if (_numThreads > 1u)
+        {
+            for (unsigned lod = 0; lod <= _maxLevel; ++lod)
             {
-                OE_WARN << key.str() << ": " << s.message() << std::endl;
+                unsigned tx, ty;
+                mapProfile->getNumTiles(lod, tx, ty);
+                if (tx * ty >= 4u * _numThreads || lod == _maxLevel)
+                {
+                    _splitLevel = lod;
+                    break;
+                }
             }
+
+            std::vector<TileKey> splitKeys;
+            std::vector<TileKey> keys;
+            mapProfile->getRootKeys(keys);
+            for (unsigned i = 0; i < keys.size(); ++i)
+            {
+                collectKeys(keys[i], splitKeys);
+            }
+
+            JobArena arena("oe.bottomup", _numThreads);
+            JobGroup group;
+            for (unsigned i = 0; i < splitKeys.size(); ++i)
+            {
+                TileKey key = splitKeys[i];
+                std::function<void()> delegate = [this, key]()
+                {
+                    osg::ref_ptr<const osg::Object> tile = buildTile(key);
+                    Threading::ScopedMutexLock lock(_splitMutex);
+                    _splitTiles[key] = tile;
+                };
+                arena.dispatch(delegate, &group);
+            }
+            group.join();
+            _useSplitTiles = true;
+        }
+
+        std::vector<TileKey> keys;
+        mapProfile->getRootKeys(keys);
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            buildTile(keys[i]);
+        }
+
+        _splitTiles.clear();
+        _useSplitTiles = false;
+    }
+
+protected:
+
+    // Gathers the keys at the split level that need building.
+    void collectKeys(const TileKey& key, std::vector<TileKey>& out)
+    {
+        if (!hasData(key) || !intersects(key.getExtent()))
+            return;
+
+        if (key.getLOD() == _splitLevel)
+        {
+            out.push_back(key);
         }
         else
         {
-            //OE_WARN << key.str() << " : " << hf.getStatus().message() << std::endl;
+            for (unsigned i = 0; i < 4; ++i)
+                collectKeys(key.createChildKey(i), out);
         }
-        return ok;
     }
 
-    bool hasData(const TileKey& key) const
+    // Creates the tile for a key from its children (or the source at the max
+    // level), writing it if it's within the requested level range.
+    osg::ref_ptr<const osg::Object> buildTile(const TileKey& key)
     {
-        return _source->mayHaveData(key);
+        if (_progress.valid() && _progress->isCanceled())
+            return 0L;
+
+        unsigned lod = key.getLOD();
+
+        // Already built by a parallel subtree?
+        if (_useSplitTiles && lod == _splitLevel)
+        {
+            Threading::ScopedMutexLock lock(_splitMutex);
+            std::map<TileKey, osg::ref_ptr<const osg::Object> >::iterator i = _splitTiles.find(key);
+            if (i == _splitTiles.end())
+                return 0L;
+            osg::ref_ptr<const osg::Object> tile = i->second;
+            _splitTiles.erase(i);
+            return tile;
+        }
+
+        if (!hasData(key) || !intersects(key.getExtent()))
+            return 0L;
+
+        // A tile we don't write isn't worth checking for.
+        if (lod >= _minLevel)
+        {
+            osg::ref_ptr<const osg::Object> existing = _handler->getExistingTile(key);
+            if (existing.valid())
+            {
+                incrementProgress(1);
+                return existing;
+            }
+        }
+
+        osg::ref_ptr<const osg::Object> tile;
+
+        if (lod >= _maxLevel)
+        {
+            if (_handler->hasData(key))
+            {
+                tile = _handler->createTile(key);
+            }
+        }
+        else
+        {
+            osg::ref_ptr<const osg::Object> children[4];
+            bool haveChildren = false;
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                children[i] = buildTile(key.createChildKey(i));
+                haveChildren = haveChildren || children[i].valid();
+            }
+
+            if (haveChildren)
+            {
+                tile = _handler->createParentTile(key, children);
+            }
+        }
+
+        if (lod >= _minLevel)
+        {
+            if (tile.valid())
+            {
+                _handler->writeTile(key, tile.get());
+            }
+            incrementProgress(1);
+        }
+
+        return tile;
     }
 
-    osg::ref_ptr<ElevationLayer> _source;
-    osg::ref_ptr<ElevationLayer> _dest;
-    bool _overwrite;
+    osg::ref_ptr<PyramidTileHandler> _handler;
+    unsigned _numThreads;
+    unsigned _splitLevel;
+    bool _useSplitTiles;
+    std::map<TileKey, osg::ref_ptr<const osg::Object> > _splitTiles;
+    Threading::Mutex _splitMutex;
 };
 
 
@@ -255,6 +615,8 @@ struct ProgressReporter : public osgEarth::ProgressCallback
  *      --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy (*)
  *      --no-overwrite        : don't overwrite data that already exists
  *      --threads [int]       : number of threads to launch
+ *      --bottom-up           : read only the max level from the source and derive
+ *                              each lower level by downsampling its four children
  *
  * OSG arguments:
  *
@@ -435,11 +797,49 @@ main(int argc, char** argv)
         << outConf.toJSON(true)
         << std::endl;
 
+    bool overwrite = true;
+    if (args.read("--no-overwrite"))
+        overwrite = false;
+
+    // create the tile handler.
+    osg::ref_ptr<PyramidTileHandler> handler;
+
+    if (dynamic_cast<ImageLayer*>(input.get()) && dynamic_cast<ImageLayer*>(output.get()))
+    {
+        handler = new ImageLayerTileCopy(
+            dynamic_cast<ImageLayer*>(input.get()),
+            dynamic_cast<ImageLayer*>(output.get()),
+            overwrite,
+            compress);
+    }
+    else if (dynamic_cast<ElevationLayer*>(input.get()) && dynamic_cast<ElevationLayer*>(output.get()))
+    {
+        handler = new ElevationLayerTileCopy(
+            dynamic_cast<ElevationLayer*>(input.get()),
+            dynamic_cast<ElevationLayer*>(output.get()),
+            overwrite);
+    }
+
     // create the visitor.
     osg::ref_ptr<TileVisitor> visitor;
 
     unsigned numThreads = 1;
-    if (args.read("--threads", numThreads))
+    bool multithreaded = args.read("--threads", numThreads);
+
+    bool bottomUp = args.read("--bottom-up");
+    if (bottomUp)
+    {
+        if (!handler.valid())
+        {
+            OE_WARN << LC << "--bottom-up requires an image or elevation input and output" << std::endl;
+            return -1;
+        }
+
+        BottomUpTileVisitor* buv = new BottomUpTileVisitor(handler.get());
+        buv->setNumThreads( multithreaded ? numThreads : 1u );
+        visitor = buv;
+    }
+    else if (multithreaded)
     {
         MultithreadedTileVisitor* mtv = new MultithreadedTileVisitor();
         mtv->setNumThreads( numThreads < 1 ? 1 : numThreads );
@@ -450,24 +850,9 @@ main(int argc, char** argv)
         visitor = new TileVisitor();
     }
 
-    bool overwrite = true;
-    if (args.read("--no-overwrite"))
-        overwrite = false;
-
-    if (dynamic_cast<ImageLayer*>(input.get()) && dynamic_cast<ImageLayer*>(output.get()))
-    {
-        visitor->setTileHandler(new ImageLayerTileCopy(
-            dynamic_cast<ImageLayer*>(input.get()),
-            dynamic_cast<ImageLayer*>(output.get()),
-            overwrite,
-            compress));
-    }
-    else if (dynamic_cast<ElevationLayer*>(input.get()) && dynamic_cast<ElevationLayer*>(output.get()))
+    if (handler.valid())
     {
-        visitor->setTileHandler(new ElevationLayerTileCopy(
-            dynamic_cast<ElevationLayer*>(input.get()),
-            dynamic_cast<ElevationLayer*>(output.get()),
-            overwrite));
+        visitor->setTileHandler(handler.get());
     }
 
     // set the manula extents, if specified:
@@ -509,6 +894,7 @@ main(int argc, char** argv)
 
     unsigned maxLevel = 0;
     bool maxLevelSet = args.read("--max-level", maxLevel);
+    bool maxLevelKnown = maxLevelSet;
 
     // figure out the max source level:
     if ( !minLevelSet || !maxLevelSet )
@@ -517,8 +903,12 @@ main(int argc, char** argv)
             i != input->getDataExtents().end();
             ++i)
         {
-            if ( !maxLevelSet && i->maxLevel().isSet() && i->maxLevel().value() > maxLevel )
-                maxLevel = i->maxLevel().value();
+            if ( !maxLevelSet && i->maxLevel().isSet() )
+            {
+                maxLevelKnown = true;
+                if ( i->maxLevel().value() > maxLevel )
+                    maxLevel = i->maxLevel().value();
+            }
             if ( !minLevelSet && i->minLevel().isSet() && i->minLevel().value() < minLevel )
                 minLevel = i->minLevel().value();
 
@@ -534,7 +924,15 @@ main(int argc, char** argv)
         visitor->setMinLevel( minLevel );
     }
 
-    if ( maxLevel > 0 )
+    // (bottom-up always needs a real max level, since that's where it reads the source)
+    if ( bottomUp && !maxLevelKnown )
+    {
+        OE_WARN << LC << "--bottom-up cannot determine the source's max level from its data extents; "
+            "please specify one with --max-level" << std::endl;
+        return -1;
+    }
+
+    if ( maxLevel > 0 || bottomUp )
     {
         maxLevel = outputProfile->getEquivalentLOD( input->getProfile(), maxLevel );
         visitor->setMaxLevel( maxLevel );
@@ -144,6 +144,9 @@ main(int argc, char** argv)
     osg::ArgumentParser arguments(&argc,argv);
     osgViewer::Viewer viewer(arguments);
 
+    // compute the radial LOS from elevation data instead of the terrain graph
+    bool useElevationData = arguments.read("--elevation");
+
     // load the .earth file from the command line.
     osg::ref_ptr<osg::Node> earthNode = osgDB::readNodeFiles( arguments );
     if (!earthNode.valid())
@@ -208,6 +211,7 @@ main(int argc, char** argv)
     radial->setCenter( GeoPoint(geoSRS, -121.515, 46.054, 847.604, ALTMODE_ABSOLUTE) );
     radial->setRadius( 2000 );
     radial->setNumSpokes( 100 );
+    radial->setUseElevationData( useElevationData );
     losGroup->addChild( radial );
     RadialLineOfSightEditor* radialEditor = new RadialLineOfSightEditor( radial );
     losGroup->addChild( radialEditor );
@@ -217,6 +221,7 @@ main(int argc, char** argv)
     radialRelative->setCenter( GeoPoint(geoSRS, -121.2, 46.054, 10, ALTMODE_RELATIVE) );
     radialRelative->setRadius( 3000 );
     radialRelative->setNumSpokes(60);
+    radialRelative->setUseElevationData( useElevationData );
     losGroup->addChild( radialRelative );
     RadialLineOfSightEditor* radialRelEditor = new RadialLineOfSightEditor( radialRelative );
     losGroup->addChild( radialRelEditor );
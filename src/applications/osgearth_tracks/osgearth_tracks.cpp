@@ -32,12 +32,15 @@
 #include <osgEarth/MGRSFormatter>
 #include <osgEarth/Controls>
 #include <osgEarth/TrackNode>
+#include <osgEarth/TrackNodeBatch>
 #include <osgEarth/Color>
 
 #include <osgViewer/Viewer>
 #include <osgViewer/ViewerEventHandlers>
 #include <osgGA/StateSetManipulator>
 #include <osgDB/ReadFile>
+#include <osgUtil/UpdateVisitor>
+#include <osg/Timer>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -65,6 +68,7 @@ static MGRSFormatter s_format(MGRSFormatter::PRECISION_10000M);
 bool                g_showCoords        = true;
 optional<float>     g_duration          = 60.0;
 unsigned            g_numTracks         = 500;
+bool                g_batch             = false;
 ScreenSpaceLayoutOptions g_dcOptions;
 
 
@@ -120,6 +124,35 @@ struct TrackSimUpdate : public osg::Operation
 };
 
 
+/** Simulates all the tracks of a TrackNodeBatch with one bulk update per frame. */
+struct BatchSimUpdate : public osg::Operation
+{
+    BatchSimUpdate(TrackNodeBatch* batch) : osg::Operation( "batchsim", true ), _batch(batch) { }
+
+    void operator()( osg::Object* obj ) {
+        osg::View* view = dynamic_cast<osg::View*>(obj);
+        double t = fmod(view->getFrameStamp()->getSimulationTime(), (double)g_duration.get()) / (double)g_duration.get();
+
+        for( unsigned i=0; i<_ids.size(); ++i )
+        {
+            _positions[i] = _start[i].interpolate(_end[i], t);
+            _positions[i].alt() = 10000.0;
+        }
+
+        _batch->setPositions( _ids, _positions );
+
+        for( unsigned i=0; i<_ids.size(); ++i )
+        {
+            _batch->setFieldValue( _ids[i], FIELD_POSITION, g_showCoords ? s_format(_positions[i]) : "" );
+        }
+    }
+
+    osg::ref_ptr<TrackNodeBatch> _batch;
+    std::vector<TrackNodeBatch::TrackID> _ids;
+    std::vector<GeoPoint> _start, _end, _positions;
+};
+
+
 /**
  * Creates a field schema that we'll later use as a labeling template for
  * TrackNode instances.
@@ -196,6 +229,136 @@ createTrackNodes(const SpatialReference* mapSRS, osg::Group* parent, const Track
 }
 
 
+/** Builds a bunch of tracks in a single TrackNodeBatch. */
+TrackNodeBatch*
+createTrackNodeBatch(MapNode* mapNode, const TrackNodeFieldSchema& schema, BatchSimUpdate*& sim)
+{
+    osg::ref_ptr<osg::Image> srcImage = osgDB::readRefImageFile( ICON_URL );
+    osg::ref_ptr<osg::Image> image;
+    ImageUtils::resizeImage( srcImage.get(), ICON_SIZE, ICON_SIZE, image );
+
+    const SpatialReference* mapSRS = mapNode->getMapSRS();
+
+    TrackNodeBatch* batch = new TrackNodeBatch(mapNode, image.get(), schema);
+    sim = new BatchSimUpdate(batch);
+
+    Random prng;
+    for( unsigned i=0; i<g_numTracks; ++i )
+    {
+        double lon0 = -180.0 + prng.next() * 360.0;
+        double lat0 = -80.0 + prng.next() * 160.0;
+        double lon1 = -180.0 + prng.next() * 360.0;
+        double lat1 = -80.0 + prng.next() * 160.0;
+
+        GeoPoint pos(mapSRS, lon0, lat0, 0.0, ALTMODE_ABSOLUTE);
+        TrackNodeBatch::TrackID id = batch->addTrack(pos);
+
+        batch->setFieldValue( id, FIELD_NAME,     Stringify() << "Track:" << i );
+        batch->setFieldValue( id, FIELD_POSITION, Stringify() << s_format(pos) );
+        batch->setFieldValue( id, FIELD_NUMBER,   Stringify() << (1 + prng.next(9)) );
+
+        sim->_ids.push_back(id);
+        sim->_start.push_back(pos);
+        sim->_end.push_back(GeoPoint(mapSRS, lon1, lat1, 0.0, ALTMODE_ABSOLUTE));
+        sim->_positions.push_back(pos);
+    }
+
+    return batch;
+}
+
+
+/**
+ * Measures the per-frame cost of moving every track, for individual
+ * TrackNodes vs. a TrackNodeBatch, at increasing track counts; first
+ * moving the tracks only, then also updating each track's position label
+ * as the demo does.
+ */
+int
+runBenchmark(const TrackNodeFieldSchema& schema)
+{
+    const SpatialReference* srs = SpatialReference::get("wgs84");
+    const unsigned counts[] = { 1000, 5000, 10000, 20000, 50000 };
+    const unsigned frames = 10;
+
+    Random prng;
+    osg::Timer* timer = osg::Timer::instance();
+
+    OE_NOTICE << LC << "tracks, TrackNode (ms/frame), TrackNodeBatch (ms/frame), "
+        "TrackNode with labels (ms/frame), TrackNodeBatch with labels (ms/frame)" << std::endl;
+
+    for( unsigned c=0; c<sizeof(counts)/sizeof(counts[0]); ++c )
+    {
+        unsigned count = counts[c];
+
+        std::vector<GeoPoint> positions;
+        std::vector<std::string> labels;
+        for( unsigned i=0; i<count; ++i )
+        {
+            positions.push_back(GeoPoint(srs, -180.0 + prng.next()*360.0, -80.0 + prng.next()*160.0, 10000.0, ALTMODE_ABSOLUTE));
+            labels.push_back(s_format(positions.back()));
+        }
+
+        std::vector< osg::ref_ptr<TrackNode> > nodes;
+        osg::ref_ptr<TrackNodeBatch> batch = new TrackNodeBatch((MapNode*)0L, (osg::Image*)0L, schema);
+        std::vector<TrackNodeBatch::TrackID> ids;
+        for( unsigned i=0; i<count; ++i )
+        {
+            nodes.push_back(new TrackNode(positions[i], (osg::Image*)0L, schema));
+            ids.push_back(batch->addTrack(positions[i]));
+        }
+
+        osg::Timer_t t0 = timer->tick();
+        for( unsigned f=0; f<frames; ++f )
+        {
+            for( unsigned i=0; i<count; ++i )
+                nodes[i]->setPosition(positions[(i+f) % count]);
+        }
+        double nodeTime = timer->delta_m(t0, timer->tick()) / (double)frames;
+
+        // include the GPU buffer refresh, which happens during the update traversal
+        osgUtil::UpdateVisitor uv;
+        std::vector<GeoPoint> shifted(count);
+        osg::Timer_t t1 = timer->tick();
+        for( unsigned f=0; f<frames; ++f )
+        {
+            for( unsigned i=0; i<count; ++i )
+                shifted[i] = positions[(i+f) % count];
+            batch->setPositions(ids, shifted);
+            batch->accept(uv);
+        }
+        double batchTime = timer->delta_m(t1, timer->tick()) / (double)frames;
+
+        osg::Timer_t t2 = timer->tick();
+        for( unsigned f=0; f<frames; ++f )
+        {
+            for( unsigned i=0; i<count; ++i )
+            {
+                nodes[i]->setPosition(positions[(i+f) % count]);
+                nodes[i]->setFieldValue(FIELD_POSITION, labels[(i+f) % count]);
+            }
+        }
+        double nodeLabelTime = timer->delta_m(t2, timer->tick()) / (double)frames;
+
+        osg::Timer_t t3 = timer->tick();
+        for( unsigned f=0; f<frames; ++f )
+        {
+            for( unsigned i=0; i<count; ++i )
+                shifted[i] = positions[(i+f) % count];
+            batch->setPositions(ids, shifted);
+            for( unsigned i=0; i<count; ++i )
+                batch->setFieldValue(ids[i], FIELD_POSITION, labels[(i+f) % count]);
+            batch->accept(uv);
+        }
+        double batchLabelTime = timer->delta_m(t3, timer->tick()) / (double)frames;
+
+        OE_NOTICE << LC << count << ", " << nodeTime << ", " << batchTime
+            << ", " << nodeLabelTime << ", " << batchLabelTime << std::endl;
+    }
+
+    return 0;
+}
+
+
 /** creates some UI controls for adjusting the decluttering parameters. */
 Container*
 createControls( osgViewer::View* view )
@@ -288,6 +451,17 @@ main(int argc, char** argv)
 
     osg::ArgumentParser arguments(&argc,argv);
 
+    // compare update costs without rendering anything
+    if ( arguments.read("--benchmark") )
+    {
+        TrackNodeFieldSchema schema;
+        createFieldSchema( schema );
+        return runBenchmark( schema );
+    }
+
+    // render all tracks with one TrackNodeBatch instead of many TrackNodes
+    g_batch = arguments.read("--batch");
+
     // initialize a viewer.
     osgViewer::Viewer viewer( arguments );
     viewer.setCameraManipulator( new EarthManipulator );
@@ -310,9 +484,17 @@ main(int argc, char** argv)
 
     // create some track nodes.
     TrackSims trackSims;
-    osg::Group* tracks = new osg::Group();
-    createTrackNodes( mapNode->getMapSRS(), tracks, schema, trackSims );
-    mapNode->addChild( tracks );
+    BatchSimUpdate* batchSim = 0L;
+    if ( g_batch )
+    {
+        mapNode->addChild( createTrackNodeBatch( mapNode, schema, batchSim ) );
+    }
+    else
+    {
+        osg::Group* tracks = new osg::Group();
+        createTrackNodes( mapNode->getMapSRS(), tracks, schema, trackSims );
+        mapNode->addChild( tracks );
+    }
 
     // Set up the automatic decluttering. setEnabled() activates decluttering for
     // all drawables under that state set. We are also activating priority-based
@@ -326,7 +508,10 @@ main(int argc, char** argv)
     ScreenSpaceLayout::setOptions( g_dcOptions );
 
     // attach the simulator to the viewer.
-    viewer.addUpdateOperation( new TrackSimUpdate(trackSims) );
+    if ( batchSim )
+        viewer.addUpdateOperation( batchSim );
+    else
+        viewer.addUpdateOperation( new TrackSimUpdate(trackSims) );
     viewer.setRunFrameScheme( viewer.CONTINUOUS );
 
     viewer.run();
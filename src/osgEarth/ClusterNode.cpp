@@ -1,12 +1,164 @@
 #include <osgEarth/ClusterNode>
+#include <osgEarth/MapNode>
+#include <osgEarth/Metrics>
 
-#include <osgEarth/kdbush.hpp>
-
-typedef std::pair<int, int> TPoint;
-typedef std::vector< std::size_t > TIds;
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <unordered_map>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
+using namespace osgEarth::Threading;
+
+namespace
+{
+    // Deepest level of the cluster hierarchy; views closer than this show individual nodes.
+    const unsigned MAX_ZOOM = 18u;
+
+    // Size of a "tile" in pixels; level z spans (TILE_PIXELS * 2^z) pixels across the map.
+    const double TILE_PIXELS = 256.0;
+
+    // Number of clusters per culling chunk
+    const unsigned CHUNK_SIZE = 256u;
+
+    // Normalized [0..1] map coordinates for a world position. Geographic maps
+    // use spherical mercator so the clustering radius is the same in x and y.
+    bool toNormalized(const SpatialReference* srs, const GeoExtent& extent, const osg::Vec3d& world, double& out_x, double& out_y)
+    {
+        osg::Vec3d map;
+        if (!srs->transformFromWorld(world, map))
+            return false;
+
+        if (srs->isGeographic())
+        {
+            double s = sin(osg::DegreesToRadians(osg::clampBetween(map.y(), -85.0, 85.0)));
+            out_x = map.x() / 360.0 + 0.5;
+            out_y = 0.5 - 0.25 * log((1.0 + s) / (1.0 - s)) / osg::PI;
+        }
+        else
+        {
+            double size = osg::maximum(extent.width(), extent.height());
+            out_x = (map.x() - extent.xMin()) / size;
+            out_y = (map.y() - extent.yMin()) / size;
+        }
+        return true;
+    }
+
+    // Interleaves the bits of two 16-bit values, to sort clusters spatially
+    inline std::uint32_t morton(double x, double y)
+    {
+        std::uint32_t ix = (std::uint32_t)(osg::clampBetween(x, 0.0, 1.0) * 65535.0);
+        std::uint32_t iy = (std::uint32_t)(osg::clampBetween(y, 0.0, 1.0) * 65535.0);
+        std::uint32_t code = 0u;
+        for (unsigned b = 0; b < 16u; ++b)
+        {
+            code |= ((ix >> b) & 1u) << (2u*b);
+            code |= ((iy >> b) & 1u) << (2u*b + 1u);
+        }
+        return code;
+    }
+
+    inline std::int64_t cellKey(std::int64_t cx, std::int64_t cy)
+    {
+        // shift as unsigned; cell coordinates can be negative
+        return (std::int64_t)(((std::uint64_t)cx << 32) ^ ((std::uint64_t)cy & 0xffffffffu));
+    }
+
+    // Hierarchy level that matches the scale of the view, where a cluster's
+    // radius is about the requested number of pixels.
+    unsigned computeZoom(osgUtil::CullVisitor* cv, const SpatialReference* srs, const GeoExtent& extent)
+    {
+        osg::Camera* camera = cv->getCurrentCamera();
+        osg::Viewport* viewport = camera->getViewport();
+
+        osg::Vec3d eye, center, up;
+        camera->getViewMatrixAsLookAt(eye, center, up);
+        osg::Vec3d look = center - eye;
+        look.normalize();
+
+        // focal point of the view on the ground:
+        double distance;
+        if (srs->isGeographic())
+        {
+            double R = srs->getEllipsoid()->getRadiusEquator();
+            double b = eye * look;
+            double c = eye.length2() - R*R;
+            double disc = b*b - c;
+            distance = (disc >= 0.0 && -b - sqrt(disc) > 0.0) ? -b - sqrt(disc) : eye.length() - R;
+        }
+        else
+        {
+            distance = look.z() < 0.0 ? -eye.z() / look.z() : eye.z();
+        }
+        distance = osg::maximum(distance, 1.0);
+        osg::Vec3d focus = eye + look*distance;
+
+        double metersPerPixel;
+        const osg::Matrixd& proj = camera->getProjectionMatrix();
+        if (osg::equivalent(proj(3, 3), 1.0))
+        {
+            double l, r, b, t, n, f;
+            proj.getOrtho(l, r, b, t, n, f);
+            metersPerPixel = (r - l) / viewport->width();
+        }
+        else
+        {
+            double fovy, ar, n, f;
+            proj.getPerspective(fovy, ar, n, f);
+            metersPerPixel = 2.0 * distance * tan(osg::DegreesToRadians(0.5*fovy)) / viewport->height();
+        }
+
+        double metersPerUnit = osg::maximum(extent.width(), extent.height());
+        if (srs->isGeographic())
+        {
+            osg::Vec3d focusMap;
+            srs->transformFromWorld(focus, focusMap);
+            metersPerUnit = 2.0 * osg::PI * srs->getEllipsoid()->getRadiusEquator() *
+                cos(osg::DegreesToRadians(osg::clampBetween(focusMap.y(), -85.0, 85.0)));
+        }
+
+        double zoom = log(metersPerUnit / metersPerPixel / TILE_PIXELS) / log(2.0);
+        return (unsigned)osg::clampBetween(floor(zoom), 0.0, (double)(MAX_ZOOM + 1u));
+    }
+}
+
+//...................................................................
+
+// Precomputed cluster hierarchy. Level z holds the clusters for zoom level z,
+// and the last level holds the individual nodes. The nodes are ordered so that
+// every cluster at every level covers a contiguous range of them.
+struct ClusterNode::ClusterIndex
+{
+    struct Item
+    {
+        unsigned begin, end;  // range of member nodes
+        osg::Vec3d world;     // world position of the members' centroid
+    };
+
+    struct Chunk
+    {
+        osg::BoundingSphere bound;
+        unsigned begin, end;  // range of items
+    };
+
+    struct Level
+    {
+        std::vector<Item> items;
+        std::vector<Chunk> chunks;
+    };
+
+    osg::NodeList nodes;
+    std::vector<bool> removed;
+    std::unordered_map<osg::Node*, unsigned> positions;
+    std::vector<Level> levels;
+    osg::NodeList unindexed;
+
+    osg::ref_ptr<const SpatialReference> srs;
+    GeoExtent extent;
+};
+
+//...................................................................
 
 ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _radius(50),
@@ -15,18 +167,37 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _enabled(true),
     _dirty(true),
     _defaultImage(defaultImage),
-    _dirtyIndex(true)
+    _indexJobPending(false),
+    _rebuildIndex(true),
+    _changesSinceIndex(0u)
 {
     setCullingActive(false);
-    
+
     _horizon = new Horizon();
 }
 
+void ClusterNode::markChanged(osg::Node* node)
+{
+    if (_index)
+    {
+        auto i = _index->positions.find(node);
+        if (i != _index->positions.end())
+            _index->removed[i->second] = true;
+    }
+
+    if (_dynamicNodes.insert(node))
+        ++_changesSinceIndex;
+
+    if (_indexJobPending)
+        _changedSinceIndexJob.insert(node);
+
+    _dirty = true;
+}
+
 void ClusterNode::addNode(osg::Node* node)
 {
     _nodes.push_back(node);
-    _dirty = true;
-    _dirtyIndex = true;
+    markChanged(node);
 }
 
 void ClusterNode::removeNode(osg::Node* node)
@@ -34,17 +205,62 @@ void ClusterNode::removeNode(osg::Node* node)
     osg::NodeList::iterator itr = std::find(_nodes.begin(), _nodes.end(), node);
     if (itr != _nodes.end())
     {
+        // drop the index's reference; the removal counts as a change
+        // toward the next rebuild.
+        if (_index)
+        {
+            auto i = _index->positions.find(node);
+            if (i != _index->positions.end())
+            {
+                _index->removed[i->second] = true;
+                _index->nodes[i->second] = nullptr;
+                _index->positions.erase(i);
+                ++_changesSinceIndex;
+            }
+        }
+        _dynamicNodes.erase(node);
+        _changedSinceIndexJob.erase(node);
+
         _nodes.erase(itr);
     }
     _dirty = true;
-    _dirtyIndex = true;
+}
+
+void ClusterNode::updateNode(osg::Node* node)
+{
+    if (node && std::find(_nodes.begin(), _nodes.end(), node) != _nodes.end())
+    {
+        markChanged(node);
+    }
+}
+
+void ClusterNode::updateNodes(const osg::NodeList& nodes)
+{
+    for (osg::NodeList::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
+    {
+        // The index tells us cheaply whether a node belongs to us:
+        if (i->valid() && (
+            _dynamicNodes.count(i->get()) > 0 ||
+            (_index && _index->positions.count(i->get()) > 0)))
+        {
+            markChanged(i->get());
+        }
+    }
 }
 
 void ClusterNode::clear()
 {
     _nodes.clear();
+    _index.reset();
+    _dynamicNodes.clear();
+    _changedSinceIndexJob.clear();
+    _changesSinceIndex = 0u;
+    if (_indexJobPending)
+    {
+        _indexJob.abandon();
+        _indexJobPending = false;
+    }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 unsigned int ClusterNode::getRadius() const
@@ -55,6 +271,7 @@ unsigned int ClusterNode::getRadius() const
 void ClusterNode::setRadius(unsigned int radius)
 {
     _radius = radius;
+    _rebuildIndex = true;
     _dirty = true;
 }
 
@@ -80,9 +297,21 @@ void ClusterNode::setMapNode(MapNode* mapNode)
     {
         _mapNode = mapNode;
         _dirty = true;
-        _dirtyIndex = true;
         _labelPool.clear();
         _nextLabel = 0;
+
+        // the index is in the old map's coordinates
+        _index.reset();
+        if (_indexJobPending)
+        {
+            _indexJob.abandon();
+            _indexJobPending = false;
+        }
+        _dynamicNodes.clear();
+        for (osg::NodeList::const_iterator i = _nodes.begin(); i != _nodes.end(); ++i)
+            _dynamicNodes.insert(i->get());
+        _changesSinceIndex = 0u;
+        _rebuildIndex = true;
     }
 }
 
@@ -106,47 +335,336 @@ ClusterNode::CanClusterCallback* ClusterNode::getCanClusterCallback()
 void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callback)
 {
     _canClusterCallback = callback;
+    _rebuildIndex = true;
     _dirty = true;
 }
 
-namespace
+std::shared_ptr<ClusterNode::ClusterIndex>
+ClusterNode::createIndex(const osg::NodeList& nodes,
+                         const std::vector<osg::Vec3d>& worlds,
+                         const SpatialReference* srs,
+                         const GeoExtent& extent,
+                         unsigned radius,
+                         CanClusterCallback* canCluster,
+                         Cancelable* progress)
 {
-    bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
-    {
-        osg::BoundingSphere bsI = i->getBound();
-        osg::BoundingSphere bsJ = j->getBound();
+    OE_PROFILING_ZONE;
 
-        return bsI.center().x() < bsJ.center().x();
+    // Build-time cluster: normalized position and world position (weighted
+    // centroids), number of nodes, representative node, and parent on the
+    // next level up.
+    struct Node
+    {
+        double x, y;
+        osg::Vec3d world;
+        double radius;  // distance of the world position from the origin
+        unsigned count;
+        unsigned rep;
+        unsigned parent;
+    };
+
+    const unsigned numLevels = MAX_ZOOM + 2u;
+    std::vector<std::vector<Node>> levels(numLevels);
+
+    std::shared_ptr<ClusterIndex> index = std::make_shared<ClusterIndex>();
+    index->srs = srs;
+    index->extent = extent;
+
+    // individual nodes form the last level:
+    std::vector<Node>& leaves = levels[numLevels - 1];
+    leaves.reserve(nodes.size());
+    for (unsigned i = 0; i < nodes.size(); ++i)
+    {
+        Node leaf;
+        if (toNormalized(srs, extent, worlds[i], leaf.x, leaf.y))
+        {
+            leaf.world = worlds[i];
+            leaf.radius = worlds[i].length();
+            leaf.count = 1u;
+            leaf.rep = i;
+            leaf.parent = 0u;
+            leaves.push_back(leaf);
+        }
+        else
+        {
+            index->unindexed.push_back(nodes[i]);
+        }
     }
-}
-void ClusterNode::buildIndex()
-{
-    if (_dirtyIndex)
+
+    // Cluster each level into the one above it. A cluster absorbs every
+    // unclustered neighbor within the radius of its seed, using a grid with
+    // the same cell size to find the neighbors.
+    for (int z = (int)MAX_ZOOM; z >= 0; --z)
     {
-        _clusterIndex.clear();
+        if (progress && progress->isCanceled())
+            return nullptr;
 
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
+        std::vector<Node>& prev = levels[z + 1];
+        std::vector<Node>& next = levels[z];
+        const double r = (double)radius / (TILE_PIXELS * (double)(1u << z));
 
-        unsigned int maxNodes = 10000;
+        std::vector<std::pair<std::int64_t, unsigned>> sorted(prev.size());
+        for (unsigned i = 0; i < prev.size(); ++i)
+        {
+            sorted[i].first = cellKey((std::int64_t)floor(prev[i].x / r), (std::int64_t)floor(prev[i].y / r));
+            sorted[i].second = i;
+        }
+        std::sort(sorted.begin(), sorted.end());
 
-        osg::Group* currentGroup = 0;
+        std::unordered_map<std::int64_t, std::pair<unsigned, unsigned>> cells;
+        for (unsigned i = 0; i < sorted.size(); )
+        {
+            unsigned j = i;
+            while (j < sorted.size() && sorted[j].first == sorted[i].first) ++j;
+            cells[sorted[i].first] = std::make_pair(i, j);
+            i = j;
+        }
 
-        for (unsigned int i = 0; i < _nodes.size(); i++)
+        std::vector<bool> visited(prev.size(), false);
+        std::vector<unsigned> members;
+
+        for (unsigned i = 0; i < prev.size(); ++i)
         {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
+            if (visited[i])
+                continue;
+            visited[i] = true;
+
+            const Node& seed = prev[i];
+            double sumX = seed.x*seed.count, sumY = seed.y*seed.count;
+            osg::Vec3d sumWorld = seed.world*(double)seed.count;
+            double sumRadius = seed.radius*seed.count;
+            unsigned total = seed.count;
+            members.clear();
+            members.push_back(i);
+
+            std::int64_t cx = (std::int64_t)floor(seed.x / r);
+            std::int64_t cy = (std::int64_t)floor(seed.y / r);
+            for (std::int64_t dx = -1; dx <= 1; ++dx)
             {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
+                for (std::int64_t dy = -1; dy <= 1; ++dy)
+                {
+                    auto cell = cells.find(cellKey(cx + dx, cy + dy));
+                    if (cell == cells.end())
+                        continue;
+
+                    for (unsigned k = cell->second.first; k < cell->second.second; ++k)
+                    {
+                        unsigned j = sorted[k].second;
+                        const Node& other = prev[j];
+                        if (visited[j] ||
+                            (other.x - seed.x)*(other.x - seed.x) + (other.y - seed.y)*(other.y - seed.y) > r*r)
+                            continue;
+
+                        if (canCluster && !(*canCluster)(nodes[seed.rep].get(), nodes[other.rep].get()))
+                            continue;
+
+                        visited[j] = true;
+                        sumX += other.x*other.count, sumY += other.y*other.count;
+                        sumWorld += other.world*(double)other.count;
+                        sumRadius += other.radius*other.count;
+                        total += other.count;
+                        members.push_back(j);
+                    }
+                }
             }
-            currentGroup->addChild(_nodes[i]);                      
+
+            for (auto m : members)
+                prev[m].parent = (unsigned)next.size();
+
+            Node cluster;
+            cluster.x = sumX / (double)total;
+            cluster.y = sumY / (double)total;
+            cluster.world = sumWorld / (double)total;
+            cluster.radius = sumRadius / (double)total;
+            cluster.count = total;
+            cluster.rep = seed.rep;
+            cluster.parent = 0u;
+            next.push_back(cluster);
         }
     }
-    _dirtyIndex = false;
+
+    // Order the nodes so every cluster covers a contiguous range: lay out the
+    // top level in order, then place each child inside its parent's range.
+    std::vector<std::vector<unsigned>> begins(numLevels);
+    begins[0].resize(levels[0].size());
+    for (unsigned i = 0, offset = 0; i < levels[0].size(); ++i)
+    {
+        begins[0][i] = offset;
+        offset += levels[0][i].count;
+    }
+    for (unsigned z = 0; z + 1 < numLevels; ++z)
+    {
+        std::vector<unsigned> cursor = begins[z];
+        begins[z + 1].resize(levels[z + 1].size());
+        for (unsigned i = 0; i < levels[z + 1].size(); ++i)
+        {
+            const Node& child = levels[z + 1][i];
+            begins[z + 1][i] = cursor[child.parent];
+            cursor[child.parent] += child.count;
+        }
+    }
+
+    index->nodes.resize(leaves.size());
+    index->removed.assign(leaves.size(), false);
+    for (unsigned i = 0; i < leaves.size(); ++i)
+    {
+        unsigned pos = begins[numLevels - 1][i];
+        index->nodes[pos] = nodes[leaves[i].rep];
+        index->positions[nodes[leaves[i].rep].get()] = pos;
+    }
+
+    // Sort each level spatially and group it into chunks for culling.
+    index->levels.resize(numLevels);
+    for (unsigned z = 0; z < numLevels; ++z)
+    {
+        const std::vector<Node>& level = levels[z];
+
+        std::vector<std::pair<std::uint32_t, unsigned>> order(level.size());
+        for (unsigned i = 0; i < level.size(); ++i)
+            order[i] = std::make_pair(morton(level[i].x, level[i].y), i);
+        std::sort(order.begin(), order.end());
+
+        ClusterIndex::Level& out = index->levels[z];
+        out.items.resize(level.size());
+        for (unsigned i = 0; i < order.size(); ++i)
+        {
+            const Node& n = level[order[i].second];
+            ClusterIndex::Item& item = out.items[i];
+            item.begin = begins[z][order[i].second];
+            item.end = item.begin + n.count;
+            item.world = n.world;
+
+            // On a geocentric map the centroid of the members is below the
+            // surface; lift it back to their average distance from the center.
+            if (srs->isGeographic() && item.world.length() > 0.0)
+                item.world *= n.radius / item.world.length();
+        }
+
+        for (unsigned i = 0; i < out.items.size(); i += CHUNK_SIZE)
+        {
+            ClusterIndex::Chunk chunk;
+            chunk.begin = i;
+            chunk.end = osg::minimum(i + CHUNK_SIZE, (unsigned)out.items.size());
+            for (unsigned k = chunk.begin; k < chunk.end; ++k)
+                chunk.bound.expandBy(out.items[k].world);
+            out.chunks.push_back(chunk);
+        }
+    }
+
+    return index;
 }
 
+void ClusterNode::startIndexJob()
+{
+    osg::ref_ptr<MapNode> mapNode;
+    if (!_mapNode.lock(mapNode) || !mapNode->getMap()->getProfile())
+        return;
+
+    // Snapshot the nodes and positions here; bounds aren't safe to compute
+    // from another thread.
+    osg::NodeList nodes = _nodes;
+    std::vector<osg::Vec3d> worlds(nodes.size());
+    for (unsigned i = 0; i < nodes.size(); ++i)
+        worlds[i] = nodes[i]->getBound().center();
+
+    osg::ref_ptr<const SpatialReference> srs = mapNode->getMapSRS();
+    GeoExtent extent = mapNode->getMap()->getProfile()->getExtent();
+    unsigned radius = _radius;
+    osg::ref_ptr<CanClusterCallback> canCluster = _canClusterCallback;
+
+    _changedSinceIndexJob.clear();
+    _rebuildIndex = false;
+    _indexJobPending = true;
+
+    _indexJob = Job<std::shared_ptr<ClusterIndex>>::dispatch(
+        "oe.cluster",
+        [nodes, worlds, srs, extent, radius, canCluster](Cancelable* progress)
+        {
+            return createIndex(nodes, worlds, srs.get(), extent, radius, canCluster.get(), progress);
+        }
+    );
+}
+
+void ClusterNode::installIndex(std::shared_ptr<ClusterIndex> index)
+{
+    _indexJobPending = false;
+    _indexJob = Future<std::shared_ptr<ClusterIndex>>();
+
+    if (!index)
+        return;
+
+    // Reconcile changes that happened while the index was building.
+    std::unordered_set<osg::Node*> live;
+    for (osg::NodeList::const_iterator i = _nodes.begin(); i != _nodes.end(); ++i)
+        live.insert(i->get());
+
+    // Only changes the new index doesn't include count toward the next
+    // rebuild. Nodes that can't be indexed at all don't, or every rebuild
+    // would trigger another one.
+    _changesSinceIndex = 0u;
+
+    for (unsigned i = 0; i < index->nodes.size(); ++i)
+    {
+        if (live.count(index->nodes[i].get()) == 0)
+        {
+            index->removed[i] = true;
+            index->positions.erase(index->nodes[i].get());
+            index->nodes[i] = nullptr;
+            ++_changesSinceIndex;
+        }
+    }
+
+    _dynamicNodes.clear();
+    for (auto node : _changedSinceIndexJob)
+    {
+        if (live.count(node) > 0)
+        {
+            _dynamicNodes.insert(node);
+            ++_changesSinceIndex;
+            auto i = index->positions.find(node);
+            if (i != index->positions.end())
+                index->removed[i->second] = true;
+        }
+    }
+    for (osg::NodeList::const_iterator i = index->unindexed.begin(); i != index->unindexed.end(); ++i)
+    {
+        if (live.count(i->get()) > 0)
+            _dynamicNodes.insert(i->get());
+    }
+    _changedSinceIndexJob.clear();
+
+    _index = index;
+    _dirty = true;
+}
+
+bool ClusterNode::isIndexStale() const
+{
+    return _changesSinceIndex > osg::maximum((std::size_t)256u, _nodes.size() / 10u);
+}
+
+void ClusterNode::getIndexedClusters(unsigned zoom, std::vector<osg::NodeList>& out) const
+{
+    if (!_index || zoom >= _index->levels.size())
+        return;
+
+    const ClusterIndex::Level& level = _index->levels[zoom];
+    for (auto& item : level.items)
+    {
+        osg::NodeList nodes;
+        for (unsigned k = item.begin; k < item.end; ++k)
+        {
+            if (!_index->removed[k])
+                nodes.push_back(_index->nodes[k]);
+        }
+        if (!nodes.empty())
+            out.push_back(nodes);
+    }
+}
 
 void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 {
+    OE_PROFILING_ZONE;
+
     _nextLabel = 0;
 
     osg::Camera* camera = cv->getCurrentCamera();
@@ -161,105 +679,127 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
         camera->getProjectionMatrix() *
         camera->getViewport()->computeWindowMatrix();
 
-    std::vector<TPoint> points;
+    auto onScreen = [&](const osg::Vec3d& world, osg::Vec3d& screen)
+    {
+        if (!_horizon->isVisible(world))
+            return false;
+
+        screen = world * mvpw;
+        return
+            screen.x() >= 0 && screen.x() <= viewport->width() &&
+            screen.y() >= 0 && screen.y() <= viewport->height();
+    };
+
+    // Screen-space grid of the clusters, so nodes outside the index
+    // can join a nearby cluster.
+    const double radius = (double)osg::maximum(_radius, 1u);
+    std::unordered_map<std::int64_t, std::vector<unsigned>> grid;
+    std::vector<osg::Vec3d> screenPositions;
+
+    auto addCluster = [&](const osg::Vec3d& world, const osg::Vec3d& screen, Cluster& cluster)
+    {
+        std::stringstream buf;
+        buf << cluster.nodes.size() << std::endl;
 
-    osg::NodeList validPlaces;
+        PlaceNode* marker = getOrCreateLabel();
+        GeoPoint markerPos;
+        markerPos.fromWorld(_mapNode->getMapSRS(), world);
+        marker->setPosition(markerPos);
+        marker->setText(buf.str());
+        cluster.marker = marker;
+
+        grid[cellKey((std::int64_t)floor(screen.x() / radius), (std::int64_t)floor(screen.y() / radius))].push_back(out.size());
+        screenPositions.push_back(screen);
+        out.push_back(cluster);
+    };
 
-    buildIndex();
+    osg::Vec3d screen;
 
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    // Clusters from the precomputed hierarchy at the level matching the view:
+    if (_index)
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
-        if (cv->isCulled(index->getBound()))
-        {
-            continue;
-        }
+        unsigned zoom = computeZoom(cv, _index->srs.get(), _index->extent);
+        const ClusterIndex::Level& level = _index->levels[zoom];
 
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
+        for (auto& chunk : level.chunks)
         {
-            osg::Node* node = index->getChild(i);
-            osg::Vec3d world = node->getBound().center();
-
-            if (cv->isCulled(*node))
-            {
+            if (cv->isCulled(chunk.bound))
                 continue;
-            }
 
-            if (!_horizon->isVisible(world))
+            for (unsigned i = chunk.begin; i < chunk.end; ++i)
             {
-                continue;
-            }
+                const ClusterIndex::Item& item = level.items[i];
+                if (!onScreen(item.world, screen))
+                    continue;
 
-            osg::Vec3d screen = world * mvpw;
+                Cluster cluster;
+                for (unsigned k = item.begin; k < item.end; ++k)
+                {
+                    if (!_index->removed[k])
+                        cluster.nodes.push_back(_index->nodes[k]);
+                }
 
-            if (screen.x() >= 0 && screen.x() <= viewport->width() &&
-                screen.y() >= 0 && screen.y() <= viewport->height())
-            {
-                validPlaces.push_back(node);
-                points.push_back(TPoint(screen.x(), screen.y()));
+                if (!cluster.nodes.empty())
+                {
+                    addCluster(item.world, screen, cluster);
+                }
             }
         }
     }
 
-    if (validPlaces.size() == 0) return;
-
-    kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
-
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
+    // Nodes not (yet) in the hierarchy join the nearest cluster on the
+    // screen, or start a new one.
+    for (auto node : _dynamicNodes)
     {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
-
-        // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
-        {
-            continue;
-        }
-
         osg::Vec3d world = node->getBound().center();
+        if (cv->isCulled(*node) || !onScreen(world, screen))
+            continue;
 
-        // Get any matching indices that are part of this cluster.
-        TIds indices;
-
-        index.range(screen.first - _radius, screen.second - _radius, screen.first + _radius, screen.second + _radius, indices);
-
-        // Create a new cluster.
-        Cluster cluster;
-
-        unsigned int actualCount = 0;
+        std::int64_t cx = (std::int64_t)floor(screen.x() / radius);
+        std::int64_t cy = (std::int64_t)floor(screen.y() / radius);
 
-        // Add all of the points to the cluster.
-        for (unsigned int j = 0; j < indices.size(); j++)
+        int best = -1;
+        double bestDist2 = DBL_MAX;
+        for (std::int64_t dx = -1; dx <= 1; ++dx)
         {
-            if (clustered.find(indices[j]) == clustered.end())
+            for (std::int64_t dy = -1; dy <= 1; ++dy)
             {
-                if (_canClusterCallback.valid())
+                auto cell = grid.find(cellKey(cx + dx, cy + dy));
+                if (cell == grid.end())
+                    continue;
+
+                for (auto c : cell->second)
                 {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
-                    if (!canCluster) {
+                    osg::Vec3d delta = screenPositions[c] - screen;
+                    if (fabs(delta.x()) > radius || fabs(delta.y()) > radius)
                         continue;
+
+                    double dist2 = delta.x()*delta.x() + delta.y()*delta.y();
+                    if (dist2 < bestDist2 &&
+                        (!_canClusterCallback.valid() || (*_canClusterCallback)(out[c].nodes[0].get(), node)))
+                    {
+                        best = (int)c;
+                        bestDist2 = dist2;
                     }
                 }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
             }
         }
 
-        std::stringstream buf;
-        buf << actualCount << std::endl;
-
-        PlaceNode* marker = getOrCreateLabel();
-        GeoPoint markerPos;
-        markerPos.fromWorld(_mapNode->getMapSRS(), world);
-        marker->setPosition(markerPos);
-        marker->setText(buf.str());
-
-        cluster.marker = marker;
-        out.push_back(cluster);
+        if (best >= 0)
+        {
+            Cluster& cluster = out[best];
+            cluster.nodes.push_back(node);
 
-        clustered.insert(i);
+            std::stringstream buf;
+            buf << cluster.nodes.size() << std::endl;
+            cluster.marker->setText(buf.str());
+        }
+        else
+        {
+            Cluster cluster;
+            cluster.nodes.push_back(node);
+            addCluster(world, screen, cluster);
+        }
     }
 }
 
@@ -275,12 +815,27 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
             for (osg::NodeList::iterator itr = _nodes.begin(); itr != _nodes.end(); ++itr)
             {
                 itr->get()->accept(nv);
-            }            
+            }
         }
         else
         {
             if (_mapNode.valid())
             {
+                // Pick up a finished hierarchy, or start building a new one
+                // once enough of the nodes have changed since the last one.
+                if (_indexJobPending)
+                {
+                    if (_indexJob.isAvailable())
+                        installIndex(_indexJob.get());
+                    else if (_indexJob.isAbandoned())
+                        _indexJobPending = false;
+                }
+
+                if (!_indexJobPending && !_nodes.empty() && (_rebuildIndex || isIndexStale()))
+                {
+                    startIndexJob();
+                }
+
                 const osg::Matrixd &currentViewMatrix = cv->getCurrentCamera()->getViewMatrix();
                 if (_lastViewMatrix != currentViewMatrix || _dirty)
                 {
@@ -356,4 +911,4 @@ PlaceNode* ClusterNode::getOrCreateLabel()
     return node;
 
 
-}
\ No newline at end of file
+}
@@ -55,6 +55,12 @@ Config::setReferrer( const std::string& referrer )
         absReferrer = referrer;
     }
 
+    setAbsoluteReferrer( absReferrer );
+}
+
+void
+Config::setAbsoluteReferrer( const std::string& absReferrer )
+{
     // Don't overwrite an existing referrer:
     if ( _referrer.empty() )
     {
@@ -63,17 +69,19 @@ Config::setReferrer( const std::string& referrer )
 
     for( ConfigSet::iterator i = _children.begin(); i != _children.end(); i++ )
     { 
-        i->setReferrer( absReferrer );
+        i->setAbsoluteReferrer( absReferrer );
     }
 }
 
 bool
 Config::fromXML( std::istream& in )
 {
-    osg::ref_ptr<XmlDocument> xml = XmlDocument::load( in );
-    if ( xml.valid() )
-        *this = xml->getConfig();
-    return xml.valid();
+    Config conf = XmlDocument::loadConfig( in );
+    if ( conf.empty() )
+        return false;
+
+    *this = std::move(conf);
+    return true;
 }
 
 #if 1
@@ -320,9 +328,8 @@ namespace
                     }
                     else
                     {
-                        Config element( *i );
-                        json2conf( value, element, depth+1 );
-                        conf.add( element );
+                        conf.add( Config(*i) );
+                        json2conf( value, conf.children().back(), depth+1 );
                     }
                 }
                 else if ( value.isArray() )
@@ -332,9 +339,9 @@ namespace
                         std::string key = i->substr(0, i->length()-9);
                         for( Json::Value::const_iterator j = value.begin(); j != value.end(); ++j )
                         {
-                            Config child;
-                            json2conf( *j, child, depth+1 );
-                            conf.add( key, child );
+                            conf.add( Config() );
+                            json2conf( *j, conf.children().back(), depth+1 );
+                            conf.children().back().key() = key;
                         }
                     }
                     else if ( endsWith(*i, "_$set") ) // backwards compatibility
@@ -342,16 +349,15 @@ namespace
                         std::string key = i->substr(0, i->length()-5);
                         for( Json::Value::const_iterator j = value.begin(); j != value.end(); ++j )
                         {
-                            Config child;
-                            json2conf( *j, child, depth+1 );
-                            conf.add( key, child );
+                            conf.add( Config() );
+                            json2conf( *j, conf.children().back(), depth+1 );
+                            conf.children().back().key() = key;
                         }
                     }
                     else
                     {
-                        Config element( *i );
-                        json2conf( value, element, depth+1 );
-                        conf.add( element );
+                        conf.add( Config(*i) );
+                        json2conf( value, conf.children().back(), depth+1 );
                     }
                 }
                 else if ( (*i) == "$key" )
@@ -385,10 +391,10 @@ namespace
         {          
             for( Json::Value::const_iterator j = json.begin(); j != json.end(); ++j )
             {
-                Config child;
-                json2conf( *j, child, depth+1 );
-                if ( !child.empty() )
-                    conf.add( child );
+                conf.add( Config() );
+                json2conf( *j, conf.children().back(), depth+1 );
+                if ( conf.children().back().empty() )
+                    conf.children().pop_back();
             }
         }
         else if ( json.type() != Json::nullValue )
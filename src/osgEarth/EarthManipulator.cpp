@@ -297,7 +297,8 @@ _terrainAvoidanceEnabled        ( true ),
 _terrainAvoidanceMinDistance    ( 1.0 ),
 _throwingEnabled                ( false ),
 _throwDecayRate                 ( 0.05 ),
-_zoomToMouse                    ( false )
+_zoomToMouse                    ( false ),
+_terrainRayCasting              ( false )
 {
     //NOP
 }
@@ -329,7 +330,8 @@ _terrainAvoidanceEnabled( rhs._terrainAvoidanceEnabled ),
 _terrainAvoidanceMinDistance( rhs._terrainAvoidanceMinDistance ),
 _throwingEnabled( rhs._throwingEnabled ),
 _throwDecayRate( rhs._throwDecayRate ),
-_zoomToMouse( rhs._zoomToMouse )
+_zoomToMouse( rhs._zoomToMouse ),
+_terrainRayCasting( rhs._terrainRayCasting )
 {
     //NOP
 }
@@ -352,6 +354,8 @@ EarthManipulator::Settings::apply(osg::ArgumentParser& args)
         setMinMaxPitch(doubleval, _max_pitch);
     if ( args.read("--manip-max-pitch", doubleval) )
         setMinMaxPitch(_min_pitch, doubleval);
+    if ( args.read("--manip-terrain-ray-casting", boolval) )
+        setTerrainRayCasting( boolval );
 }
 
 #define HASMODKEY( W, V ) (( W & V ) == V )
@@ -1365,6 +1369,18 @@ EarthManipulator::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg:
     osg::ref_ptr<MapNode> mapNode;
     if ( _mapNode.lock(mapNode) && mapNode->getTerrainEngine() )
     {
+        if (_settings->getTerrainRayCasting() && mapNode->getTerrain()->hasElevationData())
+        {
+            Terrain::Ray ray(start, end);
+            if (mapNode->getTerrain()->intersectRay(ray))
+            {
+                intersection = ray.point;
+                normal = ray.normal;
+                return true;
+            }
+            return false;
+        }
+
 		osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi = NULL;
 
 		lsi = new osgUtil::LineSegmentIntersector(start,end);
@@ -1399,22 +1415,37 @@ EarthManipulator::intersectLookVector(osg::Vec3d& out_eye,
         getWorldInverseMatrix().getLookAt(out_eye, out_target, out_up, 1.0);
         osg::Vec3d look = out_target-out_eye;
 
-		osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi =
-		    new osgUtil::LineSegmentIntersector(out_eye, out_eye+look*1e8);
+        if (_settings->getTerrainRayCasting() && mapNode->getTerrain()->hasElevationData())
+        {
+            Terrain::Ray ray(out_eye, out_eye+look*1e8);
+            if (mapNode->getTerrain()->intersectRay(ray))
+            {
+                out_target = ray.point;
+                if ( !_srs->isGeographic() || GeoMath::isPointVisible(out_eye, out_target, R) )
+                {
+                    success = true;
+                }
+            }
+        }
+        else
+        {
+            osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi =
+                new osgUtil::LineSegmentIntersector(out_eye, out_eye+look*1e8);
 
-        lsi->setIntersectionLimit(lsi->LIMIT_NEAREST);
+            lsi->setIntersectionLimit(lsi->LIMIT_NEAREST);
 
-        osgUtil::IntersectionVisitor iv(lsi.get());
-        iv.setTraversalMask(_intersectTraversalMask);
+            osgUtil::IntersectionVisitor iv(lsi.get());
+            iv.setTraversalMask(_intersectTraversalMask);
 
-        mapNode->getTerrainEngine()->getNode()->accept(iv);
+            mapNode->getTerrainEngine()->getNode()->accept(iv);
 
-        if (lsi->containsIntersections())
-        {
-            out_target = lsi->getIntersections().begin()->getWorldIntersectPoint();
-            if ( !_srs->isGeographic() || GeoMath::isPointVisible(out_eye, out_target, R) )
+            if (lsi->containsIntersections())
             {
-                success = true;
+                out_target = lsi->getIntersections().begin()->getWorldIntersectPoint();
+                if ( !_srs->isGeographic() || GeoMath::isPointVisible(out_eye, out_target, R) )
+                {
+                    success = true;
+                }
             }
         }
 
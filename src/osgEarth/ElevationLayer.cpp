@@ -23,6 +23,7 @@
 #include <osgEarth/Metrics>
 #include <osgEarth/NetworkMonitor>
 #include <cinttypes>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -645,6 +646,151 @@ namespace
     };
 
     typedef std::vector<LayerData> LayerDataVector;
+
+    // Samples a heightfield at each post of an output grid for which needed[p]
+    // is set (p = row*numColumns + col), writing NO_DATA_VALUE where the
+    // heightfield has no data. The result matches GeoHeightField::getElevation.
+    // When the heightfield is in the output SRS and interpolation is bilinear,
+    // the sample positions and weights are computed once per row and column
+    // instead of transforming and bounds-checking every post.
+    void sampleHeightField(
+        const GeoHeightField&             layerHF,
+        const SpatialReference*           srs,
+        double                            xmin,
+        double                            ymin,
+        double                            dx,
+        double                            dy,
+        unsigned                          numColumns,
+        unsigned                          numRows,
+        RasterInterpolation               interpolation,
+        const std::vector<unsigned char>& needed,
+        std::vector<float>&               out)
+    {
+        const GeoExtent& extent = layerHF.getExtent();
+        const osg::HeightField* hf = layerHF.getHeightField();
+
+        bool useTables =
+            interpolation == INTERP_BILINEAR &&
+            srs->isHorizEquivalentTo(extent.getSRS()) &&
+            srs->isVertEquivalentTo(extent.getSRS());
+
+        if (!useTables)
+        {
+            for (unsigned r = 0; r < numRows; ++r)
+            {
+                double y = ymin + (dy * (double)r);
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    unsigned p = r*numColumns + c;
+                    float elevation;
+                    if (needed[p] && layerHF.getElevation(srs, xmin + (dx * (double)c), y, interpolation, srs, elevation))
+                        out[p] = elevation;
+                    else
+                        out[p] = NO_DATA_VALUE;
+                }
+            }
+            return;
+        }
+
+        // Index and weight tables; GeoExtent::contains tests X and Y separately,
+        // so it can be evaluated per column and per row.
+        struct Sample {
+            bool inside;
+            int i0, i1;
+            double w0, w1;
+        };
+
+        const int cols = hf->getNumColumns();
+        const int rows = hf->getNumRows();
+        const double xInterval = extent.width() / (double)(cols - 1);
+        const double yInterval = extent.height() / (double)(rows - 1);
+        const double midX = extent.xMin() + 0.5*extent.width();
+        const double midY = extent.yMin() + 0.5*extent.height();
+
+        std::vector<Sample> colTable(numColumns), rowTable(numRows);
+
+        for (unsigned c = 0; c < numColumns; ++c)
+        {
+            double x = xmin + (dx * (double)c);
+            Sample& s = colTable[c];
+            s.inside = extent.contains(x, midY);
+            double px = osg::clampBetween((x - extent.xMin()) / xInterval, 0.0, (double)(cols - 1));
+            s.i0 = osg::maximum((int)floor(px), 0);
+            s.i1 = osg::maximum(osg::minimum((int)ceil(px), cols - 1), 0);
+            if (s.i0 > s.i1) s.i0 = s.i1;
+            s.w0 = (double)s.i1 - px;
+            s.w1 = px - (double)s.i0;
+        }
+
+        for (unsigned r = 0; r < numRows; ++r)
+        {
+            double y = ymin + (dy * (double)r);
+            Sample& s = rowTable[r];
+            s.inside = extent.contains(midX, y);
+            double py = osg::clampBetween((y - extent.yMin()) / yInterval, 0.0, (double)(rows - 1));
+            s.i0 = osg::maximum((int)floor(py), 0);
+            s.i1 = osg::maximum(osg::minimum((int)ceil(py), rows - 1), 0);
+            if (s.i0 > s.i1) s.i0 = s.i1;
+            s.w0 = (double)s.i1 - py;
+            s.w1 = py - (double)s.i0;
+        }
+
+        const float* heights = &hf->getFloatArray()->front();
+
+        for (unsigned r = 0; r < numRows; ++r)
+        {
+            const Sample& rs = rowTable[r];
+            float* outRow = &out[r*numColumns];
+            const unsigned char* neededRow = &needed[r*numColumns];
+
+            if (!rs.inside)
+            {
+                std::fill(outRow, outRow + numColumns, NO_DATA_VALUE);
+                continue;
+            }
+
+            const float* row0 = heights + rs.i0*cols;
+            const float* row1 = heights + rs.i1*cols;
+
+            for (unsigned c = 0; c < numColumns; ++c)
+            {
+                const Sample& cs = colTable[c];
+
+                if (!neededRow[c] || !cs.inside)
+                {
+                    outRow[c] = NO_DATA_VALUE;
+                    continue;
+                }
+
+                // Same arithmetic as HeightFieldUtils::getHeightAtPixel (bilinear)
+                float ll = row0[cs.i0], lr = row0[cs.i1];
+                float ul = row1[cs.i0], ur = row1[cs.i1];
+
+                if (!HeightFieldUtils::validateSamples(ur, ll, ul, lr))
+                {
+                    outRow[c] = NO_DATA_VALUE;
+                }
+                else if (cs.i0 == cs.i1 && rs.i0 == rs.i1)
+                {
+                    outRow[c] = ll;
+                }
+                else if (cs.i0 == cs.i1)
+                {
+                    outRow[c] = rs.w0 * ll + rs.w1 * ul;
+                }
+                else if (rs.i0 == rs.i1)
+                {
+                    outRow[c] = cs.w0 * ll + cs.w1 * lr;
+                }
+                else
+                {
+                    double r1 = cs.w0 * (double)ll + cs.w1 * (double)lr;
+                    double r2 = cs.w0 * (double)ul + cs.w1 * (double)ur;
+                    outRow[c] = rs.w0 * r1 + rs.w1 * r2;
+                }
+            }
+        }
+    }
 }
 
 bool
@@ -795,10 +941,6 @@ ElevationLayerVector::populateHeightField(
 
     unsigned int total = numColumns * numRows;
 
-    int nodataCount = 0;
-
-    TileKey actualKey; // Storage if a new key needs to be constructed
-
     bool requiresResample = true;
 
     // If we only have a single contender layer, and the tile is the same size as the requested
@@ -832,197 +974,137 @@ ElevationLayerVector::populateHeightField(
         }
     }
 
-    // If we need to mosaic multiple layers or resample it to a new output tilesize go through a resampling loop.
+    // If we need to mosaic multiple layers or resample it to a new output tilesize,
+    // composite the layers one at a time in priority order. Each post takes its
+    // height from the first contender with data there, so a contender is only
+    // loaded if some posts are still unresolved after the ones above it.
     if (requiresResample)
     {
-        // We will load the actual heightfields on demand. We might not need them all.
-        GeoHeightFieldVector heightFields(contenders.size());
-        std::vector<TileKey> heightFieldActualKeys(contenders.size());
-        GeoHeightFieldVector offsetFields(offsets.size());
-        std::vector<bool>    heightFallback(contenders.size(), false);
-        std::vector<bool>    heightFailed(contenders.size(), false);
-        std::vector<bool>    offsetFailed(offsets.size(), false);
-
-        // Initialize the actual keys to match the contender keys.
-        // We'll adjust these as necessary if we need to fall back
-        for(unsigned i=0; i<contenders.size(); ++i)
-        {
-            heightFieldActualKeys[i] = contenders[i].key;
-        }
-
-        // The maximum number of heightfields to keep in this local cache
-        const unsigned maxHeightFields = 50;
-        unsigned numHeightFieldsInCache = 0;
-
-        for (unsigned c = 0; c < numColumns; ++c)
+        std::vector<float>& heights = hf->getFloatArray()->asVector();
+        std::vector<int> resolvedIndex(total, -1);
+        std::vector<float> resolution(total, FLT_MAX);
+        std::vector<unsigned char> needed(total, 1);
+        std::vector<float> samples(total);
+        unsigned numUnresolved = total;
+
+        for (unsigned i = 0; i < contenders.size() && numUnresolved > 0; ++i)
         {
-            double x = xmin + (dx * (double)c);
-
-            // periodically check for cancelation
             if (progress && progress->isCanceled())
             {
                 return false;
             }
 
-            for (unsigned r = 0; r < numRows; ++r)
-            {
-                double y = ymin + (dy * (double)r);
-
-                // Collect elevations from each layer as necessary.
-                int resolvedIndex = -1;
-
-                float resolution = FLT_MAX;
-
-                osg::Vec3 normal_sum(0, 0, 0);
+            ElevationLayer* layer = contenders[i].layer.get();
+            TileKey actualKey = contenders[i].key;
 
-                for (int i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+            // Fall back on parent keys to make sure that we have data at the
+            // location even if it's fallback.
+            GeoHeightField layerHF;
+            while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
+            {
+                layerHF = layer->createHeightField(actualKey, progress);
+                if (!layerHF.valid())
                 {
-                    ElevationLayer* layer = contenders[i].layer.get();
-                    TileKey& contenderKey = contenders[i].key;
-                    int index = contenders[i].index;
-
-                    if (heightFailed[i])
-                        continue;
-
-                    GeoHeightField& layerHF = heightFields[i];
-                    TileKey& actualKey = heightFieldActualKeys[i];
-
-                    if (!layerHF.valid())
-                    {
-                        // We couldn't get the heightfield from the cache, so try to create it.
-                        // We also fallback on parent layers to make sure that we have data at the location even if it's fallback.
-                        while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
-                        {
-                            layerHF = layer->createHeightField(actualKey, progress);
-                            if (!layerHF.valid())
-                            {
-                                actualKey.makeParent();
-                            }
-                        }
-
-                        // Mark this layer as fallback if necessary.
-                        if (layerHF.valid())
-                        {
-                            //TODO: check this. Should it be actualKey != keyToUse...?
-                            heightFallback[i] = 
-                                contenders[i].isFallback ||
-                                (actualKey != contenderKey);
+                    actualKey.makeParent();
+                }
+            }
 
-                            numHeightFieldsInCache++;
-                        }
-                        else
-                        {
-                            heightFailed[i] = true;
+            if (!layerHF.valid())
+            {
 #ifdef ANALYZE
-                            layerAnalysis[layer].failed = true;
-                            layerAnalysis[layer].actualKeyValid = actualKey->valid();
-                            if (progress) layerAnalysis[layer].message = progress->message();
+                layerAnalysis[layer].failed = true;
+                layerAnalysis[layer].actualKeyValid = actualKey.valid();
+                if (progress) layerAnalysis[layer].message = progress->message();
 #endif
-                            continue;
-                        }
-                    }
+                continue;
+            }
+
+            //TODO: check this. Should it be actualKey != keyToUse...?
+            bool isFallback =
+                contenders[i].isFallback ||
+                (actualKey != contenders[i].key);
 
-                    if (layerHF.valid())
-                    {
-                        bool isFallback = heightFallback[i];
 #ifdef ANALYZE
-                        layerAnalysis[layer].fallback = isFallback;
+            layerAnalysis[layer].fallback = isFallback;
 #endif
 
-                        // We only have real data if this is not a fallback heightfield.
-                        if (!isFallback)
-                        {
-                            realData = true;
-                        }
-
-                        float elevation;
-                        if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
-                        {
-                            if (elevation != NO_DATA_VALUE)
-                            {
-                                // remember the index so we can only apply offset layers that
-                                // sit on TOP of this layer.
-                                resolvedIndex = index;
+            // We only have real data if this is not a fallback heightfield.
+            if (!isFallback)
+            {
+                realData = true;
+            }
 
-                                hf->setHeight(c, r, elevation);
+            for (unsigned p = 0; p < total; ++p)
+            {
+                needed[p] = resolvedIndex[p] < 0 ? 1 : 0;
+            }
 
-                                resolution = actualKey.getResolution(hf->getNumColumns()).second;
-#ifdef ANALYZE
-                                layerAnalysis[layer].samples++;
-#endif
-                            }
-                            else
-                            {
-                                ++nodataCount;
-                            }
-                        }
-                    }
+            sampleHeightField(layerHF, keySRS, xmin, ymin, dx, dy, numColumns, numRows, interpolation, needed, samples);
 
+            // remember the index so we can only apply offset layers that
+            // sit on TOP of this layer.
+            int index = contenders[i].index;
+            float layerResolution = actualKey.getResolution(numColumns).second;
 
-                    // Clear the heightfield cache if we have too many heightfields in the cache.
-                    if (numHeightFieldsInCache >= maxHeightFields)
-                    {
-                        //OE_NOTICE << "Clearing cache" << std::endl;
-                        for (unsigned int k = 0; k < heightFields.size(); k++)
-                        {
-                            heightFields[k] = GeoHeightField::INVALID;
-                            heightFallback[k] = false;
-                        }
-                        numHeightFieldsInCache = 0;
-                    }
-                }
-
-                for (int i = offsets.size() - 1; i >= 0; --i)
+            for (unsigned p = 0; p < total; ++p)
+            {
+                if (needed[p] && samples[p] != NO_DATA_VALUE)
                 {
-                    if (progress && progress->isCanceled())
-                        return false;
-
-                    // Only apply an offset layer if it sits on top of the resolved layer
-                    // (or if there was no resolved layer).
-                    if (resolvedIndex >= 0 && offsets[i].index < resolvedIndex)
-                        continue;
+                    heights[p] = samples[p];
+                    resolvedIndex[p] = index;
+                    resolution[p] = layerResolution;
+                    --numUnresolved;
+                }
+            }
 
-                    TileKey& contenderKey = offsets[i].key;
+#ifdef ANALYZE
+            layerAnalysis[layer].samples = std::count(resolvedIndex.begin(), resolvedIndex.end(), index);
+#endif
+        }
 
-                    if (offsetFailed[i] == true)
-                        continue;
+        for (int i = offsets.size() - 1; i >= 0; --i)
+        {
+            if (progress && progress->isCanceled())
+            {
+                return false;
+            }
 
-                    GeoHeightField& layerHF = offsetFields[i];
-                    if (!layerHF.valid())
-                    {
-                        ElevationLayer* offset = offsets[i].layer.get();
+            // Only apply an offset layer where it sits on top of the resolved layer
+            // (or where there was no resolved layer).
+            bool anyNeeded = false;
+            for (unsigned p = 0; p < total; ++p)
+            {
+                needed[p] = (resolvedIndex[p] < 0 || offsets[i].index >= resolvedIndex[p]) ? 1 : 0;
+                anyNeeded = anyNeeded || needed[p];
+            }
 
-                        layerHF = offset->createHeightField(contenderKey, progress);
-                        if (!layerHF.valid())
-                        {
-                            offsetFailed[i] = true;
-                            continue;
-                        }
-                    }
+            if (!anyNeeded)
+                continue;
 
-                    // If we actually got a layer then we have real data
-                    realData = true;
+            GeoHeightField layerHF = offsets[i].layer->createHeightField(offsets[i].key, progress);
+            if (!layerHF.valid())
+                continue;
 
-                    float elevation = 0.0f;
-                    if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) &&
-                        elevation != NO_DATA_VALUE &&
-                        !osg::equivalent(elevation, 0.0f) )
-                    {
-                        hf->getHeight(c, r) += elevation;
+            // If we actually got a layer then we have real data
+            realData = true;
 
-                        // Technically this is correct, but the resultin normal maps
-                        // look awful and faceted. TODO
-                        //resolution = osg::minimum(
-                        //    resolution,
-                        //    (float)contenderKey.getResolution(hf->getNumColumns()).second);
-                    }
-                }
+            sampleHeightField(layerHF, keySRS, xmin, ymin, dx, dy, numColumns, numRows, interpolation, needed, samples);
 
-                if (resolutions)
+            for (unsigned p = 0; p < total; ++p)
+            {
+                if (needed[p] && samples[p] != NO_DATA_VALUE && !osg::equivalent(samples[p], 0.0f))
                 {
-                    resolutions[r*numColumns+c] = resolution;
+                    heights[p] += samples[p];
                 }
             }
+
+            // Technically we should take the offset resolution into account here,
+            // but the resulting normal maps look awful and faceted. TODO
+        }
+
+        if (resolutions)
+        {
+            std::copy(resolution.begin(), resolution.end(), resolutions);
         }
     }
 
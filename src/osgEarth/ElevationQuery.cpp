@@ -41,6 +41,12 @@ ElevationQuery::setMap(const Map* map)
     _map = map;
 }
 
+void
+ElevationQuery::setTerrain(const Terrain* terrain)
+{
+    _terrain = terrain;
+}
+
 void
 ElevationQuery::reset()
 {
@@ -262,6 +268,31 @@ ElevationQuery::getElevationImpl(const GeoPoint& point,
         return true;
     }
 
+    // next try the elevation data already loaded in the terrain, if requested.
+    // Only use it if it's at least as fine as the requested resolution; a
+    // request for the best available resolution always goes to the pool.
+    osg::ref_ptr<const Terrain> terrain;
+    if (desiredResolution > 0.0 && _terrain.lock(terrain) && terrain->hasElevationData())
+    {
+        osg::Vec3d surface, nvector;
+        point.toWorld(surface);
+        point.createWorldUpVector(nvector);
+
+        Terrain::Ray ray(surface + nvector*5e5, surface - nvector*5e5);
+        if (terrain->intersectRay(ray) &&
+            ray.resolution > 0.0 &&
+            ray.resolution <= desiredResolution)
+        {
+            GeoPoint output;
+            output.fromWorld(point.getSRS(), ray.point);
+            out_elevation = (float)output.z();
+            if (out_actualResolution)
+                *out_actualResolution = ray.resolution;
+
+            return true;
+        }
+    }
+
     // secure map pointer:
     osg::ref_ptr<const Map> map;
     if (!_map.lock(map))
@@ -31,6 +31,7 @@
 #include <osgEarth/LineDrawable>
 #include <osgEarth/StateSetCache>
 #include <osgEarth/Registry>
+#include <osgEarth/earcut.hpp>
 
 #include <osg/Geode>
 #include <osg/Geometry>
@@ -77,10 +78,42 @@ namespace
 
 #define AS_VEC4(V3, X) osg::Vec4f( (V3).x(), (V3).y(), (V3).z(), X )
 
+namespace
+{
+    // Outward normal of a wall face given its base edge and one roof corner.
+    inline osg::Vec3f faceNormal(const osg::Vec3d& baseL, const osg::Vec3d& baseR, const osg::Vec3d& roofL)
+    {
+        osg::Vec3f n = (baseR - baseL) ^ (roofL - baseL);
+        n.normalize();
+        return n;
+    }
+}
+
+// point accessors for the earcut triangulator (used for batched roofs)
+namespace mapbox {
+    namespace util {
+        template <>
+        struct nth<0, osg::Vec3f> {
+            inline static float get(const osg::Vec3f &t) {
+                return t.x();
+            };
+        };
+
+        template <>
+        struct nth<1, osg::Vec3f> {
+            inline static float get(const osg::Vec3f &t) {
+                return t.y();
+            };
+        };
+    }
+}
+
 //------------------------------------------------------------------------
 
 ExtrudeGeometryFilter::ExtrudeGeometryFilter() :
+_batchReserve          ( 0u ),
 _mergeGeometry         ( true ),
+_batchGeometry         ( false ),
 _wallAngleThresh_deg   ( 60.0 ),
 _styleDirty            ( true ),
 _makeStencilVolume     ( false ),
@@ -101,6 +134,9 @@ ExtrudeGeometryFilter::reset( const FilterContext& context )
 {
     _cosWallAngleThresh = cos( _wallAngleThresh_deg );
     _geodes.clear();
+    _wallBatches.clear();
+    _roofBatches.clear();
+    _outlineBatch = 0L;
     
     if ( _styleDirty )
     {
@@ -541,19 +577,7 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
     // 6 verts per face total (3 triangles)
     unsigned numWallVerts = structure.getNumPoints();
 
-    double texWidthM   = wallSkin ? *wallSkin->imageWidth()  : 1.0;
-    double texHeightM  = wallSkin ? *wallSkin->imageHeight() : 1.0;
     bool   useColor    = (!wallSkin || wallSkin->texEnvMode() != osg::TexEnv::DECAL) && !_makeStencilVolume;
-    
-    // Scale and bias:
-    osg::Vec2f scale, bias;
-    float layer;
-    if ( wallSkin )
-    {
-        bias.set (wallSkin->imageBiasS().get(),  wallSkin->imageBiasT().get());
-        scale.set(wallSkin->imageScaleS().get(), wallSkin->imageScaleT().get());
-        layer = (float)wallSkin->imageLayer().get();
-    }
 
     // create all the OSG geometry components
     osg::Vec3Array* verts = new osg::Vec3Array( numWallVerts );
@@ -583,12 +607,9 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
         walls->setVertexAttribArray    ( Clamping::AnchorAttrLocation, anchors );
     }
 
-    unsigned vertptr = 0;
-    bool     tex_repeats_y = wallSkin && wallSkin->isTiled() == true;
+    writeWallVerts(structure, 0u, verts, tex, colors, anchors, wallColor, wallBaseColor, wallSkin);
 
-    bool flatten =
-        _style.has<ExtrusionSymbol>() &&
-        _style.get<ExtrusionSymbol>()->flatten() == true;
+    unsigned vertptr = 0;
 
     for(Elevations::const_iterator elev = structure.elevations.begin(); elev != structure.elevations.end(); ++elev)
     {
@@ -602,6 +623,57 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
 
         walls->addPrimitiveSet( de );
 
+        for(unsigned i = 0; i < elev->getNumPoints(); ++i)
+        {
+            de->addElement( vertptr++ );
+        }
+    }
+    
+    // generate per-vertex normals, altering the geometry as necessary to avoid
+    // smoothing around sharp corners
+
+    // TODO: reconsider this, given the new Structure setup
+    // it won't actual smooth corners since we don't have shared edges.
+    osgUtil::SmoothingVisitor::smooth(
+        *walls,
+        osg::DegreesToRadians(_wallAngleThresh_deg) );
+
+    return madeGeom;
+}
+
+void
+ExtrudeGeometryFilter::writeWallVerts(const Structure&     structure,
+                                      unsigned             offset,
+                                      osg::Vec3Array*      verts,
+                                      osg::Vec3Array*      tex,
+                                      osg::Vec4Array*      colors,
+                                      osg::Vec4Array*      anchors,
+                                      const osg::Vec4&     wallColor,
+                                      const osg::Vec4&     wallBaseColor,
+                                      const SkinResource*  wallSkin)
+{
+    // assumes all arrays are already sized to hold offset + structure.getNumPoints() verts.
+    double texWidthM   = wallSkin ? *wallSkin->imageWidth()  : 1.0;
+    
+    // Scale and bias:
+    osg::Vec2f scale, bias;
+    float layer;
+    if ( wallSkin )
+    {
+        bias.set (wallSkin->imageBiasS().get(),  wallSkin->imageBiasT().get());
+        scale.set(wallSkin->imageScaleS().get(), wallSkin->imageScaleT().get());
+        layer = (float)wallSkin->imageLayer().get();
+    }
+
+    unsigned vertptr = offset;
+    bool     tex_repeats_y = wallSkin && wallSkin->isTiled() == true;
+
+    bool flatten =
+        _style.has<ExtrusionSymbol>() &&
+        _style.get<ExtrusionSymbol>()->flatten() == true;
+
+    for(Elevations::const_iterator elev = structure.elevations.begin(); elev != structure.elevations.end(); ++elev)
+    {
         for(Faces::const_iterator f = elev->faces.begin(); f != elev->faces.end(); ++f, vertptr+=6)
         {
             // set the 6 wall verts.
@@ -635,7 +707,7 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
             }
 
             // Assign wall polygon colors.
-            if (useColor)
+            if (colors)
             {
                 (*colors)[vertptr+0] = wallColor;
                 (*colors)[vertptr+1] = wallBaseColor;
@@ -646,7 +718,7 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
             }
 
             // Calculate texture coordinates:
-            if (wallSkin)
+            if (wallSkin && tex)
             {
                 // Calculate left and right corner V coordinates:
                 double hL = tex_repeats_y ? (f->left.roof - f->left.base).length()   : elev->texHeightAdjustedM;
@@ -679,24 +751,8 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
                 (*tex)[vertptr+4].set( texRoofR.x(), texRoofR.y(), layer );
                 (*tex)[vertptr+5].set( texRoofL.x(), texRoofL.y(), layer );
             }
-
-            for(int i=0; i<6; ++i)
-            {
-                de->addElement( vertptr+i );
-            }
         }
     }
-    
-    // generate per-vertex normals, altering the geometry as necessary to avoid
-    // smoothing around sharp corners
-
-    // TODO: reconsider this, given the new Structure setup
-    // it won't actual smooth corners since we don't have shared edges.
-    osgUtil::SmoothingVisitor::smooth(
-        *walls,
-        osg::DegreesToRadians(_wallAngleThresh_deg) );
-
-    return madeGeom;
 }
 
 
@@ -812,13 +868,10 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
 }
 
 
-osg::Drawable*
-ExtrudeGeometryFilter::buildOutlineGeometry(const Structure& structure)
+LineDrawable*
+ExtrudeGeometryFilter::createOutlineDrawable() const
 {
-    // minimum angle between adjacent faces for which to draw a post.
-    const float cosMinAngle = cos(osg::DegreesToRadians(_outlineSymbol->creaseAngle().get()));
-
-    osg::ref_ptr<LineDrawable> lines = new LineDrawable(GL_LINES);
+    LineDrawable* lines = new LineDrawable(GL_LINES);
 
     // if the user requested legacy lines:
     if (_outlineSymbol->useGLLines() == true)
@@ -839,14 +892,26 @@ ExtrudeGeometryFilter::buildOutlineGeometry(const Structure& structure)
             lines->setStippleFactor(stroke->stippleFactor().get());
     }
 
-    osg::Vec4Array* anchors = 0L;
     if ( _gpuClamping )
     {
-        anchors = new osg::Vec4Array();
+        osg::Vec4Array* anchors = new osg::Vec4Array();
         anchors->setBinding(osg::Array::BIND_PER_VERTEX);
         lines->setVertexAttribArray( Clamping::AnchorAttrLocation, anchors );
     }
 
+    return lines;
+}
+
+void
+ExtrudeGeometryFilter::appendOutlineGeometry(const Structure& structure, LineDrawable* lines)
+{
+    // minimum angle between adjacent faces for which to draw a post.
+    const float cosMinAngle = cos(osg::DegreesToRadians(_outlineSymbol->creaseAngle().get()));
+
+    osg::Vec4Array* anchors = _gpuClamping ?
+        static_cast<osg::Vec4Array*>(lines->getVertexAttribArray(Clamping::AnchorAttrLocation)) :
+        0L;
+
     bool flatten =
         _style.has<ExtrusionSymbol>() &&
         _style.get<ExtrusionSymbol>()->flatten() == true;
@@ -939,12 +1004,266 @@ ExtrudeGeometryFilter::buildOutlineGeometry(const Structure& structure)
         }
     }
 
+}
+
+osg::Drawable*
+ExtrudeGeometryFilter::buildOutlineGeometry(const Structure& structure)
+{
+    osg::ref_ptr<LineDrawable> lines = createOutlineDrawable();
+
+    appendOutlineGeometry(structure, lines.get());
+
     // finalize the line set
     lines->dirty();
 
     return lines->empty() ? 0L : lines.release();
 }
 
+ExtrudeGeometryFilter::Batch&
+ExtrudeGeometryFilter::getBatch(BatchMap&       batches,
+                                osg::StateSet*  stateSet,
+                                unsigned        numVerts,
+                                bool            useColor,
+                                bool            useTex)
+{
+    Batch& batch = batches[stateSet];
+
+    unsigned maxVerts = Registry::instance()->getMaxNumberOfVertsPerDrawable();
+
+    // start a new geometry when this one would grow past the vertex limit.
+    // (the old one is already in the scene graph.)
+    if ( batch.geom.valid() && !batch.verts->empty() && batch.verts->size() + numVerts > maxVerts )
+    {
+        batch = Batch();
+    }
+
+    if ( !batch.geom.valid() )
+    {
+        // pre-size everything so appending features does not reallocate.
+        unsigned limit   = osg::maximum(maxVerts, numVerts);
+        unsigned reserve = osg::clampBetween(_batchReserve, numVerts, limit);
+
+        batch.geom = new osg::Geometry();
+        batch.geom->setUseVertexBufferObjects(true);
+        batch.geom->setUseDisplayList(false);
+
+        batch.verts = new osg::Vec3Array();
+        batch.verts->reserve( reserve );
+        batch.geom->setVertexArray( batch.verts.get() );
+
+        batch.normals = new osg::Vec3Array( osg::Array::BIND_PER_VERTEX );
+        batch.normals->reserve( reserve );
+        batch.geom->setNormalArray( batch.normals.get() );
+
+        if ( useColor )
+        {
+            batch.colors = new osg::Vec4Array( osg::Array::BIND_PER_VERTEX );
+            batch.colors->reserve( reserve );
+            batch.geom->setColorArray( batch.colors.get() );
+        }
+
+        if ( useTex )
+        {
+            batch.texcoords = new osg::Vec3Array( osg::Array::BIND_PER_VERTEX );
+            batch.texcoords->reserve( reserve );
+            batch.geom->setTexCoordArray( 0, batch.texcoords.get() );
+        }
+
+        if ( _gpuClamping )
+        {
+            batch.anchors = new osg::Vec4Array( osg::Array::BIND_PER_VERTEX );
+            batch.anchors->setNormalize( false );
+            batch.anchors->reserve( reserve );
+            batch.geom->setVertexAttribArray( Clamping::AnchorAttrLocation, batch.anchors.get() );
+        }
+
+        batch.indices = limit > 0xFFFF ?
+            (osg::DrawElements*) new osg::DrawElementsUInt  ( GL_TRIANGLES ) :
+            (osg::DrawElements*) new osg::DrawElementsUShort( GL_TRIANGLES );
+        batch.indices->reserveElements( reserve );
+        batch.geom->addPrimitiveSet( batch.indices.get() );
+
+        addDrawable( batch.geom.get(), stateSet, std::string(), 0L, 0L );
+    }
+
+    return batch;
+}
+
+void
+ExtrudeGeometryFilter::appendWallGeometry(const Structure&     structure,
+                                          osg::StateSet*       stateSet,
+                                          const osg::Vec4&     wallColor,
+                                          const osg::Vec4&     wallBaseColor,
+                                          const SkinResource*  wallSkin,
+                                          Feature*             feature,
+                                          FeatureIndexBuilder* index)
+{
+    unsigned numWallVerts = structure.getNumPoints();
+    if ( numWallVerts == 0 )
+        return;
+
+    bool useColor = (!wallSkin || wallSkin->texEnvMode() != osg::TexEnv::DECAL) && !_makeStencilVolume;
+
+    Batch& batch = getBatch(_wallBatches, stateSet, numWallVerts, useColor, wallSkin != 0L);
+
+    unsigned offset = batch.verts->size();
+    unsigned size   = offset + numWallVerts;
+
+    batch.verts->resize( size );
+    batch.normals->resize( size );
+    if ( batch.colors.valid() )    batch.colors->resize( size );
+    if ( batch.texcoords.valid() ) batch.texcoords->resize( size );
+    if ( batch.anchors.valid() )   batch.anchors->resize( size );
+
+    writeWallVerts(
+        structure, offset,
+        batch.verts.get(), batch.texcoords.get(), batch.colors.get(), batch.anchors.get(),
+        wallColor, wallBaseColor, wallSkin);
+
+    // Compute the normals directly instead of running the smoothing visitor
+    // over the whole batch. Adjacent faces that meet at less than the wall
+    // angle threshold share a smoothed normal along their common edge.
+    const float cosThresh = cos(osg::DegreesToRadians(_wallAngleThresh_deg));
+
+    unsigned vertptr = offset;
+    for(Elevations::const_iterator elev = structure.elevations.begin(); elev != structure.elevations.end(); ++elev)
+    {
+        const Faces& faces = elev->faces;
+        unsigned numFaces = faces.size();
+
+        for(unsigned i = 0; i < numFaces; ++i, vertptr += 6)
+        {
+            const Face& f = faces[i];
+            osg::Vec3f n = faceNormal(f.left.base, f.right.base, f.left.roof);
+            osg::Vec3f nL = n, nR = n;
+
+            if ( i > 0 || structure.isPolygon )
+            {
+                const Face& prev = faces[(i + numFaces - 1) % numFaces];
+                osg::Vec3f p = faceNormal(prev.left.base, prev.right.base, prev.left.roof);
+                if ( n*p >= cosThresh )
+                {
+                    nL = n + p;
+                    nL.normalize();
+                }
+            }
+
+            if ( i+1 < numFaces || structure.isPolygon )
+            {
+                const Face& next = faces[(i + 1) % numFaces];
+                osg::Vec3f q = faceNormal(next.left.base, next.right.base, next.left.roof);
+                if ( n*q >= cosThresh )
+                {
+                    nR = n + q;
+                    nR.normalize();
+                }
+            }
+
+            (*batch.normals)[vertptr+0] = nL;
+            (*batch.normals)[vertptr+1] = nL;
+            (*batch.normals)[vertptr+2] = nR;
+            (*batch.normals)[vertptr+3] = nR;
+            (*batch.normals)[vertptr+4] = nR;
+            (*batch.normals)[vertptr+5] = nL;
+        }
+    }
+
+    for(unsigned i = offset; i < size; ++i)
+    {
+        batch.indices->addElement( i );
+    }
+
+    if ( index )
+    {
+        index->tagRange( batch.geom.get(), feature, offset, numWallVerts );
+    }
+}
+
+void
+ExtrudeGeometryFilter::appendRoofGeometry(const Structure&     structure,
+                                          osg::StateSet*       stateSet,
+                                          const osg::Vec4&     roofColor,
+                                          const SkinResource*  roofSkin,
+                                          Feature*             feature,
+                                          FeatureIndexBuilder* index)
+{
+    // Collect the rings to triangulate. Like the non-batched path, only use
+    // source verts; the interim verts are co-linear anyway. The first ring is
+    // the outer boundary and the rest are holes.
+    unsigned numRoofVerts = 0;
+    _roofRings.resize( structure.elevations.size() );
+    for(unsigned r = 0; r < structure.elevations.size(); ++r)
+    {
+        std::vector<osg::Vec3f>& ring = _roofRings[r];
+        ring.clear();
+
+        const Faces& faces = structure.elevations[r].faces;
+        for(Faces::const_iterator f = faces.begin(); f != faces.end(); ++f)
+        {
+            if ( f->left.isFromSource )
+                ring.push_back( f->left.roof );
+        }
+        numRoofVerts += ring.size();
+    }
+
+    if ( numRoofVerts < 3 )
+        return;
+
+    // The roof lies in the XY plane of the local tangent frame.
+    std::vector<uint32_t> indices = mapbox::earcut<uint32_t>( _roofRings );
+    if ( indices.empty() )
+        return;
+
+    Batch& batch = getBatch(_roofBatches, stateSet, numRoofVerts, true, roofSkin != 0L);
+
+    unsigned offset = batch.verts->size();
+
+    bool flatten =
+        _style.has<ExtrusionSymbol>() &&
+        _style.get<ExtrusionSymbol>()->flatten() == true;
+
+    float
+        x  = structure.baseCentroid.x(),
+        y  = structure.baseCentroid.y(),
+        vo = structure.verticalOffset;
+
+    for(Elevations::const_iterator e = structure.elevations.begin(); e != structure.elevations.end(); ++e)
+    {
+        for(Faces::const_iterator f = e->faces.begin(); f != e->faces.end(); ++f)
+        {
+            if ( f->left.isFromSource )
+            {
+                batch.verts->push_back( f->left.roof );
+                batch.normals->push_back( osg::Vec3f(0,0,1) );
+                batch.colors->push_back( roofColor );
+
+                if ( batch.texcoords.valid() )
+                {
+                    batch.texcoords->push_back( osg::Vec3f(f->left.roofTexU, f->left.roofTexV, 0.0f) );
+                }
+
+                if ( batch.anchors.valid() )
+                {
+                    if ( flatten )
+                        batch.anchors->push_back( osg::Vec4f(x, y, vo, Clamping::ClampToAnchor) );
+                    else
+                        batch.anchors->push_back( osg::Vec4f(x, y, vo + f->left.height, Clamping::ClampToGround) );
+                }
+            }
+        }
+    }
+
+    for(std::vector<uint32_t>::const_iterator i = indices.begin(); i != indices.end(); ++i)
+    {
+        batch.indices->addElement( offset + *i );
+    }
+
+    if ( index )
+    {
+        index->tagRange( batch.geom.get(), feature, offset, numRoofVerts );
+    }
+}
+
 void
 ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
                                    osg::StateSet*       stateSet,
@@ -996,6 +1315,30 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
 bool
 ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
 {
+    // Batching writes all features into shared geometries, so it's only
+    // possible when we don't need to name the individual features. A feature
+    // index is fine; it tags each feature's vertex range instead. Stencil
+    // volumes need their per-feature base caps, which batches don't carry.
+    bool batch =
+        _batchGeometry &&
+        _featureNameExpr.empty() &&
+        !_makeStencilVolume;
+
+    FeatureIndexBuilder* index = context.featureIndex();
+
+    if ( batch )
+    {
+        // estimate the wall vertex count (6 per source point) so we can
+        // size the batches once up front.
+        unsigned numPoints = 0;
+        for( FeatureList::const_iterator f = features.begin(); f != features.end(); ++f )
+        {
+            if ( f->get()->getGeometry() )
+                numPoints += f->get()->getGeometry()->getTotalPointCount();
+        }
+        _batchReserve = numPoints * 6;
+    }
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -1026,18 +1369,28 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
         {
             Geometry* part = iter.next();
 
-            osg::ref_ptr<osg::Geometry> walls = new osg::Geometry();
-            walls->setUseVertexBufferObjects(true);
-            
+            osg::ref_ptr<osg::Geometry> walls = 0L;
             osg::ref_ptr<osg::Geometry> rooflines = 0L;
             osg::ref_ptr<osg::Geometry> baselines = 0L;
             osg::ref_ptr<osg::Drawable> outlines  = 0L;
+
+            bool makeRoof = (part->getType() == Geometry::TYPE_POLYGON);
+
+            if ( !batch )
+            {
+                walls = new osg::Geometry();
+                walls->setUseVertexBufferObjects(true);
+            }
             
-            if ( part->getType() == Geometry::TYPE_POLYGON )
+            if ( makeRoof )
             {
 		part->rewind(osgEarth::Geometry::ORIENTATION_CCW);
-                rooflines = new osg::Geometry();
-                rooflines->setUseVertexBufferObjects(true);
+
+                if ( !batch )
+                {
+                    rooflines = new osg::Geometry();
+                    rooflines->setUseVertexBufferObjects(true);
+                }
 
                 // prep the shapes by making sure all polys are open:
                 static_cast<Polygon*>(part)->open();
@@ -1124,7 +1477,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                 context);
 
             // Create the walls.
-            if ( walls.valid() )
+            if ( walls.valid() || batch )
             {
                 osg::Vec4f wallColor(1,1,1,1), wallBaseColor(1,1,1,1);
 
@@ -1142,17 +1495,20 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                     wallBaseColor = wallColor;
                 }
 
-                buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin);
-
                 if ( wallSkin )
                 {
                     // Get a stateset for the individual wall stateset
                     context.resourceCache()->getOrCreateStateSet(wallSkin, wallStateSet, context.getDBOptions());
                 }
+
+                if ( batch )
+                    appendWallGeometry(structure, wallStateSet.get(), wallColor, wallBaseColor, wallSkin, input, index);
+                else
+                    buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin);
             }
 
             // tessellate and add the roofs if necessary:
-            if ( rooflines.valid() )
+            if ( rooflines.valid() || (batch && makeRoof) )
             {
                 osg::Vec4f roofColor(1,1,1,1);
                 if ( _roofPolygonSymbol.valid() )
@@ -1160,18 +1516,51 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                     roofColor = _roofPolygonSymbol->fill()->color();
                 }
 
-                buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
-
                 if ( roofSkin )
                 {
                     // Get a stateset for the individual roof skin
                     context.resourceCache()->getOrCreateStateSet(roofSkin, roofStateSet, context.getDBOptions());
                 }
+
+                if ( batch )
+                    appendRoofGeometry(structure, roofStateSet.get(), roofColor, roofSkin, input, index);
+                else
+                    buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
             }
 
             if (_outlineSymbol.valid())
             {
-                outlines = buildOutlineGeometry(structure);
+                // LineDrawable vertices don't map 1:1 to the source vertices,
+                // so indexed outlines stay one-per-feature.
+                if ( batch && !index )
+                {
+                    if ( !_outlineBatch.valid() )
+                    {
+                        _outlineBatch = createOutlineDrawable();
+                        addDrawable( _outlineBatch.get(), 0L, std::string(), 0L, 0L );
+                    }
+                    appendOutlineGeometry(structure, _outlineBatch.get());
+                }
+                else
+                {
+                    outlines = buildOutlineGeometry(structure);
+                }
+            }
+
+            // Set up for feature naming and feature indexing:
+            std::string name;
+            if ( !_featureNameExpr.empty() )
+                name = input->eval( _featureNameExpr, &context );
+
+            // batched geometry is already in the scene graph; only the
+            // per-feature outlines of an indexed batch remain to be added.
+            if ( batch )
+            {
+                if ( outlines.valid() )
+                {
+                    addDrawable( outlines.get(), 0L, name, input, index );
+                }
+                continue;
             }
 
             if ( baselines.valid() )
@@ -1182,13 +1571,6 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                 tess.retessellatePolygons( *(baselines.get()) );
             }
 
-            // Set up for feature naming and feature indexing:
-            std::string name;
-            if ( !_featureNameExpr.empty() )
-                name = input->eval( _featureNameExpr, &context );
-
-            FeatureIndexBuilder* index = context.featureIndex();
-
             if ( walls.valid() && walls->getVertexArray() && walls->getVertexArray()->getNumElements() > 0 )
             {
                 addDrawable( walls.get(), wallStateSet.get(), name, input, index );
@@ -1264,6 +1646,16 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     // push all the features through the extruder.
     bool ok = process( input, context );
 
+    // finalize the batches, if any.
+    if ( _outlineBatch.valid() )
+    {
+        _outlineBatch->dirty();
+    }
+    bool batched = !_wallBatches.empty() || !_roofBatches.empty() || _outlineBatch.valid();
+    _wallBatches.clear();
+    _roofBatches.clear();
+    _outlineBatch = 0L;
+
     // parent geometry with a delocalizer (if necessary)
     osg::Group* group = createDelocalizeGroup();
     
@@ -1279,7 +1671,8 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     }
     _lineGroups.clear();
 
-    if ( _mergeGeometry == true && _featureNameExpr.empty() )
+    // batched geometry is already consolidated; no need to merge it again.
+    if ( _mergeGeometry == true && _featureNameExpr.empty() && !batched )
     {
         osg::ref_ptr<StateSetCache> cache = new StateSetCache();
         cache->consolidateStateSets(group);
@@ -47,6 +47,28 @@
 
 using namespace osgEarth;
 
+namespace
+{
+    // Combined extent of a feature list in the given SRS, so the terrain
+    // only notifies us about tiles under the features.
+    GeoExtent getFeaturesExtent(const FeatureList& features, const SpatialReference* srs)
+    {
+        GeoExtent extent(srs);
+        for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+        {
+            if (i->valid() && i->get()->getExtent().isValid())
+            {
+                GeoExtent fe = i->get()->getExtent().transform(srs);
+                if (!fe.isValid() || fe.crossesAntimeridian())
+                    return GeoExtent::INVALID;
+                extent.expandToInclude(fe.west(), fe.south());
+                extent.expandToInclude(fe.east(), fe.north());
+            }
+        }
+        return extent;
+    }
+}
+
 FeatureNode::FeatureNode(Feature* feature,
                          const Style& in_style,
                          const GeometryCompilerOptions& options,
@@ -214,7 +236,9 @@ FeatureNode::build()
                 SetDataVarianceVisitor sdv(osg::Object::DYNAMIC);
                 this->accept(sdv);
 
-                getMapNode()->getTerrain()->addTerrainCallback(_clampCallback.get());
+                getMapNode()->getTerrain()->addTerrainCallback(
+                    _clampCallback.get(),
+                    getFeaturesExtent(_features, getMapNode()->getMapSRS()));
                 clamp(getMapNode()->getTerrain()->getGraph(), getMapNode()->getTerrain());
             }
             else
@@ -326,7 +350,8 @@ FeatureNode::onTileUpdate(const TileKey&          key,
                          osg::Node*              graph,
                          TerrainCallbackContext& context)
 {
-    if (!_clampDirty)
+    // If we are already set to clamp everything, ignore this
+    if (!_clampDirty || _clampExtent.isValid())
     {
         bool needsClamp;
 
@@ -345,15 +370,31 @@ FeatureNode::onTileUpdate(const TileKey&          key,
 
         if (needsClamp)
         {
-            _clampDirty = true;
-            ADJUST_UPDATE_TRAV_COUNT(this, +1);
-            //clamp(graph, context.getTerrain());
+            // accumulate the area to reclamp; an invalid extent means everywhere.
+            if (!_clampDirty)
+                _clampExtent = key.valid() ? key.getExtent() : GeoExtent::INVALID;
+            else if (key.valid())
+                _clampExtent.expandToInclude(key.getExtent());
+            else
+                _clampExtent = GeoExtent::INVALID;
+
+            if (!_clampDirty)
+            {
+                _clampDirty = true;
+                ADJUST_UPDATE_TRAV_COUNT(this, +1);
+            }
         }
     }
 }
 
 void
 FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
+{
+    clamp(graph, terrain, GeoExtent::INVALID);
+}
+
+void
+FeatureNode::clamp(osg::Node* graph, const Terrain* terrain, const GeoExtent& extent)
 {
     if ( terrain && graph )
     {
@@ -369,6 +410,8 @@ FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
         clamper.setTerrainSRS( terrain->getSRS() );
         clamper.setUseVertexZ( relative );
         clamper.setOffset( offset );
+        clamper.setTerrain( terrain );
+        clamper.setExtent( extent );
 
         this->accept( clamper );
     }
@@ -383,10 +426,11 @@ FeatureNode::traverse(osg::NodeVisitor& nv)
         {
             osg::ref_ptr<Terrain> terrain = getMapNode()->getTerrain();
             if (terrain.valid())
-                clamp(terrain->getGraph(), terrain.get());
+                clamp(terrain->getGraph(), terrain.get(), _clampExtent);
 
             ADJUST_UPDATE_TRAV_COUNT(this, -1);
             _clampDirty = false;
+            _clampExtent = GeoExtent::INVALID;
         }
     }
     AnnotationNode::traverse(nv);
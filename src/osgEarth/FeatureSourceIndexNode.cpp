@@ -129,6 +129,15 @@ FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
+ObjectID
+FeatureSourceIndexNode::tagRange(osg::Drawable* drawable, Feature* feature, unsigned first, unsigned count)
+{
+    if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
+    RefIDPair* r = _index->tagRange( drawable, feature, first, count );
+    if ( r ) _fids[ feature->getFID() ] = r;
+    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+}
+
 bool
 FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
 {
@@ -456,6 +465,39 @@ FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature)
     return p;
 }
 
+RefIDPair*
+FeatureSourceIndex::tagRange(osg::Drawable* drawable, Feature* feature, unsigned first, unsigned count)
+{
+    if ( !feature ) return 0L;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    RefIDPair* p = 0L;
+    FeatureID fid = feature->getFID();
+
+    FIDMap::const_iterator f = _fids.find( fid );
+    if ( f != _fids.end() )
+    {
+        ObjectID oid = f->second->_oid;
+        _masterIndex->tagRange( drawable, oid, first, count );
+        p = f->second.get();
+    }
+    else
+    {
+        ObjectID oid = _masterIndex->tagRange( drawable, this, first, count );
+        p = new RefIDPair( fid, oid );
+        _fids[fid] = p;
+        _oids[oid] = fid;
+
+        if ( _embed )
+        {
+            _embeddedFeatures[fid] = feature;
+        }
+    }
+
+    return p;
+}
+
 Feature*
 FeatureSourceIndex::getFeature(ObjectID oid) const
 {
@@ -23,6 +23,7 @@
 #include <osgEarth/Containers>
 #include <osgEarth/rtree.h>
 #include <osgEarth/Metrics>
+#include <climits>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -156,25 +157,6 @@ namespace
         return p->getBounds().center();
     }
 
-    double getDistanceSquaredToClosestEdge(const osg::Vec3d& P, const Polygon* poly)
-    {
-        double Dmin = DBL_MAX;
-        ConstSegmentIterator segIter(poly, true);
-        while (segIter.hasMore())
-        {
-            const Segment segment = segIter.next();
-            const POINT& A = segment.first;
-            const POINT& B = segment.second;
-            const VECTOR AP = P - A, AB = B - A;
-            double t = clamp((AP*AB) / AB.length2(), 0.0, 1.0);
-            VECTOR PROJ = A + AB * t;
-            double D = (P - PROJ).length2();
-            if (D < Dmin) Dmin = D;
-        }
-        return Dmin;
-    }
-
-
     struct Widths {
         Widths(const Widths& rhs) {
             bufferWidth = rhs.bufferWidth;
@@ -192,112 +174,400 @@ namespace
 
     typedef std::vector<Widths> WidthsList;
 
+    // A polygon that affects the tile we're flattening.
+    struct FlattenPolygon
+    {
+        const Polygon* polygon;
+        double bufferWidth;
+        float elevation;                 // elevation sampled at a point inside the polygon
+        unsigned firstVert;              // offset of its rings in the shared vertex array
+        std::vector<unsigned> ringSizes; // outer ring, then holes
+        unsigned internalPoint;          // index of its internal point in the shared array
+    };
+
+    // 1D squared Euclidean distance transform of a sampled function
+    // (Felzenszwalb & Huttenlocher, "Distance Transforms of Sampled Functions").
+    // f holds 0 at sites and DBL_MAX elsewhere; samples are "spacing" apart.
+    // Outputs the squared distance to and index of the nearest site (or -1).
+    void distanceTransform1D(
+        const double* f, unsigned n, double spacing,
+        double* out_d2, int* out_site,
+        std::vector<int>& v, std::vector<double>& z)
+    {
+        v.resize(n);
+        z.resize(n + 1);
+
+        int k = -1;
+        for (unsigned q = 0; q < n; ++q)
+        {
+            if (f[q] == DBL_MAX)
+                continue;
+
+            double xq = (double)q * spacing;
+            double s = -DBL_MAX;
+
+            while (k >= 0)
+            {
+                double xv = (double)v[k] * spacing;
+                s = ((f[q] + xq*xq) - (f[v[k]] + xv*xv)) / (2.0*(xq - xv));
+                if (s > z[k])
+                    break;
+                --k;
+            }
+
+            ++k;
+            v[k] = q;
+            z[k] = k == 0 ? -DBL_MAX : s;
+            z[k + 1] = DBL_MAX;
+        }
+
+        if (k < 0)
+        {
+            for (unsigned q = 0; q < n; ++q)
+            {
+                out_d2[q] = DBL_MAX;
+                out_site[q] = -1;
+            }
+            return;
+        }
+
+        k = 0;
+        for (unsigned q = 0; q < n; ++q)
+        {
+            double xq = (double)q * spacing;
+            while (z[k + 1] < xq)
+                ++k;
+            double dx = xq - (double)v[k] * spacing;
+            out_d2[q] = dx*dx + f[v[k]];
+            out_site[q] = v[k];
+        }
+    }
+
+    // Whether two bounds overlap in XY; an invalid "a" overlaps everything.
+    bool intersects2D(const Bounds& a, const Bounds& b)
+    {
+        return
+            !a.isValid() ||
+            (a.xMin() <= b.xMax() && a.xMax() >= b.xMin() &&
+             a.yMin() <= b.yMax() && a.yMax() >= b.yMin());
+    }
+
+    // Scanline-fills a polygon (with holes, even-odd rule) into the label grid,
+    // claiming only unlabeled posts. Vertices are in grid coordinates.
+    // Returns the number of posts claimed.
+    unsigned rasterizePolygon(
+        const osg::Vec3d* verts, const std::vector<unsigned>& ringSizes,
+        int label, std::vector<int>& labels, unsigned cols, unsigned rows,
+        std::vector<double>& crossings)
+    {
+        // vertical range of the polygon, clamped to the grid:
+        double ymin = DBL_MAX, ymax = -DBL_MAX;
+        unsigned total = 0;
+        for (unsigned i = 0; i < ringSizes.size(); ++i)
+            total += ringSizes[i];
+        for (unsigned i = 0; i < total; ++i)
+            ymin = std::min(ymin, verts[i].y()), ymax = std::max(ymax, verts[i].y());
+
+        int r0 = std::max(0, (int)ceil(ymin));
+        int r1 = std::min((int)rows - 1, (int)floor(ymax));
+
+        unsigned claimed = 0;
+
+        for (int r = r0; r <= r1; ++r)
+        {
+            double y = (double)r;
+            crossings.clear();
+
+            const osg::Vec3d* ring = verts;
+            for (unsigned k = 0; k < ringSizes.size(); ++k)
+            {
+                unsigned n = ringSizes[k];
+                for (unsigned i = 0; i < n; ++i)
+                {
+                    const osg::Vec3d& a = ring[i];
+                    const osg::Vec3d& b = ring[(i + 1) % n];
+                    if ((a.y() > y) != (b.y() > y))
+                    {
+                        crossings.push_back(a.x() + (y - a.y()) * (b.x() - a.x()) / (b.y() - a.y()));
+                    }
+                }
+                ring += n;
+            }
+
+            std::sort(crossings.begin(), crossings.end());
+
+            for (unsigned i = 0; i + 1 < crossings.size(); i += 2)
+            {
+                int c0 = std::max(0, (int)ceil(crossings[i]));
+                int c1 = std::min((int)cols - 1, (int)floor(crossings[i + 1]));
+                int* row = &labels[r * cols];
+                for (int c = c0; c <= c1; ++c)
+                {
+                    if (row[c] < 0)
+                    {
+                        row[c] = label;
+                        ++claimed;
+                    }
+                }
+            }
+        }
+
+        return claimed;
+    }
+
     // Creates a heightfield that flattens an area intersecting the input polygon geometry.
     // The height of the area is found by sampling a point internal to the polygon.
     // bufferWidth = width of transition from flat area to natural terrain.
+    //
+    // Rather than testing every post against every polygon edge, we rasterize the
+    // polygons onto the tile grid and then run a distance transform outward from the
+    // rasterized posts to find each remaining post's distance to (and identity of)
+    // the nearest polygon for the buffer falloff. The work grid extends past the tile
+    // by the largest buffer width so that polygons just outside the tile still reach
+    // in, and neighboring tiles agree along their shared edges.
     bool integratePolygons(const TileKey& key, osg::HeightField* hf, const MultiGeometry* geom, const SpatialReference* geomSRS,
         WidthsList& widths, ElevationPool* pool, ElevationPool::WorkingSet* workingSet,
-        bool fillAllPixels, ProgressCallback* progress)
+        bool fillAllPixels, unsigned maxPad, unsigned& out_padNeeded, ProgressCallback* progress)
     {
-        bool wroteChanges = false;
-
         const GeoExtent& ex = key.getExtent();
+        const SpatialReference* gridSRS = ex.getSRS();
+
+        unsigned cols = hf->getNumColumns();
+        unsigned rows = hf->getNumRows();
+
+        double col_interval = ex.width() / (double)(cols - 1);
+        double row_interval = ex.height() / (double)(rows - 1);
+
+        bool needsTransform = !gridSRS->isHorizEquivalentTo(geomSRS);
+
+        // Size of a grid cell in the geometry SRS (for distance calculations), measured
+        // at the center of the tile.
+        std::vector<osg::Vec3d> cell(3);
+        cell[0].set(ex.xMin() + col_interval*(double)(cols/2), ex.yMin() + row_interval*(double)(rows/2), 0.0);
+        cell[1] = cell[0] + osg::Vec3d(col_interval, 0.0, 0.0);
+        cell[2] = cell[0] + osg::Vec3d(0.0, row_interval, 0.0);
+        if (needsTransform && !gridSRS->transform(cell, geomSRS))
+            return false;
+        double cellX = (cell[1] - cell[0]).length();
+        double cellY = (cell[2] - cell[0]).length();
+
+        // Find the polygons that can possibly affect this tile.
+        double maxBufferWidth = 0.0;
+        for (unsigned i = 0; i < widths.size(); ++i)
+            maxBufferWidth = std::max(maxBufferWidth, widths[i].bufferWidth);
+
+        // Number of posts by which to pad the work grid on every side. The pad
+        // covers the widest buffer, up to maxPad; past that, buffers from
+        // polygons outside the tile get cut off at the tile edge.
+        double minCell = std::min(cellX, cellY);
+        unsigned pad = 0u;
+        out_padNeeded = 0u;
+        if (maxBufferWidth > 0.0 && minCell > 0.0)
+        {
+            double padNeeded = ceil(maxBufferWidth / minCell);
+            out_padNeeded = (unsigned)std::min(padNeeded, (double)UINT_MAX);
+            pad = (unsigned)std::min((double)maxPad, padNeeded);
+        }
 
-        double col_interval = ex.width() / (double)(hf->getNumColumns() - 1);
-        double row_interval = ex.height() / (double)(hf->getNumRows() - 1);
+        // Dimensions of the padded work grid. Tile post (col,row) is at
+        // work post (col+pad,row+pad).
+        unsigned wcols = cols + 2u*pad;
+        unsigned wrows = rows + 2u*pad;
 
-        POINT Pex, P, internalP;
+        Bounds tileBounds;
+        GeoExtent geomExtent = needsTransform ? ex.transform(geomSRS) : ex;
+        if (geomExtent.isValid())
+        {
+            tileBounds = geomExtent.bounds();
+            tileBounds.expandBy(tileBounds.xMin() - maxBufferWidth, tileBounds.yMin() - maxBufferWidth);
+            tileBounds.expandBy(tileBounds.xMax() + maxBufferWidth, tileBounds.yMax() + maxBufferWidth);
+        }
+
+        std::vector<FlattenPolygon> polygons;
+        std::vector<osg::Vec3d> verts;
+
+        for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+        {
+            const Geometry* component = geom->getComponents()[geomIndex].get();
+            if (!intersects2D(tileBounds, component->getBounds()))
+                continue;
+
+            ConstGeometryIterator giter(component, false);
+            while (giter.hasMore())
+            {
+                const Polygon* polygon = dynamic_cast<const Polygon*>(giter.next());
+                if (!polygon || polygon->size() < 3)
+                    continue;
+
+                if (!intersects2D(tileBounds, polygon->getBounds()))
+                    continue;
+
+                FlattenPolygon fp;
+                fp.polygon = polygon;
+                fp.bufferWidth = widths[geomIndex].bufferWidth;
+                fp.elevation = NO_DATA_VALUE;
+                fp.firstVert = verts.size();
+
+                verts.insert(verts.end(), polygon->begin(), polygon->end());
+                fp.ringSizes.push_back(polygon->size());
+                for (RingCollection::const_iterator h = polygon->getHoles().begin(); h != polygon->getHoles().end(); ++h)
+                {
+                    verts.insert(verts.end(), (*h)->begin(), (*h)->end());
+                    fp.ringSizes.push_back((*h)->size());
+                }
+
+                polygons.push_back(fp);
+            }
+        }
+
+        if (polygons.empty())
+        {
+            if (fillAllPixels)
+            {
+                GeoPoint EP(gridSRS, 0, 0, 0);
+                for (unsigned row = 0; row < rows; ++row)
+                {
+                    EP.y() = ex.yMin() + (double)row * row_interval;
+                    for (unsigned col = 0; col < cols; ++col)
+                    {
+                        EP.x() = ex.xMin() + (double)col * col_interval;
+                        hf->setHeight(col, row, pool->getSample(EP, workingSet).elevation());
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Sample the flattening elevation of each polygon once, and tack its
+        // internal point on to the vertex list so we can locate it on the grid.
         GeoPoint EP(geomSRS, 0, 0, 0);
+        for (unsigned p = 0; p < polygons.size(); ++p)
+        {
+            osg::Vec3d internalP = getInternalPoint(polygons[p].polygon);
+            EP.x() = internalP.x(), EP.y() = internalP.y();
+            polygons[p].elevation = pool->getSample(EP, workingSet).elevation();
+            polygons[p].internalPoint = verts.size();
+            verts.push_back(internalP);
+        }
 
-        bool needsTransform = ex.getSRS() != geomSRS;
+        // Bring everything into grid coordinates in one batch.
+        if (needsTransform && !geomSRS->transform(verts, gridSRS))
+            return false;
 
-        for (unsigned col = 0; col < hf->getNumColumns(); ++col)
+        for (unsigned i = 0; i < verts.size(); ++i)
         {
-            Pex.x() = ex.xMin() + (double)col * col_interval;
+            verts[i].x() = (verts[i].x() - ex.xMin()) / col_interval + (double)pad;
+            verts[i].y() = (verts[i].y() - ex.yMin()) / row_interval + (double)pad;
+        }
+
+        // Rasterize. In overlapping areas the first polygon wins.
+        std::vector<int> labels(wcols*wrows, -1);
+        std::vector<double> crossings;
+        bool anyLabels = false;
 
-            for (unsigned row = 0; row < hf->getNumRows(); ++row)
+        for (unsigned p = 0; p < polygons.size(); ++p)
+        {
+            unsigned claimed = rasterizePolygon(
+                &verts[polygons[p].firstVert], polygons[p].ringSizes,
+                (int)p, labels, wcols, wrows, crossings);
+
+            // A polygon smaller than a grid cell may miss every post; seed the
+            // post nearest to its internal point so it still gets a buffer.
+            if (claimed == 0)
             {
-                // check for cancelation periodically
-                //if (progress && progress->isCanceled())
-                //    return false;
+                const osg::Vec3d& ip = verts[polygons[p].internalPoint];
+                int c = (int)floor(ip.x() + 0.5), r = (int)floor(ip.y() + 0.5);
+                if (c >= 0 && c < (int)wcols && r >= 0 && r < (int)wrows && labels[r*wcols + c] < 0)
+                {
+                    labels[r*wcols + c] = (int)p;
+                    ++claimed;
+                }
+            }
 
-                Pex.y() = ex.yMin() + (double)row * row_interval;
+            anyLabels = anyLabels || claimed > 0;
+        }
 
-                if (needsTransform)
-                    ex.getSRS()->transform(Pex, geomSRS, P);
-                else
-                    P = Pex;
+        // Distance from every post to the nearest rasterized post, and which one it is,
+        // via a separable two-pass transform (columns, then rows).
+        std::vector<double> dist2;
+        std::vector<int> nearest;
 
-                bool done = false;
-                double minD2 = DBL_MAX;//bufferWidth * bufferWidth; // minimum distance(squared) to closest polygon edge
-                double bufferWidth = 0.0;
+        if (anyLabels && maxBufferWidth > 0.0)
+        {
+            std::vector<double> colD2(wcols*wrows);
+            std::vector<int> colSite(wcols*wrows);
+            std::vector<double> f(std::max(wcols, wrows)), d2(std::max(wcols, wrows));
+            std::vector<int> site(std::max(wcols, wrows)), v;
+            std::vector<double> z;
+
+            for (unsigned col = 0; col < wcols; ++col)
+            {
+                for (unsigned row = 0; row < wrows; ++row)
+                    f[row] = labels[row*wcols + col] >= 0 ? 0.0 : DBL_MAX;
 
-                const Polygon* bestPoly = 0L;
+                distanceTransform1D(&f[0], wrows, cellY, &d2[0], &site[0], v, z);
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                for (unsigned row = 0; row < wrows; ++row)
                 {
-                    Geometry* component = geom->getComponents()[geomIndex].get();
-                    Widths width = widths[geomIndex];
-                    ConstGeometryIterator giter(component, false);
-                    while (giter.hasMore() && !done)
-                    {
-                        const Polygon* polygon = dynamic_cast<const Polygon*>(giter.next());
-                        if (polygon)
-                        {
-                            // Does the point P fall within the polygon?
-                            if (polygon->contains2D(P.x(), P.y()))
-                            {
-                                // yes, flatten it to the polygon's centroid elevation;
-                                // and we're dont with this point.
-                                done = true;
-                                bestPoly = polygon;
-                                minD2 = -1.0;
-                                bufferWidth = width.bufferWidth;
-                            }
+                    colD2[row*wcols + col] = d2[row];
+                    colSite[row*wcols + col] = site[row];
+                }
+            }
 
-                            // If not in the polygon, how far to the closest edge?
-                            else
-                            {
-                                double D2 = getDistanceSquaredToClosestEdge(P, polygon);
-                                if (D2 < minD2)
-                                {
-                                    minD2 = D2;
-                                    bestPoly = polygon;
-                                    bufferWidth = width.bufferWidth;
-                                }
-                            }
-                        }
-                    }
+            // Only the tile's own rows are needed from the second pass.
+            dist2.resize(wcols*wrows);
+            nearest.resize(wcols*wrows, -1);
+
+            for (unsigned row = pad; row < pad + rows; ++row)
+            {
+                distanceTransform1D(&colD2[row*wcols], wcols, cellX, &dist2[row*wcols], &site[0], v, z);
+
+                for (unsigned col = 0; col < wcols; ++col)
+                {
+                    int c = site[col];
+                    int r = c >= 0 ? colSite[row*wcols + c] : -1;
+                    nearest[row*wcols + col] = r >= 0 ? r*wcols + c : -1;
                 }
+            }
+        }
+
+        // Write the heights.
+        bool wroteChanges = false;
+        GeoPoint NP(gridSRS, 0, 0, 0);
+
+        for (unsigned row = 0; row < rows; ++row)
+        {
+            NP.y() = ex.yMin() + (double)row * row_interval;
+
+            for (unsigned col = 0; col < cols; ++col)
+            {
+                unsigned i = (row + pad)*wcols + (col + pad);
+                NP.x() = ex.xMin() + (double)col * col_interval;
 
-                if (bestPoly && minD2 != 0.0)
+                if (labels[i] >= 0)
                 {
-                    float h;
-                    POINT internalP = getInternalPoint(bestPoly);
-                    EP.x() = internalP.x(), EP.y() = internalP.y();
-                    float elevInternal = pool->getSample(EP, workingSet).elevation();
+                    hf->setHeight(col, row, polygons[labels[i]].elevation);
+                    wroteChanges = true;
+                    continue;
+                }
 
-                    if (minD2 < 0.0)
-                    {
-                        h = elevInternal;
-                    }
-                    else
+                if (!nearest.empty() && nearest[i] >= 0)
+                {
+                    const FlattenPolygon& fp = polygons[labels[nearest[i]]];
+                    double D = sqrt(dist2[i]);
+                    if (D < fp.bufferWidth)
                     {
-                        EP.x() = P.x(), EP.y() = P.y();
-                        float elevNatural = pool->getSample(EP, workingSet).elevation();
-                        double blend = clamp(sqrt(minD2) / bufferWidth, 0.0, 1.0); // [0..1] 0=internal, 1=natural
-                        h = smootherstep(elevInternal, elevNatural, blend);
+                        float elevNatural = pool->getSample(NP, workingSet).elevation();
+                        double blend = clamp(D / fp.bufferWidth, 0.0, 1.0); // [0..1] 0=internal, 1=natural
+                        hf->setHeight(col, row, smootherstep(fp.elevation, elevNatural, blend));
+                        wroteChanges = true;
+                        continue;
                     }
-
-                    hf->setHeight(col, row, h);
-                    wroteChanges = true;
                 }
 
-                else if (fillAllPixels)
+                if (fillAllPixels)
                 {
-                    EP.x() = P.x(), EP.y() = P.y();
-                    float h = pool->getSample(EP, workingSet).elevation();
-                    hf->setHeight(col, row, h);
+                    hf->setHeight(col, row, pool->getSample(NP, workingSet).elevation());
                     // do not set wroteChanges
                 }
             }
@@ -702,8 +972,9 @@ namespace
 
     bool integrate(const TileKey& key, osg::HeightField* hf, const MultiGeometry* geom, const SpatialReference* geomSRS,
         WidthsList& widths, ElevationPool* pool, ElevationPool::WorkingSet* workingSet,
-        bool fillAllPixels, ProgressCallback* progress)
+        bool fillAllPixels, unsigned maxPad, unsigned& out_padNeeded, ProgressCallback* progress)
     {
+        out_padNeeded = 0u;
         if (geom->isLinear())
         {
             LineSegmentList segments;
@@ -712,7 +983,7 @@ namespace
             return integrateLines(key, hf, segments, index, geomSRS, widths, pool, workingSet, fillAllPixels, progress);
         }
         else
-            return integratePolygons(key, hf, geom, geomSRS, widths, pool, workingSet, fillAllPixels, progress);
+            return integratePolygons(key, hf, geom, geomSRS, widths, pool, workingSet, fillAllPixels, maxPad, out_padNeeded, progress);
     }
 }
 
@@ -728,6 +999,7 @@ FlatteningLayer::Options::getConfig() const
     conf.set("line_width", _lineWidth);
     conf.set("buffer_width", _bufferWidth);
     conf.set("fill", _fill);
+    conf.set("max_buffer_posts", _maxBufferPosts);
 
     if (_script.valid())
     {
@@ -756,6 +1028,7 @@ FlatteningLayer::Options::fromConfig(const Config& conf)
     fill().init(false);
     lineWidth().init(40);
     bufferWidth().init(40);
+    maxBufferPosts().init(512u);
     URIContext uriContext = URIContext(conf.referrer());
 
     featureSource().get(conf, "features");
@@ -763,6 +1036,7 @@ FlatteningLayer::Options::fromConfig(const Config& conf)
     conf.get("line_width", _lineWidth);
     conf.get("buffer_width", _bufferWidth);
     conf.get("fill", _fill);
+    conf.get("max_buffer_posts", _maxBufferPosts);
 
     // TODO:  Separate out ScriptDef from Stylesheet and include it as a standalone class, along with this loading code.
     ConfigSet scripts = conf.children("script");
@@ -798,12 +1072,15 @@ FlatteningLayer::Options::fromConfig(const Config& conf)
 OE_LAYER_PROPERTY_IMPL(FlatteningLayer, NumericExpression, LineWidth, lineWidth);
 OE_LAYER_PROPERTY_IMPL(FlatteningLayer, NumericExpression, BufferWidth, bufferWidth);
 OE_LAYER_PROPERTY_IMPL(FlatteningLayer, bool, Fill, fill);
+OE_LAYER_PROPERTY_IMPL(FlatteningLayer, unsigned, MaxBufferPosts, maxBufferPosts);
 
 void
 FlatteningLayer::init()
 {
     ElevationLayer::init();
 
+    _warnedBufferPosts = false;
+
     // Experiment with this and see what will work.
     _pool = new ElevationPool();
 }
@@ -1137,6 +1414,8 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
         hf->getFloatArray()->assign(hf->getNumColumns()*hf->getNumRows(), NO_DATA_VALUE);
 
         bool fill = (options().fill() == true);
+        unsigned maxPad = options().maxBufferPosts().get();
+        unsigned padNeeded = 0u;
 
         bool wrote_to_hf = integrate(
             key,
@@ -1147,8 +1426,17 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
             _pool.get(),
             &_elevWorkingSet,
             fill,
+            maxPad,
+            padNeeded,
             progress);
 
+        if (padNeeded > maxPad && !_warnedBufferPosts.exchange(true))
+        {
+            OE_WARN << LC << getName() << ": buffer width needs " << padNeeded
+                << " posts of padding at " << key.str() << " but max_buffer_posts is " << maxPad
+                << "; buffers from features outside a tile will be cut off at the tile edge" << std::endl;
+        }
+
         if (wrote_to_hf)
         {
             return GeoHeightField(hf.get(), key.getExtent());
@@ -48,8 +48,13 @@ osg::MatrixTransform(rhs, op)
 
 GeoTransform::~GeoTransform()
 {
-    if (_terrain.valid())
-        _terrain->removeObserver(this);
+    osg::ref_ptr<Terrain> terrain;
+    if (_terrain.lock(terrain))
+    {
+        if (_terrainCallback.valid())
+            terrain->removeTerrainCallback(_terrainCallback.get());
+        terrain->removeObserver(this);
+    }
 }
 
 void
@@ -57,8 +62,17 @@ GeoTransform::setTerrain(Terrain* terrain)
 {
     if (terrain)
     {
-        if (_terrain.valid())
-            _terrain->removeObserver(this);
+        osg::ref_ptr<Terrain> oldTerrain;
+        if (_terrain.lock(oldTerrain))
+        {
+            if (_terrainCallback.valid() && oldTerrain.get() != terrain)
+            {
+                oldTerrain->removeTerrainCallback(_terrainCallback.get());
+                _terrainCallback = 0L;
+                _terrainCallbackInstalled = false;
+            }
+            oldTerrain->removeObserver(this);
+        }
         _terrain = terrain;
         _terrain->addObserver(this);
         setPosition(_position);
@@ -147,14 +161,40 @@ GeoTransform::setPosition(const GeoPoint& position)
 
     // Is this is a relative-Z position, we need to install a terrain callback
     // so we can recompute the altitude when new terrain tiles become available.
+    // The callback only cares about tiles under our position, so register
+    // it with the terrain's spatial index for the index cell containing us,
+    // and only move it (which takes the terrain's callback lock) when we
+    // leave that cell. onTileUpdate filters out tiles that miss the point.
     if (_position.altitudeMode() == ALTMODE_RELATIVE &&
         _autoRecomputeHeights &&
-        !_terrainCallbackInstalled &&
         terrain.valid())
     {
-        // The Adapter template auto-destructs, so we never need to remote it manually.
-        terrain->addTerrainCallback( new TerrainCallbackAdapter<GeoTransform>(this) );
-        _terrainCallbackInstalled = true;
+        bool moved =
+            !_terrainCallbackExtent.isValid() ||
+            !_terrainCallbackExtent.contains(p.x(), p.y(), p.getSRS());
+
+        if (!_terrainCallbackInstalled || moved)
+        {
+            GeoExtent extent = terrain->getTerrainCallbackCell(p);
+            if (!extent.isValid())
+                extent = GeoExtent(p.getSRS(), p.x(), p.y(), p.x(), p.y());
+
+            if (!_terrainCallbackInstalled)
+            {
+                // The destructor removes the callback; the Adapter also
+                // stops forwarding once we are gone.
+                osg::ref_ptr<TerrainCallback> callback = new TerrainCallbackAdapter<GeoTransform>(this);
+                terrain->addTerrainCallback( callback.get(), extent );
+                _terrainCallback = callback.get();
+                _terrainCallbackInstalled = true;
+            }
+            else if (_terrainCallback.valid())
+            {
+                terrain->setTerrainCallbackExtent( _terrainCallback.get(), extent );
+            }
+
+            _terrainCallbackExtent = extent;
+        }
     }
 
     // Finally, assemble the matrix from our position point.
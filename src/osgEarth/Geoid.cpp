@@ -19,6 +19,7 @@
 
 #include <osgEarth/Geoid>
 #include <osgEarth/HeightFieldUtils>
+#include <algorithm>
 
 #define LC "[Geoid] "
 
@@ -27,7 +28,8 @@ using namespace osgEarth;
 
 Geoid::Geoid() :
 _units( Units::METERS ),
-_valid( false )
+_valid( false ),
+_hasNoData( false )
 {
     //nop
 }
@@ -48,6 +50,11 @@ Geoid::setHeightField( osg::HeightField* hf )
         _hf->getOrigin().y(),
         _hf->getOrigin().x() + _hf->getXInterval() * double(_hf->getNumColumns()-1),
         _hf->getOrigin().y() + _hf->getYInterval() * double(_hf->getNumRows()-1) );
+
+    // the bulk queries skip NO_DATA handling, so note whether we need it
+    const osg::FloatArray* heights = _hf->getFloatArray();
+    _hasNoData = std::find(heights->begin(), heights->end(), NO_DATA_VALUE) != heights->end();
+
     validate();
 }
 
@@ -91,6 +98,143 @@ Geoid::getHeight(double lat_deg, double lon_deg, const RasterInterpolation& inte
     return result;
 }
 
+namespace
+{
+    // Resolves one coordinate into the pair of grid samples that bracket it
+    // and the interpolation weight of the second. Mirrors the bilinear math
+    // in HeightFieldUtils::getHeightAtPixel (without the NO_DATA handling).
+    // Returns false if the coordinate falls outside the grid.
+    inline bool getTap(double value, double minValue, double span, unsigned num,
+                       unsigned& i0, unsigned& i1, double& w)
+    {
+        double n = (value - minValue) / span;
+        if (!(n >= 0.0 && n <= 1.0))
+            return false;
+
+        double p = n * (double)(num - 1);
+        i0 = std::min((unsigned)p, num - 1);
+        i1 = std::min(i0 + 1, num - 1);
+        w = p - (double)i0;
+        return true;
+    }
+}
+
+void
+Geoid::getHeights(const osg::Vec3d* points, unsigned count, float* out_heights) const
+{
+    if (!_valid)
+    {
+        std::fill(out_heights, out_heights + count, 0.0f);
+        return;
+    }
+
+    if (_hasNoData)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            out_heights[i] = getHeight(points[i].y(), points[i].x(), INTERP_BILINEAR);
+        return;
+    }
+
+    const float* grid = static_cast<const float*>(_hf->getFloatArray()->getDataPointer());
+    unsigned numCols = _hf->getNumColumns();
+    unsigned numRows = _hf->getNumRows();
+
+    unsigned c0, c1, r0, r1;
+    double cw, rw;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (getTap(points[i].x(), _bounds.xMin(), _bounds.width(), numCols, c0, c1, cw) &&
+            getTap(points[i].y(), _bounds.yMin(), _bounds.height(), numRows, r0, r1, rw))
+        {
+            const float* row0 = grid + r0 * numCols;
+            const float* row1 = grid + r1 * numCols;
+            double h0 = (double)row0[c0] + ((double)row0[c1] - (double)row0[c0]) * cw;
+            double h1 = (double)row1[c0] + ((double)row1[c1] - (double)row1[c0]) * cw;
+            out_heights[i] = (float)(h0 + (h1 - h0) * rw);
+        }
+        else
+        {
+            out_heights[i] = 0.0f;
+        }
+    }
+}
+
+void
+Geoid::getHeights(double west, double south,
+                  double xInterval, double yInterval,
+                  unsigned cols, unsigned rows,
+                  float* out_heights) const
+{
+    if (!_valid)
+    {
+        std::fill(out_heights, out_heights + cols*rows, 0.0f);
+        return;
+    }
+
+    if (_hasNoData)
+    {
+        for (unsigned r = 0; r < rows; ++r)
+        {
+            double lat = south + yInterval * (double)r;
+            for (unsigned c = 0; c < cols; ++c)
+            {
+                double lon = west + xInterval * (double)c;
+                out_heights[r*cols + c] = getHeight(lat, lon, INTERP_BILINEAR);
+            }
+        }
+        return;
+    }
+
+    const float* grid = static_cast<const float*>(_hf->getFloatArray()->getDataPointer());
+    unsigned numCols = _hf->getNumColumns();
+    unsigned numRows = _hf->getNumRows();
+
+    // Every row of the output grid samples the same geoid columns, so resolve
+    // the column indices and weights once up front. Out-of-bounds columns get
+    // a zero mask so the inner loop stays branch-free.
+    std::vector<unsigned> c0(cols), c1(cols);
+    std::vector<double> cw(cols), cmask(cols);
+    for (unsigned c = 0; c < cols; ++c)
+    {
+        bool ok = getTap(west + xInterval * (double)c, _bounds.xMin(), _bounds.width(), numCols, c0[c], c1[c], cw[c]);
+        if (!ok)
+            c0[c] = c1[c] = 0, cw[c] = 0.0;
+        cmask[c] = ok ? 1.0 : 0.0;
+    }
+
+    std::vector<double> h0(cols), h1(cols);
+
+    for (unsigned r = 0; r < rows; ++r)
+    {
+        float* out = out_heights + r * cols;
+
+        unsigned r0, r1;
+        double rw;
+        if (!getTap(south + yInterval * (double)r, _bounds.yMin(), _bounds.height(), numRows, r0, r1, rw))
+        {
+            std::fill(out, out + cols, 0.0f);
+            continue;
+        }
+
+        const float* row0 = grid + r0 * numCols;
+        const float* row1 = grid + r1 * numCols;
+
+        // gather, then blend; the blend loop is a straight line of arithmetic
+        // that the compiler can vectorize.
+        for (unsigned c = 0; c < cols; ++c)
+        {
+            h0[c] = (double)row0[c0[c]] + ((double)row0[c1[c]] - (double)row0[c0[c]]) * cw[c];
+            h1[c] = (double)row1[c0[c]] + ((double)row1[c1[c]] - (double)row1[c0[c]]) * cw[c];
+        }
+
+        for (unsigned c = 0; c < cols; ++c)
+        {
+            out[c] = (float)((h0[c] + (h1[c] - h0[c]) * rw) * cmask[c]);
+        }
+    }
+}
+
 bool
 Geoid::isEquivalentTo( const Geoid& rhs ) const
 {
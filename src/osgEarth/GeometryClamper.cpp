@@ -132,10 +132,37 @@ GeometryClamper::apply(osg::Drawable& drawable)
         storeAltitudes = true;
     }
 
-    for( unsigned k=0; k<verts->size(); ++k )
+    const unsigned numVerts = verts->size();
+
+    _world.resize(numVerts);
+    for (unsigned k = 0; k < numVerts; ++k)
+    {
+        _world[k] = osg::Vec3d((*verts)[k]) * local2world;
+    }
+
+    bool useTerrain = _terrain.valid() && _terrain->hasElevationData();
+    bool useExtent = _extent.isValid();
+
+    // Clamping moves each vert along its up vector, so its map coordinates
+    // are those of the original (unclamped) position.
+    if (useTerrain || useExtent)
+    {
+        _map.resize(numVerts);
+        for (unsigned k = 0; k < numVerts; ++k)
+        {
+            _terrainSRS->transformFromWorld(_world[k], _map[k]);
+        }
+    }
+
+    // Sample the loaded elevation data for the whole batch at once.
+    if (useTerrain)
+    {
+        _terrain->getHeights(_map, _heights);
+    }
+
+    for( unsigned k=0; k<numVerts; ++k )
     {
-        osg::Vec3d vw = (*verts)[k];
-        vw = vw * local2world;
+        const osg::Vec3d& vw = _world[k];
 
         if ( isGeocentric )
         {
@@ -160,16 +187,40 @@ GeometryClamper::apply(osg::Drawable& drawable)
             }
         }
 
-        _lsi->reset();
-        _lsi->setStart( vw + n_vector*r*_scale );
-        _lsi->setEnd( vw - n_vector*r );
-        _lsi->setIntersectionLimit( _lsi->LIMIT_NEAREST );
+        // skip verts where the terrain did not change:
+        if (useExtent && !_extent.contains(_map[k].x(), _map[k].y()))
+        {
+            continue;
+        }
+
+        osg::Vec3d fw;
+        bool clamped = false;
+
+        if (useTerrain && _heights[k] != NO_DATA_VALUE)
+        {
+            clamped = _terrainSRS->transformToWorld(
+                osg::Vec3d(_map[k].x(), _map[k].y(), _heights[k]),
+                fw);
+        }
 
-        _terrainPatch->accept( iv );
+        if (!clamped && _terrainPatch.valid())
+        {
+            _lsi->reset();
+            _lsi->setStart( vw + n_vector*r*_scale );
+            _lsi->setEnd( vw - n_vector*r );
+            _lsi->setIntersectionLimit( _lsi->LIMIT_NEAREST );
+
+            _terrainPatch->accept( iv );
+
+            if ( _lsi->containsIntersections() )
+            {
+                fw = _lsi->getFirstIntersection().getWorldIntersectPoint();
+                clamped = true;
+            }
+        }
 
-        if ( _lsi->containsIntersections() )
+        if ( clamped )
         {
-            osg::Vec3d fw = _lsi->getFirstIntersection().getWorldIntersectPoint();
             //if ( _scale != 1.0 )
             //{
             //    osg::Vec3d delta = fw - msl;
@@ -229,5 +280,6 @@ GeometryClamperCallback::onTileUpdate(const TileKey&          key,
                                      osg::Node*              tile,
                                      TerrainCallbackContext& context)
 {
+    _clamper.setExtent(key.valid() ? key.getExtent() : GeoExtent::INVALID);
     tile->accept( _clamper );
 }
@@ -66,6 +66,7 @@ GeometryCompilerOptions::setDefaults(const GeometryCompilerOptions& defaults)
 GeometryCompilerOptions::GeometryCompilerOptions(bool stockDefaults) :
 _maxGranularity_deg    ( 10.0 ),
 _mergeGeometry         ( true ),
+_batchExtrusions       ( false ),
 _clustering            ( false ),
 _instancing            ( true ),
 _ignoreAlt             ( false ),
@@ -86,6 +87,7 @@ _useOSGTessellator     ( false )
 GeometryCompilerOptions::GeometryCompilerOptions(const ConfigOptions& conf) :
 _maxGranularity_deg    ( s_defaults.maxGranularity().value() ),
 _mergeGeometry         ( s_defaults.mergeGeometry().value() ),
+_batchExtrusions       ( s_defaults.batchExtrusions().value() ),
 _clustering            ( s_defaults.clustering().value() ),
 _instancing            ( s_defaults.instancing().value() ),
 _ignoreAlt             ( s_defaults.ignoreAltitudeSymbol().value() ),
@@ -106,6 +108,7 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
 {
     conf.get( "max_granularity",  _maxGranularity_deg );
     conf.get( "merge_geometry",   _mergeGeometry );
+    conf.get( "batch_extrusions", _batchExtrusions );
     conf.get( "clustering",       _clustering );
     conf.get( "instancing",       _instancing );
     conf.get( "feature_name",     _featureNameExpr );
@@ -130,6 +133,7 @@ GeometryCompilerOptions::getConfig() const
     Config conf;
     conf.set( "max_granularity",  _maxGranularity_deg );
     conf.set( "merge_geometry",   _mergeGeometry );
+    conf.set( "batch_extrusions", _batchExtrusions );
     conf.set( "clustering",       _clustering );
     conf.set( "instancing",       _instancing );
     conf.set( "feature_name",     _featureNameExpr );
@@ -412,6 +416,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.mergeGeometry().isSet() )
             extrude.setMergeGeometry( *_options.mergeGeometry() );
 
+        if ( _options.batchExtrusions().isSet() )
+            extrude.setBatchGeometry( *_options.batchExtrusions() );
+
         osg::Node* node = extrude.push( workingSet, sharedCX );
         if ( node )
         {
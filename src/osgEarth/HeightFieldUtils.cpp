@@ -528,15 +528,17 @@ HeightFieldUtils::createReferenceHeightField(const GeoExtent& ex,
         double latStart = latMin - latInterval*(double)border;
         double lonStart = lonMin - lonInterval*(double)border;
 
-        for( unsigned r=0; r<hf->getNumRows(); ++r )
-        {            
-            double lat = latStart + latInterval*(double)r;
-            for( unsigned c=0; c<hf->getNumColumns(); ++c )
-            {
-                double lon = lonStart + lonInterval*(double)c;
-                double offset = vdatum->msl2hae(lat, lon, 0.0);
-                hf->setHeight( c, r, offset );
-            }
+        if ( vdatum->getGeoid() )
+        {
+            // sample the geoid offsets for the whole grid in one pass:
+            vdatum->getGeoid()->getHeights(
+                lonStart, latStart, lonInterval, latInterval,
+                hf->getNumColumns(), hf->getNumRows(),
+                &(*hf->getFloatArray())[0]);
+        }
+        else
+        {
+            hf->getFloatArray()->assign(hf->getNumColumns()*hf->getNumRows(), 0.0f);
         }
     }
     else
@@ -27,6 +27,8 @@
 
 #include <osg/ValueObject>
 
+#include <algorithm>
+
 #define LC "[ImageUtils] "
 
 
@@ -448,6 +450,225 @@ ImageUtils::bicubicUpsample(const osg::Image* source,
     return true;
 }
 
+namespace
+{
+    inline unsigned char average4(unsigned char a, unsigned char b, unsigned char c, unsigned char d)
+    {
+        return (unsigned char)(((unsigned)a + (unsigned)b + (unsigned)c + (unsigned)d + 2u) >> 2);
+    }
+
+    inline float average4(float a, float b, float c, float d)
+    {
+        return (a + b + c + d) * 0.25f;
+    }
+
+    inline void setAverage(unsigned char& out, double sum, int count)
+    {
+        out = (unsigned char)(sum / (double)count + 0.5);
+    }
+
+    inline void setAverage(float& out, double sum, int count)
+    {
+        out = (float)(sum / (double)count);
+    }
+
+    // Averages numCols texels starting at column x across the given rows.
+    template<typename T, int N>
+    void averageBlock(const T* const* rows, int numRows, int x, int numCols, T* out)
+    {
+        for (int c = 0; c < N; ++c)
+        {
+            double sum = 0.0;
+            for (int r = 0; r < numRows; ++r)
+                for (int k = 0; k < numCols; ++k)
+                    sum += rows[r][(x + k) * N + c];
+            setAverage(out[c], sum, numRows * numCols);
+        }
+    }
+
+    // 2x2 box filter over N interleaved components of type T. The main loop has
+    // no clamping so the compiler can vectorize it. An odd last column or row
+    // folds into the last output texel (a 3-texel box on that axis), and a
+    // 1-pixel dimension reuses its only texel.
+    template<typename T, int N>
+    void boxFilter2x2(
+        const unsigned char* src, int s, int t, unsigned srcRowBytes,
+        unsigned char* dst, int ds, int dt, unsigned dstRowBytes)
+    {
+        int pairs = s / 2;
+        bool foldColumn = (s & 1) != 0 && s > 1;
+        bool foldRow = (t & 1) != 0 && t > 1;
+
+        for (int y = 0; y < dt; ++y)
+        {
+            const T* rows[3];
+            rows[0] = reinterpret_cast<const T*>(src + (2 * y) * srcRowBytes);
+            rows[1] = reinterpret_cast<const T*>(src + std::min(2 * y + 1, t - 1) * srcRowBytes);
+            int numRows = 2;
+            if (foldRow && y == dt - 1)
+            {
+                rows[2] = reinterpret_cast<const T*>(src + (2 * y + 2) * srcRowBytes);
+                numRows = 3;
+            }
+
+            T* out = reinterpret_cast<T*>(dst + y * dstRowBytes);
+
+            if (numRows == 2)
+            {
+                const T* r0 = rows[0];
+                const T* r1 = rows[1];
+                for (int x = 0; x < pairs; ++x)
+                {
+                    const T* a = r0 + 2 * x * N;
+                    const T* b = r1 + 2 * x * N;
+                    T* o = out + x * N;
+                    for (int c = 0; c < N; ++c)
+                        o[c] = average4(a[c], a[c + N], b[c], b[c + N]);
+                }
+            }
+            else
+            {
+                for (int x = 0; x < pairs; ++x)
+                    averageBlock<T, N>(rows, numRows, 2 * x, 2, out + x * N);
+            }
+
+            if (foldColumn)
+            {
+                averageBlock<T, N>(rows, numRows, 2 * (pairs - 1), 3, out + (pairs - 1) * N);
+            }
+            else if (pairs < ds)
+            {
+                // s == 1
+                averageBlock<T, N>(rows, numRows, 0, 1, out);
+            }
+        }
+    }
+
+    template<typename T>
+    bool boxFilter2x2(
+        int numComponents,
+        const unsigned char* src, int s, int t, unsigned srcRowBytes,
+        unsigned char* dst, int ds, int dt, unsigned dstRowBytes)
+    {
+        switch (numComponents)
+        {
+        case 1: boxFilter2x2<T, 1>(src, s, t, srcRowBytes, dst, ds, dt, dstRowBytes); return true;
+        case 2: boxFilter2x2<T, 2>(src, s, t, srcRowBytes, dst, ds, dt, dstRowBytes); return true;
+        case 3: boxFilter2x2<T, 3>(src, s, t, srcRowBytes, dst, ds, dt, dstRowBytes); return true;
+        case 4: boxFilter2x2<T, 4>(src, s, t, srcRowBytes, dst, ds, dt, dstRowBytes); return true;
+        default: return false;
+        }
+    }
+
+    // Assigns to "output" a copy of level 0 of "input" followed by a full
+    // mipmap chain, building each level from the one before it. "output"
+    // may be the input itself.
+    void createMipmaps(const osg::Image* input, osg::Image* output)
+    {
+        int s = input->s(), t = input->t(), r = input->r();
+        GLint internalFormat = input->getInternalTextureFormat();
+        GLenum pixelFormat = input->getPixelFormat();
+        GLenum dataType = input->getDataType();
+        int packing = input->getPacking();
+        int rowLength = input->getRowLength();
+
+        int numLevels = osg::Image::computeNumberOfMipmapLevels(s, t, r);
+        int imageSizeBytes = input->getTotalSizeInBytes();
+
+        // offset vector does not include level 0 (the full-resolution level)
+        osg::Image::MipmapDataType mipOffsets;
+        mipOffsets.reserve(numLevels-1);
+
+        // calculate memory requirements:
+        int totalSizeBytes = imageSizeBytes;
+        for( int i=1; i<numLevels; ++i )
+        {
+            mipOffsets.push_back(totalSizeBytes);
+            int level_s = std::max(1, s >> i), level_t = std::max(1, t >> i);
+            totalSizeBytes += osg::Image::computeRowWidthInBytes(level_s, pixelFormat, dataType, packing) * level_t;
+        }
+
+        // allocate space for the new data and copy over level 0 of the old data
+        unsigned char* newData = new unsigned char[totalSizeBytes];
+        ::memcpy(newData, input->data(), imageSizeBytes);
+
+        output->setImage(
+            s, t, r,
+            internalFormat,
+            pixelFormat,
+            dataType,
+            newData,
+            osg::Image::USE_NEW_DELETE,
+            packing,
+            rowLength);
+
+        output->setMipmapLevels(mipOffsets);
+
+        // now, populate the image levels.
+        osg::PixelStorageModes psm;
+        psm.pack_alignment = packing;
+        psm.pack_row_length = rowLength;
+        psm.unpack_alignment = packing;
+
+        int numComponents = osg::Image::computeNumComponents(pixelFormat);
+
+        for(int level=1; level<numLevels; ++level)
+        {
+            int prev_s = std::max(1, s >> (level-1)), prev_t = std::max(1, t >> (level-1));
+            int level_s = std::max(1, s >> level), level_t = std::max(1, t >> level);
+
+            const unsigned char* prev = output->getMipmapData(level-1);
+            unsigned prevRowBytes = level == 1 ?
+                output->getRowStepInBytes() :
+                osg::Image::computeRowWidthInBytes(prev_s, pixelFormat, dataType, packing);
+            unsigned levelRowBytes = osg::Image::computeRowWidthInBytes(level_s, pixelFormat, dataType, packing);
+
+            bool ok =
+                dataType == GL_UNSIGNED_BYTE ? boxFilter2x2<unsigned char>(numComponents, prev, prev_s, prev_t, prevRowBytes, output->getMipmapData(level), level_s, level_t, levelRowBytes) :
+                dataType == GL_FLOAT ? boxFilter2x2<float>(numComponents, prev, prev_s, prev_t, prevRowBytes, output->getMipmapData(level), level_s, level_t, levelRowBytes) :
+                false;
+
+            if (!ok)
+            {
+                // OSG-custom gluScaleImage that does not require a graphics context
+                gluScaleImage(
+                    &psm,
+                    pixelFormat,
+                    prev_s,
+                    prev_t,
+                    dataType,
+                    prev,
+                    level_s,
+                    level_t,
+                    dataType,
+                    output->getMipmapData(level));
+            }
+        }
+    }
+}
+
+bool
+ImageUtils::downsample2x2(
+    const unsigned char* src, int s, int t,
+    GLenum pixelFormat, GLenum dataType, int packing,
+    unsigned char* dst)
+{
+    if (!src || !dst || s < 1 || t < 1)
+        return false;
+
+    int ds = std::max(1, s / 2), dt = std::max(1, t / 2);
+    unsigned srcRowBytes = osg::Image::computeRowWidthInBytes(s, pixelFormat, dataType, packing);
+    unsigned dstRowBytes = osg::Image::computeRowWidthInBytes(ds, pixelFormat, dataType, packing);
+    int numComponents = osg::Image::computeNumComponents(pixelFormat);
+
+    if (dataType == GL_UNSIGNED_BYTE)
+        return boxFilter2x2<unsigned char>(numComponents, src, s, t, srcRowBytes, dst, ds, dt, dstRowBytes);
+    else if (dataType == GL_FLOAT)
+        return boxFilter2x2<float>(numComponents, src, s, t, srcRowBytes, dst, ds, dt, dstRowBytes);
+    else
+        return false;
+}
+
 const osg::Image*
 ImageUtils::mipmapImage(const osg::Image* input)
 {
@@ -477,62 +698,10 @@ ImageUtils::mipmapImage(const osg::Image* input)
         return input;
     }
 
-    // first, build the image that will hold all the mipmap levels.
-    int numLevels = osg::Image::computeNumberOfMipmapLevels(input->s(), input->t(), input->r());
-    int imageSizeBytes = input->getTotalSizeInBytes();
-
-    // offset vector does not include level 0 (the full-resolution level)
-    osg::Image::MipmapDataType mipOffsets;
-    mipOffsets.reserve(numLevels-1);
-
-    // calculate memory requirements:
-    int totalSizeBytes = imageSizeBytes;
-    for( int i=1; i<numLevels; ++i )
-    {
-        mipOffsets.push_back(totalSizeBytes);
-        totalSizeBytes += (imageSizeBytes >> i);
-    }
-
     osg::Image* output = new osg::Image();
     output->setName(input->getName());
 
-    // allocate space for the new data and copy over level 0 of the old data
-    unsigned char* newData = new unsigned char[totalSizeBytes];
-    ::memcpy(newData, input->data(), imageSizeBytes);
-
-    output->setImage(
-        input->s(), input->t(), input->r(),
-        input->getInternalTextureFormat(),
-        input->getPixelFormat(),
-        input->getDataType(),
-        newData,
-        osg::Image::USE_NEW_DELETE,
-        input->getPacking(),
-        input->getRowLength());
-
-    output->setMipmapLevels(mipOffsets);
-
-    // now, populate the image levels.
-    osg::PixelStorageModes psm;
-    psm.pack_alignment = input->getPacking();
-    psm.pack_row_length = input->getRowLength();
-    psm.unpack_alignment = input->getPacking();
-
-    for(int level=1; level<numLevels; ++level)
-    {
-        // OSG-custom gluScaleImage that does not require a graphics context
-        GLint status = gluScaleImage(
-            &psm,
-            output->getPixelFormat(),
-            output->s(),
-            output->t(),
-            output->getDataType(),
-            output->data(),
-            output->s() >> level,
-            output->t() >> level,
-            output->getDataType(),
-            output->getMipmapData(level));
-    }
+    createMipmaps(input, output);
 
     return output;
 }
@@ -566,59 +735,7 @@ ImageUtils::mipmapImageInPlace(osg::Image* input)
         return;
     }
 
-    // first, build the image that will hold all the mipmap levels.
-    int numLevels = osg::Image::computeNumberOfMipmapLevels(input->s(), input->t(), input->r());
-    int imageSizeBytes = input->getTotalSizeInBytes();
-
-    // offset vector does not include level 0 (the full-resolution level)
-    osg::Image::MipmapDataType mipOffsets;
-    mipOffsets.reserve(numLevels-1);
-
-    // calculate memory requirements:
-    int totalSizeBytes = imageSizeBytes;
-    for( int i=1; i<numLevels; ++i )
-    {
-        mipOffsets.push_back(totalSizeBytes);
-        totalSizeBytes += (imageSizeBytes >> i);
-    }
-
-    // allocate space for the new data and copy over level 0 of the old data
-    unsigned char* newData = new unsigned char[totalSizeBytes];
-    ::memcpy(newData, input->data(), input->getTotalSizeInBytes());
-
-    input->setImage(
-        input->s(), input->t(), input->r(),
-        input->getInternalTextureFormat(),
-        input->getPixelFormat(),
-        input->getDataType(),
-        newData,
-        osg::Image::USE_NEW_DELETE,
-        input->getPacking(),
-        input->getRowLength());
-
-    input->setMipmapLevels(mipOffsets);
-
-    // now, populate the image levels.
-    osg::PixelStorageModes psm;
-    psm.pack_alignment = input->getPacking();
-    psm.pack_row_length = input->getRowLength();
-    psm.unpack_alignment = input->getPacking();
-
-    for(int level=1; level<numLevels; ++level)
-    {
-        // OSG-custom gluScaleImage that does not require a graphics context
-        GLint status = gluScaleImage(
-            &psm,
-            input->getPixelFormat(),
-            input->s(),
-            input->t(),
-            input->getDataType(),
-            input->data(),
-            input->s() >> level,
-            input->t() >> level,
-            input->getDataType(),
-            input->getMipmapData(level));
-    }
+    createMipmaps(input, input);
 }
 
 const osg::Image*
@@ -83,9 +83,8 @@ Layer::Options::fromConfig(const Config& conf)
     }
     conf.get("shader_define", shaderDefine());
 
-    const ConfigSet& shadersConf = conf.children("shader");
-    for(ConfigSet::const_iterator i = shadersConf.begin(); i != shadersConf.end(); ++i)
-        shaders().push_back(ShaderOptions(*i));
+    for(const Config& shaderConf : conf.children_view("shader"))
+        shaders().push_back(ShaderOptions(shaderConf));
 
     conf.get("terrain", terrainPatch());
     conf.get("patch", terrainPatch());
@@ -297,6 +296,11 @@ Layer::init()
 Status
 Layer::open()
 {
+    // Layers may open concurrently (see Map::openLayers), and a layer can
+    // also be opened by another layer that references it. Only one thread
+    // gets to do the work; the rest wait here and return its status.
+    Threading::ScopedRecursiveMutexLock lock(_openMutex);
+
     // Cannot open a layer that's already open OR is disabled.
     if (isOpen() || !getEnabled())
     {
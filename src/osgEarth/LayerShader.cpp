@@ -78,14 +78,14 @@ ShaderOptions::fromConfig(const Config& conf)
     _code = conf.value();
 
     _samplers.clear();
-    ConfigSet s = conf.children("sampler");
-    for (ConfigSet::const_iterator i = s.begin(); i != s.end(); ++i) {
+    Config::ChildrenView samplers = conf.children_view("sampler");
+    for (Config::ChildrenView::const_iterator i = samplers.begin(); i != samplers.end(); ++i) {
         _samplers.push_back(Sampler());
         _samplers.back()._name = i->value("name");
         const Config* urlarray = i->find("array");
         if (urlarray) {
-            ConfigSet uris = urlarray->children("url");
-            for (ConfigSet::const_iterator j = uris.begin(); j != uris.end(); ++j) {
+            Config::ChildrenView uris = urlarray->children_view("url");
+            for (Config::ChildrenView::const_iterator j = uris.begin(); j != uris.end(); ++j) {
                 URI uri(j->value(), URIContext(conf.referrer()));
                 _samplers.back()._uris.push_back(uri);
             }
@@ -98,8 +98,8 @@ ShaderOptions::fromConfig(const Config& conf)
         }
     }
 
-    s = conf.children("uniform");
-    for (ConfigSet::const_iterator i = s.begin(); i != s.end(); ++i)
+    Config::ChildrenView uniforms = conf.children_view("uniform");
+    for (Config::ChildrenView::const_iterator i = uniforms.begin(); i != uniforms.end(); ++i)
     {
         _uniforms.push_back(Uniform());
         _uniforms.back()._name = i->value("name");
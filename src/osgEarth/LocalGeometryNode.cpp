@@ -217,8 +217,8 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
                                 osg::Node*              graph, 
                                 TerrainCallbackContext& context)
 {
-    // If we are already set to clamp, ignore this
-    if (_clampInUpdateTraversal)
+    // If we are already set to clamp everything, ignore this
+    if (_clampInUpdateTraversal && _clampExtent.isInvalid())
         return;
 
     bool needsClamp;
@@ -239,6 +239,17 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
 
     if (needsClamp)
     {
+        // accumulate the area to reclamp; an invalid extent means everywhere.
+        if (!_clampInUpdateTraversal)
+            _clampExtent = key.valid() ? key.getExtent() : GeoExtent::INVALID;
+        else if (key.valid())
+            _clampExtent.expandToInclude(key.getExtent());
+        else
+            _clampExtent = GeoExtent::INVALID;
+
+        if (_clampInUpdateTraversal)
+            return;
+
         _clampInUpdateTraversal = true;
         ADJUST_UPDATE_TRAV_COUNT(this, +1);
 
@@ -247,20 +258,26 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
 }
 
 void
-LocalGeometryNode::reclamp()
+LocalGeometryNode::reclamp(const GeoExtent& extent)
 {
     if (_perVertexClampingEnabled)
     {
         osg::ref_ptr<Terrain> terrain = getGeoTransform()->getTerrain();
         if (terrain.valid())
         {
-            clamp(terrain->getGraph(), terrain.get());
+            clamp(terrain->getGraph(), terrain.get(), extent);
         }
     }
 }
 
 void
 LocalGeometryNode::clamp(osg::Node* graph, const Terrain* terrain)
+{
+    clamp(graph, terrain, GeoExtent::INVALID);
+}
+
+void
+LocalGeometryNode::clamp(osg::Node* graph, const Terrain* terrain, const GeoExtent& extent)
 {
     if (terrain && graph)
     {
@@ -269,6 +286,8 @@ LocalGeometryNode::clamp(osg::Node* graph, const Terrain* terrain)
         // The data to clamp to
         clamper.setTerrainPatch( graph );
         clamper.setTerrainSRS( terrain ? terrain->getSRS() : 0L );
+        clamper.setTerrain( terrain );
+        clamper.setExtent( extent );
 
         // Since the GeometryClamper will use the matrix stack to
         // resolve vertex locations, and that matrix stack will incorporate
@@ -287,9 +306,10 @@ LocalGeometryNode::traverse(osg::NodeVisitor& nv)
 {
     if (nv.getVisitorType() == nv.UPDATE_VISITOR && _clampInUpdateTraversal)
     {
-        reclamp();
+        reclamp(_clampExtent);
 
         _clampInUpdateTraversal = false;
+        _clampExtent = GeoExtent::INVALID;
         ADJUST_UPDATE_TRAV_COUNT(this, -1);
     }
     GeoPositionNode::traverse(nv);
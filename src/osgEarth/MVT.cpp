@@ -61,65 +61,100 @@ namespace osgEarth { namespace MVT
         Polygon = 3
     };
 
-    int zig_zag_decode(int n)
+    inline int zig_zag_decode(int n)
     {
         return (n >> 1) ^ (-(n & 1));
     }
 
-    Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+    // Maps tile-space integer coordinates into the tile key's extent.
+    struct TileTransform
+    {
+        TileTransform(const TileKey& key, unsigned int tileres)
+        {
+            const GeoExtent& extent = key.getExtent();
+            _xmin = extent.xMin();
+            _ymax = extent.yMax();
+            _xres = extent.width() / (double)tileres;
+            _yres = extent.height() / (double)tileres;
+        }
+
+        inline void push(Geometry* geom, int x, int y) const
+        {
+            geom->push_back(_xmin + _xres * (double)x, _ymax - _yres * (double)y, 0.0);
+        }
+
+        double _xmin, _ymax, _xres, _yres;
+    };
+
+    // Walks the command stream of a feature geometry, calling "visit" with
+    // each command and, for MOVETO/LINETO, the absolute tile coordinates.
+    template<typename VISITOR>
+    void decodeCommands(const mapnik::vector::tile_feature& feature, VISITOR& visit)
     {
-        unsigned int length = 0;
-        int cmd = -1;
         const int cmd_bits = 3;
+        const uint32_t* g = feature.geometry().data();
+        const int size = feature.geometry_size();
 
         int x = 0;
         int y = 0;
 
-        std::vector< osg::ref_ptr< osgEarth::LineString > > lines;
-        osg::ref_ptr< osgEarth::LineString > currentLine;
-
-        for (int k = 0; k < feature.geometry_size();)
+        for (int k = 0; k < size;)
         {
-            if (!length)
+            unsigned int cmd_length = g[k++];
+            int cmd = cmd_length & ((1 << cmd_bits) - 1);
+            unsigned int length = cmd_length >> cmd_bits;
+
+            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
             {
-                unsigned int cmd_length = feature.geometry(k++);
-                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                length = cmd_length >> cmd_bits;
+                for (unsigned int i = 0; i < length && k + 1 < size; ++i)
+                {
+                    x += zig_zag_decode(g[k++]);
+                    y += zig_zag_decode(g[k++]);
+                    visit(cmd, x, y);
+                }
             }
-            if (length > 0)
+            else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1)))
             {
-                length--;
-
-                if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
-                {
-                    if (cmd == SEG_MOVETO)
-                    {
-                        currentLine = new osgEarth::LineString;
-                        lines.push_back( currentLine.get() );
-                    }
-                    int px = feature.geometry(k++);
-                    int py = feature.geometry(k++);
-                    px = zig_zag_decode(px);
-                    py = zig_zag_decode(py);
-
-                    x += px;
-                    y += py;
-
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
+                for (unsigned int i = 0; i < length; ++i)
+                    visit(cmd, x, y);
+            }
+            else
+            {
+                // malformed command stream
+                break;
+            }
+        }
+    }
 
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+    struct LineVisitor
+    {
+        LineVisitor(const TileTransform& xform, unsigned int reserve) : _xform(xform), _reserve(reserve) { }
 
-                    if (currentLine.valid())
-                    {
-                        currentLine->push_back(geoX, geoY, 0);
-                    }
-                }
+        void operator()(int cmd, int x, int y)
+        {
+            if (cmd == SEG_MOVETO)
+            {
+                _current = new osgEarth::LineString(_lines.empty() ? _reserve : 2u);
+                _lines.push_back(_current.get());
+            }
+            if (_current.valid() && (cmd == SEG_MOVETO || cmd == SEG_LINETO))
+            {
+                _xform.push(_current.get(), x, y);
             }
         }
 
-        currentLine = 0;
+        const TileTransform& _xform;
+        unsigned int _reserve;
+        std::vector< osg::ref_ptr< osgEarth::LineString > > _lines;
+        osg::ref_ptr< osgEarth::LineString > _current;
+    };
+
+    Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileTransform& xform)
+    {
+        LineVisitor visitor(xform, feature.geometry_size() / 2);
+        decodeCommands(feature, visitor);
+
+        std::vector< osg::ref_ptr< osgEarth::LineString > >& lines = visitor._lines;
 
         if (lines.size() == 0)
         {
@@ -142,152 +177,105 @@ namespace osgEarth { namespace MVT
         }
     }
 
-    Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+    struct PointVisitor
     {
-        unsigned int length = 0;
-        int cmd = -1;
-        const int cmd_bits = 3;
-
-        int x = 0;
-        int y = 0;
-
-        osgEarth::PointSet *geometry = new osgEarth::PointSet();
+        PointVisitor(const TileTransform& xform, osgEarth::PointSet* points) : _xform(xform), _points(points) { }
 
-        for (int k = 0; k < feature.geometry_size();)
+        void operator()(int cmd, int x, int y)
         {
-            if (!length)
+            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
             {
-                unsigned int cmd_length = feature.geometry(k++);
-                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                length = cmd_length >> cmd_bits;
-            }
-            if (length > 0)
-            {
-                length--;
-                if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
-                {
-                    int px = feature.geometry(k++);
-                    int py = feature.geometry(k++);
-                    px = zig_zag_decode(px);
-                    py = zig_zag_decode(py);
-
-                    x += px;
-                    y += py;
-
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
-
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                    geometry->push_back(geoX, geoY, 0);
-                }
+                _xform.push(_points, x, y);
             }
         }
 
+        const TileTransform& _xform;
+        osgEarth::PointSet* _points;
+    };
+
+    Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileTransform& xform)
+    {
+        osgEarth::PointSet *geometry = new osgEarth::PointSet(feature.geometry_size() / 2);
+        PointVisitor visitor(xform, geometry);
+        decodeCommands(feature, visitor);
         return geometry;
     }
 
-    Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  TileKey& key, unsigned int tileres)
+    struct PolygonVisitor
     {
-        /*
-         https://github.com/mapbox/vector-tile-spec/tree/master/2.1
-         Decoding polygons is a bit more difficult than lines or points.
-         A Polygon geometry is either a single polygon or a multipolygon.  Each polygon has one exterior ring and zero or more interior rings.
-         The rings are in sequence and you must check the orientation of the ring to know if it's an exterior ring (new polygon) or an
-         interior ring (inner polygon of the current polygon).
-         */
-
-
-        unsigned int length = 0;
-        int cmd = -1;
-        const int cmd_bits = 3;
-
-        int x = 0;
-        int y = 0;
-
-        // The list of polygons we've collected
-        std::vector< osg::ref_ptr< osgEarth::Polygon > > polygons;
+        PolygonVisitor(const TileTransform& xform, unsigned int reserve) : _xform(xform), _reserve(reserve) { }
 
-        osg::ref_ptr< osgEarth::Polygon > currentPolygon;
-
-        osg::ref_ptr< osgEarth::Ring > currentRing;
-
-        for (int k = 0; k < feature.geometry_size();)
+        void operator()(int cmd, int x, int y)
         {
-            if (!length)
+            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
             {
-                unsigned int cmd_length = feature.geometry(k++);
-                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                length = cmd_length >> cmd_bits;
+                if (!_currentRing.valid())
+                {
+                    _currentRing = new osgEarth::Ring(_polygons.empty() ? _reserve : 4u);
+                }
+                _xform.push(_currentRing.get(), x, y);
             }
-            if (length > 0)
+            else if (_currentRing.valid())
             {
-                length--;
-                if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
-                {
-                    if (!currentRing)
-                    {
-                        currentRing = new osgEarth::Ring();
-                    }
-
-                    int px = feature.geometry(k++);
-                    int py = feature.geometry(k++);
-                    px = zig_zag_decode(px);
-                    py = zig_zag_decode(py);
+                // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
 
-                    x += px;
-                    y += py;
+                // Figure out what to do with the ring based on the orientation of the ring
+                Geometry::Orientation orientation = _currentRing->getOrientation();
+                // Close the ring.
+                _currentRing->close();
 
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
+                // Clockwise means exterior ring.  Start a new polygon and add the ring.
+                if (orientation == Geometry::ORIENTATION_CW)
+                {
+                    // osgearth orientations are reversed from mvt
+                    _currentRing->rewind(Geometry::ORIENTATION_CCW);
 
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                    currentRing->push_back(geoX, geoY, 0);
+                    _currentPolygon = new osgEarth::Polygon(&_currentRing->asVector());
+                    _polygons.push_back(_currentPolygon.get());
                 }
-                else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1)))
+                else if (orientation == Geometry::ORIENTATION_CCW)
+                // Counter clockwise means a hole, add it to the existing polygon.
                 {
-                    // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
-
-                    // Figure out what to do with the ring based on the orientation of the ring
-                    Geometry::Orientation orientation = currentRing->getOrientation();
-                    // Close the ring.
-                    currentRing->close();
-
-                    // Clockwise means exterior ring.  Start a new polygon and add the ring.
-                    if (orientation == Geometry::ORIENTATION_CW)
+                    if (_currentPolygon.valid())
                     {
                         // osgearth orientations are reversed from mvt
-                        currentRing->rewind(Geometry::ORIENTATION_CCW);
-
-                        currentPolygon = new osgEarth::Polygon(&currentRing->asVector());
-                        polygons.push_back(currentPolygon.get());
+                        _currentRing->rewind(Geometry::ORIENTATION_CW);
+                        _currentPolygon->getHoles().push_back( _currentRing );
                     }
-                    else if (orientation == Geometry::ORIENTATION_CCW)
-                    // Counter clockwise means a hole, add it to the existing polygon.
+                    else
                     {
-                        if (currentPolygon.valid())
-                        {
-                            // osgearth orientations are reversed from mvt
-                            currentRing->rewind(Geometry::ORIENTATION_CW);
-                            currentPolygon->getHoles().push_back( currentRing );
-                        }
-                        else
-                        {
-                            // this means we encountered a "hole" without a parent outer ring,
-                            // discard for now -gw
-                            OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
-                        }
+                        // this means we encountered a "hole" without a parent outer ring,
+                        // discard for now -gw
+                        OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
                     }
-
-                    // Start a new ring
-                    currentRing = 0;
                 }
+
+                // Start a new ring
+                _currentRing = 0;
             }
         }
 
-        currentRing = 0;
-        currentPolygon = 0;
+        const TileTransform& _xform;
+        unsigned int _reserve;
+        std::vector< osg::ref_ptr< osgEarth::Polygon > > _polygons;
+        osg::ref_ptr< osgEarth::Polygon > _currentPolygon;
+        osg::ref_ptr< osgEarth::Ring > _currentRing;
+    };
+
+    Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const TileTransform& xform)
+    {
+        /*
+         https://github.com/mapbox/vector-tile-spec/tree/master/2.1
+         Decoding polygons is a bit more difficult than lines or points.
+         A Polygon geometry is either a single polygon or a multipolygon.  Each polygon has one exterior ring and zero or more interior rings.
+         The rings are in sequence and you must check the orientation of the ring to know if it's an exterior ring (new polygon) or an
+         interior ring (inner polygon of the current polygon).
+         */
+
+        PolygonVisitor visitor(xform, feature.geometry_size() / 2);
+        decodeCommands(feature, visitor);
+
+        std::vector< osg::ref_ptr< osgEarth::Polygon > >& polygons = visitor._polygons;
 
         if (polygons.size() == 0)
         {
@@ -310,154 +298,312 @@ namespace osgEarth { namespace MVT
         }
     }
 
-    bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
+    // Minimal protobuf wire format reader. We use it to walk the top level of
+    // a tile in place so that layers we don't need are skipped without parsing.
+    struct WireReader
     {
-        features.clear();
+        enum { WIRE_VARINT = 0, WIRE_FIXED64 = 1, WIRE_BYTES = 2, WIRE_FIXED32 = 5 };
+
+        WireReader(const char* data, size_t length) :
+            _ptr((const unsigned char*)data),
+            _end((const unsigned char*)data + length) { }
 
-        // Get the compressor
-        osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
-        if (!compressor.valid())
+        bool varint(uint64_t& out)
         {
+            out = 0u;
+            for (int shift = 0; shift < 64 && _ptr < _end; shift += 7)
+            {
+                unsigned char b = *_ptr++;
+                out |= (uint64_t)(b & 0x7f) << shift;
+                if ((b & 0x80) == 0)
+                    return true;
+            }
             return false;
         }
 
-        // Decompress the tile
-        std::string original((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-        in.seekg (0, std::ios::beg);
-        std::string value;
-        if (!compressor->decompress(in, value))
+        bool tag(unsigned& field, unsigned& wireType)
         {
-            value = original;
+            uint64_t t;
+            if (_ptr >= _end || !varint(t))
+                return false;
+            field = (unsigned)(t >> 3);
+            wireType = (unsigned)(t & 0x7);
+            return true;
         }
 
+        bool bytes(const char*& data, size_t& length)
+        {
+            uint64_t len;
+            if (!varint(len) || len > (uint64_t)(_end - _ptr))
+                return false;
+            data = (const char*)_ptr;
+            length = (size_t)len;
+            _ptr += len;
+            return true;
+        }
+
+        bool skip(unsigned wireType)
+        {
+            uint64_t v;
+            const char* data;
+            size_t length;
+            switch (wireType)
+            {
+            case WIRE_VARINT:  return varint(v);
+            case WIRE_BYTES:   return bytes(data, length);
+            case WIRE_FIXED64: if (_end - _ptr < 8) return false; _ptr += 8; return true;
+            case WIRE_FIXED32: if (_end - _ptr < 4) return false; _ptr += 4; return true;
+            default:           return false;
+            }
+        }
 
-        mapnik::vector::tile tile;
+        const unsigned char* _ptr;
+        const unsigned char* _end;
+    };
 
-        if (tile.ParseFromString(value))
+    // Finds the name of an encoded tile_layer message without parsing it.
+    bool peekLayerName(const char* data, size_t length, std::string& name)
+    {
+        WireReader reader(data, length);
+        unsigned field, wireType;
+        while (reader.tag(field, wireType))
         {
-            for (int i = 0; i < tile.layers().size(); i++)
+            if (field == 1 && wireType == WireReader::WIRE_BYTES)
+            {
+                const char* str;
+                size_t len;
+                if (!reader.bytes(str, len))
+                    return false;
+                name.assign(str, len);
+                return true;
+            }
+            else if (!reader.skip(wireType))
             {
-                const mapnik::vector::tile_layer &layer = tile.layers().Get(i);
+                return false;
+            }
+        }
+        return false;
+    }
 
-                for (int j = 0; j < layer.features().size(); j++)
-                {
-                    const mapnik::vector::tile_feature &feature = layer.features().Get(j);
+    // Read-only std::streambuf over an existing buffer, so we can hand
+    // memory to an osgDB compressor without copying it into a string.
+    struct MemoryBuffer : public std::streambuf
+    {
+        MemoryBuffer(const char* data, size_t length)
+        {
+            char* p = const_cast<char*>(data);
+            setg(p, p, p + length);
+        }
+    };
 
-                    osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
+    void readLayer(const mapnik::vector::tile_layer& layer, const TileKey& key, FeatureList& features)
+    {
+        TileTransform xform(key, layer.extent());
+
+        for (int j = 0; j < layer.features().size(); j++)
+        {
+            const mapnik::vector::tile_feature &feature = layer.features().Get(j);
 
-                    // Set the layer name as "mvt_layer" so we can filter it later
-                    oeFeature->set("mvt_layer", layer.name());
+            osg::ref_ptr< osgEarth::Geometry > geometry;
 
-                    // Read attributes
-                    for (int k = 0; k < feature.tags().size(); k+=2)
+            eGeomType geomType = static_cast<eGeomType>(feature.type());
+            if (geomType == MVT::Polygon)
+            {
+                geometry = decodePolygon(feature, xform);
+            }
+            else if (geomType == MVT::LineString)
+            {
+                geometry = decodeLine(feature, xform);
+            }
+            else if (geomType == MVT::Point)
+            {
+                geometry = decodePoint(feature, xform);
+
+                // This is a bit of a hack, but if a point is outside of the extents we remove it.
+                // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
+                // extent.  Should probably make this an option somewhere.
+                if (geometry)
+                {
+                    if (!key.getExtent().contains(geometry->getBounds().center()))
                     {
-                        std::string key = layer.keys().Get(feature.tags().Get(k));
-                        mapnik::vector::tile_value value = layer.values().Get(feature.tags().Get(k+1));
+                        geometry = NULL;
+                    }
+                }
+            }
+            else
+            {
+                geometry = decodeLine(feature, xform);
+            }
 
-                        if (value.has_bool_value())
-                        {
-                            oeFeature->set(key, value.bool_value());
-                        }
-                        else if (value.has_double_value())
-                        {
-                            oeFeature->set(key, value.double_value());
-                        }
-                        else if (value.has_float_value())
-                        {
-                            oeFeature->set(key, value.float_value());
-                        }
-                        else if (value.has_int_value())
-                        {
-                            oeFeature->set(key, (long long)value.int_value());
-                        }
-                        else if (value.has_sint_value())
-                        {
-                            oeFeature->set(key, (long long)value.sint_value());
-                        }
-                        else if (value.has_string_value())
-                        {
-                            oeFeature->set(key, value.string_value());
-                        }
-                        else if (value.has_uint_value())
-                        {
-                            oeFeature->set(key, (long long)value.uint_value());
-                        }
+            // no geometry, no feature; don't bother with the attributes
+            if (!geometry.valid())
+            {
+                continue;
+            }
 
-                        // Special path for getting heights from our test dataset.
-                        if (key == "other_tags")
-                        {
-                            std::string other_tags = value.string_value();
+            osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
 
-                            StringTokenizer tok("=>");
-                            StringVector tized;
-                            tok.tokenize(other_tags, tized);
-                            if (tized.size() == 3)
-                            {
-                                if (tized[0] == "height")
-                                {
-                                    std::string value = tized[2];
-                                    // Remove quotes from the height
-                                    float height = as<float>(value, FLT_MAX);
-                                    if (height != FLT_MAX)
-                                    {
-                                        oeFeature->set("height", height);
-                                    }
-                                }
-                            }
-                        }
-                    }
+            // Set the layer name as "mvt_layer" so we can filter it later
+            oeFeature->set("mvt_layer", layer.name());
+
+            // Read attributes
+            for (int k = 0; k + 1 < feature.tags().size(); k+=2)
+            {
+                unsigned keyIndex = feature.tags().Get(k);
+                unsigned valueIndex = feature.tags().Get(k+1);
+                if ((int)keyIndex >= layer.keys().size() || (int)valueIndex >= layer.values().size())
+                {
+                    continue;
+                }
 
+                const std::string& key = layer.keys().Get(keyIndex);
+                const mapnik::vector::tile_value& value = layer.values().Get(valueIndex);
 
+                if (value.has_bool_value())
+                {
+                    oeFeature->set(key, value.bool_value());
+                }
+                else if (value.has_double_value())
+                {
+                    oeFeature->set(key, value.double_value());
+                }
+                else if (value.has_float_value())
+                {
+                    oeFeature->set(key, value.float_value());
+                }
+                else if (value.has_int_value())
+                {
+                    oeFeature->set(key, (long long)value.int_value());
+                }
+                else if (value.has_sint_value())
+                {
+                    oeFeature->set(key, (long long)value.sint_value());
+                }
+                else if (value.has_string_value())
+                {
+                    oeFeature->set(key, value.string_value());
+                }
+                else if (value.has_uint_value())
+                {
+                    oeFeature->set(key, (long long)value.uint_value());
+                }
 
-                    osg::ref_ptr< osgEarth::Geometry > geometry;
+                // Special path for getting heights from our test dataset.
+                if (key == "other_tags")
+                {
+                    std::string other_tags = value.string_value();
 
-                    eGeomType geomType = static_cast<eGeomType>(feature.type());
-                    if (geomType == MVT::Polygon)
-                    {
-                        geometry = decodePolygon(feature, key, layer.extent());
-                    }
-                    else if (geomType == MVT::LineString)
-                    {
-                        geometry = decodeLine(feature, key, layer.extent());
-                    }
-                    else if (geomType == MVT::Point)
+                    StringTokenizer tok("=>");
+                    StringVector tized;
+                    tok.tokenize(other_tags, tized);
+                    if (tized.size() == 3)
                     {
-                        geometry = decodePoint(feature, key, layer.extent());
-
-                        // This is a bit of a hack, but if a point is outside of the extents we remove it.
-                        // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
-                        // extent.  Should probably make this an option somewhere.
-                        if (geometry)
+                        if (tized[0] == "height")
                         {
-                            if (!key.getExtent().contains(geometry->getBounds().center()))
+                            std::string value = tized[2];
+                            // Remove quotes from the height
+                            float height = as<float>(value, FLT_MAX);
+                            if (height != FLT_MAX)
                             {
-                                geometry = NULL;
+                                oeFeature->set("height", height);
                             }
                         }
                     }
-                    else
-                    {
-                        geometry = decodeLine(feature, key, layer.extent());
-                    }
-
-                    if (geometry)
-                    {
-                        oeFeature->setGeometry( geometry.get() );
-                        features.push_back(oeFeature.get());
-                    }
-
                 }
             }
+
+            oeFeature->setGeometry( geometry.get() );
+            features.push_back(oeFeature.get());
         }
-        else
+    }
+
+    bool readTile(const char* data, size_t length, const TileKey& key, const std::set<std::string>& layers, FeatureList& features)
+    {
+        features.clear();
+
+        if (data == nullptr || length == 0)
         {
-            OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
             return false;
         }
 
+        // Decompress the tile if it's gzip or zlib encoded; otherwise we read it in place.
+        std::string inflated;
+        const unsigned char* magic = (const unsigned char*)data;
+        bool gzip = length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+        bool zlib = length >= 2 && magic[0] == 0x78 && ((magic[0] << 8) | magic[1]) % 31 == 0;
+        if (gzip || zlib)
+        {
+            osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+            if (!compressor.valid())
+            {
+                OE_WARN << LC << "Failed to get zlib compressor" << std::endl;
+                return false;
+            }
+
+            MemoryBuffer buffer(data, length);
+            std::istream in(&buffer);
+            if (compressor->decompress(in, inflated) && !inflated.empty())
+            {
+                data = inflated.data();
+                length = inflated.size();
+            }
+        }
+
+        // Walk the layers, decoding only the ones we want.
+        WireReader reader(data, length);
+        mapnik::vector::tile_layer layer;
+        std::string name;
+        unsigned field, wireType;
+
+        while (reader._ptr < reader._end)
+        {
+            if (!reader.tag(field, wireType))
+            {
+                OE_WARN << LC << "Failed to parse mvt " << key.str() << std::endl;
+                return false;
+            }
+
+            if (field == 3 && wireType == WireReader::WIRE_BYTES)
+            {
+                const char* layerData;
+                size_t layerLength;
+                if (!reader.bytes(layerData, layerLength))
+                {
+                    OE_WARN << LC << "Failed to parse mvt " << key.str() << std::endl;
+                    return false;
+                }
+
+                if (!layers.empty() &&
+                    (!peekLayerName(layerData, layerLength, name) || layers.find(name) == layers.end()))
+                {
+                    continue;
+                }
+
+                layer.Clear();
+                if (!layer.ParseFromArray(layerData, (int)layerLength))
+                {
+                    OE_WARN << LC << "Failed to parse mvt layer in " << key.str() << std::endl;
+                    return false;
+                }
+
+                readLayer(layer, key, features);
+            }
+            else if (!reader.skip(wireType))
+            {
+                OE_WARN << LC << "Failed to parse mvt " << key.str() << std::endl;
+                return false;
+            }
+        }
+
         return true;
     }
 
+    bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
+    {
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return readTile(data.data(), data.size(), key, std::set<std::string>(), features);
+    }
+
 }} // namespace osgEarth::MVT
 
 //........................................................................
@@ -467,6 +613,7 @@ MVTFeatureSourceOptions::getConfig() const
 {
     Config conf = FeatureSource::Options::getConfig();
     conf.set("url", url());
+    conf.set("layers", layers());
     return conf;
 }
 
@@ -474,6 +621,7 @@ void
 MVTFeatureSourceOptions::fromConfig(const Config& conf)
 {
     conf.get("url", url());
+    conf.get("layers", layers());
 }
 
 //........................................................................
@@ -481,6 +629,7 @@ MVTFeatureSourceOptions::fromConfig(const Config& conf)
 REGISTER_OSGEARTH_LAYER(mvtfeatures, MVTFeatureSource);
 
 OE_LAYER_PROPERTY_IMPL(MVTFeatureSource, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(MVTFeatureSource, std::string, Layers, layers);
 
 
 Status
@@ -501,9 +650,39 @@ MVTFeatureSource::openImplementation()
 
     setFeatureProfile(createFeatureProfile());
 
+    _layers.clear();
+    if (options().layers().isSet())
+    {
+        StringVector names;
+        StringTokenizer(options().layers().get(), names, ", ", "'\"", false, true);
+        _layers.insert(names.begin(), names.end());
+    }
+
     return Status::NoError;
 }
 
+Status
+MVTFeatureSource::closeImplementation()
+{
+    {
+        Threading::ScopedMutexLock lock(_selectTile);
+        for (PerThread<void*>::iterator i = _selectTile.begin(); i != _selectTile.end(); ++i)
+        {
+            if (i->second)
+                sqlite3_finalize((sqlite3_stmt*)i->second);
+        }
+    }
+    _selectTile.clear();
+
+    if (_database)
+    {
+        sqlite3_close_v2((sqlite3*)_database);
+        _database = 0L;
+    }
+
+    return FeatureSource::closeImplementation();
+}
+
 void
 MVTFeatureSource::init()
 {
@@ -539,43 +718,45 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     tileY = numRows - tileY - 1;
 
-    //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string queryStr = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2((sqlite3*)_database, queryStr.c_str(), -1, &select, 0L);
-    if (rc != SQLITE_OK)
+    // Reuse this thread's prepared statement if we have one
+    void*& selectSlot = _selectTile.get();
+    sqlite3_stmt* select = (sqlite3_stmt*)selectSlot;
+    if (select == NULL)
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << queryStr << "; "
-            << sqlite3_errmsg((sqlite3*)_database) << std::endl;
-        return NULL;
+        std::string queryStr = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+        int rc = sqlite3_prepare_v2((sqlite3*)_database, queryStr.c_str(), -1, &select, 0L);
+        if (rc != SQLITE_OK)
+        {
+            OE_WARN << LC << "Failed to prepare SQL: " << queryStr << "; "
+                << sqlite3_errmsg((sqlite3*)_database) << std::endl;
+            return NULL;
+        }
+        selectSlot = select;
     }
 
-    bool valid = true;
-
     sqlite3_bind_int(select, 1, z);
     sqlite3_bind_int(select, 2, tileX);
     sqlite3_bind_int(select, 3, tileY);
 
-    rc = sqlite3_step(select);
+    int rc = sqlite3_step(select);
 
     FeatureList features;
 
     if (rc == SQLITE_ROW)
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
+        // decode straight from the blob, which sqlite owns until the statement is reset
         const char* data = (const char*)sqlite3_column_blob(select, 0);
         int dataLen = sqlite3_column_bytes(select, 0);
-        std::string dataBuffer(data, dataLen);
-        std::stringstream in(dataBuffer);
-        MVT::readTile(in, key, features);
+
+        MVT::readTile(data, dataLen, key, _layers, features);
     }
     else
     {
-        OE_DEBUG << LC << "SQL QUERY failed for " << queryStr << ": " << std::endl;
-        valid = false;
+        OE_DEBUG << LC << "SQL QUERY failed for tile " << key.str() << std::endl;
     }
 
-    sqlite3_finalize(select);
+    sqlite3_reset(select);
+    sqlite3_clear_bindings(select);
 
     // apply filters before returning.
     applyFilters(features, query.tileKey()->getExtent());
@@ -652,13 +833,12 @@ MVTFeatureSource::iterateTiles(int zoomLevel, int limit, int offset, const GeoEx
 
         TileKey key(zoom, tile_column, numRows - tile_row - 1, profile);
 
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
+        // decode straight from the blob, which sqlite owns until the next step
         const char* data = (const char*)sqlite3_column_blob(select, 3);
         int dataLen = sqlite3_column_bytes(select, 3);
-        std::string dataBuffer(data, dataLen);
-        std::stringstream in(dataBuffer);
 
         FeatureList features;
+        MVT::readTile(data, dataLen, key, _layers, features);
 
         // If we have any features and we have an fid attribute, override the fid of the features
         if (options().fidAttribute().isSet())
@@ -672,9 +852,6 @@ MVTFeatureSource::iterateTiles(int zoomLevel, int limit, int offset, const GeoEx
             }
         }
 
-
-        MVT::readTile(in, key, features);
-
         // apply filters before returning.
         applyFilters(features, key.getExtent());
 
@@ -19,6 +19,8 @@
 #include <osgEarth/Map>
 #include <osgEarth/MapModelChange>
 #include <osgEarth/Registry>
+#include <osgEarth/Metrics>
+#include <iomanip>
 
 using namespace osgEarth;
 
@@ -60,6 +62,8 @@ Map::Options::getConfig() const
     conf.set( "elevation_interpolation", "triangulate", elevationInterpolation(), INTERP_TRIANGULATE);
 
     conf.set( "profile_layer", profileLayer() );
+    conf.set( "open_layers_in_parallel", openLayersInParallel() );
+    conf.set( "open_layers_threads", openLayersThreads() );
 
     return conf;
 }
@@ -68,6 +72,8 @@ void
 Map::Options::fromConfig(const Config& conf)
 {
     elevationInterpolation().init(INTERP_BILINEAR);
+    openLayersInParallel().init(false);
+    openLayersThreads().init(12u);
     
     conf.get( "name",         name() );
     conf.get( "profile",      profile() );
@@ -87,6 +93,8 @@ Map::Options::fromConfig(const Config& conf)
     conf.get( "elevation_interpolation", "triangulate", elevationInterpolation(), INTERP_TRIANGULATE);
 
     conf.get( "profile_layer", profileLayer() );
+    conf.get( "open_layers_in_parallel", openLayersInParallel() );
+    conf.get( "open_layers_threads", openLayersThreads() );
 }
 
 //...................................................................
@@ -323,6 +331,30 @@ Map::getElevationInterpolation() const
     return options().elevationInterpolation().get();
 }
 
+void
+Map::setOpenLayersInParallel(bool value)
+{
+    options().openLayersInParallel() = value;
+}
+
+bool
+Map::getOpenLayersInParallel() const
+{
+    return options().openLayersInParallel().get();
+}
+
+void
+Map::setOpenLayersThreads(unsigned value)
+{
+    options().openLayersThreads() = osg::maximum(value, 1u);
+}
+
+unsigned
+Map::getOpenLayersThreads() const
+{
+    return options().openLayersThreads().get();
+}
+
 Cache*
 Map::getCache() const
 {
@@ -618,11 +650,11 @@ Map::addLayers(const LayerVector& layers)
             continue;
 
         layer->setReadOptions(getReadOptions());
-
-        // open, but don't call addedToMap(layer) yet.
-        layer->open();
     }
 
+    // open, but don't call addedToMap(layer) yet.
+    openLayers(layers);
+
     unsigned firstIndex;
     unsigned count = 0;
     int newRevision;
@@ -674,6 +706,74 @@ Map::addLayers(const LayerVector& layers)
     }
 }
 
+namespace
+{
+    // opens one layer and reports how long it took
+    double openAndTimeLayer(Layer* layer)
+    {
+        OE_PROFILING_ZONE;
+        OE_PROFILING_ZONE_TEXT(layer->getName());
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        layer->open();
+        double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+        OE_INFO << LC << "Opened \"" << layer->getName() << "\" in "
+            << std::fixed << std::setprecision(1) << ms << " ms"
+            << (layer->getStatus().isError() ? " (" + layer->getStatus().message() + ")" : "")
+            << std::endl;
+
+        return ms;
+    }
+}
+
+void
+Map::openLayers(const LayerVector& layers)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    if (getOpenLayersInParallel() && layers.size() > 1)
+    {
+        // Layer::open() is serialized per layer, so a layer whose open()
+        // opens a referenced layer (e.g. a FeatureImageLayer and its
+        // feature source) just waits for that layer if it's already
+        // opening on another thread. The opens mostly wait on I/O, so
+        // the arena is sized well past the default.
+        JobArena::setSize("oe.layeropen", osg::maximum(getOpenLayersThreads(), 1u));
+        JobArena* arena = JobArena::arena("oe.layeropen");
+        JobGroup group;
+        for (unsigned i = 1; i < layers.size(); ++i)
+        {
+            Layer* layer = layers[i].get();
+            if (layer)
+            {
+                std::function<void()> job = [layer]() { openAndTimeLayer(layer); };
+                arena->dispatch(job, &group);
+            }
+        }
+
+        // open the first one on this thread while we wait
+        if (layers[0].valid())
+            openAndTimeLayer(layers[0].get());
+
+        group.join();
+    }
+    else
+    {
+        for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+        {
+            if (i->valid())
+                openAndTimeLayer(i->get());
+        }
+    }
+
+    OE_INFO << LC << "Opened " << layers.size() << " layers in "
+        << std::fixed << std::setprecision(1)
+        << osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) << " ms"
+        << (getOpenLayersInParallel() ? " (parallel)" : "")
+        << std::endl;
+}
+
 void
 Map::installLayerCallbacks(Layer* layer)
 {
@@ -798,17 +798,21 @@ MapNode::openMapLayers()
     LayerVector layers;
     _map->getLayers(layers);
 
+    LayerVector toOpen;
     for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
     {
-        Layer* layer = i->get();
+        if (!i->get()->getStatus().isError())
+            toOpen.push_back(i->get());
+    }
 
-        if (!layer->getStatus().isError())
+    _map->openLayers(toOpen);
+
+    for (LayerVector::const_iterator i = toOpen.begin(); i != toOpen.end(); ++i)
+    {
+        Layer* layer = i->get();
+        if (layer->getStatus().isError())
         {
-            const Status& status = layer->open();
-            if (status.isError())
-            {
-                OE_WARN << LC << "Failed to open layer \"" << layer->getName() << "\" ... " << status.message() << std::endl;
-            }
+            OE_WARN << LC << "Failed to open layer \"" << layer->getName() << "\" ... " << layer->getStatus().message() << std::endl;
         }
     }
 }
@@ -60,9 +60,13 @@ namespace
 }
 
 ObjectIndex::ObjectIndex() :
-_idGen( STARTING_OBJECT_ID ),
-_mutex("ObjectIndex(OE)")
+_idGen( STARTING_OBJECT_ID )
 {
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        _shards[s]._mutex.setName("ObjectIndex(OE)");
+    }
+
     _attribName     = "oe_index_objectid_attr";
     _attribLocation = osg::Drawable::SECONDARY_COLORS;
     _oidUniformName = "oe_index_objectid_uniform";
@@ -82,10 +86,22 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
     return vp != 0L;
 }
 
+unsigned
+ObjectIndex::size() const
+{
+    unsigned count = 0u;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedMutexLock lock(_shards[s]._mutex);
+        count += _shards[s]._index.size();
+    }
+    return count;
+}
+
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    if ( size() == 0 )
     {
         _attribLocation = value;
     } 
@@ -98,49 +114,50 @@ ObjectIndex::setObjectIDAtrribLocation(int value)
 ObjectID
 ObjectIndex::insert(osg::Referenced* object)
 {
-    Threading::ScopedMutexLock excl( _mutex );
-    return insertImpl( object );
+    ObjectID id = ++_idGen;
+    Shard& shard = _shards[shardOf(id)];
+    Threading::ScopedMutexLock excl( shard._mutex );
+    insertImpl( id, object );
+    return id;
 }
 
-ObjectID
-ObjectIndex::insertImpl(osg::Referenced* object)
+void
+ObjectIndex::insertImpl(ObjectID id, osg::Referenced* object)
 {
-    // internal: assume mutex is locked
-    ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
-    return id;
+    // internal: assume the shard's mutex is locked
+    _shards[shardOf(id)]._index[id] = object;
+    OE_DEBUG << LC << "Insert " << id << "\n";
 }
 
 osg::Referenced*
 ObjectIndex::getImpl(ObjectID id) const
 {
-    // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    // assume the shard's mutex is locked
+    const IndexMap& index = _shards[shardOf(id)]._index;
+    IndexMap::const_iterator i = index.find(id);
+    return i != index.end() ? i->second.get() : 0L;
 }
 
 void
 ObjectIndex::remove(ObjectID id)
 {
-    Threading::ScopedMutexLock excl(_mutex);
+    Shard& shard = _shards[shardOf(id)];
+    Threading::ScopedMutexLock excl( shard._mutex );
     removeImpl(id);
 }
 
 void
 ObjectIndex::removeImpl(ObjectID id)
 {
-    // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
-
+    // internal - assume the shard's mutex is locked
+    _shards[shardOf(id)]._index.erase( id );
+    OE_DEBUG << "Remove " << id << "\n";
 }
 
 ObjectID
 ObjectIndex::tagDrawable(osg::Drawable* drawable, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagDrawable(drawable, oid);
     return oid;
 }
@@ -167,6 +184,51 @@ ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id) const
     ids->assign( geom->getVertexArray()->getNumElements(), id );
 }
 
+ObjectID
+ObjectIndex::tagRange(osg::Drawable* drawable, osg::Referenced* object, unsigned first, unsigned count)
+{
+    ObjectID oid = insert(object);
+    tagRange(drawable, oid, first, count);
+    return oid;
+}
+
+void
+ObjectIndex::tagRange(osg::Drawable* drawable, ObjectID id, unsigned first, unsigned count) const
+{
+    if ( drawable == 0L )
+        return;
+
+    osg::Geometry* geom = drawable->asGeometry();
+    if ( !geom || !geom->getVertexArray() )
+        return;
+
+    unsigned numVerts = geom->getVertexArray()->getNumElements();
+
+    // re-use the existing ID array if there is one; it's the same size as
+    // the vertex array so there is exactly one allocation per drawable.
+    ObjectIDArray* ids = dynamic_cast<ObjectIDArray*>(geom->getVertexAttribArray(_attribLocation));
+    if ( !ids )
+    {
+        ids = new ObjectIDArray();
+        ids->setBinding(osg::Array::BIND_PER_VERTEX);
+        ids->setNormalize(false);
+        ids->setPreserveDataType(true);
+        geom->setVertexAttribArray(_attribLocation, ids);
+    }
+
+    if ( ids->size() < numVerts )
+    {
+        ids->resize( numVerts, OSGEARTH_OBJECTID_EMPTY );
+    }
+
+    unsigned last = std::min(first + count, numVerts);
+    if ( first < last )
+    {
+        std::fill( ids->begin() + first, ids->begin() + last, id );
+        ids->dirty();
+    }
+}
+
 namespace
 {
     struct FindAndTagDrawables : public osg::NodeVisitor
@@ -191,8 +253,7 @@ namespace
 ObjectID
 ObjectIndex::tagAllDrawables(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagAllDrawables(node, oid);
     return oid;
 }
@@ -210,8 +271,7 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 ObjectID
 ObjectIndex::tagNode(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagNode(node, oid);
     return oid;
 }
@@ -86,7 +86,9 @@ _outlineColor( 1.0f, 1.0f, 1.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
 //_altitudeMode( ALTMODE_ABSOLUTE ),
 _fill(false),
-_terrainOnly( false )
+_terrainOnly( false ),
+_useElevationData( false ),
+_elevationResolution( 0.0 )
 {
     //compute(getNode());
     _terrainChangedCallback = new RadialLineOfSightNodeTerrainChangedCallback( this );
@@ -211,6 +213,39 @@ void RadialLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+bool
+RadialLineOfSightNode::getUseElevationData() const
+{
+    return _useElevationData;
+}
+
+void
+RadialLineOfSightNode::setUseElevationData( bool value )
+{
+    if (_useElevationData != value)
+    {
+        _useElevationData = value;
+        compute(getNode());
+    }
+}
+
+double
+RadialLineOfSightNode::getElevationResolution() const
+{
+    return _elevationResolution;
+}
+
+void
+RadialLineOfSightNode::setElevationResolution( double meters )
+{
+    if (_elevationResolution != meters)
+    {
+        _elevationResolution = osg::clampAbove(meters, 0.0);
+        if (_useElevationData)
+            compute(getNode());
+    }
+}
+
 osg::Node*
 RadialLineOfSightNode::getNode()
 {
@@ -224,32 +259,18 @@ void
 RadialLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "RadialLineOfSightNode::terrainChanged" << std::endl;
-    compute( getNode() );    
-}
 
-void
-RadialLineOfSightNode::compute(osg::Node* node )
-{
-    if (_fill)
+    // Elevation data doesn't change when terrain tiles page in and out
+    if (!_useElevationData)
     {
-        compute_fill( node );
-    }
-    else
-    {
-        compute_line( node );
+        compute( getNode() );
     }
 }
 
 void
-RadialLineOfSightNode::compute_line(osg::Node* node)
-{    
-    if ( !getMapNode() )
-        return;
-
-    GeoPoint centerMap;
-    _center.transform( getMapNode()->getMapSRS(), centerMap );
-    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
-
+RadialLineOfSightNode::initSpokes(std::vector<Spoke>& spokes)
+{
+    // Each spoke is a horizontal segment from the observer out to the radius.
     bool isProjected = getMapNode()->getMapSRS()->isProjected();
     osg::Vec3d up = isProjected ? osg::Vec3d(0,0,1) : osg::Vec3d(_centerWorld);
     up.normalize();
@@ -259,31 +280,45 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
 
     //Get the number of spokes
     double delta = osg::PI * 2.0 / (double)_numSpokes;
-    
-    osg::Geometry* geometry = new osg::Geometry;
-    geometry->setUseVertexBufferObjects(true);
 
-    osg::Vec3Array* verts = new osg::Vec3Array();
-    verts->reserve(_numSpokes * 5);
-    geometry->setVertexArray( verts );
+    spokes.resize(_numSpokes);
 
-    osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
-    colors->reserve( _numSpokes * 5 );
+    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    {
+        double angle = delta * (double)i;
+        osg::Quat quat(angle, up );
+        Spoke& spoke = spokes[i];
+        spoke.start = _centerWorld;
+        spoke.end = _centerWorld + quat * (side * _radius);
+        spoke.hasLOS = true;
+    }
+}
 
-    geometry->setColorArray( colors );
+bool
+RadialLineOfSightNode::computeSpokes(osg::Node* node, std::vector<Spoke>& spokes)
+{
+    GeoPoint centerMap;
+    _center.transform( getMapNode()->getMapSRS(), centerMap );
+    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
 
-    osg::Vec3d previousEnd;
-    osg::Vec3d firstEnd;
+    spokes.clear();
+
+    if (_useElevationData)
+    {
+        if (computeSpokesFromElevation( centerMap, spokes ))
+            return true;
+    }
+
+    if (!node)
+        return false;
+
+    initSpokes( spokes );
 
     osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
-        double angle = delta * (double)i;
-        osg::Quat quat(angle, up );
-        osg::Vec3d spoke = quat * (side * _radius);
-        osg::Vec3d end = _centerWorld + spoke;
-        osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, end );
+        osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( spokes[i].start, spokes[i].end );
         ivGroup->addIntersector( dplsi.get() );
     }
 
@@ -294,21 +329,109 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
-        osgUtil::LineSegmentIntersector* los = dynamic_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        if ( !los )
-            continue;
-
+        osgUtil::LineSegmentIntersector* los = static_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
         osgUtil::LineSegmentIntersector::Intersections& hits = los->getIntersections();
 
-        osg::Vec3d start = los->getStart();
-        osg::Vec3d end = los->getEnd();
+        Spoke& spoke = spokes[i];
+        spoke.hasLOS = hits.empty();
+        if (!spoke.hasLOS)
+        {
+            spoke.hit = hits.begin()->getWorldIntersectPoint();
+        }
+    }
+
+    return true;
+}
+
+bool
+RadialLineOfSightNode::computeSpokesFromElevation(const GeoPoint& centerMap, std::vector<Spoke>& spokes)
+{
+    Viewshed viewshed( getMapNode()->getMap() );
+    viewshed.setObserver( centerMap );
+    viewshed.setRadius( _radius );
+    viewshed.setResolution( _elevationResolution > 0.0 ? _elevationResolution : _radius / 128.0 );
+
+    Viewshed::Result result = viewshed.compute();
+    if (!result.valid())
+        return false;
 
-        osg::Vec3d hit;
-        bool hasLOS = hits.empty();
-        if (!hasLOS)
+    // The observer's altitude comes from the elevation data too.
+    result.getObserver().toWorld( _centerWorld );
+
+    // Same spokes as the intersector path; a spoke is blocked where the
+    // terrain first rises above it.
+    initSpokes( spokes );
+
+    const SpatialReference* mapSRS = getMapNode()->getMapSRS();
+    const int numSamples = osg::maximum(1, (int)ceil(_radius / result.getResolution()));
+
+    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    {
+        Spoke& spoke = spokes[i];
+
+        for (int s = 1; s <= numSamples; ++s)
         {
-            hit = hits.begin()->getWorldIntersectPoint();
+            osg::Vec3d world = spoke.start + (spoke.end - spoke.start) * ((double)s / (double)numSamples);
+            osg::Vec3d map;
+            float terrainZ;
+            if (mapSRS->transformFromWorld( world, map ) &&
+                result.getElevation( map, terrainZ ) &&
+                (double)terrainZ >= map.z())
+            {
+                spoke.hit = world;
+                spoke.hasLOS = false;
+                break;
+            }
         }
+    }
+
+    return true;
+}
+
+void
+RadialLineOfSightNode::compute(osg::Node* node )
+{
+    if (_fill)
+    {
+        compute_fill( node );
+    }
+    else
+    {
+        compute_line( node );
+    }
+}
+
+void
+RadialLineOfSightNode::compute_line(osg::Node* node)
+{    
+    if ( !getMapNode() )
+        return;
+
+    std::vector<Spoke> spokes;
+    if ( !computeSpokes( node, spokes ) )
+        return;
+
+    osg::Geometry* geometry = new osg::Geometry;
+    geometry->setUseVertexBufferObjects(true);
+
+    osg::Vec3Array* verts = new osg::Vec3Array();
+    verts->reserve(_numSpokes * 5);
+    geometry->setVertexArray( verts );
+
+    osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
+    colors->reserve( _numSpokes * 5 );
+
+    geometry->setColorArray( colors );
+
+    osg::Vec3d previousEnd;
+    osg::Vec3d firstEnd;
+
+    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    {
+        const osg::Vec3d& start = spokes[i].start;
+        const osg::Vec3d& end = spokes[i].end;
+        const osg::Vec3d& hit = spokes[i].hit;
+        bool hasLOS = spokes[i].hasLOS;
 
         if (hasLOS)
         {
@@ -390,21 +513,10 @@ RadialLineOfSightNode::compute_fill(osg::Node* node)
     if ( !getMapNode() )
         return;
 
-    GeoPoint centerMap;
-    _center.transform( getMapNode()->getMapSRS(), centerMap );
-    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
-
-    bool isProjected = getMapNode()->getMapSRS()->isProjected();
-
-    osg::Vec3d up = isProjected ? osg::Vec3d(0,0,1) : osg::Vec3d(_centerWorld);
-    up.normalize();
-
-    //Get the "side" vector
-    osg::Vec3d side = isProjected ? osg::Vec3d(1,0,0) : up ^ osg::Vec3d(0,0,1);
+    std::vector<Spoke> spokes;
+    if ( !computeSpokes( node, spokes ) )
+        return;
 
-    //Get the number of spokes
-    double delta = osg::PI * 2.0 / (double)_numSpokes;
-    
     osg::Geometry* geometry = new osg::Geometry;
     geometry->setUseVertexBufferObjects(true);
 
@@ -417,46 +529,20 @@ RadialLineOfSightNode::compute_fill(osg::Node* node)
 
     geometry->setColorArray( colors );
 
-    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
-
-    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
-    {
-        double angle = delta * (double)i;
-        osg::Quat quat(angle, up );
-        osg::Vec3d spoke = quat * (side * _radius);
-        osg::Vec3d end = _centerWorld + spoke;        
-        osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, end );
-        if (dplsi)
-            ivGroup->addIntersector( dplsi.get() );
-    }
-
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
-
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
         //Get the current hit
-        osgUtil::LineSegmentIntersector* los = dynamic_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        if ( !los )
-            continue;
-
-        osgUtil::LineSegmentIntersector::Intersections& hits = los->getIntersections();
-
-        osg::Vec3d currEnd = los->getEnd();
-        bool currHasLOS = hits.empty();
-        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : hits.begin()->getWorldIntersectPoint();
+        osg::Vec3d currEnd = spokes[i].end;
+        bool currHasLOS = spokes[i].hasLOS;
+        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : spokes[i].hit;
 
         //Get the next hit
         unsigned int nextIndex = i + 1;
         if (nextIndex == _numSpokes) nextIndex = 0;
-        osgUtil::LineSegmentIntersector* losNext = static_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[nextIndex].get());
-        osgUtil::LineSegmentIntersector::Intersections& hitsNext = losNext->getIntersections();
 
-        osg::Vec3d nextEnd = losNext->getEnd();
-        bool nextHasLOS = hitsNext.empty();
-        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : hitsNext.begin()->getWorldIntersectPoint();
+        osg::Vec3d nextEnd = spokes[nextIndex].end;
+        bool nextHasLOS = spokes[nextIndex].hasLOS;
+        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : spokes[nextIndex].hit;
         
         if (currHasLOS && nextHasLOS)
         {
@@ -23,6 +23,9 @@
 #include <osgEarth/LocalTangentPlane>
 #include <ogr_spatialref.h>
 #include <cpl_conv.h>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
 
 #define LC "[SpatialReference] "
 
@@ -72,6 +75,193 @@ namespace
         }
     }
 
+    // Built-in transformation kernels for the most common SRS pairs.
+    // These replicate PROJ's math (including its failure conditions and
+    // longitude wrapping) but run in a tight loop without any OGR overhead.
+
+    std::atomic<bool> s_useFastTransforms(true);
+
+    const double FAST_EPS10 = 1.0e-10;
+
+    // PROJ refuses transverse mercator coordinates with |eta| beyond this
+    const double FAST_TM_MAX_ETA = 2.623395162778;
+
+    // Wraps a longitude (radians) into [-PI, PI], same as PROJ's adjlon
+    inline double adjlon(double lon)
+    {
+        if (fabs(lon) < osg::PI + 1.0e-12)
+            return lon;
+        lon += osg::PI;
+        lon -= 2.0*osg::PI * floor(lon / (2.0*osg::PI));
+        lon -= osg::PI;
+        return lon;
+    }
+
+    bool geographicToSphericalMercator(double* x, double* y, unsigned count, double R)
+    {
+        bool ok = true;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lam = adjlon(osg::DegreesToRadians(x[i]));
+            double phi = osg::DegreesToRadians(y[i]);
+            if (fabs(phi) >= osg::PI_2 - FAST_EPS10)
+            {
+                x[i] = y[i] = HUGE_VAL;
+                ok = false;
+                continue;
+            }
+            x[i] = R * lam;
+            y[i] = R * log(tan(osg::PI_4 + 0.5*phi));
+        }
+        return ok;
+    }
+
+    bool sphericalMercatorToGeographic(double* x, double* y, unsigned count, double R)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lam = x[i] / R;
+            double phi = osg::PI_2 - 2.0*atan(exp(-y[i] / R));
+            x[i] = osg::RadiansToDegrees(adjlon(lam));
+            y[i] = osg::RadiansToDegrees(phi);
+        }
+        return true;
+    }
+
+    // Transverse mercator using the 6th order Krueger series
+    // (C.F.F. Karney, "Transverse Mercator with an accuracy of a few nanometers",
+    // J. Geodesy 85(8), 2011). This is the same algorithm PROJ uses for UTM.
+    struct TransverseMercator
+    {
+        double e, e2m, k0A, lon0, fe, fn;
+        double alpha[6], beta[6];
+
+        TransverseMercator(double a, double b, int zone, bool north)
+        {
+            double f = (a - b) / a;
+            double n = f / (2.0 - f);
+            double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+
+            e = sqrt(f * (2.0 - f));
+            e2m = 1.0 - e*e;
+            k0A = 0.9996 * a / (1.0 + n) * (1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+            lon0 = osg::DegreesToRadians(-183.0 + 6.0*(double)zone);
+            fe = 500000.0;
+            fn = north ? 0.0 : 10000000.0;
+
+            alpha[0] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0 + 41.0*n4/180.0 - 127.0*n5/288.0 + 7891.0*n6/37800.0;
+            alpha[1] = 13.0*n2/48.0 - 3.0*n3/5.0 + 557.0*n4/1440.0 + 281.0*n5/630.0 - 1983433.0*n6/1935360.0;
+            alpha[2] = 61.0*n3/240.0 - 103.0*n4/140.0 + 15061.0*n5/26880.0 + 167603.0*n6/181440.0;
+            alpha[3] = 49561.0*n4/161280.0 - 179.0*n5/168.0 + 6601661.0*n6/7257600.0;
+            alpha[4] = 34729.0*n5/80640.0 - 3418889.0*n6/1995840.0;
+            alpha[5] = 212378941.0*n6/319334400.0;
+
+            beta[0] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0 - n4/360.0 - 81.0*n5/512.0 + 96199.0*n6/604800.0;
+            beta[1] = n2/48.0 + n3/15.0 - 437.0*n4/1440.0 + 46.0*n5/105.0 - 1118711.0*n6/3870720.0;
+            beta[2] = 17.0*n3/480.0 - 37.0*n4/840.0 - 209.0*n5/4480.0 + 5569.0*n6/90720.0;
+            beta[3] = 4397.0*n4/161280.0 - 11.0*n5/504.0 - 830251.0*n6/7257600.0;
+            beta[4] = 4583.0*n5/161280.0 - 108847.0*n6/3991680.0;
+            beta[5] = 20648693.0*n6/638668800.0;
+        }
+
+        // conformal latitude (as tan) from geodetic latitude (as tan)
+        inline double taupf(double tau) const
+        {
+            double tau1 = sqrt(1.0 + tau*tau);
+            double sig = sinh(e * atanh(e * tau / tau1));
+            return sqrt(1.0 + sig*sig) * tau - sig * tau1;
+        }
+
+        // inverse of taupf by Newton's method; converges in 2-3 iterations
+        inline double tauf(double taup) const
+        {
+            double tau = taup / e2m;
+            for (int i = 0; i < 8; ++i)
+            {
+                double taupa = taupf(tau);
+                double dtau =
+                    (taup - taupa) * (1.0 + e2m*tau*tau) /
+                    (e2m * sqrt(1.0 + tau*tau) * sqrt(1.0 + taupa*taupa));
+                tau += dtau;
+                if (fabs(dtau) < 1.0e-14 * std::max(1.0, fabs(tau)))
+                    break;
+            }
+            return tau;
+        }
+
+        bool forward(double* x, double* y, unsigned count) const
+        {
+            bool ok = true;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double lam = adjlon(osg::DegreesToRadians(x[i]) - lon0);
+                double phi = osg::DegreesToRadians(y[i]);
+                if (fabs(phi) > osg::PI_2 + 1.0e-12)
+                {
+                    x[i] = y[i] = HUGE_VAL;
+                    ok = false;
+                    continue;
+                }
+
+                double taup = taupf(tan(phi));
+                double clam = cos(lam), slam = sin(lam);
+                double xip = atan2(taup, clam);
+                double etap = asinh(slam / sqrt(taup*taup + clam*clam));
+
+                double xi = xip, eta = etap;
+                for (int j = 0; j < 6; ++j)
+                {
+                    double k = 2.0*(double)(j+1);
+                    xi  += alpha[j] * sin(k*xip) * cosh(k*etap);
+                    eta += alpha[j] * cos(k*xip) * sinh(k*etap);
+                }
+
+                if (!(fabs(eta) <= FAST_TM_MAX_ETA))
+                {
+                    x[i] = y[i] = HUGE_VAL;
+                    ok = false;
+                    continue;
+                }
+
+                x[i] = k0A * eta + fe;
+                y[i] = k0A * xi + fn;
+            }
+            return ok;
+        }
+
+        bool inverse(double* x, double* y, unsigned count) const
+        {
+            bool ok = true;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double xi = (y[i] - fn) / k0A;
+                double eta = (x[i] - fe) / k0A;
+                if (!(fabs(eta) <= FAST_TM_MAX_ETA))
+                {
+                    x[i] = y[i] = HUGE_VAL;
+                    ok = false;
+                    continue;
+                }
+
+                double xip = xi, etap = eta;
+                for (int j = 0; j < 6; ++j)
+                {
+                    double k = 2.0*(double)(j+1);
+                    xip  -= beta[j] * sin(k*xi) * cosh(k*eta);
+                    etap -= beta[j] * cos(k*xi) * sinh(k*eta);
+                }
+
+                double sxip = sin(xip), cxip = cos(xip), shetap = sinh(etap);
+                double taup = sxip / sqrt(shetap*shetap + cxip*cxip);
+                double lam = atan2(shetap, cxip);
+
+                x[i] = osg::RadiansToDegrees(adjlon(lam + lon0));
+                y[i] = osg::RadiansToDegrees(atan(tauf(taup)));
+            }
+            return ok;
+        }
+    };
+
     // Make a MatrixTransform suitable for use with a Locator object based on the given extents.
     // Calling Locator::setTransformAsExtents doesn't work with OSG 2.6 due to the fact that the
     // _inverse member isn't updated properly.  Calling Locator::setTransform works correctly.
@@ -154,7 +344,10 @@ SpatialReference::SpatialReference(void* handle) :
     _is_spherical_mercator(false),
     _ellipsoidId(0u),
     _local("OE.SRS.Local"),
-    _mutex("OE.SRS")
+    _mutex("OE.SRS"),
+    _fastKind(FAST_NONE),
+    _utmZone(0),
+    _utmNorth(true)
 {
     _setup.srcHandle = handle;
 
@@ -175,7 +368,10 @@ SpatialReference::SpatialReference(const Key& key) :
     _is_spherical_mercator(false),
     _ellipsoidId(0u),
     _local("OE.SRS.Local"),
-    _mutex("OE.SRS")
+    _mutex("OE.SRS"),
+    _fastKind(FAST_NONE),
+    _utmZone(0),
+    _utmNorth(true)
 {
     // shortcut for spherical-mercator:
     // https://wiki.openstreetmap.org/wiki/EPSG:3857
@@ -396,6 +592,18 @@ SpatialReference::createFromHandle(void* ogrHandle)
     return new SpatialReference(ogrHandle);
 }
 
+void
+SpatialReference::setUseFastTransforms(bool value)
+{
+    s_useFastTransforms = value;
+}
+
+bool
+SpatialReference::getUseFastTransforms()
+{
+    return s_useFastTransforms;
+}
+
 #if 0
 SpatialReference*
 SpatialReference::fixWKT()
@@ -1043,6 +1251,11 @@ SpatialReference::transformXYPointArrays(
     if (!valid())
         return false;
 
+    // Use a built-in kernel if we have one for this SRS pair:
+    bool fastSuccess;
+    if (transformXYPointArraysFast(x, y, count, out_srs, fastSuccess))
+        return fastSuccess;
+
     // Transform the X and Y values inside an exclusive GDAL/OGR lock
     optional<TransformInfo>& xform = local._xformCache[out_srs->getWKT()];
     if (!xform.isSet())
@@ -1078,6 +1291,64 @@ SpatialReference::transformXYPointArrays(
 }
 
 
+bool
+SpatialReference::hasFastTransform(const SpatialReference* out_srs) const
+{
+    bool ok;
+    return out_srs != nullptr && transformXYPointArraysFast(nullptr, nullptr, 0u, out_srs, ok);
+}
+
+bool
+SpatialReference::transformXYPointArraysFast(
+    double*  x,
+    double*  y,
+    unsigned count,
+    const SpatialReference* out_srs,
+    bool& out_success) const
+{
+    if (_fastKind == FAST_NONE || out_srs->_fastKind == FAST_NONE || !s_useFastTransforms)
+        return false;
+
+    if (_fastKind == FAST_GEOGRAPHIC && out_srs->_fastKind == FAST_SPHERICAL_MERCATOR &&
+        _datum == "wgs_1984")
+    {
+        out_success = geographicToSphericalMercator(x, y, count, out_srs->getEllipsoid()->getRadiusEquator());
+        return true;
+    }
+
+    if (_fastKind == FAST_SPHERICAL_MERCATOR && out_srs->_fastKind == FAST_GEOGRAPHIC &&
+        out_srs->_datum == "wgs_1984")
+    {
+        out_success = sphericalMercatorToGeographic(x, y, count, getEllipsoid()->getRadiusEquator());
+        return true;
+    }
+
+    // UTM <-> geographic requires a common datum so there's no datum shift
+    if (_datum.empty() || _datum != out_srs->_datum || _ellipsoidId != out_srs->_ellipsoidId)
+        return false;
+
+    if (_fastKind == FAST_GEOGRAPHIC && out_srs->_fastKind == FAST_UTM)
+    {
+        TransverseMercator tm(
+            getEllipsoid()->getRadiusEquator(), getEllipsoid()->getRadiusPolar(),
+            out_srs->_utmZone, out_srs->_utmNorth);
+        out_success = tm.forward(x, y, count);
+        return true;
+    }
+
+    if (_fastKind == FAST_UTM && out_srs->_fastKind == FAST_GEOGRAPHIC)
+    {
+        TransverseMercator tm(
+            getEllipsoid()->getRadiusEquator(), getEllipsoid()->getRadiusPolar(),
+            _utmZone, _utmNorth);
+        out_success = tm.inverse(x, y, count);
+        return true;
+    }
+
+    return false;
+}
+
+
 bool
 SpatialReference::transformZ(std::vector<osg::Vec3d>& points,
                              const SpatialReference*  outputSRS,
@@ -1097,50 +1368,38 @@ SpatialReference::transformZ(std::vector<osg::Vec3d>& points,
     Units inUnits = _vdatum.valid() ? _vdatum->getUnits() : Units::METERS;
     Units outUnits = outVDatum ? outVDatum->getUnits() : inUnits;
 
-    if ( isGeographic() || pointsAreLatLong )
-    {
-        for( unsigned i=0; i<points.size(); ++i )
-        {
-            if ( _vdatum.valid() )
-            {
-                // to HAE:
-                points[i].z() = _vdatum->msl2hae( points[i].y(), points[i].x(), points[i].z() );
-            }
-
-            // do the units conversion:
-            points[i].z() = inUnits.convertTo(outUnits, points[i].z());
-
-            if ( outVDatum )
-            {
-                // to MSL:
-                points[i].z() = outVDatum->hae2msl( points[i].y(), points[i].x(), points[i].z() );
-            }
-        }
-    }
+    if ( points.empty() )
+        return true;
 
-    else // need to xform input points
+    // copy the points and convert them to geographic coordinates (lat/long with the same Z)
+    // if necessary, so we can look up the geoid offsets:
+    std::vector<osg::Vec3d> geopoints;
+    if ( !isGeographic() && !pointsAreLatLong )
     {
-        // copy the points and convert them to geographic coordinates (lat/long with the same Z):
-        std::vector<osg::Vec3d> geopoints(points);
+        geopoints = points;
         transform( geopoints, getGeographicSRS() );
+    }
+    const osg::Vec3d* geo = geopoints.empty() ? &points[0] : &geopoints[0];
+    unsigned count = points.size();
 
-        for( unsigned i=0; i<geopoints.size(); ++i )
-        {
-            if ( _vdatum.valid() )
-            {
-                // to HAE:
-                points[i].z() = _vdatum->msl2hae( geopoints[i].y(), geopoints[i].x(), points[i].z() );
-            }
+    if ( _vdatum.valid() )
+    {
+        // to HAE:
+        _vdatum->msl2hae( geo, &points[0], count );
+    }
 
-            // do the units conversion:
-            points[i].z() = inUnits.convertTo(outUnits, points[i].z());
+    // do the units conversion:
+    if ( inUnits != outUnits )
+    {
+        double scale = inUnits.convertTo(outUnits, 1.0);
+        for( unsigned i=0; i<count; ++i )
+            points[i].z() *= scale;
+    }
 
-            if ( outVDatum )
-            {
-                // to MSL:
-                points[i].z() = outVDatum->hae2msl( geopoints[i].y(), geopoints[i].x(), points[i].z() );
-            }
-        }
+    if ( outVDatum )
+    {
+        // to MSL:
+        outVDatum->hae2msl( geo, &points[0], count );
     }
 
     return true;
@@ -1543,12 +1802,51 @@ SpatialReference::init()
     }
 
     int isNorth;
-    if (OSRGetUTMZone(handle, &isNorth))
+    int utmZone = OSRGetUTMZone(handle, &isNorth);
+    if (utmZone)
     {
         if (isNorth)
             _bounds.set(166000, 0, 834000, 9330000);
         else
             _bounds.set(166000, 1116915, 834000, 10000000);
     }
+
+    // See whether one of the built-in transformation kernels can handle this SRS.
+    _fastKind = FAST_NONE;
+    if (_is_cube || _is_ltp || isGeocentric())
+    {
+        // custom handling; leave it alone
+    }
+    else if (isGeographic())
+    {
+        if (osg::equivalent(OSRGetAngularUnits(handle, nullptr), osg::PI/180.0, 1e-12) &&
+            OSRGetPrimeMeridian(handle, nullptr) == 0.0)
+        {
+            _fastKind = FAST_GEOGRAPHIC;
+        }
+    }
+    else if (_is_spherical_mercator)
+    {
+        // nadgrids=@null means lat/long pass through without a datum shift.
+        // Check the init string too in case the PROJ export dropped it.
+        OGRErr e;
+        if ((_proj4.find("+nadgrids=@null") != std::string::npos ||
+             _setup.horiz.find("+nadgrids=@null") != std::string::npos) &&
+            _reportedLinearUnits == 1.0 &&
+            OSRGetProjParm(handle, SRS_PP_CENTRAL_MERIDIAN, 0.0, &e) == 0.0 &&
+            OSRGetProjParm(handle, SRS_PP_FALSE_EASTING, 0.0, &e) == 0.0 &&
+            OSRGetProjParm(handle, SRS_PP_FALSE_NORTHING, 0.0, &e) == 0.0 &&
+            OSRGetProjParm(handle, SRS_PP_SCALE_FACTOR, 1.0, &e) == 1.0 &&
+            OSRGetProjParm(handle, SRS_PP_STANDARD_PARALLEL_1, 0.0, &e) == 0.0)
+        {
+            _fastKind = FAST_SPHERICAL_MERCATOR;
+        }
+    }
+    else if (utmZone > 0 && utmZone <= 60 && _reportedLinearUnits == 1.0)
+    {
+        _fastKind = FAST_UTM;
+        _utmZone = utmZone;
+        _utmNorth = (isNorth != 0);
+    }
 }
 
@@ -90,10 +90,8 @@ StyleSheet::Options::fromConfig(const Config& conf)
 
     // read in any resource library references
     _libraries.clear();
-    ConfigSet librariesConf = conf.children("library");
-    for (ConfigSet::iterator i = librariesConf.begin(); i != librariesConf.end(); ++i)
+    for (const Config& libConf : conf.children_view("library"))
     {
-        const Config& libConf = *i;
         ResourceLibrary* resLib = new ResourceLibrary(libConf);
         if (resLib && libConf.value("name").empty() == false)
             resLib->setName(libConf.value("name"));
@@ -132,22 +130,17 @@ StyleSheet::Options::fromConfig(const Config& conf)
 
     // read any style class definitions. either "class" or "selector" is allowed
     _selectors.clear();
-    ConfigSet selectors = conf.children("selector");
-    for (ConfigSet::iterator i = selectors.begin(); i != selectors.end(); ++i)
+    for (const Config& selectorConf : conf.children_view("selector"))
     {
-        StyleSelector s(*i);
+        StyleSelector s(selectorConf);
         std::string unique = Stringify() << s.name().get() << ":" << s.styleName().get();
         _selectors[unique] = s;
     }
 
     // read in the actual styles
     _styles.clear();
-    ConfigSet stylesConf = conf.children("style");
-    for (ConfigSet::iterator i = stylesConf.begin();
-        i != stylesConf.end();
-        ++i)
+    for (const Config& styleConf : conf.children_view("style"))
     {
-        const Config& styleConf = *i;
 
         if (styleConf.value("type") == "text/css")
         {
@@ -32,6 +32,7 @@
 #include <osg/ShapeDrawable>
 #include <osg/PolygonMode>
 #include <osgEarth/LineDrawable>
+#include <unordered_set>
 
 using namespace osgEarth;
 using namespace osgEarth::Threading;
@@ -568,6 +569,87 @@ namespace
         return node;
     }
 
+    // Estimates the memory used by a tile's content: vertex data,
+    // primitive sets, and texture images. Shared objects count once.
+    struct ContentSizeVisitor : public osg::NodeVisitor
+    {
+        std::size_t _bytes;
+        std::unordered_set<const osg::Object*> _seen;
+
+        ContentSizeVisitor() :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+            _bytes(0u) { }
+
+        bool firstTime(const osg::Object* object)
+        {
+            return object && _seen.insert(object).second;
+        }
+
+        void add(const osg::Array* array)
+        {
+            if (firstTime(array))
+                _bytes += array->getTotalDataSize();
+        }
+
+        void apply(osg::StateSet* stateSet)
+        {
+            if (!firstTime(stateSet))
+                return;
+
+            for (unsigned unit = 0; unit < stateSet->getNumTextureAttributeLists(); ++unit)
+            {
+                const osg::Texture* texture = dynamic_cast<const osg::Texture*>(
+                    stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+
+                if (!firstTime(texture))
+                    continue;
+
+                for (unsigned i = 0; i < texture->getNumImages(); ++i)
+                {
+                    const osg::Image* image = texture->getImage(i);
+                    if (!firstTime(image))
+                        continue;
+
+                    if (image->data())
+                        _bytes += image->getTotalSizeInBytesIncludingMipmaps();
+                    else
+                        _bytes += (std::size_t)image->s() * (std::size_t)image->t() * 4u;
+                }
+            }
+        }
+
+        void apply(osg::Node& node) override
+        {
+            apply(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable) override
+        {
+            apply(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                add(geom->getVertexArray());
+                add(geom->getNormalArray());
+                add(geom->getColorArray());
+                add(geom->getSecondaryColorArray());
+                add(geom->getFogCoordArray());
+                for (unsigned i = 0; i < geom->getNumTexCoordArrays(); ++i)
+                    add(geom->getTexCoordArray(i));
+                for (unsigned i = 0; i < geom->getNumVertexAttribArrays(); ++i)
+                    add(geom->getVertexAttribArray(i));
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                {
+                    const osg::PrimitiveSet* primSet = geom->getPrimitiveSet(i);
+                    if (firstTime(primSet))
+                        _bytes += primSet->getTotalDataSize();
+                }
+            }
+        }
+    };
+
     AsyncTileJob::Result readTileContentAsync(
         const URI& uri,
         osg::ref_ptr<const osgDB::Options> options)
@@ -598,7 +680,12 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
     _options(options),
     _trackerItrValid(false),
     _lastCulledFrameNumber(0),
-    _lastCulledFrameTime(0.0f)
+    _lastCulledFrameTime(0.0f),
+    _contentBytes(0u),
+    _requestFrameNumber(0u),
+    _requestSSE(0.0),
+    _requestDistance(0.0),
+    _requestQueued(false)
 {
     OE_PROFILING_ZONE;
     if (_tile->content().isSet())
@@ -894,21 +981,61 @@ void ThreeDTileNode::resolveContent()
 
             _tileset->runPreMergeOperations(_content.get());
             _tileset->runPostMergeOperations(_content.get());
+
+            // Track the size of the content so the tileset can enforce its
+            // memory budget. (Immediately loaded tiles never expire.)
+            if (!_immediateLoad)
+            {
+                ContentSizeVisitor sizer;
+                _content->accept(sizer);
+                _contentBytes = sizer._bytes;
+                _tileset->addContentBytes(_contentBytes);
+            }
         }
     }
 }
 
 
-void ThreeDTileNode::requestContent(ICO* ico)
+void ThreeDTileNode::requestContent(ICO* ico, osgUtil::CullVisitor* cv)
+{
+    if (!_content.valid() && hasContent())
+    {
+        // no request limit: load right away, same as always
+        if (_tileset->getMaxActiveRequests() == 0u)
+        {
+            _requestICO = ico;
+            dispatchContentRequest();
+            return;
+        }
+
+        double sse = DBL_MAX;
+        double distance = 0.0;
+        unsigned int frameNumber = 0u;
+
+        if (cv)
+        {
+            sse = computeScreenSpaceError(cv);
+            distance = getDistanceToTile(cv);
+            frameNumber = cv->getFrameStamp()->getFrameNumber();
+        }
+
+        _tileset->queueContentRequest(this, ico, sse, distance, frameNumber);
+    }
+}
+
+void ThreeDTileNode::dispatchContentRequest()
 {
     if (!_content.valid() && !_requestedContent && hasContent())
     {
         // if there's an ICO, install it:
+        osg::ref_ptr<ICO> ico;
+        _requestICO.lock(ico);
+
         osg::ref_ptr<osgDB::Options> localOptions;
-        if (ico)
+        if (ico.valid())
         {
             localOptions = Registry::instance()->cloneOrCreateOptions(_options.get());
-            OptionsData<ICO>::set(localOptions.get(), ico);
+            OptionsData<ICO>::set(localOptions.get(), ico.get());
         }
         else
         {
@@ -940,6 +1067,15 @@ void ThreeDTileNode::requestContent(ICO* ico)
     }
 }
 
+void ThreeDTileNode::cancelContentRequest()
+{
+    if (!_content.valid() && _requestedContent)
+    {
+        _contentFuture.abandon();
+        _requestedContent = false;
+    }
+}
+
 double ThreeDTileNode::getDistanceToTile(osgUtil::CullVisitor* cv)
 {
     osg::BoundingSphere bs = _localBoundingSphere;
@@ -979,6 +1115,7 @@ bool ThreeDTileNode::unloadContent()
         _content = nullptr;
     }
 
+    _contentBytes = 0u;
     _firstVisit = true;
     _content = 0;
     _requestedContent = false;
@@ -1070,7 +1207,7 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
         }
 
         // This allows nodes to reload themselves
-        requestContent(ico);
+        requestContent(ico, cv);
         resolveContent();
 
         // Compute the SSE
@@ -1091,7 +1228,7 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
                     // Can we traverse the child?
                     if (childTile->hasContent() && !childTile->isContentReady())
                     {
-                        childTile->requestContent(ico);
+                        childTile->requestContent(ico, cv);
                         areChildrenReady = false;
                     }
                 }
@@ -1200,6 +1337,9 @@ ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& author
     _showBoundingVolumes(false),
     _showColorPerTile(false),
     _maxAge(5.0f),
+    _maxBytes(0u),
+    _totalBytes(0u),
+    _maxActiveRequests(0u),
     _lastExpiredFrame(0),
     _authorizationHeader(authorizationHeader),
     _sgCallbacks(sceneGraphCallbacks),
@@ -1218,6 +1358,13 @@ ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& author
         setMaxAge((float)atof(c));
     }
 
+    // memory budget in MB
+    c = ::getenv("OSGEARTH_3DTILES_MEMORY_BUDGET");
+    if (c)
+    {
+        setMaxBytes((std::size_t)atoi(c) * 1048576u);
+    }
+
     _tracker.push_back(0);
     // Pointer to last element
     _sentryItr = --_tracker.end();
@@ -1268,6 +1415,32 @@ void ThreeDTilesetNode::setMaxTiles(unsigned int maxTiles)
     _maxTiles = maxTiles;
 }
 
+std::size_t ThreeDTilesetNode::getMaxBytes() const
+{
+    return _maxBytes;
+}
+
+void ThreeDTilesetNode::setMaxBytes(std::size_t maxBytes)
+{
+    _maxBytes = maxBytes;
+}
+
+std::size_t ThreeDTilesetNode::getTotalBytes() const
+{
+    ScopedMutexLock lock(_mutex);
+    return _totalBytes;
+}
+
+unsigned int ThreeDTilesetNode::getMaxActiveRequests() const
+{
+    return _maxActiveRequests;
+}
+
+void ThreeDTilesetNode::setMaxActiveRequests(unsigned int maxActiveRequests)
+{
+    _maxActiveRequests = maxActiveRequests;
+}
+
 float ThreeDTilesetNode::getMaxAge() const
 {
     return _maxAge;
@@ -1365,6 +1538,99 @@ void ThreeDTilesetNode::touchTile(ThreeDTileNode* node)
     node->_trackerItr = --_tracker.end();
 }
 
+void ThreeDTilesetNode::addContentBytes(std::size_t bytes)
+{
+    ScopedMutexLock lock(_mutex);
+    _totalBytes += bytes;
+}
+
+void ThreeDTilesetNode::queueContentRequest(
+    ThreeDTileNode* tile,
+    ICO* ico,
+    double sse,
+    double distance,
+    unsigned int frameNumber)
+{
+    ScopedMutexLock lock(_mutex);
+
+    // Multiple views may request the same tile in one frame;
+    // keep the most urgent priority.
+    if (tile->_requestFrameNumber != frameNumber)
+    {
+        tile->_requestFrameNumber = frameNumber;
+        tile->_requestSSE = sse;
+        tile->_requestDistance = distance;
+    }
+    else
+    {
+        tile->_requestSSE = osg::maximum(tile->_requestSSE, sse);
+        tile->_requestDistance = osg::minimum(tile->_requestDistance, distance);
+    }
+
+    // already loading? the frame number above keeps it alive.
+    if (tile->_requestedContent || tile->_requestQueued)
+        return;
+
+    tile->_requestQueued = true;
+    tile->_requestICO = ico;
+    _pendingRequests.push_back(tile);
+}
+
+void ThreeDTilesetNode::dispatchContentRequests(const osg::NodeVisitor& nv)
+{
+    OE_PROFILING_ZONE;
+
+    unsigned int frameNumber = nv.getFrameStamp()->getFrameNumber();
+
+    ScopedMutexLock lock(_mutex);
+
+    // Retire finished requests, and cancel the ones for tiles that
+    // nobody asked for during the last cull (they left the view).
+    for (auto i = _activeRequests.begin(); i != _activeRequests.end(); )
+    {
+        ThreeDTileNode* tile = i->get();
+        if (!tile->_requestedContent || tile->_content.valid() || tile->_contentFuture.isAvailable())
+        {
+            i = _activeRequests.erase(i);
+        }
+        else if (tile->_requestFrameNumber + 1u < frameNumber)
+        {
+            tile->cancelContentRequest();
+            i = _activeRequests.erase(i);
+        }
+        else ++i;
+    }
+
+    // Highest screen-space error first, then nearest first.
+    std::sort(
+        _pendingRequests.begin(), _pendingRequests.end(),
+        [](const osg::ref_ptr<ThreeDTileNode>& lhs, const osg::ref_ptr<ThreeDTileNode>& rhs)
+        {
+            if (lhs->_requestSSE > rhs->_requestSSE) return true;
+            if (lhs->_requestSSE < rhs->_requestSSE) return false;
+            return lhs->_requestDistance < rhs->_requestDistance;
+        });
+
+    for (auto& tile : _pendingRequests)
+    {
+        tile->_requestQueued = false;
+
+        if ((_maxActiveRequests == 0u || _activeRequests.size() < _maxActiveRequests) &&
+            tile->_requestFrameNumber + 1u >= frameNumber)
+        {
+            tile->dispatchContentRequest();
+            if (tile->_requestedContent)
+            {
+                _activeRequests.push_back(tile);
+            }
+        }
+    }
+
+    // Anything not dispatched gets queued again by the next cull
+    // if it's still needed.
+    _pendingRequests.clear();
+}
+
 void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
 {
     OE_PROFILING_ZONE;
@@ -1384,15 +1650,19 @@ void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
 
     unsigned int numErased = 0;
     unsigned int numSkipped = 0;
-    while (_tracker.size() > _maxTiles && itr != _sentryItr)
+    // With a memory budget, expire least-recently-used tiles until the
+    // content fits; otherwise fall back on the tile count.
+    while ((_maxBytes > 0u ? _totalBytes > _maxBytes : _tracker.size() > _maxTiles) && itr != _sentryItr)
     {
         osg::ref_ptr< ThreeDTileNode > tile = dynamic_cast<ThreeDTileNode*>(itr->get());
         if (tile.valid())
         {
             float age = frameTime - tile->getLastCulledFrameTime();
             bool canUnload = age >= _maxAge;
+            std::size_t bytes = tile->getContentSizeInBytes();
             if (canUnload && tile->unloadContent())
             {
+                _totalBytes -= osg::minimum(bytes, _totalBytes);
                 tile->_trackerItrValid = false;
                 itr = _tracker.erase(itr);
                 ++numErased;
@@ -1445,6 +1715,12 @@ void ThreeDTilesetNode::traverse(osg::NodeVisitor& nv)
 		double fovy, ar, zn, zf;
 		proj.getPerspective(fovy, ar, zn, zf);
 		_sseDenominator = 2.0 * tan(0.5 * osg::DegreesToRadians(fovy));
+
+        osg::Group::traverse(nv);
+
+        // Dispatch what this cull queued, so loading starts this frame
+        dispatchContentRequests(nv);
+        return;
 	}
 
     osg::Group::traverse(nv);
@@ -18,7 +18,13 @@
  */
 
 #include <osgEarth/Terrain>
+#include <osgEarth/Elevation>
+#include <osgEarth/Profile>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/Metrics>
 #include <osgViewer/View>
+#include <cfloat>
+#include <algorithm>
 
 #define LC "[Terrain] "
 
@@ -61,10 +67,121 @@ void Terrain::onTileUpdateOperation::operator()(osg::Object*)
 
 //---------------------------------------------------------------------------
 
+// Elevation grid of one loaded terrain tile, indexed for ray casting by a
+// min/max height pyramid. Level 0 has one cell per quad of height samples;
+// each subsequent level halves the resolution down to a single cell.
+struct Terrain::ElevationTile
+{
+    struct Level
+    {
+        unsigned cols, rows;
+        unsigned span; // number of level-0 cells per cell side
+        std::vector<float> minH, maxH;
+    };
+
+    osg::observer_ptr<ElevationTexture> _texture;
+    osg::ref_ptr<const osg::HeightField> _hf;
+    double _xmin, _ymin, _xmax, _ymax;
+    double _dx, _dy;
+    unsigned _cols, _rows;
+    double _cellSizeMeters;
+    std::vector<Level> _levels;
+
+    ElevationTile(ElevationTexture* texture, const osg::HeightField* hf, const SpatialReference* srs);
+
+    inline float sample(unsigned c, unsigned r) const {
+        float h = _hf->getHeight(c, r);
+        return h == NO_DATA_VALUE ? 0.0f : h;
+    }
+
+    //! Bilinearly interpolated height at map coordinates
+    float getHeight(double x, double y) const;
+
+    //! Highest height in the tile
+    float getMaxHeight() const { return _levels.back().maxH[0]; }
+};
+
+Terrain::ElevationTile::ElevationTile(ElevationTexture* texture, const osg::HeightField* hf, const SpatialReference* srs) :
+    _texture(texture),
+    _hf(hf)
+{
+    const GeoExtent& ex = texture->getExtent();
+    _xmin = ex.xMin(), _ymin = ex.yMin(), _xmax = ex.xMax(), _ymax = ex.yMax();
+    _cols = hf->getNumColumns(), _rows = hf->getNumRows();
+    _dx = ex.width() / (double)(_cols - 1);
+    _dy = ex.height() / (double)(_rows - 1);
+
+    _cellSizeMeters = osg::minimum(_dx, _dy);
+    if (srs->isGeographic())
+    {
+        double lat = osg::clampBetween(0.5*(_ymin + _ymax), -89.0, 89.0);
+        _cellSizeMeters = srs->getEllipsoid()->getRadiusEquator() * osg::DegreesToRadians(
+            osg::minimum(_dx*cos(osg::DegreesToRadians(lat)), _dy));
+    }
+
+    // finest level: min/max of the four corners of each sample quad
+    Level level;
+    level.cols = _cols - 1, level.rows = _rows - 1, level.span = 1u;
+    level.minH.resize(level.cols*level.rows);
+    level.maxH.resize(level.cols*level.rows);
+    for (unsigned r = 0; r < level.rows; ++r)
+    {
+        for (unsigned c = 0; c < level.cols; ++c)
+        {
+            float a = sample(c, r), b = sample(c + 1, r), d = sample(c, r + 1), e = sample(c + 1, r + 1);
+            level.minH[r*level.cols + c] = osg::minimum(osg::minimum(a, b), osg::minimum(d, e));
+            level.maxH[r*level.cols + c] = osg::maximum(osg::maximum(a, b), osg::maximum(d, e));
+        }
+    }
+    _levels.emplace_back(std::move(level));
+
+    // coarser levels, each cell covering 2x2 cells of the level below
+    while (_levels.back().cols > 1 || _levels.back().rows > 1)
+    {
+        const Level& prev = _levels.back();
+        Level next;
+        next.cols = (prev.cols + 1) / 2, next.rows = (prev.rows + 1) / 2, next.span = prev.span * 2u;
+        next.minH.resize(next.cols*next.rows, FLT_MAX);
+        next.maxH.resize(next.cols*next.rows, -FLT_MAX);
+        for (unsigned r = 0; r < prev.rows; ++r)
+        {
+            for (unsigned c = 0; c < prev.cols; ++c)
+            {
+                unsigned i = (r / 2)*next.cols + (c / 2);
+                next.minH[i] = osg::minimum(next.minH[i], prev.minH[r*prev.cols + c]);
+                next.maxH[i] = osg::maximum(next.maxH[i], prev.maxH[r*prev.cols + c]);
+            }
+        }
+        _levels.emplace_back(std::move(next));
+    }
+}
+
+float
+Terrain::ElevationTile::getHeight(double x, double y) const
+{
+    double u = osg::clampBetween((x - _xmin) / _dx, 0.0, (double)(_cols - 1));
+    double v = osg::clampBetween((y - _ymin) / _dy, 0.0, (double)(_rows - 1));
+    unsigned c = osg::minimum((unsigned)u, _cols - 2);
+    unsigned r = osg::minimum((unsigned)v, _rows - 2);
+    double fu = u - (double)c, fv = v - (double)r;
+    double h0 = sample(c, r)*(1.0 - fu) + sample(c + 1, r)*fu;
+    double h1 = sample(c, r + 1)*(1.0 - fu) + sample(c + 1, r + 1)*fu;
+    return (float)(h0*(1.0 - fv) + h1*fv);
+}
+
+//---------------------------------------------------------------------------
+
 Terrain::Terrain(osg::Node* graph, const Profile* mapProfile) :
 _graph         ( graph ),
 _profile       ( mapProfile ),
-_callbacksMutex(OE_MUTEX_NAME)
+_callbacksMutex(OE_MUTEX_NAME),
+_callbacksSize(0),
+_callbacksInvoked(0u),
+_callbacksInvokedLastFrame(0u),
+_elevationTilesMutex(OE_MUTEX_NAME),
+_elevationTilesMaxLOD(-1),
+_elevationTilesMaxHeight(0.0),
+_elevationTilesUpdates(0u)
 {
     _updateQueue = new osg::OperationQueue();
 }
@@ -73,6 +190,10 @@ void
 Terrain::update()
 {
     _updateQueue->runOperations();
+
+    _callbacksInvokedLastFrame = _callbacksInvoked;
+    _callbacksInvoked = 0u;
+    OE_PROFILING_PLOT("Terrain callbacks", (float)_callbacksInvokedLastFrame);
 }
 
 bool
@@ -215,6 +336,396 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d&
     return good;
 }
 
+void
+Terrain::notifyElevationTileUpdate(const TileKey& key, ElevationTexture* texture)
+{
+    if (!key.valid())
+        return;
+
+    // Build the index outside the lock; this runs during the merge
+    std::shared_ptr<ElevationTile> tile;
+    if (texture && texture->getHeightField() &&
+        texture->getHeightField()->getNumColumns() > 1 &&
+        texture->getHeightField()->getNumRows() > 1)
+    {
+        tile = std::make_shared<ElevationTile>(texture, texture->getHeightField(), getSRS());
+    }
+
+    Threading::ScopedWriteLock exclusiveLock(_elevationTilesMutex);
+
+    if (tile)
+    {
+        _elevationTiles[key] = tile;
+        _elevationTilesMaxHeight = osg::maximum(_elevationTilesMaxHeight, (double)tile->getMaxHeight());
+        if ((int)key.getLOD() > _elevationTilesMaxLOD)
+            _elevationTilesMaxLOD = key.getLOD();
+    }
+    else
+    {
+        _elevationTiles.erase(key);
+    }
+
+    // Periodically discard entries whose textures have expired
+    if (++_elevationTilesUpdates % 256u == 0u)
+    {
+        for (ElevationTiles::iterator i = _elevationTiles.begin(); i != _elevationTiles.end(); )
+        {
+            if (!i->second->_texture.valid())
+                i = _elevationTiles.erase(i);
+            else
+                ++i;
+        }
+    }
+}
+
+bool
+Terrain::hasElevationData() const
+{
+    Threading::ScopedReadLock sharedLock(_elevationTilesMutex);
+    return !_elevationTiles.empty();
+}
+
+unsigned
+Terrain::getHeights(const std::vector<osg::Vec3d>& points,
+                    std::vector<float>&            out_heights) const
+{
+    out_heights.assign(points.size(), NO_DATA_VALUE);
+
+    const Profile* profile = getProfile();
+    if (!profile || points.empty())
+        return 0u;
+
+    unsigned count = 0u;
+
+    Threading::ScopedReadLock sharedLock(_elevationTilesMutex);
+
+    const int maxLOD = _elevationTilesMaxLOD;
+    if (maxLOD < 0)
+        return 0u;
+
+    // Consecutive points usually fall in the same tile, so remember the
+    // deepest-LOD key of the last search and reuse its result.
+    TileKey lastKey;
+    const ElevationTile* lastTile = nullptr;
+
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        const osg::Vec3d& p = points[i];
+
+        TileKey key = profile->createTileKey(p.x(), p.y(), maxLOD);
+        if (!key.valid())
+            continue;
+
+        if (!lastKey.valid() ||
+            key.getTileX() != lastKey.getTileX() ||
+            key.getTileY() != lastKey.getTileY())
+        {
+            lastKey = key;
+            lastTile = nullptr;
+
+            for (; key.valid(); key = key.createParentKey())
+            {
+                ElevationTiles::const_iterator t = _elevationTiles.find(key);
+                if (t != _elevationTiles.end() && t->second->_texture.valid())
+                {
+                    lastTile = t->second.get();
+                    break;
+                }
+            }
+        }
+
+        if (lastTile)
+        {
+            out_heights[i] = lastTile->getHeight(p.x(), p.y());
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+std::shared_ptr<Terrain::ElevationTile>
+Terrain::getElevationTile(double x, double y) const
+{
+    Threading::ScopedReadLock sharedLock(_elevationTilesMutex);
+
+    // deepest loaded tile containing the point:
+    for (int lod = _elevationTilesMaxLOD; lod >= 0; --lod)
+    {
+        TileKey key = getProfile()->createTileKey(x, y, lod);
+        if (!key.valid())
+            break;
+
+        ElevationTiles::const_iterator i = _elevationTiles.find(key);
+        if (i != _elevationTiles.end() && i->second->_texture.valid())
+            return i->second;
+    }
+    return nullptr;
+}
+
+bool
+Terrain::intersectRay(Ray& ray) const
+{
+    ray.hit = false;
+    ray.resolution = 0.0;
+
+    osg::Vec3d dir = ray.end - ray.start;
+    double length = dir.normalize();
+    if (length <= 0.0)
+        return false;
+
+    const SpatialReference* srs = getSRS();
+    const bool geocentric = srs->isGeographic();
+
+    double maxHeight;
+    int maxLOD;
+    {
+        Threading::ScopedReadLock sharedLock(_elevationTilesMutex);
+        if (_elevationTiles.empty())
+            return false;
+        maxHeight = _elevationTilesMaxHeight + 1.0;
+        maxLOD = _elevationTilesMaxLOD;
+    }
+
+    const Profile* profile = getProfile();
+
+    // Clip the ray to the volume that can contain terrain.
+    double t = 0.0, tmax = length;
+    if (geocentric)
+    {
+        double R = srs->getEllipsoid()->getRadiusEquator() + maxHeight;
+        double b = ray.start * dir;
+        double c = ray.start.length2() - R*R;
+        if (c > 0.0)
+        {
+            double disc = b*b - c;
+            if (b > 0.0 || disc < 0.0)
+                return false;
+            t = -b - sqrt(disc);
+        }
+    }
+    else if (ray.start.z() > maxHeight)
+    {
+        if (dir.z() >= 0.0)
+            return false;
+        t = (maxHeight - ray.start.z()) / dir.z();
+    }
+
+    if (t > tmax)
+        return false;
+
+    const double minStep = 0.01;
+    const int maxSteps = 65536;
+
+    // height of the terrain at a map location (0 where there's no data)
+    auto terrainHeight = [this](double x, double y)
+    {
+        std::shared_ptr<ElevationTile> tile = getElevationTile(x, y);
+        return tile ? tile->getHeight(x, y) : 0.0f;
+    };
+
+    osg::Vec3d map, ahead;
+    double tPrev = t;
+    bool hit = false;
+
+    for (int steps = 0; steps < maxSteps && t <= tmax; ++steps)
+    {
+        osg::Vec3d world = ray.start + dir*t;
+        srs->transformFromWorld(world, map);
+
+        std::shared_ptr<ElevationTile> tile = getElevationTile(map.x(), map.y());
+
+        // Map-space motion per meter along the ray, for computing the
+        // distance to the edge of a map-space box.
+        srs->transformFromWorld(world + dir, ahead);
+        double mx = ahead.x() - map.x();
+        double my = ahead.y() - map.y();
+        if (geocentric && mx > 180.0) mx -= 360.0;
+        else if (geocentric && mx < -180.0) mx += 360.0;
+
+        auto exitBox = [&](double x0, double x1, double y0, double y1)
+        {
+            double tx = mx > 0.0 ? (x1 - map.x()) / mx : mx < 0.0 ? (x0 - map.x()) / mx : DBL_MAX;
+            double ty = my > 0.0 ? (y1 - map.y()) / my : my < 0.0 ? (y0 - map.y()) / my : DBL_MAX;
+            return osg::maximum(osg::minimum(tx, ty), 0.0);
+        };
+
+        double step;
+
+        if (!tile)
+        {
+            // no data here; treat as the datum.
+            if (map.z() <= 0.0)
+            {
+                hit = true;
+                break;
+            }
+
+            // Loaded tiles nearby may rise up to the max height, so the ray may
+            // drop freely to that height. Below it, stay within the deepest-LOD
+            // cell under the ray; no loaded tile overlaps that cell, since
+            // otherwise one would contain this point.
+            step = map.z() - maxHeight;
+            if (step <= 0.0)
+            {
+                TileKey cell = profile ? profile->createTileKey(map.x(), map.y(), maxLOD) : TileKey::INVALID;
+                double exit = minStep;
+                if (cell.valid())
+                {
+                    const GeoExtent& e = cell.getExtent();
+                    exit = exitBox(e.xMin(), e.xMax(), e.yMin(), e.yMax()) + minStep;
+                }
+                step = osg::minimum(map.z(), exit);
+            }
+            step = osg::maximum(step, minStep);
+        }
+        else
+        {
+            auto exitDistance = [&](const ElevationTile::Level& level, unsigned i, unsigned j)
+            {
+                double x0 = tile->_xmin + (double)(i*level.span)*tile->_dx;
+                double x1 = osg::minimum(tile->_xmax, x0 + (double)level.span*tile->_dx);
+                double y0 = tile->_ymin + (double)(j*level.span)*tile->_dy;
+                double y1 = osg::minimum(tile->_ymax, y0 + (double)level.span*tile->_dy);
+                return exitBox(x0, x1, y0, y1);
+            };
+
+            double u = osg::clampBetween((map.x() - tile->_xmin) / tile->_dx, 0.0, (double)(tile->_cols - 2));
+            double v = osg::clampBetween((map.y() - tile->_ymin) / tile->_dy, 0.0, (double)(tile->_rows - 2));
+            unsigned c0 = (unsigned)u, r0 = (unsigned)v;
+
+            // Largest step that provably stays above the terrain: for each
+            // pyramid cell the ray is above, it can travel to the cell's edge
+            // or down to the cell's max height, whichever comes first.
+            step = 0.0;
+            for (int L = (int)tile->_levels.size() - 1; L >= 0; --L)
+            {
+                const ElevationTile::Level& level = tile->_levels[L];
+                unsigned i = osg::minimum(c0 / level.span, level.cols - 1);
+                unsigned j = osg::minimum(r0 / level.span, level.rows - 1);
+                double clearance = map.z() - (double)level.maxH[j*level.cols + i];
+                if (clearance > 0.0)
+                {
+                    step = osg::maximum(step, osg::minimum(clearance, exitDistance(level, i, j) + minStep));
+                }
+            }
+
+            if (step == 0.0)
+            {
+                // Below the max height of the finest cell; test the surface.
+                if (map.z() <= tile->getHeight(map.x(), map.y()))
+                {
+                    hit = true;
+                    break;
+                }
+
+                const ElevationTile::Level& leaf = tile->_levels[0];
+                unsigned i = osg::minimum(c0, leaf.cols - 1);
+                unsigned j = osg::minimum(r0, leaf.rows - 1);
+                step = osg::clampBetween(
+                    exitDistance(leaf, i, j) + minStep,
+                    minStep,
+                    osg::maximum(0.25*tile->_cellSizeMeters, minStep));
+            }
+        }
+
+        tPrev = t;
+        t += step;
+    }
+
+    if (!hit)
+        return false;
+
+    // Refine the hit between the last point above and the first point below.
+    if (t > tPrev)
+    {
+        double lo = tPrev, hi = t;
+        for (int i = 0; i < 20; ++i)
+        {
+            double mid = 0.5*(lo + hi);
+            srs->transformFromWorld(ray.start + dir*mid, map);
+            if (map.z() <= terrainHeight(map.x(), map.y()))
+                hi = mid;
+            else
+                lo = mid;
+        }
+        t = hi;
+    }
+
+    ray.hit = true;
+    ray.point = ray.start + dir*t;
+
+    // Normal from the height gradient around the hit point.
+    srs->transformFromWorld(ray.point, map);
+    std::shared_ptr<ElevationTile> tile = getElevationTile(map.x(), map.y());
+    if (tile)
+        ray.resolution = osg::maximum(tile->_dx, tile->_dy);
+    double ex = tile ? tile->_dx : 1e-5;
+    double ey = tile ? tile->_dy : 1e-5;
+    osg::Vec3d w, e, s, n;
+    srs->transformToWorld(osg::Vec3d(map.x() - ex, map.y(), terrainHeight(map.x() - ex, map.y())), w);
+    srs->transformToWorld(osg::Vec3d(map.x() + ex, map.y(), terrainHeight(map.x() + ex, map.y())), e);
+    srs->transformToWorld(osg::Vec3d(map.x(), map.y() - ey, terrainHeight(map.x(), map.y() - ey)), s);
+    srs->transformToWorld(osg::Vec3d(map.x(), map.y() + ey, terrainHeight(map.x(), map.y() + ey)), n);
+    ray.normal = (e - w) ^ (n - s);
+    ray.normal.normalize();
+
+    return true;
+}
+
+unsigned
+Terrain::intersectRays(std::vector<Ray>& rays) const
+{
+    OE_PROFILING_ZONE;
+
+    const unsigned raysPerJob = 16u;
+    const unsigned count = rays.size();
+
+    auto intersect = [this, &rays](unsigned first, unsigned last)
+    {
+        for (unsigned i = first; i < last; ++i)
+            intersectRay(rays[i]);
+    };
+
+    JobArena* arena = JobArena::arena("oe.terrain");
+    JobGroup group;
+    for (unsigned first = raysPerJob; first < count; first += raysPerJob)
+    {
+        unsigned last = osg::minimum(count, first + raysPerJob);
+        std::function<void()> job = [&intersect, first, last]() { intersect(first, last); };
+        arena->dispatch(job, &group);
+    }
+
+    // intersect the first batch on this thread while we wait
+    intersect(0u, osg::minimum(count, raysPerJob));
+
+    group.join();
+
+    unsigned hits = 0u;
+    for (auto& ray : rays)
+        if (ray.hit)
+            ++hits;
+    return hits;
+}
+
+namespace
+{
+    // deepest index cell we'll use; tiny cells just cost memory
+    const unsigned MAX_CALLBACK_INDEX_LOD = 16u;
+
+    // Inclusive extent overlap test, so that a point on a tile edge
+    // notifies both tiles (both extents must share an SRS)
+    inline bool touches(const GeoExtent& a, const GeoExtent& b)
+    {
+        if (a.crossesAntimeridian() || b.crossesAntimeridian())
+            return a.intersects(b, false);
+
+        return
+            a.west() <= b.east() && a.east() >= b.west() &&
+            a.south() <= b.north() && a.north() >= b.south();
+    }
+}
+
 void
 Terrain::addTerrainCallback( TerrainCallback* cb )
 {
@@ -228,6 +739,77 @@ Terrain::addTerrainCallback( TerrainCallback* cb )
     }
 }
 
+void
+Terrain::addTerrainCallback(TerrainCallback* cb, const GeoExtent& extent)
+{
+    if (!extent.isValid())
+    {
+        addTerrainCallback(cb);
+        return;
+    }
+
+    if (cb)
+    {
+        removeTerrainCallback(cb);
+
+        SpatialCallback entry;
+        entry._callback = cb;
+        entry._extent = extent.transform(getSRS());
+        entry._cell = getCallbackIndexCell(entry._extent);
+
+        Threading::ScopedWriteLock exclusiveLock(_callbacksMutex);
+        _spatialCallbacks[cb] = entry;
+        insertSpatialCallback(cb);
+        ++_callbacksSize;
+    }
+}
+
+void
+Terrain::setTerrainCallbackExtent(TerrainCallback* cb, const GeoExtent& extent)
+{
+    if (!cb || !extent.isValid())
+        return;
+
+    GeoExtent mapExtent = extent.transform(getSRS());
+
+    Threading::ScopedWriteLock exclusiveLock(_callbacksMutex);
+
+    auto i = _spatialCallbacks.find(cb);
+    if (i == _spatialCallbacks.end())
+        return;
+
+    SpatialCallback& entry = i->second;
+
+    // Fast path: still inside a cell at the deepest index level.
+    if (entry._cell.valid() &&
+        entry._cell.getLOD() == MAX_CALLBACK_INDEX_LOD &&
+        entry._cell.getExtent().contains(mapExtent))
+    {
+        entry._extent = mapExtent;
+        return;
+    }
+
+    TileKey cell = getCallbackIndexCell(mapExtent);
+    entry._extent = mapExtent;
+    if (cell != entry._cell)
+    {
+        removeSpatialCallback(cb);
+        entry._cell = cell;
+        insertSpatialCallback(cb);
+    }
+}
+
+GeoExtent
+Terrain::getTerrainCallbackCell(const GeoPoint& point) const
+{
+    GeoPoint mapPoint = point.transform(getSRS());
+    if (!mapPoint.isValid() || !getProfile())
+        return GeoExtent::INVALID;
+
+    TileKey key = getProfile()->createTileKey(mapPoint.x(), mapPoint.y(), MAX_CALLBACK_INDEX_LOD);
+    return key.valid() ? key.getExtent() : GeoExtent::INVALID;
+}
+
 void
 Terrain::removeTerrainCallback( TerrainCallback* cb )
 {
@@ -245,6 +827,126 @@ Terrain::removeTerrainCallback( TerrainCallback* cb )
             ++i;
         }
     }
+
+    auto i = _spatialCallbacks.find(cb);
+    if (i != _spatialCallbacks.end())
+    {
+        removeSpatialCallback(cb);
+        _spatialCallbacks.erase(i);
+        --_callbacksSize;
+    }
+}
+
+TileKey
+Terrain::getCallbackIndexCell(const GeoExtent& extent) const
+{
+    double x, y;
+    if (!extent.getCentroid(x, y))
+        return TileKey::INVALID;
+
+    TileKey cell;
+    for (unsigned lod = 0; lod <= MAX_CALLBACK_INDEX_LOD; ++lod)
+    {
+        TileKey key = getProfile()->createTileKey(x, y, lod);
+        if (!key.valid() || !key.getExtent().contains(extent))
+            break;
+        cell = key;
+    }
+    return cell;
+}
+
+void
+Terrain::insertSpatialCallback(TerrainCallback* cb)
+{
+    // assumes a write lock on _callbacksMutex
+    const TileKey& cell = _spatialCallbacks[cb]._cell;
+    if (!cell.valid())
+    {
+        _callbackIndexRoot.push_back(cb);
+        return;
+    }
+
+    _callbackIndex[cell]._callbacks.push_back(cb);
+    for (TileKey key = cell; key.valid(); key = key.createParentKey())
+    {
+        ++_callbackIndex[key]._subtreeSize;
+    }
+}
+
+void
+Terrain::removeSpatialCallback(TerrainCallback* cb)
+{
+    // assumes a write lock on _callbacksMutex
+    const TileKey& cell = _spatialCallbacks[cb]._cell;
+    if (!cell.valid())
+    {
+        _callbackIndexRoot.erase(
+            std::remove(_callbackIndexRoot.begin(), _callbackIndexRoot.end(), cb),
+            _callbackIndexRoot.end());
+        return;
+    }
+
+    auto c = _callbackIndex.find(cell);
+    if (c == _callbackIndex.end())
+        return;
+
+    std::vector<TerrainCallback*>& list = c->second._callbacks;
+    list.erase(std::remove(list.begin(), list.end(), cb), list.end());
+
+    for (TileKey key = cell; key.valid(); key = key.createParentKey())
+    {
+        auto i = _callbackIndex.find(key);
+        if (i != _callbackIndex.end() && --i->second._subtreeSize == 0u)
+            _callbackIndex.erase(i);
+    }
+}
+
+void
+Terrain::gatherCallbacks(const TileKey& key, std::vector<osg::ref_ptr<TerrainCallback>>& output) const
+{
+    // assumes a read lock on _callbacksMutex
+    const GeoExtent& keyExtent = key.getExtent();
+
+    // callbacks that don't fit in any tile:
+    for (auto cb : _callbackIndexRoot)
+    {
+        if (touches(_spatialCallbacks.at(cb)._extent, keyExtent))
+            output.push_back(cb);
+    }
+
+    // callbacks stored in ancestor cells, which may or may not touch the tile:
+    for (TileKey parent = key.createParentKey(); parent.valid(); parent = parent.createParentKey())
+    {
+        auto i = _callbackIndex.find(parent);
+        if (i != _callbackIndex.end())
+        {
+            for (auto cb : i->second._callbacks)
+            {
+                if (touches(_spatialCallbacks.at(cb)._extent, keyExtent))
+                    output.push_back(cb);
+            }
+        }
+    }
+
+    // callbacks stored in this cell or below lie within the tile:
+    gatherSubtreeCallbacks(key, output);
+}
+
+void
+Terrain::gatherSubtreeCallbacks(const TileKey& key, std::vector<osg::ref_ptr<TerrainCallback>>& output) const
+{
+    auto i = _callbackIndex.find(key);
+    if (i == _callbackIndex.end())
+        return;
+
+    const CallbackIndexCell& cell = i->second;
+    output.insert(output.end(), cell._callbacks.begin(), cell._callbacks.end());
+
+    if (cell._subtreeSize > cell._callbacks.size() && key.getLOD() < MAX_CALLBACK_INDEX_LOD)
+    {
+        for (unsigned q = 0; q < 4; ++q)
+            gatherSubtreeCallbacks(key.createChildKey(q), output);
+    }
 }
 
 void
@@ -267,24 +969,50 @@ Terrain::notifyTileUpdate( const TileKey& key, osg::Node* node )
 void
 Terrain::fireTileUpdate( const TileKey& key, osg::Node* node )
 {
-    Threading::ScopedReadLock sharedLock( _callbacksMutex );
+    // Collect the callbacks to invoke under the lock, but invoke them
+    // without it so a callback is free to add or remove callbacks.
+    std::vector<osg::ref_ptr<TerrainCallback>> callbacks;
+    {
+        Threading::ScopedReadLock sharedLock( _callbacksMutex );
 
-    for( CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-    {       
+        callbacks.reserve(_callbacks.size());
+        callbacks.insert(callbacks.end(), _callbacks.begin(), _callbacks.end());
+
+        if (key.valid())
+        {
+            gatherCallbacks(key, callbacks);
+        }
+        else
+        {
+            // no key means a map-wide change; notify everyone.
+            for (auto& i : _spatialCallbacks)
+                callbacks.push_back(i.second._callback);
+        }
+    }
+
+    for (auto& cb : callbacks)
+    {
         TerrainCallbackContext context( this );
-        i->get()->onTileUpdate( key, node, context );
+        cb->onTileUpdate( key, node, context );
+        ++_callbacksInvoked;
 
         // if the callback set the "remove" flag, discard the callback.
         if ( context.markedForRemoval() )
-            i = _callbacks.erase( i );
-        else
-            ++i;
+            removeTerrainCallback( cb.get() );
     }
 }
 
 void
 Terrain::notifyMapElevationChanged()
 {
+    {
+        // the engine will re-register elevation data as tiles reload
+        Threading::ScopedWriteLock exclusiveLock(_elevationTilesMutex);
+        _elevationTiles.clear();
+        _elevationTilesMaxLOD = -1;
+        _elevationTilesMaxHeight = 0.0;
+    }
+
     if (_callbacksSize > 0)
     {
         onTileUpdateOperation* op = new onTileUpdateOperation(TileKey::INVALID, 0L, this);
@@ -53,6 +53,7 @@ TerrainOptions::getConfig() const
     conf.set( "color", color() );
     conf.set( "expiration_range", minExpiryRange() );
     conf.set( "expiration_threshold", expirationThreshold() );
+    conf.set( "tile_memory_budget", tileMemoryBudget() );
     conf.set( "progressive", progressive() );
     conf.set( "normal_maps", normalMaps() );
     conf.set( "normalize_edges", normalizeEdges() );
@@ -92,6 +93,7 @@ TerrainOptions::fromConfig(const Config& conf)
     heightFieldSkirtRatio().init(0.0f);
     color().init(osg::Vec4f(1,1,1,1));
     expirationThreshold().init(300u);
+    tileMemoryBudget().init(0u);
     progressive().init(false);
     normalMaps().init(true);
     normalizeEdges().init(false);
@@ -126,6 +128,7 @@ TerrainOptions::fromConfig(const Config& conf)
     conf.get( "color", color() );
     conf.get( "expiration_range", minExpiryRange() );
     conf.get( "expiration_threshold", expirationThreshold() );
+    conf.get( "tile_memory_budget", tileMemoryBudget() );
     conf.get( "progressive", progressive() );
     conf.get( "normal_maps", normalMaps() );
     conf.get( "normalize_edges", normalizeEdges() );
@@ -165,6 +168,7 @@ OE_PROPERTY_IMPL(TerrainOptionsAPI, double, MinExpiryTime, minExpiryTime);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, float, MinExpiryRange, minExpiryRange);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MaxTilesToUnloadPerFrame, maxTilesToUnloadPerFrame);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, ExpirationThreshold, expirationThreshold);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, TileMemoryBudget, tileMemoryBudget);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, float, HeightFieldSkirtRatio, heightFieldSkirtRatio);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, Color, Color, color);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, Progressive, progressive);
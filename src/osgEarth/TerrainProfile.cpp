@@ -93,14 +93,16 @@ TerrainProfile::getElevationRanges(double &min, double &max ) const
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode, const GeoPoint& start, const GeoPoint& end):
 _mapNode( mapNode ),
 _start( start),
-_end( end )
+_end( end ),
+_rayCastingSamples( 0u )
 {        
     _mapNode->getTerrain()->addTerrainCallback( this );        
     recompute();
 }
 
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode):
-_mapNode( mapNode )
+_mapNode( mapNode ),
+_rayCastingSamples( 0u )
 {
     _mapNode->getTerrain()->addTerrainCallback( this );
 }
@@ -123,6 +125,15 @@ void TerrainProfileCalculator::setMapNode( osgEarth::MapNode* mapNode )
   }
 }
 
+void TerrainProfileCalculator::setRayCastingSamples( unsigned numSamples )
+{
+    if (_rayCastingSamples != numSamples)
+    {
+        _rayCastingSamples = numSamples;
+        recompute();
+    }
+}
+
 void TerrainProfileCalculator::addChangedCallback( ChangedCallback* callback )
 {
     _changedCallbacks.push_back( callback );
@@ -203,7 +214,10 @@ void TerrainProfileCalculator::recompute()
 {
     if (_start.isValid() && _end.isValid())
     {
-        computeTerrainProfile( _mapNode.get(), _start, _end, _profile);
+        if (_rayCastingSamples > 0u)
+            computeTerrainProfile( _mapNode.get(), _start, _end, _rayCastingSamples, _profile);
+        else
+            computeTerrainProfile( _mapNode.get(), _start, _end, _profile);
 
         for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
         {
@@ -234,3 +248,42 @@ void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode
         profile.addElevation( slice.getDistanceHeightIntersections()[i].first, slice.getDistanceHeightIntersections()[i].second);
     }
 }
+
+void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode, const GeoPoint& start, const GeoPoint& end, unsigned numSamples, TerrainProfile& profile)
+{
+    profile.clear();
+
+    if (numSamples < 2u)
+        return;
+
+    const Terrain* terrain = mapNode->getTerrain();
+    GeoPoint startMap = start.transform(mapNode->getMapSRS());
+    GeoPoint endMap = end.transform(mapNode->getMapSRS());
+    double length = startMap.distanceTo(endMap);
+
+    // one vertical ray per sample:
+    std::vector<Terrain::Ray> rays(numSamples);
+    for (unsigned i = 0; i < numSamples; ++i)
+    {
+        GeoPoint p = startMap.interpolate(endMap, (double)i / (double)(numSamples - 1));
+        p.z() = 0.0;
+        p.altitudeMode() = ALTMODE_ABSOLUTE;
+
+        osg::Vec3d surface, up;
+        p.toWorld(surface);
+        p.createWorldUpVector(up);
+        rays[i] = Terrain::Ray(surface + up*1e5, surface - up*1e5);
+    }
+
+    terrain->intersectRays(rays);
+
+    for (unsigned i = 0; i < numSamples; ++i)
+    {
+        if (rays[i].hit)
+        {
+            GeoPoint p;
+            p.fromWorld(mapNode->getMapSRS(), rays[i].point);
+            profile.addElevation(length * (double)i / (double)(numSamples - 1), p.z());
+        }
+    }
+}
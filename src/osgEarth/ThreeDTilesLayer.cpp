@@ -38,6 +38,8 @@ ThreeDTilesLayer::Options::getConfig() const
     Config conf = VisibleLayer::Options::getConfig();
     conf.set("url", _url);
     conf.set("max_sse", _maximumScreenSpaceError);
+    conf.set("memory_budget", _memoryBudgetMB);
+    conf.set("max_active_requests", _maxActiveRequests);
     return conf;
 }
 
@@ -47,6 +49,8 @@ ThreeDTilesLayer::Options::fromConfig( const Config& conf )
     _maximumScreenSpaceError.init(15.0f);
     conf.get("url", _url);
     conf.get("max_sse", _maximumScreenSpaceError);
+    conf.get("memory_budget", _memoryBudgetMB);
+    conf.get("max_active_requests", _maxActiveRequests);
 }
 
 //........................................................................
@@ -96,6 +100,16 @@ ThreeDTilesLayer::openImplementation()
     _tilesetNode->setMaximumScreenSpaceError(*options().maximumScreenSpaceError());
     _tilesetNode->setOwnerName(getName());
 
+    if (options().memoryBudgetMB().isSet())
+    {
+        _tilesetNode->setMaxBytes((std::size_t)options().memoryBudgetMB().get() * 1048576u);
+    }
+
+    if (options().maxActiveRequests().isSet())
+    {
+        _tilesetNode->setMaxActiveRequests(options().maxActiveRequests().get());
+    }
+
     return STATUS_OK;
 }
 
@@ -30,14 +30,27 @@
 
 #include <osgDB/FileUtils>
 
+#include <fstream>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 using namespace std;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
-TileIndex::TileIndex()
+#define LC "[TileIndex] "
+
+// header of the spatial index cache file
+#define SPATIAL_INDEX_MAGIC   "OETILEIDX"
+#define SPATIAL_INDEX_VERSION 1u
+
+TileIndex::TileIndex() :
+_cacheSpatialIndex(false)
 {
+    _rtreeMutex.setName("TileIndex(OE)");
 }
 
 TileIndex::~TileIndex()
@@ -46,7 +59,7 @@ TileIndex::~TileIndex()
 }
 
 TileIndex*
-TileIndex::load(const std::string& filename)
+TileIndex::load(const std::string& filename, bool cacheSpatialIndex)
 {        
     if (!osgDB::fileExists( filename ) )
     {
@@ -68,9 +81,177 @@ TileIndex::load(const std::string& filename)
     TileIndex* index = new TileIndex();
     index->_features = features.get();
     index->_filename = filename;
+    index->_cacheSpatialIndex = cacheSpatialIndex;
+
+    // Read all the extents into memory once so getFiles() is just a tree search.
+    bool loaded = false;
+    if (cacheSpatialIndex)
+    {
+        std::string cacheFile = index->getSpatialIndexFilename();
+        if (osgDB::fileExists(cacheFile) &&
+            getLastModifiedTime(cacheFile) >= getLastModifiedTime(filename))
+        {
+            loaded = index->readSpatialIndex(cacheFile);
+        }
+    }
+
+    if (!loaded)
+    {
+        index->buildSpatialIndex();
+
+        if (cacheSpatialIndex)
+        {
+            index->writeSpatialIndex(index->getSpatialIndexFilename());
+        }
+    }
+
+    OE_INFO << LC << "Loaded " << index->size() << " entries from " << filename << std::endl;
+
     return index;
 }
 
+std::string
+TileIndex::getSpatialIndexFilename() const
+{
+    return _filename + ".rtree";
+}
+
+unsigned
+TileIndex::size() const
+{
+    Threading::ScopedReadLock lock(_rtreeMutex);
+    return _locations.size();
+}
+
+void
+TileIndex::insert(const Bounds& bounds, const std::string& location)
+{
+    // assumes the write lock is held
+    double a_min[2] = { bounds.xMin(), bounds.yMin() };
+    double a_max[2] = { bounds.xMax(), bounds.yMax() };
+    _rtree.Insert(a_min, a_max, _locations.size());
+    _locations.push_back(location);
+}
+
+void
+TileIndex::buildSpatialIndex()
+{
+    Threading::ScopedWriteLock lock(_rtreeMutex);
+
+    _rtree.RemoveAll();
+    _locations.clear();
+
+    osg::ref_ptr<FeatureCursor> cursor = _features->createFeatureCursor(Query(), 0L);
+    while (cursor.valid() && cursor->hasMore())
+    {
+        osg::ref_ptr<Feature> feature = cursor->nextFeature();
+        if (feature.valid() && feature->getGeometry())
+        {
+            insert(
+                feature->getGeometry()->getBounds(),
+                getFullPath(_filename, feature->getString("location")));
+        }
+    }
+}
+
+bool
+TileIndex::readSpatialIndex(const std::string& filename)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open())
+        return false;
+
+    char magic[sizeof(SPATIAL_INDEX_MAGIC)];
+    unsigned version = 0u, count = 0u;
+    in.read(magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&count, sizeof(count));
+
+    if (in.fail() ||
+        strncmp(magic, SPATIAL_INDEX_MAGIC, sizeof(magic)) != 0 ||
+        version != SPATIAL_INDEX_VERSION)
+    {
+        OE_WARN << LC << "Ignoring invalid spatial index cache " << filename << std::endl;
+        return false;
+    }
+
+    Threading::ScopedWriteLock lock(_rtreeMutex);
+
+    _rtree.RemoveAll();
+    _locations.clear();
+    _locations.reserve(count);
+
+    double b[4];
+    unsigned len;
+    std::string location;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        in.read((char*)b, sizeof(b));
+        in.read((char*)&len, sizeof(len));
+        if (in.fail())
+            break;
+
+        location.resize(len);
+        if (len > 0)
+            in.read(&location[0], len);
+        if (in.fail())
+            break;
+
+        insert(Bounds(b[0], b[1], b[2], b[3]), location);
+    }
+
+    if (_locations.size() != count)
+    {
+        OE_WARN << LC << "Spatial index cache " << filename << " is truncated" << std::endl;
+        _rtree.RemoveAll();
+        _locations.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+TileIndex::writeSpatialIndex(const std::string& filename)
+{
+    std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        OE_WARN << LC << "Cannot write spatial index cache " << filename << std::endl;
+        return false;
+    }
+
+    Threading::ScopedReadLock lock(_rtreeMutex);
+
+    unsigned version = SPATIAL_INDEX_VERSION;
+    unsigned count = _locations.size();
+    out.write(SPATIAL_INDEX_MAGIC, sizeof(SPATIAL_INDEX_MAGIC));
+    out.write((const char*)&version, sizeof(version));
+    out.write((const char*)&count, sizeof(count));
+
+    // walk the tree to recover each entry's extent:
+    std::vector<Bounds> bounds(count);
+    FileIndex::Iterator it;
+    for (_rtree.GetFirst(it); !_rtree.IsNull(it); _rtree.GetNext(it))
+    {
+        double a_min[2], a_max[2];
+        it.GetBounds(a_min, a_max);
+        bounds[*it] = Bounds(a_min[0], a_min[1], a_max[0], a_max[1]);
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        double b[4] = { bounds[i].xMin(), bounds[i].yMin(), bounds[i].xMax(), bounds[i].yMax() };
+        unsigned len = _locations[i].size();
+        out.write((const char*)b, sizeof(b));
+        out.write((const char*)&len, sizeof(len));
+        out.write(_locations[i].data(), len);
+    }
+
+    return !out.fail();
+}
+
 TileIndex*
 TileIndex::create( const std::string& filename, const osgEarth::SpatialReference* srs )
 {
@@ -106,21 +287,28 @@ void
 TileIndex::getFiles(const osgEarth::GeoExtent& extent, std::vector< std::string >& files)
 {            
     files.clear();
-    osgEarth::Query query;    
 
     GeoExtent transformed = extent.transform( _features->getFeatureProfile()->getSRS() );
-    query.bounds() = transformed.bounds();
-    osg::ref_ptr< osgEarth::FeatureCursor> cursor = _features->createFeatureCursor( query, 0L );
+    if (!transformed.isValid())
+        return;
 
-    while (cursor->hasMore())
+    double a_min[2] = { transformed.xMin(), transformed.yMin() };
+    double a_max[2] = { transformed.xMax(), transformed.yMax() };
+
+    std::vector<unsigned> hits;
+
+    Threading::ScopedReadLock lock(_rtreeMutex);
+
+    _rtree.Search(a_min, a_max, &hits, INT_MAX);
+
+    // report in insertion order, like the feature cursor did
+    std::sort(hits.begin(), hits.end());
+
+    files.reserve(hits.size());
+    for (std::vector<unsigned>::const_iterator i = hits.begin(); i != hits.end(); ++i)
     {
-        osg::ref_ptr< osgEarth::Feature> feature = cursor->nextFeature();
-        if (feature.valid())
-        {
-            std::string location = getFullPath(_filename, feature->getString("location"));
-            files.push_back( location );
-        }
-    }    
+        files.push_back( _locations[*i] );
+    }
 }
 
 bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
@@ -135,9 +323,15 @@ bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
     osg::ref_ptr< Feature > feature = new Feature( polygon.get(), extent.getSRS()  );
     feature->set("location", filename );
     
-    const SpatialReference* wgs84 = SpatialReference::create("epsg:4326");
-    feature->transform( wgs84 );
+    // Store the extent in the index's own SRS, which is what create() wrote
+    // into the shapefile and what getFiles() queries against.
+    feature->transform( _features->getFeatureProfile()->getSRS() );
+
+    if (!_features->insertFeature( feature.get() ))
+        return false;
+
+    Threading::ScopedWriteLock lock(_rtreeMutex);
+    insert(feature->getGeometry()->getBounds(), getFullPath(_filename, filename));
 
-    return _features->insertFeature( feature.get() );    
     return true;
 }
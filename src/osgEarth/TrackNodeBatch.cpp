@@ -0,0 +1,1081 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/TrackNodeBatch>
+#include <osgEarth/MapNode>
+#include <osgEarth/AnnotationUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/Lighting>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/Math>
+#include <osgEarth/Metrics>
+#include <osg/Depth>
+#include <osg/BlendFunc>
+#include <osg/Version>
+#include <osgText/Glyph>
+#include <cstring>
+
+#define LC "[TrackNodeBatch] "
+
+using namespace osgEarth;
+
+//------------------------------------------------------------------------
+
+// Glyph textures are single-channel; which channel depends on the GL profile.
+#if defined(OSG_GL3_AVAILABLE) && !defined(OSG_GL2_AVAILABLE) && !defined(OSG_GL1_AVAILABLE)
+#define GLYPH_CHANNEL "r"
+#else
+#define GLYPH_CHANNEL "a"
+#endif
+
+// Texture image unit of the track positions buffer (unit 0 holds the icon/glyphs)
+#define POSITIONS_UNIT 1
+
+// Initial capacity of the positions buffer
+#define INITIAL_CAPACITY 256u
+
+namespace
+{
+    // Icons and labels share these shaders. Every vertex holds a pixel offset
+    // in xy; z holds the slot of its track (labels) or -1 (icons, which are
+    // instanced with one instance per slot).
+    const char* batchVS_MODEL =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform samplerBuffer oe_TrackNodeBatch_positions; \n"
+        "out vec2 oe_TrackNodeBatch_texcoord; \n"
+        "out vec4 oe_TrackNodeBatch_fill; \n"
+        "out vec4 oe_TrackNodeBatch_halo; \n"
+        "vec2 oe_TrackNodeBatch_offset; \n"
+        "float oe_TrackNodeBatch_visible; \n"
+        "void oe_TrackNodeBatch_VS_MODEL(inout vec4 vertex) { \n"
+        "    int slot = vertex.z < 0.0 ? gl_InstanceID : int(vertex.z); \n"
+        "    vec4 track = texelFetch(oe_TrackNodeBatch_positions, slot); \n"
+        "    oe_TrackNodeBatch_offset = vertex.xy; \n"
+        "    oe_TrackNodeBatch_visible = track.w; \n"
+        "    oe_TrackNodeBatch_texcoord = gl_MultiTexCoord0.st; \n"
+        "    oe_TrackNodeBatch_fill = gl_Color; \n"
+        "    oe_TrackNodeBatch_halo = gl_MultiTexCoord1; \n"
+        "    vertex = vec4(track.xyz, 1.0); \n"
+        "} \n";
+
+    // Hides tracks behind the horizon. xyz = center of the earth in model
+    // coordinates, w = 1/radius, or zero to disable.
+    const char* batchVS_VIEW =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform vec4 oe_TrackNodeBatch_horizon; \n"
+        "float oe_TrackNodeBatch_visible; \n"
+        "void oe_TrackNodeBatch_VS_VIEW(inout vec4 vertexView) { \n"
+        "    if (oe_TrackNodeBatch_horizon.w > 0.0) { \n"
+        "        vec3 C = (gl_ModelViewMatrix * vec4(oe_TrackNodeBatch_horizon.xyz, 1.0)).xyz * oe_TrackNodeBatch_horizon.w; \n"
+        "        vec3 P = vertexView.xyz * oe_TrackNodeBatch_horizon.w; \n"
+        "        float vh = dot(C, C) - 1.0; \n"
+        "        float vtDotVc = dot(P, C); \n"
+        "        if (vtDotVc > vh && vtDotVc*vtDotVc/dot(P, P) > vh) \n"
+        "            oe_TrackNodeBatch_visible = 0.0; \n"
+        "    } \n"
+        "} \n";
+
+    const char* batchVS_CLIP =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform vec3 oe_Camera; \n"
+        "vec2 oe_TrackNodeBatch_offset; \n"
+        "float oe_TrackNodeBatch_visible; \n"
+        "void oe_TrackNodeBatch_VS_CLIP(inout vec4 vertexClip) { \n"
+        "    if (oe_TrackNodeBatch_visible == 0.0) { \n"
+        "        vertexClip = vec4(2.0, 2.0, 2.0, 1.0); \n"
+        "        return; \n"
+        "    } \n"
+        "    vertexClip.xy += oe_TrackNodeBatch_offset * 2.0 / oe_Camera.xy * vertexClip.w; \n"
+        "} \n";
+
+    const char* batchFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform sampler2D oe_TrackNodeBatch_tex; \n"
+        "uniform bool oe_TrackNodeBatch_label; \n"
+        "in vec2 oe_TrackNodeBatch_texcoord; \n"
+        "in vec4 oe_TrackNodeBatch_fill; \n"
+        "in vec4 oe_TrackNodeBatch_halo; \n"
+        "void oe_TrackNodeBatch_FS(inout vec4 color) { \n"
+        "    vec2 tc = oe_TrackNodeBatch_texcoord; \n"
+        "    if (!oe_TrackNodeBatch_label) { \n"
+        "        color = texture(oe_TrackNodeBatch_tex, tc); \n"
+        "        return; \n"
+        "    } \n"
+        "    float a = texture(oe_TrackNodeBatch_tex, tc)." GLYPH_CHANNEL "; \n"
+        "    color = vec4(oe_TrackNodeBatch_fill.rgb, oe_TrackNodeBatch_fill.a * a); \n"
+        "    if (oe_TrackNodeBatch_halo.a > 0.0) { \n"
+        "        vec2 d = 1.0/vec2(textureSize(oe_TrackNodeBatch_tex, 0)); \n"
+        "        float h = max( \n"
+        "            max(texture(oe_TrackNodeBatch_tex, tc+vec2(d.x,0))." GLYPH_CHANNEL ", texture(oe_TrackNodeBatch_tex, tc-vec2(d.x,0))." GLYPH_CHANNEL "), \n"
+        "            max(texture(oe_TrackNodeBatch_tex, tc+vec2(0,d.y))." GLYPH_CHANNEL ", texture(oe_TrackNodeBatch_tex, tc-vec2(0,d.y))." GLYPH_CHANNEL ")); \n"
+        "        color = vec4(mix(oe_TrackNodeBatch_halo.rgb, color.rgb, a), max(color.a, h * oe_TrackNodeBatch_halo.a)); \n"
+        "    } \n"
+        "    if (color.a < 0.01) \n"
+        "        discard; \n"
+        "} \n";
+
+    osg::Image* createPositionsImage(unsigned capacity)
+    {
+        osg::Image* image = new osg::Image();
+        image->setName("osgearth.tracknodebatch.positions");
+        image->allocateImage(capacity, 1, 1, GL_RGBA, GL_FLOAT);
+        ::memset(image->data(), 0, image->getTotalSizeInBytes());
+        return image;
+    }
+
+    osg::TextureBuffer* createPositionsTBO(osg::Image* image)
+    {
+        osg::TextureBuffer* tbo = new osg::TextureBuffer();
+        tbo->setImage(image);
+        tbo->setInternalFormat(GL_RGBA32F_ARB);
+        tbo->setUnRefImageDataAfterApply(false);
+        ShaderGenerator::setIgnoreHint(tbo, true);
+        return tbo;
+    }
+}
+
+//------------------------------------------------------------------------
+
+TrackNodeBatch::TrackNodeBatch(MapNode*                    mapNode,
+                               osg::Image*                 image,
+                               const TrackNodeFieldSchema& fieldSchema) :
+osg::Node(),
+_mapSRS(mapNode ? mapNode->getMapSRS() : 0L),
+_warnedRelative(false),
+_hasAnchor(false),
+_positionsDirty(false),
+_labelsDirty(false)
+{
+    if ( image )
+    {
+        IconSymbol* icon = _style.getOrCreate<IconSymbol>();
+        icon->setImage( image );
+    }
+
+    construct(fieldSchema);
+}
+
+TrackNodeBatch::TrackNodeBatch(MapNode*                    mapNode,
+                               const Style&                style,
+                               const TrackNodeFieldSchema& fieldSchema) :
+osg::Node(),
+_mapSRS(mapNode ? mapNode->getMapSRS() : 0L),
+_warnedRelative(false),
+_style(style),
+_hasAnchor(false),
+_positionsDirty(false),
+_labelsDirty(false)
+{
+    construct(fieldSchema);
+}
+
+void
+TrackNodeBatch::construct(const TrackNodeFieldSchema& fieldSchema)
+{
+    // This class makes its own shaders
+    ShaderGenerator::setIgnoreHint(this, true);
+
+    // GPU buffers are refreshed during the update traversal
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+
+    _boundCallback = new BoundCallback();
+
+    // Positions are stored relative to an anchor point to preserve precision.
+    _root = new osg::MatrixTransform();
+
+    osg::StateSet* ss = _root->getOrCreateStateSet();
+    ss->setDataVariance(osg::Object::DYNAMIC);
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("TrackNodeBatch");
+    vp->setFunction("oe_TrackNodeBatch_VS_MODEL", batchVS_MODEL, ShaderComp::LOCATION_VERTEX_MODEL);
+    vp->setFunction("oe_TrackNodeBatch_VS_VIEW", batchVS_VIEW, ShaderComp::LOCATION_VERTEX_VIEW);
+    vp->setFunction("oe_TrackNodeBatch_VS_CLIP", batchVS_CLIP, ShaderComp::LOCATION_VERTEX_CLIP);
+    vp->setFunction("oe_TrackNodeBatch_FS", batchFS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+
+    // screen-space symbols: no depth test, blended, drawn late
+    ss->setAttributeAndModes(new osg::Depth(osg::Depth::ALWAYS, 0, 1, false), 1);
+    ss->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), 1);
+    ss->setMode(GL_CULL_FACE, osg::StateAttribute::OFF);
+    ss->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+    Lighting::set(ss, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+
+    ss->addUniform(new osg::Uniform("oe_TrackNodeBatch_tex", 0));
+    ss->addUniform(new osg::Uniform("oe_TrackNodeBatch_label", false));
+
+    _horizonUniform = new osg::Uniform("oe_TrackNodeBatch_horizon", osg::Vec4f(0, 0, 0, 0));
+    ss->addUniform(_horizonUniform.get());
+
+    _positionsImage = createPositionsImage(INITIAL_CAPACITY);
+    _positionsTBO = createPositionsTBO(_positionsImage.get());
+    ss->setTextureAttribute(POSITIONS_UNIT, _positionsTBO.get());
+    ss->getOrCreateUniform("oe_TrackNodeBatch_positions", osg::Uniform::SAMPLER_BUFFER)->set(POSITIONS_UNIT);
+
+    // one icon quad, instanced once per track:
+    IconSymbol* icon = _style.get<IconSymbol>();
+    osg::Image* image = icon ? icon->getImage() : 0L;
+    if ( icon && image )
+    {
+        _icons = AnnotationUtils::createImageGeometry(
+            image,                    // image
+            osg::Vec2s(0,0),          // offset
+            0,                        // tex image unit
+            icon->heading()->eval(),
+            icon->scale()->eval() );
+    }
+
+    if ( _icons.valid() )
+    {
+        osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(_icons->getVertexArray());
+        for (osg::Vec3Array::iterator v = verts->begin(); v != verts->end(); ++v)
+            v->z() = -1.0f;
+
+        _icons->setDataVariance(osg::Object::DYNAMIC);
+        _icons->setUseDisplayList(false);
+        _icons->setComputeBoundingBoxCallback(_boundCallback.get());
+        _icons->setNodeMask(0);
+        _root->addChild(_icons.get());
+    }
+
+    // glyph quads, one geometry per glyph texture:
+    _labels = new osg::Geode();
+    _labels->getOrCreateStateSet()->addUniform(new osg::Uniform("oe_TrackNodeBatch_label", true));
+    _labels->getOrCreateStateSet()->setRenderBinDetails(11, "DepthSortedBin");
+    _root->addChild(_labels.get());
+
+    for (TrackNodeFieldSchema::const_iterator i = fieldSchema.begin(); i != fieldSchema.end(); ++i)
+    {
+        const TextSymbol* symbol = i->second._symbol.get();
+        if ( !symbol )
+            continue;
+
+        osg::ref_ptr<osgText::Font> font;
+        if ( symbol->font().isSet() )
+        {
+            font = osgText::readRefFontFile( *symbol->font() );
+        }
+        if ( !font.valid() )
+        {
+            font = Registry::instance()->getDefaultFont();
+        }
+        if ( !font.valid() )
+        {
+            OE_WARN << LC << "No font available for field \"" << i->first << "\"" << std::endl;
+            continue;
+        }
+
+        Field field;
+        field.name = i->first;
+        field.symbol = symbol;
+        field.size = (symbol->size().isSet() ? (float)(symbol->size()->eval()) : 16.0f) *
+            Registry::instance()->getDevicePixelRatio();
+        field.fill = symbol->fill().isSet() ? symbol->fill()->color() : Color::White;
+        field.halo = symbol->halo().isSet() ? symbol->halo()->color() : osg::Vec4f(0, 0, 0, 0);
+        field.offset.set(symbol->pixelOffset()->x(), symbol->pixelOffset()->y());
+        field.encoding = symbol->encoding().isSet() ?
+            AnnotationUtils::convertTextSymbolEncoding(symbol->encoding().value()) :
+            osgText::String::ENCODING_UNDEFINED;
+        field.initialValue.set(symbol->content()->expr(), field.encoding);
+
+        // Horizontal and vertical position of the text relative to the pen start.
+        // The vertical metrics approximate a typical font's ascent and descent.
+        TextSymbol::Alignment align = symbol->alignment().get();
+        switch (align)
+        {
+        case TextSymbol::ALIGN_LEFT_TOP:
+        case TextSymbol::ALIGN_LEFT_CENTER:
+        case TextSymbol::ALIGN_LEFT_BOTTOM:
+        case TextSymbol::ALIGN_LEFT_BASE_LINE:
+        case TextSymbol::ALIGN_LEFT_BOTTOM_BASE_LINE:
+            field.alignX = 0.0f; break;
+        case TextSymbol::ALIGN_RIGHT_TOP:
+        case TextSymbol::ALIGN_RIGHT_CENTER:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM:
+        case TextSymbol::ALIGN_RIGHT_BASE_LINE:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+            field.alignX = -1.0f; break;
+        default:
+            field.alignX = -0.5f; break;
+        }
+        switch (align)
+        {
+        case TextSymbol::ALIGN_LEFT_TOP:
+        case TextSymbol::ALIGN_CENTER_TOP:
+        case TextSymbol::ALIGN_RIGHT_TOP:
+            field.alignY = -0.8f*field.size; break;
+        case TextSymbol::ALIGN_LEFT_BOTTOM:
+        case TextSymbol::ALIGN_CENTER_BOTTOM:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM:
+            field.alignY = 0.2f*field.size; break;
+        case TextSymbol::ALIGN_LEFT_BASE_LINE:
+        case TextSymbol::ALIGN_CENTER_BASE_LINE:
+        case TextSymbol::ALIGN_RIGHT_BASE_LINE:
+        case TextSymbol::ALIGN_LEFT_BOTTOM_BASE_LINE:
+        case TextSymbol::ALIGN_CENTER_BOTTOM_BASE_LINE:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+            field.alignY = 0.0f; break;
+        default:
+            field.alignY = -0.3f*field.size; break;
+        }
+
+        // fields with the same font and resolution share glyphs:
+        int res = nextPowerOf2((int)(field.size*2.0f));
+        osgText::FontResolution resolution(res, res);
+        field.font = _fonts.size();
+        for (unsigned f = 0; f < _fonts.size(); ++f)
+        {
+            if (_fonts[f].font == font && _fonts[f].resolution == resolution)
+            {
+                field.font = f;
+                break;
+            }
+        }
+        if (field.font == _fonts.size())
+        {
+            _fonts.push_back(FontInfo());
+            _fonts.back().font = font;
+            _fonts.back().resolution = resolution;
+        }
+
+        _fields.push_back(field);
+    }
+
+}
+
+void
+TrackNodeBatch::toWorld(const GeoPoint* positions, unsigned count, double* x, double* y, double* z)
+{
+    OE_PROFILING_ZONE;
+
+    std::vector<osg::Vec3d> points;
+
+    // Convert runs of points that share an SRS in one tight loop each.
+    for (unsigned i = 0; i < count; )
+    {
+        const SpatialReference* srs = positions[i].getSRS();
+        unsigned end = i + 1;
+        while (end < count && positions[end].getSRS() == srs)
+            ++end;
+
+        if (srs == 0L)
+        {
+            for (unsigned k = i; k < end; ++k)
+                x[k] = y[k] = z[k] = 0.0;
+            i = end;
+            continue;
+        }
+
+        if (!_warnedRelative)
+        {
+            for (unsigned k = i; k < end; ++k)
+            {
+                if (positions[k].altitudeMode() == ALTMODE_RELATIVE)
+                {
+                    OE_WARN << LC << "ALTMODE_RELATIVE is not supported; using absolute altitudes" << std::endl;
+                    _warnedRelative = true;
+                    break;
+                }
+            }
+        }
+
+        // Bring the run into the map SRS in one batch.
+        points.resize(end - i);
+        for (unsigned k = i; k < end; ++k)
+            points[k - i] = positions[k].vec3d();
+
+        if (_mapSRS.valid() && !srs->isEquivalentTo(_mapSRS.get()))
+        {
+            if (srs->transform(points, _mapSRS.get()))
+            {
+                srs = _mapSRS.get();
+            }
+            else
+            {
+                OE_WARN << LC << "Failed to transform positions to the map SRS" << std::endl;
+            }
+        }
+
+        if (srs->getVerticalDatum() != 0L)
+        {
+            // geoid heights need the full transform
+            for (unsigned k = i; k < end; ++k)
+            {
+                osg::Vec3d world;
+                GeoPoint(srs, points[k - i], ALTMODE_ABSOLUTE).toWorld(world);
+                x[k] = world.x(), y[k] = world.y(), z[k] = world.z();
+            }
+        }
+
+        else if (srs->isGeographic())
+        {
+            const osg::EllipsoidModel* em = srs->getEllipsoid();
+            const double a = em->getRadiusEquator();
+            const double b = em->getRadiusPolar();
+            const double e2 = 1.0 - (b*b) / (a*a);
+            const double d2r = osg::PI / 180.0;
+
+            for (unsigned k = i; k < end; ++k)
+            {
+                const osg::Vec3d& p = points[k - i];
+                const double lon = p.x() * d2r;
+                const double lat = p.y() * d2r;
+                const double h = p.z();
+                const double sinLat = sin(lat);
+                const double cosLat = cos(lat);
+                const double N = a / sqrt(1.0 - e2*sinLat*sinLat);
+                x[k] = (N + h) * cosLat * cos(lon);
+                y[k] = (N + h) * cosLat * sin(lon);
+                z[k] = (N*(1.0 - e2) + h) * sinLat;
+            }
+        }
+
+        else
+        {
+            // projected world coordinates are the map coordinates
+            for (unsigned k = i; k < end; ++k)
+            {
+                x[k] = points[k - i].x();
+                y[k] = points[k - i].y();
+                z[k] = points[k - i].z();
+            }
+        }
+
+        i = end;
+    }
+}
+
+void
+TrackNodeBatch::setAnchor(const osg::Vec3d& world, const SpatialReference* srs)
+{
+    _anchor = world;
+    _hasAnchor = true;
+    _root->setMatrix(osg::Matrixd::translate(world));
+
+    if (srs && srs->isGeographic())
+    {
+        // horizon culling against a sphere with the polar radius
+        double R = srs->getEllipsoid()->getRadiusPolar();
+        _horizonUniform->set(osg::Vec4f(-world.x(), -world.y(), -world.z(), 1.0/R));
+    }
+    else
+    {
+        _horizonUniform->set(osg::Vec4f(0, 0, 0, 0));
+    }
+}
+
+TrackNodeBatch::TrackID
+TrackNodeBatch::addTrack(const GeoPoint& position)
+{
+    TrackID id;
+    if (!_freeIDs.empty())
+    {
+        id = _freeIDs.back();
+        _freeIDs.pop_back();
+    }
+    else
+    {
+        id = _idToSlot.size();
+        _idToSlot.push_back(-1);
+    }
+
+    double x, y, z;
+    toWorld(&position, 1u, &x, &y, &z);
+
+    if (!_hasAnchor)
+    {
+        setAnchor(osg::Vec3d(x, y, z), _mapSRS.valid() ? _mapSRS.get() : position.getSRS());
+    }
+
+    _idToSlot[id] = _slotToID.size();
+    _slotToID.push_back(id);
+    _worldX.push_back(x);
+    _worldY.push_back(y);
+    _worldZ.push_back(z);
+    _visible.push_back(1);
+
+    for (std::vector<Field>::iterator field = _fields.begin(); field != _fields.end(); ++field)
+    {
+        field->values.push_back(field->initialValue);
+        field->runs.push_back(QuadRuns());
+        if (!field->initialValue.empty())
+            _labelsDirty = true;
+    }
+
+    _positionsDirty = true;
+    return id;
+}
+
+void
+TrackNodeBatch::removeTrack(TrackID id)
+{
+    if (id >= _idToSlot.size() || _idToSlot[id] < 0)
+        return;
+
+    // keep the arrays dense by moving the last track into the hole
+    unsigned slot = _idToSlot[id];
+    unsigned last = _slotToID.size() - 1;
+    if (slot != last)
+    {
+        _slotToID[slot] = _slotToID[last];
+        _idToSlot[_slotToID[slot]] = slot;
+        _worldX[slot] = _worldX[last];
+        _worldY[slot] = _worldY[last];
+        _worldZ[slot] = _worldZ[last];
+        _visible[slot] = _visible[last];
+        for (std::vector<Field>::iterator field = _fields.begin(); field != _fields.end(); ++field)
+        {
+            field->values[slot].swap(field->values[last]);
+            field->runs[slot].swap(field->runs[last]);
+        }
+    }
+
+    _slotToID.pop_back();
+    _worldX.pop_back();
+    _worldY.pop_back();
+    _worldZ.pop_back();
+    _visible.pop_back();
+    for (std::vector<Field>::iterator field = _fields.begin(); field != _fields.end(); ++field)
+    {
+        field->values.pop_back();
+        field->runs.pop_back();
+    }
+
+    _idToSlot[id] = -1;
+    _freeIDs.push_back(id);
+
+    _positionsDirty = true;
+    _labelsDirty = !_fields.empty();
+}
+
+void
+TrackNodeBatch::clear()
+{
+    _slotToID.clear();
+    _worldX.clear();
+    _worldY.clear();
+    _worldZ.clear();
+    _visible.clear();
+    for (std::vector<Field>::iterator field = _fields.begin(); field != _fields.end(); ++field)
+    {
+        field->values.clear();
+        field->runs.clear();
+    }
+
+    _idToSlot.clear();
+    _freeIDs.clear();
+    _hasAnchor = false;
+
+    _positionsDirty = true;
+    _labelsDirty = true;
+}
+
+void
+TrackNodeBatch::setPosition(TrackID id, const GeoPoint& position)
+{
+    if (id >= _idToSlot.size() || _idToSlot[id] < 0)
+        return;
+
+    unsigned slot = _idToSlot[id];
+    toWorld(&position, 1u, &_worldX[slot], &_worldY[slot], &_worldZ[slot]);
+    _positionsDirty = true;
+}
+
+void
+TrackNodeBatch::setPositions(const std::vector<TrackID>& ids,
+                             const std::vector<GeoPoint>& positions)
+{
+    OE_PROFILING_ZONE;
+
+    unsigned count = osg::minimum(ids.size(), positions.size());
+    if (count == 0)
+        return;
+
+    std::vector<double> x(count), y(count), z(count);
+    toWorld(&positions[0], count, &x[0], &y[0], &z[0]);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        TrackID id = ids[i];
+        if (id < _idToSlot.size() && _idToSlot[id] >= 0)
+        {
+            unsigned slot = _idToSlot[id];
+            _worldX[slot] = x[i];
+            _worldY[slot] = y[i];
+            _worldZ[slot] = z[i];
+        }
+    }
+
+    _positionsDirty = true;
+}
+
+const osg::Vec3d
+TrackNodeBatch::getWorldPosition(TrackID id) const
+{
+    if (id >= _idToSlot.size() || _idToSlot[id] < 0)
+        return osg::Vec3d();
+
+    unsigned slot = _idToSlot[id];
+    return osg::Vec3d(_worldX[slot], _worldY[slot], _worldZ[slot]);
+}
+
+void
+TrackNodeBatch::setVisible(TrackID id, bool value)
+{
+    if (id >= _idToSlot.size() || _idToSlot[id] < 0)
+        return;
+
+    unsigned slot = _idToSlot[id];
+    if ((_visible[slot] != 0) != value)
+    {
+        _visible[slot] = value ? 1 : 0;
+        _positionsDirty = true;
+    }
+}
+
+void
+TrackNodeBatch::setFieldValue(TrackID id, const std::string& name, const std::string& value)
+{
+    for (std::vector<Field>::iterator field = _fields.begin(); field != _fields.end(); ++field)
+    {
+        if (field->name == name)
+        {
+            setFieldValue(id, name, osgText::String(value, field->encoding));
+            return;
+        }
+    }
+}
+
+void
+TrackNodeBatch::setFieldValue(TrackID id, const std::string& name, const osgText::String& value)
+{
+    if (id >= _idToSlot.size() || _idToSlot[id] < 0)
+        return;
+
+    unsigned slot = _idToSlot[id];
+
+    for (unsigned f = 0; f < _fields.size(); ++f)
+    {
+        Field& field = _fields[f];
+        if (field.name == name)
+        {
+            osgText::String& current = field.values[slot];
+            if (current.size() != value.size() || !std::equal(current.begin(), current.end(), value.begin()))
+            {
+                current = value;
+                if (!_labelsDirty)
+                    _dirtyLabels.push_back(std::make_pair(f, slot));
+            }
+            return;
+        }
+    }
+}
+
+void
+TrackNodeBatch::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        update();
+    }
+
+    _root->accept(nv);
+}
+
+osg::BoundingSphere
+TrackNodeBatch::computeBound() const
+{
+    if (!_box.valid())
+        return osg::BoundingSphere();
+
+    return osg::BoundingSphere(_anchor + _box.center(), _box.radius());
+}
+
+void
+TrackNodeBatch::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::Node::resizeGLObjectBuffers(maxSize);
+    _root->resizeGLObjectBuffers(maxSize);
+}
+
+void
+TrackNodeBatch::releaseGLObjects(osg::State* state) const
+{
+    osg::Node::releaseGLObjects(state);
+    _root->releaseGLObjects(state);
+}
+
+void
+TrackNodeBatch::update()
+{
+    if (_positionsDirty)
+    {
+        updatePositions();
+        _positionsDirty = false;
+    }
+
+    if (_labelsDirty)
+    {
+        updateLabels();
+        _labelsDirty = false;
+    }
+    else if (!_dirtyLabels.empty())
+    {
+        if (!updateLabelsInPlace())
+            updateLabels();
+    }
+
+    _dirtyLabels.clear();
+}
+
+void
+TrackNodeBatch::updatePositions()
+{
+    OE_PROFILING_ZONE;
+
+    unsigned count = _slotToID.size();
+
+    // grow the buffer as needed:
+    if (count > (unsigned)_positionsImage->s())
+    {
+        unsigned capacity = _positionsImage->s();
+        while (capacity < count)
+            capacity *= 2u;
+
+        int maxSize = Registry::capabilities().getMaxTextureBufferSize();
+        if (maxSize > 0 && capacity > (unsigned)maxSize)
+        {
+            OE_WARN << LC << "Number of tracks (" << count << ") exceeds the maximum texture buffer size ("
+                << maxSize << "); some tracks will not render" << std::endl;
+        }
+
+        osg::StateSet* ss = _root->getStateSet();
+        _positionsImage = createPositionsImage(capacity);
+        _positionsTBO = createPositionsTBO(_positionsImage.get());
+        ss->setTextureAttribute(POSITIONS_UNIT, _positionsTBO.get());
+    }
+
+    // single-precision positions relative to the anchor:
+    GLfloat* ptr = reinterpret_cast<GLfloat*>(_positionsImage->data());
+    osg::BoundingBoxd box;
+    for (unsigned slot = 0; slot < count; ++slot)
+    {
+        double x = _worldX[slot] - _anchor.x();
+        double y = _worldY[slot] - _anchor.y();
+        double z = _worldZ[slot] - _anchor.z();
+        *ptr++ = (GLfloat)x;
+        *ptr++ = (GLfloat)y;
+        *ptr++ = (GLfloat)z;
+        *ptr++ = _visible[slot] ? 1.0f : 0.0f;
+
+        if (_visible[slot])
+            box.expandBy(x, y, z);
+    }
+    _positionsImage->dirty();
+
+    _box = box;
+    _boundCallback->_box = box.valid() ?
+        osg::BoundingBox(osg::Vec3f(box._min), osg::Vec3f(box._max)) :
+        osg::BoundingBox();
+
+    if (_icons.valid())
+    {
+        _icons->getPrimitiveSet(0)->setNumInstances(count);
+        // zero instances would mean "not instanced" and draw one icon
+        _icons->setNodeMask(box.valid() ? ~0u : 0u);
+        _icons->dirtyBound();
+    }
+
+    for (unsigned i = 0; i < _labels->getNumDrawables(); ++i)
+    {
+        _labels->getDrawable(i)->dirtyBound();
+    }
+    _labels->setNodeMask(box.valid() ? ~0u : 0u);
+    _labels->dirtyBound();
+
+    dirtyBound();
+}
+
+const TrackNodeBatch::GlyphInfo*
+TrackNodeBatch::getGlyph(FontInfo& font, unsigned charcode)
+{
+    std::unordered_map<unsigned, GlyphInfo>::const_iterator i = font.glyphs.find(charcode);
+    if (i != font.glyphs.end())
+        return &i->second;
+
+    GlyphInfo& info = font.glyphs[charcode];
+    info.advance = 0.0f;
+
+    osgText::Glyph* glyph = font.font->getGlyph(font.resolution, charcode);
+    if (glyph)
+    {
+        // Glyph metrics are in units of the character size.
+        osg::Vec2 minCorner = glyph->getHorizontalBearing();
+        osg::Vec2 maxCorner = minCorner + osg::Vec2(glyph->getWidth(), glyph->getHeight());
+        info.advance = glyph->getHorizontalAdvance();
+
+        if (glyph->getWidth() > 0.0f && glyph->getHeight() > 0.0f)
+        {
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+            const osgText::Glyph::TextureInfo* tex = glyph->getOrCreateTextureInfo(osgText::GREYSCALE);
+            if (tex && tex->texture)
+            {
+                // include the texel margin around the glyph, as osgText does
+                osg::Vec2 tcSize = tex->maxTexCoord - tex->minTexCoord;
+                float tcMarginX = tex->texelMargin / (float)tex->texture->getTextureWidth();
+                float tcMarginY = tex->texelMargin / (float)tex->texture->getTextureHeight();
+                float marginX = tcSize.x() == 0.0f ? 0.0f : glyph->getWidth() * tcMarginX / tcSize.x();
+                float marginY = tcSize.y() == 0.0f ? 0.0f : glyph->getHeight() * tcMarginY / tcSize.y();
+
+                info.texture = tex->texture;
+                info.minTexCoord = tex->minTexCoord - osg::Vec2(tcMarginX, tcMarginY);
+                info.maxTexCoord = tex->maxTexCoord + osg::Vec2(tcMarginX, tcMarginY);
+                info.minCorner = minCorner - osg::Vec2(marginX, marginY);
+                info.maxCorner = maxCorner + osg::Vec2(marginX, marginY);
+            }
+#else
+            if (glyph->getTexture())
+            {
+                info.texture = glyph->getTexture();
+                info.minTexCoord = glyph->getMinTexCoord();
+                info.maxTexCoord = glyph->getMaxTexCoord();
+                info.minCorner = minCorner;
+                info.maxCorner = maxCorner;
+            }
+#endif
+        }
+    }
+
+    return &info;
+}
+
+osg::Geometry*
+TrackNodeBatch::getLabelGeometry(osg::Texture* texture)
+{
+    osg::ref_ptr<osg::Geometry>& geom = _labelGeoms[texture];
+    if (!geom.valid())
+    {
+        geom = new osg::Geometry();
+        geom->setUseVertexBufferObjects(true);
+        geom->setUseDisplayList(false);
+        geom->setDataVariance(osg::Object::DYNAMIC);
+        geom->setComputeBoundingBoxCallback(_boundCallback.get());
+
+        geom->setVertexArray(new osg::Vec3Array());
+        geom->setTexCoordArray(0, new osg::Vec2Array(), osg::Array::BIND_PER_VERTEX);
+        geom->setColorArray(new osg::Vec4Array(), osg::Array::BIND_PER_VERTEX);
+        geom->setTexCoordArray(1, new osg::Vec4Array(), osg::Array::BIND_PER_VERTEX);
+        geom->addPrimitiveSet(new osg::DrawElementsUInt(GL_TRIANGLES));
+
+        geom->getOrCreateStateSet()->setTextureAttributeAndModes(0, texture, osg::StateAttribute::ON);
+
+        _labels->addDrawable(geom.get());
+    }
+    return geom.get();
+}
+
+void
+TrackNodeBatch::updateLabels()
+{
+    OE_PROFILING_ZONE;
+
+    for (auto& i : _labelGeoms)
+    {
+        osg::Geometry* geom = i.second.get();
+        static_cast<osg::Vec3Array*>(geom->getVertexArray())->clear();
+        static_cast<osg::Vec2Array*>(geom->getTexCoordArray(0))->clear();
+        static_cast<osg::Vec4Array*>(geom->getColorArray())->clear();
+        static_cast<osg::Vec4Array*>(geom->getTexCoordArray(1))->clear();
+        static_cast<osg::DrawElementsUInt*>(geom->getPrimitiveSet(0))->clear();
+    }
+
+    for (std::vector<Field>::iterator field = _fields.begin(); field != _fields.end(); ++field)
+    {
+        field->runs.resize(field->values.size());
+
+        for (unsigned slot = 0; slot < field->values.size(); ++slot)
+        {
+            writeLabel(*field, slot, false);
+        }
+    }
+
+    for (auto& i : _labelGeoms)
+    {
+        osg::Geometry* geom = i.second.get();
+        geom->getVertexArray()->dirty();
+        geom->getTexCoordArray(0)->dirty();
+        geom->getColorArray()->dirty();
+        geom->getTexCoordArray(1)->dirty();
+        geom->getPrimitiveSet(0)->dirty();
+        geom->setNodeMask(geom->getVertexArray()->getNumElements() > 0 ? ~0u : 0u);
+    }
+}
+
+bool
+TrackNodeBatch::updateLabelsInPlace()
+{
+    OE_PROFILING_ZONE;
+
+    for (unsigned i = 0; i < _dirtyLabels.size(); ++i)
+    {
+        if (!writeLabel(_fields[_dirtyLabels[i].first], _dirtyLabels[i].second, true))
+            return false;
+    }
+
+    // only the quad corners and texture coordinates change
+    for (auto& i : _labelGeoms)
+    {
+        osg::Geometry* geom = i.second.get();
+        geom->getVertexArray()->dirty();
+        geom->getTexCoordArray(0)->dirty();
+    }
+
+    return true;
+}
+
+bool
+TrackNodeBatch::writeLabel(Field& field, unsigned slot, bool inPlace)
+{
+    FontInfo& font = _fonts[field.font];
+    const float size = field.size;
+    const osgText::String& text = field.values[slot];
+    QuadRuns& runs = field.runs[slot];
+
+    // Group the drawable glyphs into runs that share a texture.
+    float width = 0.0f;
+    _scratchRuns.clear();
+    for (osgText::String::const_iterator c = text.begin(); c != text.end(); ++c)
+    {
+        const GlyphInfo* glyph = getGlyph(font, *c);
+        width += glyph->advance;
+        if (glyph->texture.valid())
+        {
+            if (_scratchRuns.empty() || _scratchRuns.back().texture != glyph->texture.get())
+            {
+                QuadRun run;
+                run.texture = glyph->texture.get();
+                run.first = 0u;
+                run.count = 0u;
+                _scratchRuns.push_back(run);
+            }
+            ++_scratchRuns.back().count;
+        }
+    }
+
+    if (inPlace)
+    {
+        // rewriting in place only works if the new text fills the same quads
+        if (_scratchRuns.size() != runs.size())
+            return false;
+
+        for (unsigned r = 0; r < runs.size(); ++r)
+        {
+            if (_scratchRuns[r].texture != runs[r].texture || _scratchRuns[r].count != runs[r].count)
+                return false;
+        }
+    }
+    else
+    {
+        runs = _scratchRuns;
+    }
+
+    float x = field.offset.x() + field.alignX*width*size;
+    float y = field.offset.y() + field.alignY;
+
+    unsigned r = 0, n = 0;
+    for (osgText::String::const_iterator c = text.begin(); c != text.end(); ++c)
+    {
+        const GlyphInfo* glyph = getGlyph(font, *c);
+        if (glyph->texture.valid())
+        {
+            if (n == runs[r].count)
+            {
+                ++r;
+                n = 0;
+            }
+
+            osg::Geometry* geom = getLabelGeometry(runs[r].texture);
+            osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom->getVertexArray());
+            osg::Vec2Array* tcs = static_cast<osg::Vec2Array*>(geom->getTexCoordArray(0));
+
+            if (!inPlace && n == 0)
+            {
+                runs[r].first = verts->size() / 4u;
+            }
+
+            float x0 = x + glyph->minCorner.x()*size, x1 = x + glyph->maxCorner.x()*size;
+            float y0 = y + glyph->minCorner.y()*size, y1 = y + glyph->maxCorner.y()*size;
+
+            osg::Vec3 corners[4] = {
+                osg::Vec3(x0, y0, (float)slot),
+                osg::Vec3(x1, y0, (float)slot),
+                osg::Vec3(x1, y1, (float)slot),
+                osg::Vec3(x0, y1, (float)slot) };
+
+            osg::Vec2 texCoords[4] = {
+                glyph->minTexCoord,
+                osg::Vec2(glyph->maxTexCoord.x(), glyph->minTexCoord.y()),
+                glyph->maxTexCoord,
+                osg::Vec2(glyph->minTexCoord.x(), glyph->maxTexCoord.y()) };
+
+            if (inPlace)
+            {
+                unsigned base = (runs[r].first + n) * 4u;
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    (*verts)[base + k] = corners[k];
+                    (*tcs)[base + k] = texCoords[k];
+                }
+            }
+            else
+            {
+                osg::Vec4Array* fills = static_cast<osg::Vec4Array*>(geom->getColorArray());
+                osg::Vec4Array* halos = static_cast<osg::Vec4Array*>(geom->getTexCoordArray(1));
+                osg::DrawElementsUInt* indices = static_cast<osg::DrawElementsUInt*>(geom->getPrimitiveSet(0));
+
+                unsigned base = verts->size();
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    verts->push_back(corners[k]);
+                    tcs->push_back(texCoords[k]);
+                    fills->push_back(field.fill);
+                    halos->push_back(field.halo);
+                }
+
+                indices->push_back(base + 0);
+                indices->push_back(base + 1);
+                indices->push_back(base + 2);
+                indices->push_back(base + 0);
+                indices->push_back(base + 2);
+                indices->push_back(base + 3);
+            }
+
+            ++n;
+        }
+
+        x += glyph->advance*size;
+    }
+
+    return true;
+}
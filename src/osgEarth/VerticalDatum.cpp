@@ -152,23 +152,80 @@ VerticalDatum::transform(const VerticalDatum* from,
         ystep = (ne.y()-sw.y()) / double(rows-1);
     }
 
-    for( unsigned c=0; c<cols; ++c)
+    unsigned size = cols*rows;
+
+    // Sample both geoids over the whole grid in one pass each. Posts with
+    // no geoid get a zero offset.
+    std::vector<float> fromOffsets(size, 0.0f), toOffsets(size, 0.0f);
+
+    if (from && from->getGeoid())
+        from->getGeoid()->getHeights(sw.x(), sw.y(), xstep, ystep, cols, rows, &fromOffsets[0]);
+
+    if (to && to->getGeoid())
+        to->getGeoid()->getHeights(sw.x(), sw.y(), xstep, ystep, cols, rows, &toOffsets[0]);
+
+    Units fromUnits = from ? from->getUnits() : Units::METERS;
+    Units toUnits = to ? to->getUnits() : Units::METERS;
+    double scale = fromUnits.convertTo(toUnits, 1.0);
+
+    float* heights = &(*hf->getFloatArray())[0];
+
+    for (unsigned i = 0; i < size; ++i)
     {
-        double lon = sw.x() + xstep*double(c);
-        for( unsigned r=0; r<rows; ++r)
+        if (heights[i] != NO_DATA_VALUE)
         {
-            double lat = sw.y() + ystep*double(r);
-            float& h = hf->getHeight(c, r);
-            if (h != NO_DATA_VALUE)
-            {
-                VerticalDatum::transform( from, to, lat, lon, h );
-            }
+            // MSL -> HAE, units, HAE -> MSL
+            heights[i] = float(((double)heights[i] + fromOffsets[i]) * scale - toOffsets[i]);
         }
     }
 
     return true;
 }
 
+bool
+VerticalDatum::transform(const VerticalDatum* from,
+                         const VerticalDatum* to,
+                         const osg::Vec3d*    geopoints,
+                         osg::Vec3d*          points,
+                         unsigned             count)
+{
+    if ( from == to || count == 0u )
+        return true;
+
+    if ( from )
+    {
+        from->msl2hae( geopoints, points, count );
+    }
+
+    Units fromUnits = from ? from->getUnits() : Units::METERS;
+    Units toUnits = to ? to->getUnits() : Units::METERS;
+
+    if ( fromUnits != toUnits )
+    {
+        double scale = fromUnits.convertTo(toUnits, 1.0);
+        for (unsigned i = 0; i < count; ++i)
+            points[i].z() *= scale;
+    }
+
+    if ( to )
+    {
+        to->hae2msl( geopoints, points, count );
+    }
+
+    return true;
+}
+
+bool
+VerticalDatum::transform(const VerticalDatum*     from,
+                         const VerticalDatum*     to,
+                         std::vector<osg::Vec3d>& points)
+{
+    if (points.empty())
+        return true;
+
+    return transform(from, to, &points[0], &points[0], points.size());
+}
+
 double 
 VerticalDatum::msl2hae( double lat_deg, double lon_deg, double msl ) const
 {
@@ -181,6 +238,32 @@ VerticalDatum::hae2msl( double lat_deg, double lon_deg, double hae ) const
     return _geoid.valid() ? hae - _geoid->getHeight(lat_deg, lon_deg, INTERP_BILINEAR) : hae;
 }
 
+void
+VerticalDatum::msl2hae(const osg::Vec3d* geopoints, osg::Vec3d* points, unsigned count) const
+{
+    if ( !_geoid.valid() || count == 0u )
+        return;
+
+    std::vector<float> offsets(count);
+    _geoid->getHeights(geopoints, count, &offsets[0]);
+
+    for (unsigned i = 0; i < count; ++i)
+        points[i].z() += offsets[i];
+}
+
+void
+VerticalDatum::hae2msl(const osg::Vec3d* geopoints, osg::Vec3d* points, unsigned count) const
+{
+    if ( !_geoid.valid() || count == 0u )
+        return;
+
+    std::vector<float> offsets(count);
+    _geoid->getHeights(geopoints, count, &offsets[0]);
+
+    for (unsigned i = 0; i < count; ++i)
+        points[i].z() -= offsets[i];
+}
+
 bool 
 VerticalDatum::isEquivalentTo( const VerticalDatum* rhs ) const
 {
@@ -0,0 +1,426 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/Viewshed>
+#include <osgEarth/Map>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/Threading>
+#include <osgEarth/Metrics>
+#include <atomic>
+#include <cfloat>
+#include <climits>
+
+#define LC "[Viewshed] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Offset from the center of the i-th cell on the perimeter of a square
+    // of half-width h (8h cells), counter-clockwise from the south-east corner.
+    inline void getPerimeterCell(int i, int h, int& x, int& y)
+    {
+        int side = i / (2*h);
+        int offset = i % (2*h);
+        switch (side)
+        {
+        case 0:  x =  h;          y = -h + offset; break; // east edge
+        case 1:  x =  h - offset; y =  h;          break; // north edge
+        case 2:  x = -h;          y =  h - offset; break; // west edge
+        default: x = -h + offset; y = -h;          break; // south edge
+        }
+    }
+
+    // Largest grid we'll compute (cells per side)
+    const int maxHalfSize = 4096;
+
+    // Rows of elevation to sample per job
+    const unsigned rowsPerJob = 32u;
+
+    // Number of sectors into which to split the rays
+    const int numSectors = 16;
+}
+
+//........................................................................
+
+Viewshed::Result::Result() :
+    _size(0u),
+    _resolution(0.0)
+{
+    //nop
+}
+
+Viewshed::Visibility
+Viewshed::Result::getVisibility(double east, double north) const
+{
+    if (!valid())
+        return VISIBILITY_OUTSIDE;
+
+    int half = (int)(_size / 2u);
+    int col = half + (int)floor(east / _resolution + 0.5);
+    int row = half + (int)floor(north / _resolution + 0.5);
+
+    if (col < 0 || row < 0 || col >= (int)_size || row >= (int)_size)
+        return VISIBILITY_OUTSIDE;
+
+    return getVisibility((unsigned)col, (unsigned)row);
+}
+
+GeoPoint
+Viewshed::Result::getLocation(unsigned col, unsigned row) const
+{
+    if (!valid() || col >= _size || row >= _size)
+        return GeoPoint::INVALID;
+
+    int half = (int)(_size / 2u);
+    osg::Vec3d local(((int)col - half)*_resolution, ((int)row - half)*_resolution, 0.0);
+    osg::Vec3d map;
+    if (!_localSRS->transform(local, _mapSRS.get(), map))
+        return GeoPoint::INVALID;
+
+    return GeoPoint(_mapSRS.get(), map.x(), map.y(), getElevation(col, row), ALTMODE_ABSOLUTE);
+}
+
+bool
+Viewshed::Result::getElevation(const osg::Vec3d& mapPoint, float& out_elevation) const
+{
+    if (!valid())
+        return false;
+
+    osg::Vec3d local;
+    if (!_mapSRS->transform(mapPoint, _localSRS.get(), local))
+        return false;
+
+    int half = (int)(_size / 2u);
+    int col = half + (int)floor(local.x() / _resolution + 0.5);
+    int row = half + (int)floor(local.y() / _resolution + 0.5);
+
+    if (col < 0 || row < 0 || col >= (int)_size || row >= (int)_size)
+        return false;
+
+    out_elevation = getElevation((unsigned)col, (unsigned)row);
+    return true;
+}
+
+Geometry*
+Viewshed::Result::createVisibleGeometry() const
+{
+    if (!valid())
+        return nullptr;
+
+    // Merge runs of visible cells into rectangles: a run that continues
+    // unchanged into the next row extends the same rectangle.
+    struct Run {
+        unsigned start, end, firstRow;
+    };
+    std::vector<Run> open, next;
+
+    osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+    double half = (double)(_size / 2u);
+
+    auto close = [&](const Run& run, unsigned lastRow)
+    {
+        double x0 = ((double)run.start - half - 0.5) * _resolution;
+        double x1 = ((double)run.end - half + 0.5) * _resolution;
+        double y0 = ((double)run.firstRow - half - 0.5) * _resolution;
+        double y1 = ((double)lastRow - half + 0.5) * _resolution;
+
+        std::vector<osg::Vec3d> corners = {
+            osg::Vec3d(x0, y0, 0), osg::Vec3d(x1, y0, 0),
+            osg::Vec3d(x1, y1, 0), osg::Vec3d(x0, y1, 0) };
+
+        if (_localSRS->transform(corners, _mapSRS.get()))
+        {
+            Polygon* polygon = new Polygon(4);
+            for (auto& corner : corners)
+                polygon->push_back(osg::Vec3d(corner.x(), corner.y(), 0.0));
+            multi->add(polygon);
+        }
+    };
+
+    for (unsigned row = 0; row < _size; ++row)
+    {
+        next.clear();
+
+        for (unsigned col = 0; col < _size; )
+        {
+            if (getVisibility(col, row) != VISIBILITY_VISIBLE)
+            {
+                ++col;
+                continue;
+            }
+
+            Run run;
+            run.start = col;
+            while (col < _size && getVisibility(col, row) == VISIBILITY_VISIBLE)
+                ++col;
+            run.end = col - 1;
+            run.firstRow = row;
+
+            for (auto& prev : open)
+            {
+                if (prev.start == run.start && prev.end == run.end)
+                {
+                    run.firstRow = prev.firstRow;
+                    prev.firstRow = UINT_MAX; // continued
+                    break;
+                }
+            }
+            next.push_back(run);
+        }
+
+        for (auto& prev : open)
+        {
+            if (prev.firstRow != UINT_MAX)
+                close(prev, row - 1);
+        }
+
+        open.swap(next);
+    }
+
+    for (auto& run : open)
+        close(run, _size - 1);
+
+    return multi->getNumComponents() > 0 ? multi.release() : nullptr;
+}
+
+//........................................................................
+
+Viewshed::Viewshed(const Map* map) :
+    _map(map),
+    _radius(1000.0),
+    _resolution(10.0),
+    _targetHeight(0.0),
+    _parallel(true)
+{
+    //nop
+}
+
+void
+Viewshed::setMap(const Map* map)
+{
+    _map = map;
+}
+
+Viewshed::Result
+Viewshed::compute(ProgressCallback* progress) const
+{
+    OE_PROFILING_ZONE;
+
+    Result result;
+
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || !_observer.isValid() || _radius <= 0.0 || _resolution <= 0.0)
+        return result;
+
+    ElevationPool* pool = map->getElevationPool();
+    const SpatialReference* mapSRS = map->getSRS();
+
+    GeoPoint observer;
+    if (!pool || !_observer.transform(mapSRS, observer))
+        return result;
+
+    // Grid dimensions
+    double resolution = _resolution;
+    int half = (int)ceil(_radius / resolution);
+    if (half > maxHalfSize)
+    {
+        half = maxHalfSize;
+        resolution = _radius / (double)half;
+        OE_INFO << LC << "Viewshed too large; using a resolution of " << resolution << "m" << std::endl;
+    }
+    const unsigned size = 2u * (unsigned)half + 1u;
+
+    osg::ref_ptr<const SpatialReference> localSRS = mapSRS->createTangentPlaneSRS(observer.vec3d());
+    if (!localSRS.valid())
+        return result;
+
+    // Sample the elevation of every cell, in parallel bands of rows.
+    std::vector<float>& elevations = result._elevations;
+    elevations.assign(size*size, 0.0f);
+
+    Distance sampleResolution(resolution, Units::METERS);
+
+    // Set by any band that fails to sample, so we don't report a
+    // viewshed computed from missing elevations.
+    std::atomic<bool> samplingFailed(false);
+
+    auto sampleRows = [&](unsigned firstRow, unsigned lastRow)
+    {
+        std::vector<osg::Vec3d> points;
+        points.reserve((lastRow - firstRow) * size);
+        for (unsigned row = firstRow; row < lastRow; ++row)
+            for (unsigned col = 0; col < size; ++col)
+                points.emplace_back(((int)col - half)*resolution, ((int)row - half)*resolution, 0.0);
+
+        ElevationPool::WorkingSet ws;
+        if (!localSRS->transform(points, mapSRS) ||
+            pool->sampleMapCoords(points, sampleResolution, &ws, progress) < 0)
+        {
+            samplingFailed = true;
+            return;
+        }
+
+        float* out = &elevations[firstRow*size];
+        for (auto& p : points)
+        {
+            *out++ = p.z() != NO_DATA_VALUE ? (float)p.z() : 0.0f;
+        }
+    };
+
+    if (_parallel)
+    {
+        JobArena* arena = JobArena::arena("oe.viewshed");
+        JobGroup group;
+        for (unsigned first = rowsPerJob; first < size; first += rowsPerJob)
+        {
+            unsigned last = osg::minimum(size, first + rowsPerJob);
+            std::function<void()> job = [&sampleRows, first, last]() { sampleRows(first, last); };
+            arena->dispatch(job, &group);
+        }
+
+        // sample the first band on this thread while we wait
+        sampleRows(0u, osg::minimum(size, rowsPerJob));
+
+        group.join();
+    }
+    else
+    {
+        for (unsigned first = 0u; first < size && !samplingFailed; first += rowsPerJob)
+        {
+            sampleRows(first, osg::minimum(size, first + rowsPerJob));
+        }
+    }
+
+    if (progress && progress->isCanceled())
+        return result;
+
+    if (samplingFailed)
+    {
+        OE_WARN << LC << "Failed to sample elevation data; no viewshed computed" << std::endl;
+        return result;
+    }
+
+    // Observer altitude
+    double observerZ = observer.z();
+    if (observer.altitudeMode() == ALTMODE_RELATIVE)
+    {
+        observerZ += elevations[half*size + half];
+    }
+
+    // On a round earth the terrain drops away from the tangent plane
+    // with distance; account for that when comparing heights.
+    double curvature = 0.0;
+    if (mapSRS->isGeographic() && mapSRS->getEllipsoid())
+    {
+        curvature = 1.0 / (2.0 * mapSRS->getEllipsoid()->getRadiusEquator());
+    }
+
+    // Initialize the cells inside the radius to hidden; visible cells
+    // get marked by the sweep.
+    std::vector<std::atomic<unsigned char>> cells(size*size);
+    const double radius2 = (_radius * _radius) / (resolution * resolution);
+    for (unsigned row = 0; row < size; ++row)
+    {
+        double dy = (double)((int)row - half);
+        for (unsigned col = 0; col < size; ++col)
+        {
+            double dx = (double)((int)col - half);
+            cells[row*size + col].store(
+                dx*dx + dy*dy <= radius2 ? VISIBILITY_HIDDEN : VISIBILITY_OUTSIDE,
+                std::memory_order_relaxed);
+        }
+    }
+    cells[half*size + half].store(VISIBILITY_VISIBLE, std::memory_order_relaxed);
+
+    const double targetHeight = _targetHeight;
+
+    // Trace one ray from the observer to each perimeter cell, marking the
+    // cells along the way that rise above the horizon so far.
+    auto sweep = [&](int firstRay, int lastRay)
+    {
+        for (int ray = firstRay; ray < lastRay; ++ray)
+        {
+            int px, py;
+            getPerimeterCell(ray, half, px, py);
+
+            double maxSlope = -DBL_MAX;
+
+            for (int step = 1; step <= half; ++step)
+            {
+                int dx = (int)floor((double)(px * step) / (double)half + 0.5);
+                int dy = (int)floor((double)(py * step) / (double)half + 0.5);
+
+                unsigned index = (unsigned)((half + dy)*(int)size + (half + dx));
+                if (cells[index].load(std::memory_order_relaxed) == VISIBILITY_OUTSIDE)
+                    break;
+
+                double distance = sqrt((double)(dx*dx + dy*dy)) * resolution;
+                double drop = distance * distance * curvature;
+                double terrainZ = (double)elevations[index] - drop - observerZ;
+
+                double targetSlope = (terrainZ + targetHeight) / distance;
+                if (targetSlope >= maxSlope)
+                {
+                    cells[index].store(VISIBILITY_VISIBLE, std::memory_order_relaxed);
+                }
+
+                maxSlope = osg::maximum(maxSlope, terrainZ / distance);
+            }
+        }
+    };
+
+    if (half > 0 && !_parallel)
+    {
+        sweep(0, 8 * half);
+    }
+    else if (half > 0)
+    {
+        const int numRays = 8 * half;
+        const int raysPerSector = osg::maximum(1, numRays / numSectors);
+
+        JobArena* arena = JobArena::arena("oe.viewshed");
+        JobGroup group;
+        for (int first = raysPerSector; first < numRays; first += raysPerSector)
+        {
+            int last = osg::minimum(numRays, first + raysPerSector);
+            std::function<void()> job = [&sweep, first, last]() { sweep(first, last); };
+            arena->dispatch(job, &group);
+        }
+
+        // sweep the first sector on this thread while we wait
+        sweep(0, osg::minimum(numRays, raysPerSector));
+
+        group.join();
+    }
+
+    result._cells.resize(size*size);
+    for (unsigned i = 0; i < size*size; ++i)
+    {
+        result._cells[i] = cells[i].load(std::memory_order_relaxed);
+    }
+
+    result._size = size;
+    result._resolution = resolution;
+    result._observer = GeoPoint(mapSRS, observer.x(), observer.y(), observerZ, ALTMODE_ABSOLUTE);
+    result._localSRS = localSRS.get();
+    result._mapSRS = mapSRS;
+
+    return result;
+}
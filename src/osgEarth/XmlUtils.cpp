@@ -437,44 +437,98 @@ XmlDocument::load( const URI& uri, const osgDB::Options* dbOptions )
     return result;
 }
 
-XmlDocument*
-XmlDocument::load( std::istream& in, const URIContext& uriContext )
+namespace
 {
-    TiXmlDocument xmlDoc;
+    // Reads and parses an XML stream, reporting any errors.
+    bool parse(std::istream& in, const URIContext& uriContext, TiXmlDocument& xmlDoc)
+    {
+        //Read the entire document into a string
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        std::string xmlStr;
+        xmlStr = buffer.str();
 
-    //Read the entire document into a string
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string xmlStr;
-    xmlStr = buffer.str();
+        removeDocType( xmlStr );
+        //OE_NOTICE << xmlStr;
 
-    removeDocType( xmlStr );
-    //OE_NOTICE << xmlStr;
+        xmlDoc.Parse(xmlStr.c_str());    
 
-    XmlDocument* doc = NULL;
-    xmlDoc.Parse(xmlStr.c_str());    
+        if ( xmlDoc.Error() )
+        {
+            std::stringstream buf;
+            buf << "XML parsing error";
+            if (!uriContext.referrer().empty())
+                buf << " in \"" <<  uriContext.referrer() << "\"";
+            OE_WARN << buf.str() << std::endl;
+            OE_WARN << xmlDoc.ErrorDesc() << " (row " << xmlDoc.ErrorRow() << ", col " << xmlDoc.ErrorCol() << ")" << std::endl;
+
+            // print some context
+            StringVector output;
+            StringTokenizer lines(xmlStr, output, "\n", "", true, false);
+            int startLine = osg::maximum(0, xmlDoc.ErrorRow()-12);
+            int endLine = osg::minimum((int)(output.size())-1, xmlDoc.ErrorRow()+4);
+            for(int i=startLine; i<=endLine; ++i)
+            {
+                OE_WARN << " " << i+1 << (i+1 == xmlDoc.ErrorRow()? " *":"  ") << "\t" << output[i] << std::endl;
+            }
+        }
 
-    if ( xmlDoc.Error() )
+        return !xmlDoc.Error() && xmlDoc.RootElement();
+    }
+
+    // Converts a parsed element straight into a Config, with the same result
+    // as processNode() followed by XmlElement::getConfig().
+    void element2conf(const TiXmlElement* element, const std::string& referrer, Config& conf)
     {
-        std::stringstream buf;
-        buf << "XML parsing error";
-        if (!uriContext.referrer().empty())
-            buf << " in \"" <<  uriContext.referrer() << "\"";
-        OE_WARN << buf.str() << std::endl;
-        OE_WARN << xmlDoc.ErrorDesc() << " (row " << xmlDoc.ErrorRow() << ", col " << xmlDoc.ErrorCol() << ")" << std::endl;
-
-        // print some context
-        StringVector output;
-        StringTokenizer lines(xmlStr, output, "\n", "", true, false);
-        int startLine = osg::maximum(0, xmlDoc.ErrorRow()-12);
-        int endLine = osg::minimum((int)(output.size())-1, xmlDoc.ErrorRow()+4);
-        for(int i=startLine; i<=endLine; ++i)
+        std::string tag = osgEarth::toLower(element->Value());
+
+        XmlAttributes attrs;
+        for (const TiXmlAttribute* attr = element->FirstAttribute(); attr; attr = attr->Next())
+        {
+            attrs[osgEarth::toLower(attr->Name())] = attr->Value();
+        }
+
+        if (tag == "xi:include")
         {
-            OE_WARN << " " << i+1 << (i+1 == xmlDoc.ErrorRow()? " *":"  ") << "\t" << output[i] << std::endl;
+            conf = XmlElement(tag, attrs).getConfig(referrer);
+            conf.setReferrer(referrer);
+            return;
         }
+
+        conf.key() = tag;
+        conf.setReferrer(referrer);
+
+        for (XmlAttributes::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            conf.set(a->first, a->second);
+        }
+
+        std::string text;
+        for (const TiXmlNode* child = element->FirstChild(); child; child = child->NextSibling())
+        {
+            if (child->Type() == TiXmlNode::TINYXML_ELEMENT)
+            {
+                // build the child in place to avoid copying subtrees
+                conf.add(Config());
+                element2conf(child->ToElement(), referrer, conf.children().back());
+            }
+            else if (child->Type() == TiXmlNode::TINYXML_TEXT)
+            {
+                text += child->Value();
+            }
+        }
+
+        conf.setValue(trim(text));
     }
+}
+
+XmlDocument*
+XmlDocument::load( std::istream& in, const URIContext& uriContext )
+{
+    TiXmlDocument xmlDoc;
+    XmlDocument* doc = NULL;
 
-    if ( !xmlDoc.Error() && xmlDoc.RootElement() )
+    if ( parse(in, uriContext, xmlDoc) )
     {
         doc = new XmlDocument();
         processNode( doc,  xmlDoc.RootElement() );
@@ -483,6 +537,23 @@ XmlDocument::load( std::istream& in, const URIContext& uriContext )
     return doc;    
 }
 
+Config
+XmlDocument::loadConfig( std::istream& in, const URIContext& uriContext )
+{
+    TiXmlDocument xmlDoc;
+    if ( !parse(in, uriContext, xmlDoc) )
+        return Config();
+
+    // same layout as XmlDocument::getConfig(): a "Document" holding the root element
+    std::string referrer = URI("", uriContext).full();
+    Config conf( "Document" );
+    conf.setReferrer( referrer );
+    conf.add( Config() );
+    element2conf( xmlDoc.RootElement(), referrer, conf.children().back() );
+    conf.setReferrer( referrer );
+    return conf;
+}
+
 Config
 XmlDocument::getConfig() const
 {
@@ -222,18 +222,17 @@ class ReaderWriterEarth : public osgDB::ReaderWriter
             // from an "anonymous" stream here)
             URIContext uriContext( readOptions ); 
 
-            osg::ref_ptr<XmlDocument> doc = XmlDocument::load( in, uriContext );
-            if ( !doc.valid() )
+            Config docConf = XmlDocument::loadConfig( in, uriContext );
+            if ( docConf.empty() )
                 return ReadResult::ERROR_IN_READING_FILE;
 
-            Config docConf = doc->getConfig();
-
             // support both "map" and "earth" tag names at the top level
             Config conf;
-            if ( docConf.hasChild( "map" ) )
-                conf = docConf.child( "map" );
-            else if ( docConf.hasChild( "earth" ) )
-                conf = docConf.child( "earth" );
+            Config* mapConf = docConf.mutable_child( "map" );
+            if ( !mapConf )
+                mapConf = docConf.mutable_child( "earth" );
+            if ( mapConf )
+                conf = std::move( *mapConf );
 
             osg::ref_ptr<osg::Node> node;
 
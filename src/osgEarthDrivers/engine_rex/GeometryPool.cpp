@@ -22,7 +22,12 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/TopologyGraph>
 #include <osgEarth/Metrics>
+#include <osgEarth/Map>
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
 #include <osg/Point>
+#include <osg/Timer>
+#include <osg/ValueObject>
 #include <osgUtil/MeshOptimizers>
 #include <cstdlib> // for getenv
 
@@ -31,11 +36,42 @@ using namespace osgEarth::REX;
 
 #define LC "[GeometryPool] "
 
+#define PROFILING_REX_GEOMETRY_POOL "Geometry Pool Size"
+
+// Minimum time an unused constrained or prewarmed geometry stays in the
+// pool, so that a tile that pages out and back in can reuse its mesh.
+#define UNUSED_GEOMETRY_EXPIRY_SECONDS 30.0
+
+// User value holding the edits a cached constrained mesh was built from
+#define CACHED_MESH_SIGNATURE "oe.rex.edits"
+
+namespace
+{
+    std::size_t getArrayBytes(const osg::BufferData* data)
+    {
+        return data ? data->getTotalDataSize() : 0u;
+    }
+
+    std::size_t getGeometryBytes(const SharedGeometry* geom)
+    {
+        return
+            getArrayBytes(geom->getVertexArray()) +
+            getArrayBytes(geom->getNormalArray()) +
+            getArrayBytes(geom->getTexCoordArray()) +
+            getArrayBytes(geom->getNeighborArray()) +
+            getArrayBytes(geom->getNeighborNormalArray()) +
+            getArrayBytes(geom->getDrawElements());
+    }
+}
+
 
 GeometryPool::GeometryPool(const TerrainOptions& options) :
 _options ( options ),
 _enabled ( true ),
 _debug   ( false ),
+_generation( 0u ),
+_meshCacheInitialized( false ),
+_constrainedBytes( 0u ),
 _geometryMapMutex("GeometryPool(OE)")
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -79,6 +115,8 @@ GeometryPool::getPooledGeometry(
 
     if ( _enabled )
     {
+        std::string constrainedKey;
+
         // if this tile conatins mask/edit, it's a unique geometry - don't share it.
         if (!meshEditor.hasEdits())
         {
@@ -88,6 +126,54 @@ GeometryPool::getPooledGeometry(
             {
                 // found it:
                 out = i->second.get();
+                ++_stats.hits;
+
+                // first use of a prewarmed geometry; from here on the
+                // pool expires it normally.
+                _prewarmed.erase(geomKey);
+            }
+            else
+            {
+                ++_stats.misses;
+            }
+        }
+
+        else
+        {
+            // constrained geometry is unique to the tile and its edits, but
+            // we can still reuse it across reloads of the same tile.
+            createKeyForConstrainedTile(tileKey, tileSize, meshEditor, constrainedKey);
+            std::string cacheKey, cacheSignature;
+            {
+                Threading::ScopedMutexLock lock(_geometryMapMutex);
+                ConstrainedGeometryMap::iterator i = _constrainedMap.find(constrainedKey);
+                if (i != _constrainedMap.end())
+                {
+                    out = i->second._geom.get();
+                    i->second._lastUsed = osg::Timer::instance()->time_s();
+                    ++_stats.constrainedHits;
+                }
+                else
+                {
+                    ++_stats.constrainedMisses;
+                }
+            }
+
+            if (!out.valid())
+            {
+                CacheBin* bin = getMeshCacheBin(map);
+                if (bin && _meshCachePolicy.isCacheReadable())
+                {
+                    createCacheKeyForConstrainedTile(tileKey, tileSize, meshEditor, cacheKey, cacheSignature);
+                    out = readConstrainedGeometry(bin, cacheKey, cacheSignature);
+                    if (out.valid())
+                    {
+                        addConstrained(constrainedKey, tileKey, out.get());
+
+                        Threading::ScopedMutexLock lock(_geometryMapMutex);
+                        ++_stats.cacheReads;
+                    }
+                }
             }
         }
 
@@ -95,10 +181,30 @@ GeometryPool::getPooledGeometry(
         {
             out = createGeometry(tileKey, tileSize, meshEditor, progress);
 
-            if (!meshEditor.hasEdits() && out.valid())
+            if (out.valid())
             {
-                Threading::ScopedMutexLock lock(_geometryMapMutex);
-                _geometryMap[geomKey] = out.get();
+                if (!meshEditor.hasEdits())
+                {
+                    Threading::ScopedMutexLock lock(_geometryMapMutex);
+                    _geometryMap[geomKey] = out.get();
+                }
+
+                else if (progress == nullptr || !progress->isCanceled())
+                {
+                    addConstrained(constrainedKey, tileKey, out.get());
+
+                    CacheBin* bin = getMeshCacheBin(map);
+                    if (bin && _meshCachePolicy.isCacheWriteable())
+                    {
+                        if (cacheKey.empty())
+                            createCacheKeyForConstrainedTile(tileKey, tileSize, meshEditor, cacheKey, cacheSignature);
+
+                        writeConstrainedGeometry(bin, cacheKey, cacheSignature, out.get());
+
+                        Threading::ScopedMutexLock lock(_geometryMapMutex);
+                        ++_stats.cacheWrites;
+                    }
+                }
             }
         }
     }
@@ -109,6 +215,150 @@ GeometryPool::getPooledGeometry(
     }
 }
 
+void
+GeometryPool::prewarm(
+    const Map* map,
+    unsigned tileSize,
+    unsigned firstLOD,
+    unsigned numLODs)
+{
+    if (!_enabled || map == nullptr || map->getProfile() == nullptr)
+        return;
+
+    const Profile* profile = map->getProfile();
+
+    // Collect one key for each unique geometry. In a geographic profile each
+    // row of tiles has its own geometry; otherwise there's one per LOD.
+    const unsigned maxGeometries = 256u;
+    std::vector<TileKey> keys;
+    for (unsigned lod = firstLOD; lod < firstLOD + numLODs && keys.size() < maxGeometries; ++lod)
+    {
+        unsigned wide, high;
+        profile->getNumTiles(lod, wide, high);
+        unsigned rows = profile->getSRS()->isGeographic() ? high : 1u;
+
+        for (unsigned y = 0; y < rows && keys.size() < maxGeometries; ++y)
+        {
+            keys.push_back(TileKey(lod, 0, y, profile));
+        }
+    }
+
+    unsigned generation;
+    {
+        Threading::ScopedMutexLock lock(_geometryMapMutex);
+        if (!_defaultPrimSet.valid())
+        {
+            _defaultPrimSet = createPrimitiveSet(tileSize);
+        }
+        generation = _generation;
+    }
+
+    osg::observer_ptr<GeometryPool> pool_weak(this);
+
+    Job<bool>::dispatchAndForget("oe.rex",
+        [pool_weak, keys, tileSize, generation](Cancelable* progress)
+        {
+            for (auto& key : keys)
+            {
+                osg::ref_ptr<GeometryPool> pool;
+                if (!pool_weak.lock(pool) || (progress && progress->isCanceled()))
+                    return false;
+
+                if (!pool->prewarmGeometry(key, tileSize, generation))
+                    return false;
+            }
+            return true;
+        }
+    );
+
+    OE_DEBUG << LC << "Prewarming " << keys.size() << " geometries" << std::endl;
+}
+
+bool
+GeometryPool::prewarmGeometry(const TileKey& tileKey, unsigned tileSize, unsigned generation)
+{
+    GeometryKey geomKey;
+    createKeyForTileKey(tileKey, tileSize, geomKey);
+
+    {
+        Threading::ScopedMutexLock lock(_geometryMapMutex);
+        if (generation != _generation)
+            return false;
+        if (_geometryMap.find(geomKey) != _geometryMap.end())
+            return true;
+    }
+
+    // no map = no edits
+    MeshEditor meshEditor(tileKey, tileSize, nullptr, nullptr);
+    osg::ref_ptr<SharedGeometry> geom = createGeometry(tileKey, tileSize, meshEditor, nullptr);
+    if (!geom.valid())
+        return true;
+
+    Threading::ScopedMutexLock lock(_geometryMapMutex);
+
+    // pool was cleared while we were working
+    if (generation != _generation)
+        return false;
+
+    // a tile may have beaten us to it
+    if (_geometryMap.find(geomKey) == _geometryMap.end())
+    {
+        _geometryMap[geomKey] = geom.get();
+        _prewarmed[geomKey] = osg::Timer::instance()->time_s();
+        ++_stats.prewarmed;
+    }
+
+    return true;
+}
+
+GeometryPool::Stats
+GeometryPool::getStats() const
+{
+    Threading::ScopedMutexLock lock(_geometryMapMutex);
+    return _stats;
+}
+
+std::size_t
+GeometryPool::getConstrainedBytes() const
+{
+    Threading::ScopedMutexLock lock(_geometryMapMutex);
+    return _constrainedBytes;
+}
+
+void
+GeometryPool::addConstrained(const std::string& key, const TileKey& tileKey, SharedGeometry* geom)
+{
+    Threading::ScopedMutexLock lock(_geometryMapMutex);
+    ConstrainedGeometry& entry = _constrainedMap[key];
+    if (entry._geom.valid())
+        _constrainedBytes -= entry._bytes;
+    entry._geom = geom;
+    entry._key = tileKey;
+    entry._bytes = getGeometryBytes(geom);
+    entry._lastUsed = osg::Timer::instance()->time_s();
+    _constrainedBytes += entry._bytes;
+}
+
+void
+GeometryPool::invalidateConstrained(const GeoExtent& extent, unsigned minLevel, unsigned maxLevel)
+{
+    Threading::ScopedMutexLock lock(_geometryMapMutex);
+
+    for (ConstrainedGeometryMap::iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); )
+    {
+        const TileKey& key = i->second._key;
+        if (minLevel <= key.getLOD() &&
+            maxLevel >= key.getLOD() &&
+            (extent.isInvalid() || extent.intersects(key.getExtent())))
+        {
+            // tiles still using it keep their reference
+            _constrainedBytes -= i->second._bytes;
+            i = _constrainedMap.erase(i);
+        }
+        else ++i;
+    }
+}
+
 void
 GeometryPool::createKeyForTileKey(const TileKey& tileKey,
                                   unsigned tileSize,
@@ -119,6 +369,143 @@ GeometryPool::createKeyForTileKey(const TileKey& tileKey,
     out.size = tileSize;
 }
 
+void
+GeometryPool::createKeyForConstrainedTile(const TileKey& tileKey,
+                                          unsigned tileSize,
+                                          const MeshEditor& editor,
+                                          std::string& out) const
+{
+    // The terrain options are fixed for the life of the pool, so in memory
+    // the edits alone tell meshes for the same tile apart.
+    out = Stringify() << tileKey.str() << "_" << tileSize << "_" << editor.getEditsKey();
+}
+
+void
+GeometryPool::createCacheKeyForConstrainedTile(const TileKey& tileKey,
+                                               unsigned tileSize,
+                                               const MeshEditor& editor,
+                                               std::string& out_key,
+                                               std::string& out_signature) const
+{
+    // Everything that affects the generated mesh goes into the signature,
+    // which is stored with the cached mesh and compared on read, so that
+    // a hash collision never returns a mesh built from something else.
+    std::stringstream buf;
+    buf << _options.heightFieldSkirtRatio().get()
+        << '|' << (_options.morphTerrain() == true ? 1 : 0)
+        << '|' << (_options.gpuTessellation() == true ? 1 : 0)
+        << '|' << editor.getEditsSignature();
+
+    out_signature = buf.str();
+    out_key = Stringify() << tileKey.str() << "_" << tileSize << "_" << hashToString(out_signature);
+}
+
+CacheBin*
+GeometryPool::getMeshCacheBin(const Map* map)
+{
+    Threading::ScopedMutexLock lock(_geometryMapMutex);
+
+    if (!_meshCacheInitialized && map)
+    {
+        _meshCacheInitialized = true;
+
+        CacheSettings* cacheSettings = CacheSettings::get(map->getReadOptions());
+        if (cacheSettings && cacheSettings->isCacheEnabled() && cacheSettings->getCache())
+        {
+            std::string binID = Stringify()
+                << "rex_meshes_" << hashToString(map->getProfile()->getHorizSignature());
+
+            _meshCacheBin = cacheSettings->getCache()->addBin(binID);
+            if (_meshCacheBin.valid())
+            {
+                _meshCachePolicy = cacheSettings->cachePolicy().get();
+                OE_INFO << LC << "Caching constrained meshes in bin " << binID << std::endl;
+            }
+        }
+    }
+
+    return _meshCacheBin.get();
+}
+
+SharedGeometry*
+GeometryPool::readConstrainedGeometry(CacheBin* bin, const std::string& key, const std::string& signature) const
+{
+    ReadResult r = bin->readObject(key, nullptr);
+    if (!r.succeeded() || _meshCachePolicy.isExpired(r.lastModifiedTime()))
+        return nullptr;
+
+    const osg::Geometry* stored = dynamic_cast<const osg::Geometry*>(r.getObject());
+    if (stored == nullptr || stored->getNumPrimitiveSets() == 0)
+        return nullptr;
+
+    // the key is only a hash; make sure the mesh was built from these edits
+    std::string storedSignature;
+    if (!stored->getUserValue(CACHED_MESH_SIGNATURE, storedSignature) || storedSignature != signature)
+        return nullptr;
+
+    osg::Array* verts = const_cast<osg::Array*>(stored->getVertexArray());
+    osg::Array* normals = const_cast<osg::Array*>(stored->getNormalArray());
+    osg::Array* texCoords = const_cast<osg::Array*>(stored->getTexCoordArray(0));
+    osg::Array* neighbors = const_cast<osg::Array*>(stored->getTexCoordArray(1));
+    osg::Array* neighborNormals = const_cast<osg::Array*>(stored->getTexCoordArray(2));
+    osg::DrawElements* primSet = dynamic_cast<osg::DrawElements*>(
+        const_cast<osg::PrimitiveSet*>(stored->getPrimitiveSet(0)));
+
+    if (!verts || !normals || !texCoords || !primSet)
+        return nullptr;
+
+    // cached mesh must match our morphing configuration
+    if (_options.morphTerrain() == true && (!neighbors || !neighborNormals))
+        return nullptr;
+
+    osg::ref_ptr<SharedGeometry> geom = new SharedGeometry();
+    osg::ref_ptr<osg::VertexBufferObject> vbo = new osg::VertexBufferObject();
+
+    verts->setVertexBufferObject(vbo.get());
+    geom->setVertexArray(verts);
+
+    normals->setVertexBufferObject(vbo.get());
+    geom->setNormalArray(normals);
+
+    texCoords->setVertexBufferObject(vbo.get());
+    geom->setTexCoordArray(texCoords);
+
+    if (_options.morphTerrain() == true)
+    {
+        neighbors->setVertexBufferObject(vbo.get());
+        geom->setNeighborArray(neighbors);
+
+        neighborNormals->setVertexBufferObject(vbo.get());
+        geom->setNeighborNormalArray(neighborNormals);
+    }
+
+    geom->setDrawElements(primSet);
+    geom->setHasConstraints(true);
+
+    return geom.release();
+}
+
+void
+GeometryPool::writeConstrainedGeometry(CacheBin* bin, const std::string& key, const std::string& signature, SharedGeometry* geom) const
+{
+    // Store as a regular osg::Geometry so the cache can serialize it.
+    osg::ref_ptr<osg::Geometry> stored = new osg::Geometry();
+    stored->setUseVertexBufferObjects(true);
+    stored->setUseDisplayList(false);
+    stored->setVertexArray(geom->getVertexArray());
+    stored->setNormalArray(geom->getNormalArray());
+    stored->setTexCoordArray(0, geom->getTexCoordArray());
+    if (geom->getNeighborArray())
+        stored->setTexCoordArray(1, geom->getNeighborArray());
+    if (geom->getNeighborNormalArray())
+        stored->setTexCoordArray(2, geom->getNeighborNormalArray());
+    if (geom->getDrawElements())
+        stored->addPrimitiveSet(geom->getDrawElements());
+    stored->setUserValue(CACHED_MESH_SIGNATURE, signature);
+
+    bin->write(key, stored.get(), nullptr);
+}
+
 int
 GeometryPool::getNumSkirtElements(unsigned tileSize) const
 {
@@ -426,11 +813,26 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
     {
         Threading::ScopedMutexLock lock(_geometryMapMutex);
 
+        // Unused geometries stay in the pool for a while, so that a tile
+        // that pages out and back in can reuse its mesh.
+        double now = osg::Timer::instance()->time_s();
+        double expiry = osg::maximum(_options.minExpiryTime().get(), UNUSED_GEOMETRY_EXPIRY_SECONDS);
+
+        // Prewarmed geometries are kept until first use or until they
+        // expire, so they don't get released before any tile needs them.
         std::vector<GeometryKey> keys;
         for (GeometryMap::iterator i = _geometryMap.begin(); i != _geometryMap.end(); ++i)
         {
             if (i->second.get()->referenceCount() == 1)
             {
+                PrewarmedMap::iterator p = _prewarmed.find(i->first);
+                if (p != _prewarmed.end())
+                {
+                    if (now - p->second <= expiry)
+                        continue;
+                    _prewarmed.erase(p);
+                }
+
                 keys.push_back(i->first);
                 i->second->releaseGLObjects(NULL);
 
@@ -441,6 +843,26 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
         {
             _geometryMap.erase(*key);
         }
+        _stats.evictions += (unsigned)keys.size();
+
+        for (ConstrainedGeometryMap::iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); )
+        {
+            if (i->second._geom->referenceCount() > 1)
+            {
+                i->second._lastUsed = now;
+                ++i;
+            }
+            else if (now - i->second._lastUsed > expiry)
+            {
+                i->second._geom->releaseGLObjects(NULL);
+                _constrainedBytes -= i->second._bytes;
+                i = _constrainedMap.erase(i);
+                ++_stats.evictions;
+            }
+            else ++i;
+        }
+
+        OE_PROFILING_PLOT(PROFILING_REX_GEOMETRY_POOL, (float)(_geometryMap.size() + _constrainedMap.size()));
     }
 
     osg::Group::traverse(nv);
@@ -452,6 +874,12 @@ GeometryPool::clear()
     releaseGLObjects(NULL);
     Threading::ScopedMutexLock lock(_geometryMapMutex);
     _geometryMap.clear();
+    _prewarmed.clear();
+    _constrainedMap.clear();
+    _constrainedBytes = 0u;
+
+    // invalidates any prewarm in progress
+    ++_generation;
 }
 
 void
@@ -467,6 +895,10 @@ GeometryPool::resizeGLObjectBuffers(unsigned maxsize)
         {
             i->second->resizeGLObjectBuffers(maxsize);
         }
+        for (ConstrainedGeometryMap::const_iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); ++i)
+        {
+            i->second._geom->resizeGLObjectBuffers(maxsize);
+        }
     }
 }
 
@@ -490,6 +922,14 @@ GeometryPool::releaseGLObjects(osg::State* state) const
                     i->second->releaseGLObjects(state);
             }
 
+            for (ConstrainedGeometryMap::const_iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); ++i)
+            {
+                if (_releaser.valid())
+                    objects.push_back(i->second._geom.get());
+                else
+                    i->second._geom->releaseGLObjects(state);
+            }
+
             if (_releaser.valid() && !objects.empty())
             {
                 OE_DEBUG << LC << "Released " << objects.size() << " objects in the geometry pool\n";
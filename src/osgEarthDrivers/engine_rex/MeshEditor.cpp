@@ -5,9 +5,14 @@
 #include <osgEarth/Map>
 #include <osgEarth/Math>
 #include <osgEarth/TerrainConstraintLayer>
+#include <osgEarth/FeatureSource>
+#include <osgEarth/Threading>
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
 #include <osgEarth/rtree.h>
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 
 #define LC "[MeshEditor] "
 
@@ -19,6 +24,10 @@ MeshEditor::MeshEditor(const TileKey& key, unsigned tileSize, const Map* map, Pr
     _tileSize(tileSize),
     _tileEmpty(false)
 {
+    // no map means no edits (e.g., when pre-building the default meshes)
+    if (map == nullptr)
+        return;
+
     // Iterate over all constraint layers:
     std::vector<osg::ref_ptr<TerrainConstraintLayer>> layers;
     map->getOpenLayers(layers);
@@ -68,6 +77,73 @@ MeshEditor::MeshEditor(const TileKey& key, unsigned tileSize, const Map* map, Pr
     }
 }
 
+std::string
+MeshEditor::getEditsKey() const
+{
+    std::stringstream buf;
+    for (auto& edit : _edits)
+    {
+        const TerrainConstraintLayer::Options& o = edit._layer->options();
+        buf << edit._layer->getUID() << '.' << edit._layer->getRevision()
+            << ':' << (o.removeInterior() == true ? 1 : 0)
+            << (o.removeExterior() == true ? 1 : 0)
+            << (o.hasElevation() == true ? 1 : 0);
+
+        FeatureSource* fs = edit._layer->getFeatureSource();
+        if (fs)
+            buf << ':' << fs->getUID() << '.' << fs->getRevision();
+
+        buf << ':' << edit._features.size() << '(';
+        for (auto& feature : edit._features)
+            buf << feature->getFID() << ',';
+        buf << ");";
+    }
+    return buf.str();
+}
+
+const std::string&
+MeshEditor::getEditsSignature() const
+{
+    if (!_signature.empty() || _edits.empty())
+        return _signature;
+
+    // The signature checks a persistent cache, so it is built from the
+    // content of the edits (the layer settings that affect meshing and the
+    // feature geometry) rather than from in-process revision counters.
+    std::stringstream buf;
+    for (auto& edit : _edits)
+    {
+        const TerrainConstraintLayer::Options& o = edit._layer->options();
+        buf << edit._layer->getName()
+            << ':' << (o.removeInterior() == true ? 1 : 0)
+            << (o.removeExterior() == true ? 1 : 0)
+            << (o.hasElevation() == true ? 1 : 0)
+            << ':';
+
+        for (auto& feature : edit._features)
+        {
+            buf << feature->getFID() << '(';
+            ConstGeometryIterator geom_iter(feature->getGeometry(), true);
+            while (geom_iter.hasMore())
+            {
+                const Geometry* part = geom_iter.next();
+                buf << part->size() << '[';
+                if (!part->empty())
+                {
+                    buf.write(
+                        reinterpret_cast<const char*>(&part->front()),
+                        part->size() * sizeof(osg::Vec3d));
+                }
+                buf << ']';
+            }
+            buf << ')';
+        }
+        buf << ';';
+    }
+    _signature = buf.str();
+    return _signature;
+}
+
 namespace
 {
     // MESHING SDK
@@ -307,6 +383,7 @@ namespace
     {
         int uidgen;
         std::unordered_map<UID, triangle_t> _triangles;
+        std::unordered_set<UID> _degenerate_triangles;
         spatial_index_t _spatial_index;
         vert_table_t _vert_lut;
         vert_array_t _verts;
@@ -322,6 +399,8 @@ namespace
         {
             UID uid = tri.uid;
             _spatial_index.Remove(tri.a_min, tri.a_max, uid);
+            if (tri.is_2d_degenerate)
+                _degenerate_triangles.erase(uid);
             _triangles.erase(uid);
             _num_splits++;
         }
@@ -359,6 +438,8 @@ namespace
 
             _triangles.emplace(uid, tri);
             _spatial_index.Insert(tri.a_min, tri.a_max, uid);
+            if (tri.is_2d_degenerate)
+                _degenerate_triangles.insert(uid);
             return uid;
         }
 
@@ -908,6 +989,8 @@ MeshEditor::createTileMesh(
     double skirtHeightRatio,
     Cancelable* progress)
 {
+    OE_PROFILING_ZONE;
+
     // uncomment for easier debugging
     //static Mutex m;
     //ScopedMutexLock lock(m);
@@ -977,6 +1060,61 @@ MeshEditor::createTileMesh(
         }
     }
 
+    if (progress && progress->isCanceled())
+        return false;
+
+    // Transform all the constraint geometry into the tile's local frame
+    // up front. Features are independent of each other, so when there are
+    // a lot of them (e.g., a dense road network) do this in parallel.
+    std::vector<Feature*> features;
+    for (auto& edit : _edits)
+        for (auto& feature : edit._features)
+            features.push_back(feature.get());
+
+    auto toLocal = [tileSRS, world2local](Feature* feature)
+    {
+        osg::Vec3d world;
+        GeometryIterator geom_iter(feature->getGeometry(), true);
+        while (geom_iter.hasMore())
+        {
+            Geometry* part = geom_iter.next();
+            for (auto& point : *part)
+            {
+                tileSRS->transformToWorld(point, world);
+                point = world * world2local;
+            }
+        }
+    };
+
+    const unsigned featuresPerJob = 16u;
+
+    if (features.size() > featuresPerJob)
+    {
+        JobArena* arena = JobArena::arena("oe.rex.mesh");
+        JobGroup group;
+        for (unsigned first = featuresPerJob; first < features.size(); first += featuresPerJob)
+        {
+            unsigned last = std::min((unsigned)features.size(), first + featuresPerJob);
+            std::function<void()> job = [&features, &toLocal, first, last]()
+            {
+                for (unsigned i = first; i < last; ++i)
+                    toLocal(features[i]);
+            };
+            arena->dispatch(job, &group);
+        }
+
+        // do the first batch on this thread while we wait
+        for (unsigned i = 0; i < featuresPerJob; ++i)
+            toLocal(features[i]);
+
+        group.join();
+    }
+    else
+    {
+        for (auto feature : features)
+            toLocal(feature);
+    }
+
     if (progress && progress->isCanceled())
         return false;
 
@@ -998,7 +1136,6 @@ MeshEditor::createTileMesh(
         for (auto& feature : edit._features)
         {
             GeometryIterator geom_iter(feature->getGeometry(), true);
-            osg::Vec3d world, unit;
             while (geom_iter.hasMore())
             {
                 if (mesh._triangles.size() >= max_num_triangles)
@@ -1012,12 +1149,6 @@ MeshEditor::createTileMesh(
 
                 Geometry* part = geom_iter.next();
 
-                for (auto& point : *part)
-                {
-                    tileSRS->transformToWorld(point, world);
-                    point = world * world2local;
-                }
-
                 int marker = default_marker;
 
                 if (part->isPointSet())
@@ -1083,9 +1214,25 @@ MeshEditor::createTileMesh(
                     {
                         std::list<triangle_t*> trisToRemove;
 
-                        for (auto& tri_iter : mesh._triangles)
+                        // only triangles overlapping the part's bounds can be inside it.
+                        Bounds bounds = part->getBounds();
+                        vert_t::value_type a_min[2] = { bounds.xMin(), bounds.yMin() };
+                        vert_t::value_type a_max[2] = { bounds.xMax(), bounds.yMax() };
+                        std::vector<UID> uids;
+                        mesh._spatial_index.Search(a_min, a_max, &uids, ~0);
+
+                        for (auto uid : uids)
                         {
-                            triangle_t& tri = tri_iter.second;
+                            auto tri_iter = mesh._triangles.find(uid);
+                            if (tri_iter == mesh._triangles.end())
+                                continue;
+
+                            triangle_t& tri = tri_iter->second;
+
+                            // handled below
+                            if (tri.is_2d_degenerate)
+                                continue;
+
                             vert_t c = (tri.p0 + tri.p1 + tri.p2) * (1.0 / 3.0);
 
                             bool inside = part->contains2D(c.x(), c.y());
@@ -1101,14 +1248,14 @@ MeshEditor::createTileMesh(
                                 // - duplicate tris to make water surface+bed
                                 // ... pluggable behavior ?
                             }
+                        }
 
-                            // this will remove "sliver" triangles that are coincident with
-                            // the boundary, that would otherwise cause skirts to appear 
-                            // where there are (apparently) no surface.
-                            else if (tri.is_2d_degenerate)
-                            {
-                                trisToRemove.push_back(&tri);
-                            }
+                        // this will remove "sliver" triangles that are coincident with
+                        // the boundary, that would otherwise cause skirts to appear 
+                        // where there are (apparently) no surface.
+                        for (auto uid : mesh._degenerate_triangles)
+                        {
+                            trisToRemove.push_back(&mesh._triangles[uid]);
                         }
 
                         for (auto tri : trisToRemove)
@@ -51,6 +51,20 @@ using namespace osgEarth;
 
 #define DEFAULT_MAX_LOD 19u
 
+#define PROFILING_REX_CULL_VIEWS 6
+
+namespace
+{
+    const char* s_cullTimePlotNames[PROFILING_REX_CULL_VIEWS] = {
+        "Terrain Cull View 0 (ms)",
+        "Terrain Cull View 1 (ms)",
+        "Terrain Cull View 2 (ms)",
+        "Terrain Cull View 3 (ms)",
+        "Terrain Cull View 4 (ms)",
+        "Terrain Cull View 5 (ms)"
+    };
+}
+
 //------------------------------------------------------------------------
 
 namespace
@@ -313,6 +327,8 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     _unloader->setMaxAge(options().minExpiryTime().get());
     _unloader->setMaxTilesToUnloadPerFrame(options().maxTilesToUnloadPerFrame().get());
     _unloader->setMinimumRange(options().minExpiryRange().get());
+    _unloader->setMemoryBudget((std::size_t)options().tileMemoryBudget().get() * 1048576u);
+    _unloader->setGeometryPool(_geometryPool.get());
     //_unloader->setReleaser(_releaser.get());
     this->addChild( _unloader.get() );
 
@@ -401,6 +417,9 @@ RexTerrainEngineNode::invalidateRegion(
         }
 
         _liveTiles->setDirty(extentLocal, minLevel, maxLevel, manifest);
+
+        // constraint features may have changed in place
+        _geometryPool->invalidateConstrained(extentLocal, minLevel, maxLevel);
     }
 }
 
@@ -437,6 +456,9 @@ RexTerrainEngineNode::invalidateRegion(
         }
 
         _liveTiles->setDirty(extentLocal, minLevel, maxLevel, manifest);
+
+        // constraint features may have changed in place
+        _geometryPool->invalidateConstrained(extentLocal, minLevel, maxLevel);
     }
 }
 
@@ -561,6 +583,14 @@ RexTerrainEngineNode::dirtyTerrain()
     // scrub the geometry pool:
     _geometryPool->clear();
 
+    // start building the shared geometries for the first few LODs in the
+    // background so they're ready when those tiles start to load.
+    _geometryPool->prewarm(
+        getMap(),
+        options().tileSize().get(),
+        options().firstLOD().get(),
+        4u);
+
     // Build the first level of the terrain.
     // Collect the tile keys comprising the root tiles of the terrain.
     std::vector<TileKey> keys;
@@ -621,6 +651,35 @@ RexTerrainEngineNode::cacheAllLayerExtentsInMapSRS()
         cacheLayerExtentInMapSRS(i->get());
     }
 }
+int
+RexTerrainEngineNode::getCullViewIndex(const osg::Camera* camera)
+{
+    Threading::ScopedMutexLock lock(_cullViewsMutex);
+
+    int firstFree = -1;
+    for (unsigned i = 0; i < _cullViews.size(); ++i)
+    {
+        if (_cullViews[i].get() == camera)
+            return i;
+        if (firstFree < 0 && !_cullViews[i].valid())
+            firstFree = i;
+    }
+
+    if (firstFree >= 0)
+    {
+        _cullViews[firstFree] = camera;
+        return firstFree;
+    }
+
+    if (_cullViews.size() < PROFILING_REX_CULL_VIEWS)
+    {
+        _cullViews.push_back(camera);
+        return _cullViews.size() - 1;
+    }
+
+    return -1;
+}
+
 void
 RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 {
@@ -630,6 +689,11 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 
     osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
 
+    OE_PROFILING_ZONE_TEXT(cv->getCurrentCamera()->getName());
+
+    const bool plotCullTime = osgEarth::Util::Metrics::enabled();
+    osg::Timer_t cullStart = plotCullTime ? osg::Timer::instance()->tick() : 0;
+
     // Initialize a new culler
     TerrainCuller culler(cv, this->getEngineContext());
 
@@ -639,6 +703,9 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
     // Assemble the terrain drawables:
     _terrain->accept(culler);
 
+    // Build the draw commands for the tiles that passed the cull:
+    culler.buildDrawCommands();
+
     // If we're using geometry pooling, optimize the drawable for shared state
     // by sorting the draw commands.
     // TODO: benchmark this further to see whether it's worthwhile
@@ -763,6 +830,17 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
         OE_DEBUG << LC << "Detected " << culler._orphanedPassesDetected << " orphaned rendering passes\n";
     }
 
+    if (plotCullTime)
+    {
+        int view = getCullViewIndex(cv->getCurrentCamera());
+        if (view >= 0)
+        {
+            OE_PROFILING_PLOT(
+                s_cullTimePlotNames[view],
+                (float)osg::Timer::instance()->delta_m(cullStart, osg::Timer::instance()->tick()));
+        }
+    }
+
     // we don't call this b/c we don't want _terrain
     //TerrainEngineNode::traverse(nv);
 
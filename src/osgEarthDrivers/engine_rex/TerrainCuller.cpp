@@ -23,11 +23,38 @@
 #include <osgEarth/TraversalData>
 #include <osgEarth/VisibleLayer>
 #include <osgEarth/Shadowing>
+#include <osgEarth/Threading>
+#include <cstdlib> // for getenv
 
 #define LC "[TerrainCuller] "
 
 using namespace osgEarth::REX;
 
+namespace
+{
+    // Set OSGEARTH_REX_VERIFY_DRAW_COMMANDS to build the draw commands both
+    // in parallel and serially every frame and report any difference. Slow;
+    // meant for checking the parallel builder against recorded camera paths.
+    const bool s_verifyDrawCommands = ::getenv("OSGEARTH_REX_VERIFY_DRAW_COMMANDS") != 0L;
+
+    bool sameDrawCommand(const DrawTileCommand& a, const DrawTileCommand& b)
+    {
+        return
+            a._modelViewMatrix == b._modelViewMatrix &&
+            a._sharedSamplers == b._sharedSamplers &&
+            a._colorSamplers == b._colorSamplers &&
+            a._geom == b._geom &&
+            a._tile == b._tile &&
+            a._key == b._key &&
+            a._keyValue == b._keyValue &&
+            a._tileRevision == b._tileRevision &&
+            a._elevTexelCoeff == b._elevTexelCoeff &&
+            a._morphConstants == b._morphConstants &&
+            a._range == b._range &&
+            a._layerOrder == b._layerOrder;
+    }
+}
+
 
 TerrainCuller::TerrainCuller(osgUtil::CullVisitor* cullVisitor, EngineContext* context) :
 _camera(0L),
@@ -72,6 +99,26 @@ TerrainCuller::getDistanceToViewPoint(const osg::Vec3& pos, bool withLODScale) c
     return _cv->getDistanceToViewPoint(pos, withLODScale);
 }
 
+bool
+TerrainCuller::isCulledByLayerExtent(const LayerDrawable* drawable, const TileNode* tileNode) const
+{
+    if (drawable->_layer && _layerExtents)
+    {
+        // Use find() so this is safe to call from multiple threads.
+        LayerExtentMap::const_iterator i = _layerExtents->find(drawable->_layer->getUID());
+        if (i != _layerExtents->end())
+        {
+            const LayerExtent& le = i->second;
+            if (le._extent.isValid() &&
+                ! le._extent.intersects(tileNode->getKey().getExtent(), false))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 DrawTileCommand*
 TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const RenderingPass* pass, TileNode* tileNode)
 {
@@ -79,8 +126,6 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
     if ( !surface )
         return 0L;
 
-    const RenderBindings& bindings = _context->getRenderBindings();
-
     // skip layers that are not visible:
     if (pass && 
         pass->visibleLayer() && 
@@ -94,63 +139,13 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
     osg::ref_ptr<LayerDrawable> drawable = _terrain.layer(uid);
     if (drawable.valid())
     {
-        // Layer marked for drawing?
-        if (drawable->_draw)
+        // Layer marked for drawing? Cull based on the layer extent.
+        if (drawable->_draw && !isCulledByLayerExtent(drawable.get(), tileNode))
         {
-            // Cull based on the layer extent.
-            if (drawable->_layer)
-            {
-                const LayerExtent& le = (*_layerExtents)[drawable->_layer->getUID()];
-                if (le._extent.isValid() &&
-                    ! le._extent.intersects(tileNode->getKey().getExtent(), false))
-                {
-                    // culled out!
-                    //OE_DEBUG << LC << "Skippping " << drawable->_layer->getName() 
-                    //    << " key " << tileNode->getKey().str()
-                    //    << " because it was culled by extent." << std::endl;
-                    return 0L;
-                }            
-            }
-
-            drawable->_tiles.push_back(DrawTileCommand());
-            DrawTileCommand* tile = &drawable->_tiles.back();
-
-            // install everything we need in the Draw Command:
-            tile->_colorSamplers = pass ? &(pass->samplers()) : 0L;
-            tile->_sharedSamplers = &model->_sharedSamplers;
-            tile->_modelViewMatrix = _cv->getModelViewMatrix();
-            tile->_keyValue = tileNode->getTileKeyValue();
-            tile->_geom = surface->getDrawable()->_geom.get();
-            tile->_tile = surface->getDrawable();
-            //tile->_provider = surface->getDrawable();
-            tile->_morphConstants = tileNode->getMorphConstants();
-            tile->_key = &tileNode->getKey();
-            tile->_tileRevision = tileNode->getRevision();
-
             osg::Vec3 c = surface->getBound().center() * surface->getInverseMatrix();
-            tile->_range = getDistanceToViewPoint(c, true);
+            float range = getDistanceToViewPoint(c, true);
 
-            tile->_layerOrder = drawable->_drawOrder;
-
-            const osg::Image* elevRaster = tileNode->getElevationRaster();
-            if (elevRaster)
-            {
-                float bias = _context->getUseTextureBorder() ? 1.5 : 0.5;
-
-                // Compute an elevation texture sampling scale/bias so we sample elevation data on center
-                // instead of on edge (as we do with color, etc.)
-                //
-                // This starts out as:
-                //   scale = (size-1)/size : this shrinks the sample area by one texel since we're sampling on center
-                //   bias = 0.5/size : this shifts the sample area over 1/2 texel to the center.
-                //
-                // But, since we also have a 1-texel border, we need to further reduce the scale by 2 texels to
-                // remove the border, and shift an extra texel over as well. Giving us this:
-                float size = (float)elevRaster->s();
-                tile->_elevTexelCoeff.set((size - (2.0*bias)) / size, bias / size);
-            }
-
-            return tile;
+            return addDrawCommand(drawable.get(), model, pass, tileNode, _cv->getModelViewMatrix(), range);
         }
     }
     else if (pass)
@@ -168,6 +163,236 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
     return 0L;
 }
 
+DrawTileCommand*
+TerrainCuller::addDrawCommand(LayerDrawable* drawable,
+                              const TileRenderModel* model,
+                              const RenderingPass* pass,
+                              TileNode* tileNode,
+                              const osg::RefMatrix* modelViewMatrix,
+                              float range) const
+{
+    // Only touches the one LayerDrawable, so it's safe to build commands
+    // for different drawables in parallel.
+    SurfaceNode* surface = tileNode->getSurfaceNode();
+
+    drawable->_tiles.push_back(DrawTileCommand());
+    DrawTileCommand* tile = &drawable->_tiles.back();
+
+    // install everything we need in the Draw Command:
+    tile->_colorSamplers = pass ? &(pass->samplers()) : 0L;
+    tile->_sharedSamplers = &model->_sharedSamplers;
+    tile->_modelViewMatrix = modelViewMatrix;
+    tile->_keyValue = tileNode->getTileKeyValue();
+    tile->_geom = surface->getDrawable()->_geom.get();
+    tile->_tile = surface->getDrawable();
+    //tile->_provider = surface->getDrawable();
+    tile->_morphConstants = tileNode->getMorphConstants();
+    tile->_key = &tileNode->getKey();
+    tile->_tileRevision = tileNode->getRevision();
+    tile->_range = range;
+    tile->_layerOrder = drawable->_drawOrder;
+
+    const osg::Image* elevRaster = tileNode->getElevationRaster();
+    if (elevRaster)
+    {
+        float bias = _context->getUseTextureBorder() ? 1.5 : 0.5;
+
+        // Compute an elevation texture sampling scale/bias so we sample elevation data on center
+        // instead of on edge (as we do with color, etc.)
+        //
+        // This starts out as:
+        //   scale = (size-1)/size : this shrinks the sample area by one texel since we're sampling on center
+        //   bias = 0.5/size : this shifts the sample area over 1/2 texel to the center.
+        //
+        // But, since we also have a 1-texel border, we need to further reduce the scale by 2 texels to
+        // remove the border, and shift an extra texel over as well. Giving us this:
+        float size = (float)elevRaster->s();
+        tile->_elevTexelCoeff.set((size - (2.0*bias)) / size, bias / size);
+    }
+
+    return tile;
+}
+
+void
+TerrainCuller::buildDrawCommands(LayerDrawable* drawable, DeferredDrawCommands& commands)
+{
+    // Commands were queued in traversal order, so the resulting
+    // order within the drawable matches a serial cull.
+    for (auto& command : commands)
+    {
+        const CulledTile& culled = _culledTiles[command._tile];
+        command._index = -1;
+
+        if (!isCulledByLayerExtent(drawable, culled._tileNode))
+        {
+            addDrawCommand(
+                drawable,
+                &culled._tileNode->renderModel(),
+                command._pass,
+                culled._tileNode,
+                culled._modelViewMatrix.get(),
+                culled._range);
+
+            command._index = (int)drawable->_tiles.size() - 1;
+        }
+    }
+}
+
+void
+TerrainCuller::buildDrawCommands()
+{
+    LayerDrawableList& layers = _terrain.layers();
+    _deferredCommands.resize(layers.size());
+
+    std::vector<unsigned> work;
+    std::size_t total = 0;
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        if (!_deferredCommands[i].empty())
+        {
+            work.push_back(i);
+            total += _deferredCommands[i].size();
+        }
+    }
+
+    // Each LayerDrawable gets its own job; they share nothing but
+    // read-only tile data. Small workloads aren't worth the dispatch,
+    // except when verifying the parallel build.
+    const std::size_t minCommandsForParallelBuild = 512u;
+
+    if (work.size() > 1 && (total >= minCommandsForParallelBuild || s_verifyDrawCommands))
+    {
+        std::vector<std::size_t> initialSizes;
+        if (s_verifyDrawCommands)
+        {
+            for (unsigned w = 0; w < work.size(); ++w)
+                initialSizes.push_back(layers[work[w]]->_tiles.size());
+        }
+
+        JobArena* arena = JobArena::arena("oe.rex.cull");
+        JobGroup group;
+        for (unsigned w = 1; w < work.size(); ++w)
+        {
+            LayerDrawable* drawable = layers[work[w]].get();
+            DeferredDrawCommands* commands = &_deferredCommands[work[w]];
+            std::function<void()> job = [this, drawable, commands]()
+            {
+                buildDrawCommands(drawable, *commands);
+            };
+            arena->dispatch(job, &group);
+        }
+
+        // do the first one on this thread while we wait
+        buildDrawCommands(layers[work[0]].get(), _deferredCommands[work[0]]);
+        group.join();
+
+        if (s_verifyDrawCommands)
+        {
+            verifyDrawCommands(work, initialSizes);
+        }
+    }
+    else
+    {
+        for (unsigned w = 0; w < work.size(); ++w)
+        {
+            buildDrawCommands(layers[work[w]].get(), _deferredCommands[work[w]]);
+        }
+    }
+
+    // Find the first draw command for each tile. Its "layerOrder" gets set to
+    // zero so the rendering engine knows to blend it with the terrain geometry
+    // color. Layers are in draw order, so the first hit has the lowest order.
+    std::vector<bool> hasCommand(_culledTiles.size(), false);
+    for (unsigned w = 0; w < work.size(); ++w)
+    {
+        LayerDrawable* drawable = layers[work[w]].get();
+        for (auto& command : _deferredCommands[work[w]])
+        {
+            if (command._index >= 0 && !hasCommand[command._tile])
+            {
+                drawable->_tiles[command._index]._layerOrder = 0;
+                hasCommand[command._tile] = true;
+            }
+        }
+    }
+
+    // If the culler added no draw commands for a tile... we still need
+    // to draw something or else there will be a hole! So draw a blank tile.
+    // UID = -1 is the special UID code for a blank.
+    for (unsigned t = 0; t < _culledTiles.size(); ++t)
+    {
+        if (!hasCommand[t])
+        {
+            const CulledTile& culled = _culledTiles[t];
+
+            //OE_INFO << LC << "Adding blank render for tile " << culled._tileNode->getKey().str() << std::endl;
+            osg::ref_ptr<LayerDrawable> drawable = _terrain.layer(-1);
+            if (drawable.valid())
+            {
+                if (drawable->_draw && !isCulledByLayerExtent(drawable.get(), culled._tileNode))
+                {
+                    DrawTileCommand* cmd = addDrawCommand(
+                        drawable.get(),
+                        &culled._tileNode->renderModel(),
+                        0L,
+                        culled._tileNode,
+                        culled._modelViewMatrix.get(),
+                        culled._range);
+
+                    cmd->_layerOrder = 0;
+                }
+            }
+            else
+            {
+                OE_WARN << "Added nothing for a UID -1 darw command" << std::endl;
+            }
+        }
+    }
+
+    _culledTiles.clear();
+    _deferredCommands.clear();
+}
+
+void
+TerrainCuller::verifyDrawCommands(const std::vector<unsigned>& work, const std::vector<std::size_t>& initialSizes)
+{
+    LayerDrawableList& layers = _terrain.layers();
+
+    for (unsigned w = 0; w < work.size(); ++w)
+    {
+        LayerDrawable* drawable = layers[work[w]].get();
+
+        // Set the parallel result aside and rebuild the layer serially
+        // from the same starting point.
+        DrawTileCommands parallel;
+        parallel.swap(drawable->_tiles);
+        drawable->_tiles.assign(parallel.begin(), parallel.begin() + initialSizes[w]);
+
+        DeferredDrawCommands serialCommands = _deferredCommands[work[w]];
+        buildDrawCommands(drawable, serialCommands);
+
+        bool same = drawable->_tiles.size() == parallel.size();
+        for (unsigned i = 0; same && i < parallel.size(); ++i)
+        {
+            same = sameDrawCommand(parallel[i], drawable->_tiles[i]);
+        }
+        for (unsigned i = 0; same && i < serialCommands.size(); ++i)
+        {
+            same = serialCommands[i]._index == _deferredCommands[work[w]][i]._index;
+        }
+
+        if (!same)
+        {
+            OE_WARN << LC << "Parallel draw commands differ from the serial build for layer "
+                << (drawable->_layer ? drawable->_layer->getName() : std::string("(terrain)"))
+                << " (" << parallel.size() << " vs " << drawable->_tiles.size() << " commands)"
+                << std::endl;
+        }
+
+        drawable->_tiles.swap(parallel);
+    }
+}
+
 void
 TerrainCuller::apply(osg::Node& node)
 {
@@ -207,11 +432,6 @@ void
 TerrainCuller::apply(TileNode& node)
 {
     _currentTileNode = &node;
-
-    // reset the pointer to the first DrawTileCommand. We keep track of this so
-    // we can set it's "layerOrder" member to zero at the end, so the rendering engine
-    // knows to blend it with the terrain geometry color.
-    _firstDrawCommandForTile = 0L;
         
     if (!_terrain.patchLayers().empty() && node.getSurfaceNode() && !node.isEmpty())
     {
@@ -289,11 +509,16 @@ TerrainCuller::apply(SurfaceNode& node)
             node.setLastFramePassedCull(getFrameStamp()->getFrameNumber());
         }
 
-        int order = 0;
-        unsigned count = 0;
+        // Record the tile and queue a draw command for each legit rendering
+        // pass. The commands themselves are built later in buildDrawCommands().
+        unsigned tileIndex = _culledTiles.size();
+        _culledTiles.push_back(CulledTile());
+        CulledTile& culled = _culledTiles.back();
+        culled._tileNode = _currentTileNode;
+        culled._modelViewMatrix = _cv->getModelViewMatrix();
+        osg::Vec3 c = node.getBound().center() * node.getInverseMatrix();
+        culled._range = getDistanceToViewPoint(c, true);
 
-        // First go through any legit rendering pass data in the Tile and
-        // and add a DrawCommand for each.
         for (unsigned p = 0; p < renderModel._passes.size(); ++p)
         {
             const RenderingPass& pass = renderModel._passes[p];
@@ -302,42 +527,37 @@ TerrainCuller::apply(SurfaceNode& node)
             if (pass.visibleLayer() && pass.visibleLayer()->getMaxVisibleRange() < range)
                 continue;
 
+            // skip layers that are not visible:
+            if (pass.visibleLayer() && pass.visibleLayer()->getVisible() == false)
+                continue;
+
             //TODO: see if we can skip adding a draw command for 1-pixel images
             // or other "placeholder" textures
-            DrawTileCommand* cmd = addDrawCommand(pass.sourceUID(), &renderModel, &pass, _currentTileNode);
-            if (cmd)
+            osg::ref_ptr<LayerDrawable> drawable = _terrain.layer(pass.sourceUID());
+            if (drawable.valid())
             {
-                if (_firstDrawCommandForTile == 0L)
+                // Layer marked for drawing?
+                if (drawable->_draw)
                 {
-                    _firstDrawCommandForTile = cmd;
-                }
-                else if (cmd->_layerOrder < _firstDrawCommandForTile->_layerOrder)
-                {
-                    _firstDrawCommandForTile = cmd;
+                    if (_deferredCommands.size() <= (unsigned)drawable->_drawOrder)
+                        _deferredCommands.resize(drawable->_drawOrder + 1);
+
+                    DeferredDrawCommand cmd;
+                    cmd._tile = tileIndex;
+                    cmd._pass = &pass;
+                    cmd._index = -1;
+                    _deferredCommands[drawable->_drawOrder].push_back(cmd);
                 }
             }
-        }
-
-        // If the culler added no draw commands for this tile... we still need
-        // to draw something or else there will be a hole! So draw a blank tile.
-        // UID = -1 is the special UID code for a blank.
-        if (_firstDrawCommandForTile == 0L)
-        {
-            //OE_INFO << LC << "Adding blank render for tile " << _currentTileNode->getKey().str() << std::endl;
-            DrawTileCommand* cmd = addDrawCommand(-1, &renderModel, 0L, _currentTileNode);
-            if (cmd)
+            else
             {
-                _firstDrawCommandForTile = cmd;
+                // The pass exists but it's layer is not in the render data draw list.
+                // This means that the layer is no longer in the map. Detect and record
+                // this information so we can run a cleanup visitor later on.
+                ++_orphanedPassesDetected;
             }
         }
 
-        // Set the layer order of the first draw command for this tile to zero,
-        // to support proper terrain blending.
-        if (_firstDrawCommandForTile)
-        {
-            _firstDrawCommandForTile->_layerOrder = 0;
-        }
-
         // update our bounds
         _terrain._drawState->_bs.expandBy(node.getBound());
         _terrain._drawState->_box.expandBy(_terrain._drawState->_bs);
@@ -993,6 +993,10 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
             //setElevationRaster(tex->getImage(0), osg::Matrixf::identity());
             updateElevationRaster();
 
+            // index the new data for ray casting
+            _context->getEngine()->getTerrain()->notifyElevationTileUpdate(
+                getKey(), static_cast<ElevationTexture*>(tex));
+
             newElevationData = true;
         }
 
@@ -1006,6 +1010,8 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
 
             updateElevationRaster();
 
+            _context->getEngine()->getTerrain()->notifyElevationTileUpdate(getKey(), nullptr);
+
             newElevationData = true;
         }
     } 
@@ -1162,6 +1168,83 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
 
     // Bump the data revision for the tile.
     ++_revision;
+
+    // Our textures changed, so update our memory footprint.
+    _context->liveTiles()->updateMemoryUsage(this);
+}
+
+namespace
+{
+    void addTextureMemoryUsage(const Sampler& sampler, std::size_t& cpu, std::size_t& gpu)
+    {
+        if (!sampler.ownsTexture())
+            return;
+
+        const osg::Texture* tex = sampler._texture.get();
+
+        bool mipmapped =
+            tex->getFilter(osg::Texture::MIN_FILTER) != osg::Texture::LINEAR &&
+            tex->getFilter(osg::Texture::MIN_FILTER) != osg::Texture::NEAREST;
+
+        if (tex->getNumImages() > 0)
+        {
+            for (unsigned i = 0; i < tex->getNumImages(); ++i)
+            {
+                const osg::Image* image = tex->getImage(i);
+                if (image && image->data())
+                {
+                    std::size_t bytes = image->getTotalSizeInBytesIncludingMipmaps();
+                    cpu += bytes;
+
+                    // the driver builds the mip chain if the image doesn't have one
+                    if (mipmapped && !image->isMipmap())
+                        bytes = (bytes * 4) / 3;
+                    gpu += bytes;
+                }
+            }
+        }
+        else
+        {
+            // image data already released after apply; assume 4 bytes per texel
+            std::size_t bytes = 4 *
+                osg::maximum(tex->getTextureWidth(), 1) *
+                osg::maximum(tex->getTextureHeight(), 1) *
+                osg::maximum(tex->getTextureDepth(), 1);
+            if (mipmapped)
+                bytes = (bytes * 4) / 3;
+            gpu += bytes;
+        }
+    }
+}
+
+void
+TileNode::getMemoryUsage(std::size_t& cpu, std::size_t& gpu) const
+{
+    cpu = 0u, gpu = 0u;
+
+    for (unsigned s = 0; s < _renderModel._sharedSamplers.size(); ++s)
+    {
+        addTextureMemoryUsage(_renderModel._sharedSamplers[s], cpu, gpu);
+    }
+
+    for (unsigned p = 0; p < _renderModel._passes.size(); ++p)
+    {
+        const Samplers& samplers = _renderModel._passes[p].samplers();
+        for (unsigned s = 0; s < samplers.size(); ++s)
+        {
+            addTextureMemoryUsage(samplers[s], cpu, gpu);
+        }
+    }
+
+    if (_surface.valid() && _surface->getDrawable())
+    {
+        const TileDrawable* drawable = _surface->getDrawable();
+
+        cpu += drawable->_mesh.capacity() * sizeof(osg::Vec3);
+
+        // The surface geometry comes from the GeometryPool, which counts
+        // its own memory (constrained meshes can outlive their tiles).
+    }
 }
 
 void TileNode::inheritSharedSampler(int binding)
@@ -1182,6 +1265,9 @@ void TileNode::inheritSharedSampler(int binding)
 
     // Bump the data revision for the tile.
     ++_revision;
+
+    // Our textures changed, so update our memory footprint.
+    _context->liveTiles()->updateMemoryUsage(this);
 }
 
 //void TileNode::loadChildren()
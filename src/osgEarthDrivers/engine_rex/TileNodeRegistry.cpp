@@ -31,6 +31,8 @@ using namespace osgEarth;
 #define SENTRY_VALUE NULL
 
 #define PROFILING_REX_TILES "Live Terrain Tiles"
+#define PROFILING_REX_TILES_CPU_MB "Live Terrain Tiles CPU (MB)"
+#define PROFILING_REX_TILES_GPU_MB "Live Terrain Tiles GPU (MB)"
 
 //----------------------------------------------------------------------------
 
@@ -39,6 +41,8 @@ _name              ( name ),
 _revisioningEnabled( false ),
 _notifyNeighbors   ( false ),
 _firstLOD          ( 0u ),
+_totalCPUBytes     ( 0u ),
+_totalGPUBytes     ( 0u ),
 _mutex("TileNodeRegistry(OE)")
 {
     _tracker.push_front(SENTRY_VALUE);
@@ -116,6 +120,9 @@ TileNodeRegistry::setDirty(const GeoExtent& extent,
 void
 TileNodeRegistry::add(TileNode* tile)
 {
+    std::size_t cpuBytes, gpuBytes;
+    tile->getMemoryUsage(cpuBytes, gpuBytes);
+
     _mutex.lock();
 
     // It is possible that a Tile with the same key is already in the registry. 
@@ -134,6 +141,8 @@ TileNodeRegistry::add(TileNode* tile)
         recyclingOrphan = true;
         te = &i->second;
         se = (*te->_trackerptr);
+        _totalCPUBytes -= se->_cpuBytes;
+        _totalGPUBytes -= se->_gpuBytes;
         _tracker.erase(te->_trackerptr); // since we need to move it to the front
         OE_DEBUG << "Reused orphaned tile record " << tile->getKey().str() << std::endl;
     }
@@ -148,8 +157,13 @@ TileNodeRegistry::add(TileNode* tile)
     se->_lastTime = DBL_MAX;
     se->_lastFrame = ~0;
     se->_lastRange = FLT_MAX;
+    se->_cpuBytes = cpuBytes;
+    se->_gpuBytes = gpuBytes;
     _tracker.push_front(se);
 
+    _totalCPUBytes += cpuBytes;
+    _totalGPUBytes += gpuBytes;
+
     // init the table entry:
     te->_tile = tile;
     te->_trackerptr = _tracker.begin();
@@ -193,9 +207,41 @@ TileNodeRegistry::add(TileNode* tile)
             << std::endl;
     }
 
+    plotMetrics();
+
     _mutex.unlock();
 }
 
+void
+TileNodeRegistry::updateMemoryUsage(TileNode* tile)
+{
+    std::size_t cpuBytes, gpuBytes;
+    tile->getMemoryUsage(cpuBytes, gpuBytes);
+
+    ScopedMutexLock lock(_mutex);
+
+    TileTable::iterator i = _tiles.find(tile->getKey());
+    if (i != _tiles.end() && i->second._tile.get() == tile)
+    {
+        TrackerEntry* se = *(i->second._trackerptr);
+        _totalCPUBytes = _totalCPUBytes - se->_cpuBytes + cpuBytes;
+        _totalGPUBytes = _totalGPUBytes - se->_gpuBytes + gpuBytes;
+        se->_cpuBytes = cpuBytes;
+        se->_gpuBytes = gpuBytes;
+
+        plotMetrics();
+    }
+}
+
+void
+TileNodeRegistry::plotMetrics()
+{
+    // ASSUME EXCLUSIVE LOCK
+    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
+    OE_PROFILING_PLOT(PROFILING_REX_TILES_CPU_MB, (float)((double)_totalCPUBytes / 1048576.0));
+    OE_PROFILING_PLOT(PROFILING_REX_TILES_GPU_MB, (float)((double)_totalGPUBytes / 1048576.0));
+}
+
 void
 TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
 {
@@ -265,7 +311,10 @@ TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
 
     _notifiers.clear();
 
-    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
+    _totalCPUBytes = 0u;
+    _totalGPUBytes = 0u;
+
+    plotMetrics();
 
     _mutex.unlock();
 
@@ -325,40 +374,20 @@ TileNodeRegistry::collectDormantTiles(
     // non-visited tiles are behind it. Start at the sentry position and
     // iterate over the non-visited tiles, checking them for deletion.
     Tracker::iterator i = _sentryptr;
-    Tracker::iterator tmp;
     for(++i; i != _tracker.end() && count < maxTiles; ++i)
     {
         TrackerEntry* se = *i;
 
-        const TileKey& key = se->_tile->getKey();
-
         if (se->_tile->getDoNotExpire() == false &&
             se->_lastTime < oldestAllowableTime &&
             se->_lastFrame < oldestAllowableFrame &&
             se->_lastRange > farthestAllowableRange &&
             se->_tile->areSiblingsDormant())
         {
-            if (_notifyNeighbors)
-            {
-                // remove neighbor listeners:
-                stopListeningFor(key.createNeighborKey(1, 0), key);
-                stopListeningFor(key.createNeighborKey(0, 1), key);
-            }
-
-            // back up the iterator so we can safely erase the tracker entry:
-            tmp = i;
+            // collect it, backing up the iterator past the erased entry:
+            i = collect(i, output);
             --i;
 
-            // put the tile on the output list:
-            output.push_back(se->_tile);
-
-            // remove it from the main tile table:
-            _tiles.erase(key);
-
-            // remove it from the tracker list:
-            _tracker.erase(tmp);
-            delete se;
-
             ++count;
         }
         else
@@ -373,9 +402,81 @@ TileNodeRegistry::collectDormantTiles(
     _tracker.push_front(SENTRY_VALUE);
     _sentryptr =_tracker.begin();
 
+    plotMetrics();
+
     _mutex.unlock();
+}
 
-    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
+void
+TileNodeRegistry::collectTilesOverBudget(
+    std::size_t budgetBytes,
+    unsigned oldestAllowableFrame,
+    unsigned maxTiles,
+    std::vector<osg::observer_ptr<TileNode> >& output)
+{
+    ScopedMutexLock lock(_mutex);
+
+    unsigned count = 0u;
+
+    // The tracker runs from most to least recently visited, and everything
+    // behind the sentry was not visited in the last cull. Walk backwards from
+    // the least recently visited tile toward the sentry.
+    Tracker::iterator i = _tracker.end();
+    while (count < maxTiles && _totalCPUBytes + _totalGPUBytes > budgetBytes)
+    {
+        --i;
+        if (i == _sentryptr)
+            break;
+
+        TrackerEntry* se = *i;
+
+        if (se->_tile->getDoNotExpire() == false &&
+            se->_lastFrame < oldestAllowableFrame &&
+            se->_tile->areSiblingsDormant())
+        {
+            // erase returns the following entry; the next --i visits the one before.
+            i = collect(i, output);
+            ++count;
+        }
+    }
+
+    if (count > 0)
+    {
+        plotMetrics();
+    }
+}
+
+TileNodeRegistry::Tracker::iterator
+TileNodeRegistry::collect(
+    Tracker::iterator i,
+    std::vector<osg::observer_ptr<TileNode> >& output)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    TrackerEntry* se = *i;
+    const TileKey key = se->_tile->getKey();
+
+    if (_notifyNeighbors)
+    {
+        // remove neighbor listeners:
+        stopListeningFor(key.createNeighborKey(1, 0), key);
+        stopListeningFor(key.createNeighborKey(0, 1), key);
+    }
+
+    // put the tile on the output list:
+    output.push_back(se->_tile);
+
+    _totalCPUBytes -= se->_cpuBytes;
+    _totalGPUBytes -= se->_gpuBytes;
+
+    // remove it from the main tile table:
+    _tiles.erase(key);
+
+    // remove it from the tracker list:
+    Tracker::iterator next = _tracker.erase(i);
+    delete se;
+
+    return next;
 }
 
 osg::ref_ptr<TileNode>
@@ -19,6 +19,7 @@
 #include "Unloader"
 #include "TileNode"
 #include "TileNodeRegistry"
+#include "GeometryPool"
 
 #include <osgEarth/Metrics>
 #include <osgEarth/NodeUtils>
@@ -35,6 +36,8 @@ _cacheSize(0u),
 _maxAge(0.1),
 _minRange(0.0f),
 _maxTilesToUnloadPerFrame(~0),
+_memoryBudget(0u),
+_geometryPool(nullptr),
 _frameLastUpdated(0u)
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -63,13 +66,30 @@ UnloaderGroup::traverse(osg::NodeVisitor& nv)
             double oldestAllowableTime = now - _maxAge;
             unsigned oldestAllowableFrame = osg::maximum(frame, 3u) - 3u;
 
+            // If we're over the memory budget, first remove the least recently
+            // visible tiles regardless of age or range:
+            // Pooled constrained meshes live on the CPU and the GPU.
+            std::size_t pooledBytes = _geometryPool ? 2u * _geometryPool->getConstrainedBytes() : 0u;
+
+            if (_memoryBudget > 0u && _tiles->getTotalBytes() + pooledBytes > _memoryBudget)
+            {
+                _tiles->collectTilesOverBudget(
+                    _memoryBudget > pooledBytes ? _memoryBudget - pooledBytes : 0u,
+                    oldestAllowableFrame,
+                    _maxTilesToUnloadPerFrame,
+                    _deadpool);
+            }
+
             // Remove them from the registry:
-            _tiles->collectDormantTiles(
-                nv, 
-                oldestAllowableTime,
-                oldestAllowableFrame,
-                _minRange,
-                _maxTilesToUnloadPerFrame, _deadpool);
+            if (_deadpool.size() < _maxTilesToUnloadPerFrame)
+            {
+                _tiles->collectDormantTiles(
+                    nv,
+                    oldestAllowableTime,
+                    oldestAllowableFrame,
+                    _minRange,
+                    _maxTilesToUnloadPerFrame - (unsigned)_deadpool.size(), _deadpool);
+            }
 
             // Remove them from the scene graph:
             for(std::vector<osg::observer_ptr<TileNode> >::iterator i = _deadpool.begin();
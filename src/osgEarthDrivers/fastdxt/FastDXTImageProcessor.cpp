@@ -61,6 +61,7 @@ public:
         int format;
         GLenum compressedPixelFormat;
         int minLevelSize;
+        int blockBytes;
 
 #if 1
         switch (compressedFormat)
@@ -69,12 +70,14 @@ public:
             format = FORMAT_DXT1;
             compressedPixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
             minLevelSize = 8;
+            blockBytes = 8;
             OE_DEBUG << "FastDXT using dxt1 format" << std::endl;
             break;
         case osg::Texture::USE_S3TC_DXT5_COMPRESSION:
             format = FORMAT_DXT5;
             compressedPixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
             minLevelSize = 16;
+            blockBytes = 16;
             OE_DEBUG << "FastDXT dxt5 format" << std::endl;
             break;
         default:
@@ -125,7 +128,11 @@ public:
             psm.pack_row_length = sourceImage->getRowLength();
             psm.unpack_alignment = sourceImage->getPacking();
 
-            unsigned char* workspace = (unsigned char*)memalign(16, levelZeroSizeBytes);
+            // Each level is built from the previous one (ping-ponging between two
+            // workspaces) and compressed right away while it's still in cache.
+            unsigned char* workspace[2] = {
+                (unsigned char*)memalign(16, levelZeroSizeBytes),
+                (unsigned char*)memalign(16, levelZeroSizeBytes) };
             unsigned char* in;
 
             unsigned totalCompressedBytes = 0u;
@@ -135,14 +142,19 @@ public:
             {
                 int level_s = sourceImage->s() >> level;
                 int level_t = sourceImage->t() >> level;
+                unsigned levelSliceBytes = level_s * level_t * 4;
 
-                std::size_t levelAllocatedBytes = sourceImage->r() * (levelZeroSizeBytes); // max possible size
+                std::size_t levelAllocatedBytes = sourceImage->r() * ((level_s+3)/4) * ((level_t+3)/4) * blockBytes;
                 unsigned char* compressedLevelDataPtr = (unsigned char*)memalign(16, levelAllocatedBytes);
                 ::memset(compressedLevelDataPtr, 0, levelAllocatedBytes);
                 mipLevels.push_back(compressedLevelDataPtr);
 
                 unsigned levelCompressedBytes = 0u;
 
+                // this level goes in one workspace, the previous one is in the other:
+                unsigned char* levelData = workspace[level & 1];
+                const unsigned char* prevData = workspace[(level+1) & 1];
+
                 // iterate over depth:
                 for (int r = 0; r < sourceImage->r(); ++r)
                 {
@@ -158,20 +170,30 @@ public:
                             mipOffsets.push_back(totalCompressedBytes);
                         }
 
-                        // OSG-custom gluScaleImage that does not require a graphics context
-                        GLint status = gluScaleImage(
-                            &psm,
-                            sourceImage->getPixelFormat(),
-                            sourceImage->s(),
-                            sourceImage->t(),
-                            sourceImage->getDataType(),
-                            sourceImage->data(0, 0, r),
-                            level_s,
-                            level_t,
-                            sourceImage->getDataType(),
-                            workspace);
-
-                        in = workspace;
+                        const unsigned char* prev = level == 1 ?
+                            sourceImage->data(0, 0, r) :
+                            prevData + r * (levelSliceBytes * 4);
+
+                        in = levelData + r * levelSliceBytes;
+
+                        if (!ImageUtils::downsample2x2(
+                            prev, level_s * 2, level_t * 2,
+                            sourceImage->getPixelFormat(), sourceImage->getDataType(), 4,
+                            in))
+                        {
+                            // OSG-custom gluScaleImage that does not require a graphics context
+                            gluScaleImage(
+                                &psm,
+                                sourceImage->getPixelFormat(),
+                                level_s * 2,
+                                level_t * 2,
+                                sourceImage->getDataType(),
+                                prev,
+                                level_s,
+                                level_t,
+                                sourceImage->getDataType(),
+                                in);
+                        }
                     }
 
                     int outputBytes = CompressDXT(
@@ -193,8 +215,9 @@ public:
                 mipLevelBytes.push_back(levelCompressedBytes);
             }
 
-            // done with our temporary workspace
-            memfree(workspace);
+            // done with our temporary workspaces
+            memfree(workspace[0]);
+            memfree(workspace[1]);
 
             // now combine into a new mipmapped compressed image
             // and delete any workspaces along the way.
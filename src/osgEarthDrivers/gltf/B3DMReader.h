@@ -102,12 +102,18 @@ public:
             }
         }
 
-        b3dmheader header;
-        unsigned bytesRead = 0;
+        if (data->size() < sizeof(b3dmheader))
+        {
+            OE_WARN << LC << "Invalid b3dm" << std::endl;
+            return NULL;
+        }
 
-        std::stringstream buf(*data);
-        buf.read(reinterpret_cast<char*>(&header), sizeof(b3dmheader));
-        bytesRead += sizeof(b3dmheader);
+        // Read the sections in place rather than copying them out of a stream.
+        const char* ptr = data->data();
+
+        b3dmheader header;
+        memcpy(&header, ptr, sizeof(b3dmheader));
+        size_t bytesRead = sizeof(b3dmheader);
 
 #ifdef OE_IS_BIG_ENDIAN
         byteSwapInPlace(header.version);
@@ -118,15 +124,25 @@ public:
         byteSwapInPlace(header.batchTableBinaryByteLength);
 #endif
 
-        size_t sz = header.byteLength;
+        size_t sz = std::min((size_t)header.byteLength, data->size());
+
+        size_t tablesSize =
+            (size_t)header.featureTableJSONByteLength +
+            (size_t)header.featureTableBinaryByteLength +
+            (size_t)header.batchTableJSONByteLength +
+            (size_t)header.batchTableBinaryByteLength;
+
+        if (bytesRead + tablesSize > sz)
+        {
+            OE_WARN << LC << "Invalid b3dm, tables exceed the data size" << std::endl;
+            return NULL;
+        }
 
         osg::Vec3d rtc_center;
 
         if (header.featureTableJSONByteLength > 0)
         {
-            std::string featureTableJson;
-            featureTableJson.resize(header.featureTableJSONByteLength);
-            buf.read(reinterpret_cast<char*>(&featureTableJson[0]), header.featureTableJSONByteLength);
+            std::string featureTableJson(ptr + bytesRead, header.featureTableJSONByteLength);
             OE_DEBUG << "Read featureTableJson " << featureTableJson << std::endl;
 
             osgEarth::Json::Reader reader;
@@ -141,52 +157,20 @@ public:
                     rtc_center.y() = (*i++).asDouble();
                     rtc_center.z() = (*i++).asDouble();
                 }
-            }          
-
-            /*
-            json ftJson = json::parse(featureTableJson);
-            if (ftJson.find("RTC_CENTER") != ftJson.end()) {
-                json RTC_CENTER = ftJson["RTC_CENTER"];
-                rtc_center.x() = RTC_CENTER[0];
-                rtc_center.y() = RTC_CENTER[1];
-                rtc_center.z() = RTC_CENTER[2];
             }
-            OE_DEBUG << LC << "Read rtc_center " << rtc_center.x() << ", " << rtc_center.y() << ", " << rtc_center.z() << std::endl;
-            */
 
             bytesRead += header.featureTableJSONByteLength;
         }
 
-        if (header.featureTableBinaryByteLength > 0)
-        {
-            std::string featureTableBinary;
-            featureTableBinary.resize(header.featureTableBinaryByteLength);
-            buf.read(reinterpret_cast<char*>(&featureTableBinary[0]), header.featureTableBinaryByteLength);
-            OE_DEBUG << "Read featureTableJson " << featureTableBinary << std::endl;
-            bytesRead += header.featureTableBinaryByteLength;
-        }
+        // The feature table binary and the batch tables are not used.
+        bytesRead +=
+            header.featureTableBinaryByteLength +
+            header.batchTableJSONByteLength +
+            header.batchTableBinaryByteLength;
 
-        if (header.batchTableJSONByteLength > 0)
-        {
-            std::string batchTableJSON;
-            batchTableJSON.resize(header.batchTableJSONByteLength);
-            buf.read(reinterpret_cast<char*>(&batchTableJSON[0]), header.batchTableJSONByteLength);
-            OE_DEBUG << "Read batchTableJSON " << batchTableJSON << std::endl;
-            bytesRead += header.batchTableJSONByteLength;
-        }
-
-        if (header.batchTableBinaryByteLength > 0)
-        {
-            std::string batchTableBinary;
-            batchTableBinary.resize(header.batchTableBinaryByteLength);
-            buf.read(reinterpret_cast<char*>(&batchTableBinary[0]), header.batchTableBinaryByteLength);
-            OE_DEBUG << "Read batchTableJSON " << batchTableBinary << std::endl;
-            bytesRead += header.batchTableBinaryByteLength;
-        }
-
-        std::string gltfData;
-        gltfData.resize(sz - bytesRead);
-        buf.read(reinterpret_cast<char *>(&gltfData[0]), static_cast<std::streamsize>(gltfData.size()));
+        // The rest is the glb, which we hand to the parser without copying it.
+        const unsigned char* gltfData = reinterpret_cast<const unsigned char*>(ptr + bytesRead);
+        size_t gltfSize = sz - bytesRead;
 
         tinygltf::Model model;
         tinygltf::TinyGLTF loader;
@@ -200,17 +184,20 @@ public:
         fs.WriteWholeFile = &tinygltf::WriteWholeFile;
         fs.user_data = (void*)&location;
         loader.SetFsCallbacks(fs);
+        loader.SetImageLoader(&GLTFReader::LoadImageDataDeferred, nullptr);
 
         tinygltf::Options opt;
         opt.skip_imagery = readOptions && readOptions->getOptionString().find("gltfSkipImagery") != std::string::npos;        
 
-        loader.LoadBinaryFromMemory(&model, &err, &warn, reinterpret_cast<unsigned char*>(&gltfData[0]), sz, "", REQUIRE_VERSION, &opt);
+        loader.LoadBinaryFromMemory(&model, &err, &warn, gltfData, (unsigned int)gltfSize, "", REQUIRE_VERSION, &opt);
 
         if (!err.empty())
             OE_WARN << LC << "GLTF ERROR: " << err << std::endl;
         if (!warn.empty())
             OE_WARN << LC << "GLTF WARNING: " << warn << std::endl;
 
+        GLTFReader::decodeImages(model);
+
         GLTFReader gltfReader;
         gltfReader.setTextureCache(_texCache);
         GLTFReader::Env env(location, readOptions);
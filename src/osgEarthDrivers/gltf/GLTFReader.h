@@ -40,6 +40,8 @@
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/InstanceBuilder>
 #include <osgEarth/StateTransition>
+#include <osgEarth/Threading>
+#include <limits>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -65,6 +67,83 @@ public:
         return tinygltf::ExpandFilePath(path, userData);
     }
 
+    //! Image loader for tinygltf that leaves embedded images encoded so
+    //! that decodeImages() can decode them in parallel after parsing.
+    //! Images in a buffer view are decoded straight from the buffer.
+    static bool LoadImageDataDeferred(tinygltf::Image* image, const int image_idx, std::string* err,
+                                      std::string* warn, int req_width, int req_height,
+                                      const unsigned char* bytes, int size, void* user_data)
+    {
+        if (image->bufferView < 0)
+        {
+            image->image.assign(bytes, bytes + size);
+        }
+        image->as_is = true;
+        return true;
+    }
+
+    //! Decodes any images deferred by LoadImageDataDeferred.
+    static void decodeImages(tinygltf::Model& model)
+    {
+        std::vector<int> deferred;
+        for (int i = 0; i < (int)model.images.size(); ++i)
+        {
+            if (model.images[i].as_is)
+                deferred.push_back(i);
+        }
+
+        auto decode = [&model](int i)
+        {
+            tinygltf::Image& image = model.images[i];
+            image.as_is = false;
+
+            std::vector<unsigned char> encoded;
+            const unsigned char* bytes = nullptr;
+            size_t size = 0u;
+
+            if (image.bufferView >= 0)
+            {
+                const tinygltf::BufferView& view = model.bufferViews[image.bufferView];
+                bytes = &model.buffers[view.buffer].data[view.byteOffset];
+                size = view.byteLength;
+            }
+            else
+            {
+                encoded.swap(image.image);
+                bytes = encoded.data();
+                size = encoded.size();
+            }
+
+            std::string err, warn;
+            if (size == 0u || !tinygltf::LoadImageData(&image, i, &err, &warn, 0, 0, bytes, (int)size, nullptr))
+            {
+                image.image.clear();
+                OE_WARN << LC << "Failed to decode image " << i << " " << err << std::endl;
+            }
+        };
+
+        if (deferred.size() > 1)
+        {
+            JobArena* arena = JobArena::arena("oe.gltf");
+            JobGroup group;
+            for (unsigned k = 1; k < deferred.size(); ++k)
+            {
+                int i = deferred[k];
+                std::function<void()> job = [&decode, i]() { decode(i); };
+                arena->dispatch(job, &group);
+            }
+
+            // decode the first one on this thread while we wait
+            decode(deferred[0]);
+
+            group.join();
+        }
+        else if (deferred.size() == 1)
+        {
+            decode(deferred[0]);
+        }
+    }
+
     struct Env
     {
         Env(const std::string& loc, const osgDB::Options* opt) : referrer(loc), readOptions(opt) { }
@@ -100,6 +179,7 @@ public:
         fs.WriteWholeFile = &tinygltf::WriteWholeFile;
         fs.user_data = (void*)&location;
         loader.SetFsCallbacks(fs);
+        loader.SetImageLoader(&GLTFReader::LoadImageDataDeferred, nullptr);
 
         tinygltf::Options opt;
         opt.skip_imagery = readOptions && readOptions->getOptionString().find("gltfSkipImagery") != std::string::npos;
@@ -112,7 +192,7 @@ public:
                 return osgDB::ReaderWriter::ReadResult::FILE_NOT_FOUND;
             }
 
-            std::string mem = rr.getString();
+            const std::string& mem = rr.getString();
 
             if (isBinary)
             {
@@ -141,6 +221,8 @@ public:
             return osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE;
         }
 
+        decodeImages(model);
+
         Env env(location, readOptions);
         return makeNodeFromModel(model, env);
     }
@@ -158,6 +240,7 @@ public:
         fs.WriteWholeFile = &tinygltf::WriteWholeFile;
         fs.user_data = (void*)&location;
         loader.SetFsCallbacks(fs);
+        loader.SetImageLoader(&GLTFReader::LoadImageDataDeferred, nullptr);
 
         tinygltf::Options opt;
         opt.skip_imagery = readOptions && readOptions->getOptionString().find("gltfSkipImagery") != std::string::npos;
@@ -165,13 +248,17 @@ public:
         std::string decompressedData;
         const std::string* data = &inputStream;
 
-        osg::ref_ptr<osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
-        if (compressor.valid())
+        // Only try to decompress if the data is not already a glb.
+        if (inputStream.compare(0, 4, "glTF") != 0)
         {
-            std::stringstream in_data(inputStream);
-            if (compressor->decompress(in_data, decompressedData))
+            osg::ref_ptr<osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+            if (compressor.valid())
             {
-                data = &decompressedData;
+                std::stringstream in_data(inputStream);
+                if (compressor->decompress(in_data, decompressedData))
+                {
+                    data = &decompressedData;
+                }
             }
         }
 
@@ -183,6 +270,8 @@ public:
             return 0;
         }
 
+        decodeImages(model);
+
         Env env(location, readOptions);
         return makeNodeFromModel(model, env);
     }
@@ -291,12 +380,31 @@ public:
         const GLTFReader* reader;
         const tinygltf::Model &model;
         const Env& env;
-        std::vector< osg::ref_ptr< osg::Array > > arrays;
+        bool dequantize;
+        mutable std::vector< osg::ref_ptr< osg::Array > > arrays;
+        mutable std::vector< bool > extracted;
 
         NodeBuilder(const GLTFReader* reader_, const tinygltf::Model &model_, const Env& env_)
             : reader(reader_), model(model_), env(env_)
         {
-            extractArrays(arrays);
+            dequantize = env.readOptions && env.readOptions->getOptionString().find("gltfDequantize") != std::string::npos;
+            arrays.resize(model.accessors.size());
+            extracted.resize(model.accessors.size(), false);
+        }
+
+        //! OSG array for an accessor, created the first time it's needed.
+        //! (Index accessors go straight into primitive sets and never get one.)
+        osg::Array* getArray(int index) const
+        {
+            if (index < 0 || index >= (int)arrays.size())
+                return nullptr;
+
+            if (!extracted[index])
+            {
+                arrays[index] = extractArray(model.accessors[index]);
+                extracted[index] = true;
+            }
+            return arrays[index].get();
         }
 
         osg::Node* createNode(const tinygltf::Node& node) const
@@ -601,29 +709,29 @@ public:
 
                 for (; it != itEnd; it++)
                 {
-                    const tinygltf::Accessor &accessor = model.accessors[it->second];
-
                     if (it->first.compare("POSITION") == 0)
                     {
-                        geom->setVertexArray(arrays[it->second].get());
+                        // Positions are always floats since bounds, intersections
+                        // and clamping all depend on it (KHR_mesh_quantization).
+                        geom->setVertexArray(getFloatArray(it->second));
                     }
                     else if (it->first.compare("NORMAL") == 0)
                     {
-                        geom->setNormalArray(arrays[it->second].get());
+                        geom->setNormalArray(dequantize ? getFloatArray(it->second) : getArray(it->second));
                     }
                     else if (it->first.compare("TEXCOORD_0") == 0)
                     {
-                        geom->setTexCoordArray(0, arrays[it->second].get());
+                        geom->setTexCoordArray(0, dequantize ? getFloatArray(it->second) : getArray(it->second));
                     }
                     else if (it->first.compare("TEXCOORD_1") == 0)
                     {
-                        geom->setTexCoordArray(1, arrays[it->second].get());
+                        geom->setTexCoordArray(1, dequantize ? getFloatArray(it->second) : getArray(it->second));
                     }
                     else if (it->first.compare("COLOR_0") == 0)
                     {
                         // TODO:  Multipy by the baseColorFactor here?
-                        OE_DEBUG << "Setting color array " << arrays[it->second].get() << std::endl;
-                        geom->setColorArray(arrays[it->second].get());
+                        OE_DEBUG << "Setting color array " << getArray(it->second) << std::endl;
+                        geom->setColorArray(dequantize ? getFloatArray(it->second) : getArray(it->second));
                     }
                     else
                     {
@@ -632,14 +740,10 @@ public:
                 }
 
                 // If there is no color array just add one that has the base color factor in it.
-                if (!geom->getColorArray())
+                if (!geom->getColorArray() && geom->getVertexArray())
                 {
                     osg::Vec4Array* colors = new osg::Vec4Array();
-                    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom->getVertexArray());
-                    for (unsigned int i = 0; i < verts->size(); i++)
-                    {
-                        colors->push_back(baseColorFactor);
-                    }
+                    colors->assign(geom->getVertexArray()->getNumElements(), baseColorFactor);
                     geom->setColorArray(colors, osg::Array::BIND_PER_VERTEX);
                 }
 
@@ -680,25 +784,15 @@ public:
 
                     if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
                     {
-                        osg::UShortArray* indices = static_cast<osg::UShortArray*>(arrays[primitive.indices].get());
-                        osg::DrawElementsUShort* drawElements
-                            = new osg::DrawElementsUShort(mode, indices->begin(), indices->end());
-                        geom->addPrimitiveSet(drawElements);
+                        geom->addPrimitiveSet(makeDrawElements<osg::DrawElementsUShort, GLushort>(mode, indexAccessor));
                     }
                     else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
                     {
-                        osg::UIntArray* indices = static_cast<osg::UIntArray*>(arrays[primitive.indices].get());
-                        osg::DrawElementsUInt* drawElements
-                            = new osg::DrawElementsUInt(mode, indices->begin(), indices->end());
-                        geom->addPrimitiveSet(drawElements);
+                        geom->addPrimitiveSet(makeDrawElements<osg::DrawElementsUInt, GLuint>(mode, indexAccessor));
                     }
                     else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE)
                     {
-                        osg::UByteArray* indices = static_cast<osg::UByteArray*>(arrays[primitive.indices].get());
-                        // Sigh, DrawElementsUByte doesn't have the constructor with iterator arguments.
-                        osg::DrawElementsUByte* drawElements = new osg::DrawElementsUByte(mode, indexAccessor.count);
-                        std::copy(indices->begin(), indices->end(), drawElements->begin());
-                        geom->addPrimitiveSet(drawElements);
+                        geom->addPrimitiveSet(makeDrawElements<osg::DrawElementsUByte, GLubyte>(mode, indexAccessor));
                     }
                     else
                     {
@@ -724,6 +818,28 @@ public:
             return group;
         }
 
+        //! Location of an accessor's first element in its buffer, or null
+        //! if the accessor doesn't fit in the buffer.
+        const unsigned char* getAccessorData(const tinygltf::Accessor& accessor, size_t elementSize, size_t& byteStride) const
+        {
+            if (accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size())
+                return nullptr;
+
+            const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+            if (bufferView.buffer < 0 || bufferView.buffer >= (int)model.buffers.size())
+                return nullptr;
+
+            const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+            byteStride = bufferView.byteStride > 0 ? bufferView.byteStride : elementSize;
+
+            size_t begin = bufferView.byteOffset + accessor.byteOffset;
+            size_t end = accessor.count > 0 ? begin + (accessor.count - 1) * byteStride + elementSize : begin;
+            if (end > buffer.data.size() || accessor.count == 0)
+                return nullptr;
+
+            return &buffer.data[begin];
+        }
+
         // Parameterize the creation of OSG arrays from glTF
         // accessors. It's a bit gratuitous to make ComponentType and
         // AccessorType template parameters. The thought was that the
@@ -734,257 +850,337 @@ public:
         class ArrayBuilder
         {
         public:
-            static OSGArray* makeArray(unsigned int size)
+            typedef typename OSGArray::ElementDataType ElementType;
+
+            static OSGArray* makeArray(const NodeBuilder& builder, const tinygltf::Accessor& accessor)
             {
-                return new OSGArray(size);
+                const size_t elementSize =
+                    tinygltf::GetComponentSizeInBytes(ComponentType) *
+                    tinygltf::GetNumComponentsInType(AccessorType);
+
+                if (elementSize != sizeof(ElementType))
+                    return nullptr;
+
+                size_t byteStride = 0;
+                const unsigned char* ptr = builder.getAccessorData(accessor, elementSize, byteStride);
+                if (!ptr)
+                    return nullptr;
+
+                if (byteStride == elementSize)
+                {
+                    // Tightly packed: a single allocation and copy.
+                    const ElementType* first = reinterpret_cast<const ElementType*>(ptr);
+                    return new OSGArray(accessor.count, first);
+                }
+                else
+                {
+                    // Interleaved
+                    OSGArray* result = new OSGArray();
+                    result->reserve(accessor.count);
+                    ElementType value;
+                    for (size_t i = 0; i < accessor.count; ++i, ptr += byteStride)
+                    {
+                        memcpy(&value, ptr, elementSize);
+                        result->push_back(value);
+                    }
+                    return result;
+                }
             }
-            static void copyData(OSGArray* dest, const unsigned char* src, size_t viewOffset,
-                                 size_t byteStride,  size_t accessorOffset, size_t count)
+        };
+
+        //! Creates a primitive set straight from an index accessor.
+        template<typename DrawElementsType, typename IndexType>
+        osg::PrimitiveSet* makeDrawElements(GLenum mode, const tinygltf::Accessor& accessor) const
+        {
+            DrawElementsType* drawElements = new DrawElementsType(mode);
+            size_t byteStride = 0;
+            const unsigned char* ptr = getAccessorData(accessor, sizeof(IndexType), byteStride);
+            if (ptr)
             {
-                int32_t componentSize = tinygltf::GetComponentSizeInBytes(ComponentType);
-                int32_t numComponents = tinygltf::GetNumComponentsInType(AccessorType);
-                if (byteStride == 0)
+                drawElements->reserve(accessor.count);
+                if (byteStride == sizeof(IndexType))
                 {
-                    memcpy(&(*dest)[0], src + accessorOffset + viewOffset, componentSize * numComponents * count);
+                    const IndexType* first = reinterpret_cast<const IndexType*>(ptr);
+                    drawElements->insert(drawElements->end(), first, first + accessor.count);
                 }
                 else
                 {
-                    const unsigned char* ptr = src + accessorOffset + viewOffset;
-                    for (int i = 0; i < count; ++i, ptr += byteStride)
+                    IndexType index;
+                    for (size_t i = 0; i < accessor.count; ++i, ptr += byteStride)
                     {
-                        memcpy(&(*dest)[i], ptr, componentSize * numComponents);
+                        memcpy(&index, ptr, sizeof(IndexType));
+                        drawElements->push_back(index);
                     }
                 }
             }
-            static void copyData(OSGArray* dest, const tinygltf::Buffer& buffer, const tinygltf::BufferView& bufferView,
-                                 const tinygltf::Accessor& accessor)
+            return drawElements;
+        }
+
+        template<typename T>
+        static void dequantizeData(const void* in, float* out, unsigned count, bool normalized)
+        {
+            const T* src = static_cast<const T*>(in);
+            if (normalized)
             {
-                copyData(dest, &buffer.data.at(0), bufferView.byteOffset,
-                         bufferView.byteStride, accessor.byteOffset, accessor.count);
+                // glTF normalization rules: c/max for unsigned, max(c/max, -1) for signed
+                const float denom = (float)std::numeric_limits<T>::max();
+                for (unsigned i = 0; i < count; ++i)
+                    out[i] = osg::maximum((float)src[i] / denom, -1.0f);
             }
-            static OSGArray* makeArray(const tinygltf::Buffer& buffer, const tinygltf::BufferView& bufferView,
-                                       const tinygltf::Accessor& accessor)
+            else
             {
-                OSGArray* result = new OSGArray(accessor.count);
-                copyData(result, buffer, bufferView, accessor);
-                return result;
+                for (unsigned i = 0; i < count; ++i)
+                    out[i] = (float)src[i];
             }
-        };
+        }
 
-        // Take all of the accessors and turn them into arrays
-        void extractArrays(std::vector<osg::ref_ptr<osg::Array>> &arrays) const
+        //! Float version of an accessor's array. Quantized arrays
+        //! (KHR_mesh_quantization) are converted to floats, using the
+        //! accessor's normalization.
+        osg::Array* getFloatArray(int index) const
         {
-            for (unsigned int i = 0; i < model.accessors.size(); i++)
+            osg::Array* in = getArray(index);
+            if (!in || in->getDataType() == GL_FLOAT)
+                return in;
+
+            const unsigned numElements = in->getNumElements();
+            osg::ref_ptr<osg::Array> out;
+            switch (in->getDataSize())
             {
-                const tinygltf::Accessor& accessor = model.accessors[i];
-                const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-                const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-                osg::ref_ptr< osg::Array > osgArray;
+            case 1: out = new osg::FloatArray(numElements); break;
+            case 2: out = new osg::Vec2Array(numElements); break;
+            case 3: out = new osg::Vec3Array(numElements); break;
+            case 4: out = new osg::Vec4Array(numElements); break;
+            default: return in;
+            }
+
+            const unsigned count = numElements * in->getDataSize();
+            float* dest = static_cast<float*>(const_cast<GLvoid*>(out->getDataPointer()));
+            const bool normalized = in->getNormalize();
+
+            switch (in->getDataType())
+            {
+            case GL_BYTE:           dequantizeData<GLbyte>(in->getDataPointer(), dest, count, normalized); break;
+            case GL_UNSIGNED_BYTE:  dequantizeData<GLubyte>(in->getDataPointer(), dest, count, normalized); break;
+            case GL_SHORT:          dequantizeData<GLshort>(in->getDataPointer(), dest, count, normalized); break;
+            case GL_UNSIGNED_SHORT: dequantizeData<GLushort>(in->getDataPointer(), dest, count, normalized); break;
+            default: return in;
+            }
+
+            out->setBinding(in->getBinding());
+            out->setNormalize(false);
+            arrays[index] = out;
+            return out.get();
+        }
+
+        // Turn an accessor into an OSG array
+        osg::Array* extractArray(const tinygltf::Accessor& accessor) const
+        {
+            osg::ref_ptr< osg::Array > osgArray;
 
-                switch (accessor.componentType)
+            switch (accessor.componentType)
+            {
+            case TINYGLTF_COMPONENT_TYPE_BYTE:
+                switch (accessor.type)
                 {
-                case TINYGLTF_COMPONENT_TYPE_BYTE:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::ByteArray,
-                                                TINYGLTF_COMPONENT_TYPE_BYTE,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2bArray,
-                                                TINYGLTF_COMPONENT_TYPE_BYTE,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3bArray,
-                                                TINYGLTF_COMPONENT_TYPE_BYTE,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4bArray,
-                                                TINYGLTF_COMPONENT_TYPE_BYTE,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::ByteArray,
+                                            TINYGLTF_COMPONENT_TYPE_BYTE,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
                     break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::UByteArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2ubArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3ubArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4ubArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2bArray,
+                                            TINYGLTF_COMPONENT_TYPE_BYTE,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
                     break;
-                case TINYGLTF_COMPONENT_TYPE_SHORT:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::ShortArray,
-                                                TINYGLTF_COMPONENT_TYPE_SHORT,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2sArray,
-                                                TINYGLTF_COMPONENT_TYPE_SHORT,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3sArray,
-                                                TINYGLTF_COMPONENT_TYPE_SHORT,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4sArray,
-                                                TINYGLTF_COMPONENT_TYPE_SHORT,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3bArray,
+                                            TINYGLTF_COMPONENT_TYPE_BYTE,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
                     break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::UShortArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2usArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3usArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4usArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4bArray,
+                                            TINYGLTF_COMPONENT_TYPE_BYTE,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
                     break;
-                case TINYGLTF_COMPONENT_TYPE_INT:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::IntArray,
-                                                TINYGLTF_COMPONENT_TYPE_INT,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2uiArray,
-                                                TINYGLTF_COMPONENT_TYPE_INT,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3uiArray,
-                                                TINYGLTF_COMPONENT_TYPE_INT,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4uiArray,
-                                                TINYGLTF_COMPONENT_TYPE_INT,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
+                default:
                     break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::UIntArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2iArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3iArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4iArray,
-                                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
+                }
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                switch (accessor.type)
+                {
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::UByteArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2ubArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3ubArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4ubArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
+                    break;
+                default:
+                    break;
+                }
+                break;
+            case TINYGLTF_COMPONENT_TYPE_SHORT:
+                switch (accessor.type)
+                {
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::ShortArray,
+                                            TINYGLTF_COMPONENT_TYPE_SHORT,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2sArray,
+                                            TINYGLTF_COMPONENT_TYPE_SHORT,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3sArray,
+                                            TINYGLTF_COMPONENT_TYPE_SHORT,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4sArray,
+                                            TINYGLTF_COMPONENT_TYPE_SHORT,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
                     break;
-                case TINYGLTF_COMPONENT_TYPE_FLOAT:
-                    switch (accessor.type)
-                    {
-                    case TINYGLTF_TYPE_SCALAR:
-                        osgArray = ArrayBuilder<osg::FloatArray,
-                                                TINYGLTF_COMPONENT_TYPE_FLOAT,
-                                                TINYGLTF_TYPE_SCALAR>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC2:
-                        osgArray = ArrayBuilder<osg::Vec2Array,
-                                                TINYGLTF_COMPONENT_TYPE_FLOAT,
-                                                TINYGLTF_TYPE_VEC2>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC3:
-                        osgArray = ArrayBuilder<osg::Vec3Array,
-                                                TINYGLTF_COMPONENT_TYPE_FLOAT,
-                                                TINYGLTF_TYPE_VEC3>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    case TINYGLTF_TYPE_VEC4:
-                        osgArray = ArrayBuilder<osg::Vec4Array,
-                                                TINYGLTF_COMPONENT_TYPE_FLOAT,
-                                                TINYGLTF_TYPE_VEC4>::makeArray(buffer, bufferView, accessor);
-                        break;
-                    default:
-                        break;
-                    }
                 default:
                     break;
                 }
-                if (osgArray.valid())
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                switch (accessor.type)
                 {
-                    osgArray->setBinding(osg::Array::BIND_PER_VERTEX);
-                    osgArray->setNormalize(accessor.normalized);
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::UShortArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2usArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3usArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4usArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
+                    break;
+                default:
+                    break;
                 }
-                else
+                break;
+            case TINYGLTF_COMPONENT_TYPE_INT:
+                switch (accessor.type)
+                {
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::IntArray,
+                                            TINYGLTF_COMPONENT_TYPE_INT,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2uiArray,
+                                            TINYGLTF_COMPONENT_TYPE_INT,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3uiArray,
+                                            TINYGLTF_COMPONENT_TYPE_INT,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4uiArray,
+                                            TINYGLTF_COMPONENT_TYPE_INT,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
+                    break;
+                default:
+                    break;
+                }
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                switch (accessor.type)
+                {
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::UIntArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2iArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3iArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4iArray,
+                                            TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
+                    break;
+                default:
+                    break;
+                }
+                break;
+            case TINYGLTF_COMPONENT_TYPE_FLOAT:
+                switch (accessor.type)
                 {
-                    OSG_DEBUG << "Adding null array for " << i << std::endl;
+                case TINYGLTF_TYPE_SCALAR:
+                    osgArray = ArrayBuilder<osg::FloatArray,
+                                            TINYGLTF_COMPONENT_TYPE_FLOAT,
+                                            TINYGLTF_TYPE_SCALAR>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC2:
+                    osgArray = ArrayBuilder<osg::Vec2Array,
+                                            TINYGLTF_COMPONENT_TYPE_FLOAT,
+                                            TINYGLTF_TYPE_VEC2>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC3:
+                    osgArray = ArrayBuilder<osg::Vec3Array,
+                                            TINYGLTF_COMPONENT_TYPE_FLOAT,
+                                            TINYGLTF_TYPE_VEC3>::makeArray(*this, accessor);
+                    break;
+                case TINYGLTF_TYPE_VEC4:
+                    osgArray = ArrayBuilder<osg::Vec4Array,
+                                            TINYGLTF_COMPONENT_TYPE_FLOAT,
+                                            TINYGLTF_TYPE_VEC4>::makeArray(*this, accessor);
+                    break;
+                default:
+                    break;
                 }
-                arrays.push_back(osgArray);
+            default:
+                break;
+            }
+            if (osgArray.valid())
+            {
+                osgArray->setBinding(osg::Array::BIND_PER_VERTEX);
+                osgArray->setNormalize(accessor.normalized);
+            }
+            else
+            {
+                OSG_DEBUG << "Null array for accessor " << accessor.name << std::endl;
             }
+            return osgArray.release();
         }
 
         static bool null(const tinygltf::Value& val)
@@ -1007,7 +1203,7 @@ public:
             auto& scales = attributes.Get("SCALE");
             if (!null(translations) && translations.IsInt())
             {
-                osg::Vec3Array* array = dynamic_cast<osg::Vec3Array*>(arrays[translations.Get<int>()].get());
+                osg::Vec3Array* array = dynamic_cast<osg::Vec3Array*>(getFloatArray(translations.Get<int>()));
                 if (array)
                 {
                     builder.setPositions(array);
@@ -1015,7 +1211,7 @@ public:
             }
             if (!null(rotations) && rotations.IsInt())
             {
-                osg::Vec4Array* array = dynamic_cast<osg::Vec4Array*>(arrays[rotations.Get<int>()].get());
+                osg::Vec4Array* array = dynamic_cast<osg::Vec4Array*>(getFloatArray(rotations.Get<int>()));
                 if (array)
                 {
                     builder.setRotations(array);
@@ -1023,7 +1219,7 @@ public:
             }
             if (!null(scales) && scales.IsInt())
             {
-                osg::Vec3Array* array = dynamic_cast<osg::Vec3Array*>(arrays[scales.Get<int>()].get());
+                osg::Vec3Array* array = dynamic_cast<osg::Vec3Array*>(getFloatArray(scales.Get<int>()));
                 if (array)
                 {
                     builder.setScales(array);
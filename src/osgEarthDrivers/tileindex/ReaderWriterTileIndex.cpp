@@ -64,7 +64,7 @@ public:
         _dbOptions = Registry::instance()->cloneOrCreateOptions(dbOptions);
         if ( _options.url().isSet() )
         {
-            _index = TileIndex::load( _options.url()->full() );        
+            _index = TileIndex::load( _options.url()->full(), _options.cacheSpatialIndex().get() );
             if (_index.valid() )
             {
                 setProfile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() );
@@ -0,0 +1,145 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ClusterNode>
+#include <osgEarth/SpatialReference>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Contrib;
+
+namespace
+{
+    // Builds the hierarchy on the calling thread instead of in the
+    // background, so the test doesn't need a MapNode.
+    class TestClusterNode : public ClusterNode
+    {
+    public:
+        void buildIndex(const SpatialReference* srs)
+        {
+            std::vector<osg::Vec3d> worlds;
+            for (auto& node : _nodes)
+                worlds.push_back(node->getBound().center());
+
+            GeoExtent extent(srs, -180.0, -90.0, 180.0, 90.0);
+            installIndex(createIndex(_nodes, worlds, srs, extent, getRadius(), nullptr, nullptr));
+        }
+
+        std::size_t countIndexedNodes(unsigned zoom, std::size_t& numClusters) const
+        {
+            std::vector<osg::NodeList> clusters;
+            getIndexedClusters(zoom, clusters);
+            numClusters = clusters.size();
+
+            std::size_t count = 0u;
+            for (auto& cluster : clusters)
+                count += cluster.size();
+            return count;
+        }
+
+        bool isIndexed(osg::Node* node) const
+        {
+            std::vector<osg::NodeList> clusters;
+            getIndexedClusters(0u, clusters);
+            for (auto& cluster : clusters)
+                if (std::find(cluster.begin(), cluster.end(), node) != cluster.end())
+                    return true;
+            return false;
+        }
+
+        std::size_t getNumDynamicNodes() const { return _dynamicNodes.size(); }
+
+        using ClusterNode::isIndexStale;
+    };
+
+    osg::Node* makeNode(const SpatialReference* srs, double lon, double lat)
+    {
+        osg::Vec3d world;
+        srs->transformToWorld(osg::Vec3d(lon, lat, 0.0), world);
+        osg::Node* node = new osg::Node();
+        node->setInitialBound(osg::BoundingSphere(world, 1.0f));
+        return node;
+    }
+}
+
+TEST_CASE("ClusterNode index tracks adds and removes across rebuilds")
+{
+    osg::ref_ptr<const SpatialReference> srs = SpatialReference::get("wgs84");
+    osg::ref_ptr<TestClusterNode> clusterNode = new TestClusterNode();
+
+    std::vector<osg::ref_ptr<osg::Node>> nodes;
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        nodes.push_back(makeNode(srs.get(), -170.0 + (i % 50) * 6.8, -60.0 + (i / 50) * 6.0));
+        clusterNode->addNode(nodes.back().get());
+    }
+
+    // every node is a change the (missing) index doesn't include
+    REQUIRE(clusterNode->isIndexStale());
+
+    clusterNode->buildIndex(srs.get());
+    REQUIRE(clusterNode->getNumDynamicNodes() == 0u);
+    REQUIRE_FALSE(clusterNode->isIndexStale());
+
+    std::size_t numClusters;
+    REQUIRE(clusterNode->countIndexedNodes(0u, numClusters) == 1000u);
+    REQUIRE(numClusters < 1000u);
+
+    // removals below the rebuild threshold come out of the index right away
+    for (unsigned i = 0; i < 1000; i += 5)
+        clusterNode->removeNode(nodes[i].get());
+
+    REQUIRE(clusterNode->countIndexedNodes(0u, numClusters) == 800u);
+    REQUIRE_FALSE(clusterNode->isIndexed(nodes[0].get()));
+    REQUIRE(clusterNode->isIndexed(nodes[1].get()));
+    REQUIRE(nodes[0]->referenceCount() == 1);
+    REQUIRE_FALSE(clusterNode->isIndexStale());
+
+    // and enough of them trigger a rebuild
+    for (unsigned i = 1; i < 1000; i += 10)
+        clusterNode->removeNode(nodes[i].get());
+
+    REQUIRE(clusterNode->countIndexedNodes(0u, numClusters) == 700u);
+    REQUIRE(clusterNode->isIndexStale());
+
+    clusterNode->buildIndex(srs.get());
+    REQUIRE_FALSE(clusterNode->isIndexStale());
+    REQUIRE(clusterNode->getNumDynamicNodes() == 0u);
+    REQUIRE(clusterNode->countIndexedNodes(0u, numClusters) == 700u);
+    REQUIRE_FALSE(clusterNode->isIndexed(nodes[1].get()));
+    REQUIRE(clusterNode->isIndexed(nodes[2].get()));
+
+    // new nodes wait outside the index until the next rebuild
+    for (unsigned i = 0; i < 10; ++i)
+        clusterNode->addNode(makeNode(srs.get(), 10.0 + i, 10.0));
+
+    REQUIRE(clusterNode->getNumDynamicNodes() == 10u);
+    REQUIRE(clusterNode->countIndexedNodes(0u, numClusters) == 700u);
+    REQUIRE_FALSE(clusterNode->isIndexStale());
+
+    clusterNode->buildIndex(srs.get());
+    REQUIRE(clusterNode->getNumDynamicNodes() == 0u);
+    REQUIRE(clusterNode->countIndexedNodes(0u, numClusters) == 710u);
+}
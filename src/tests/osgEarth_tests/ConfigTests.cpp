@@ -0,0 +1,198 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Config>
+#include <osgEarth/XmlUtils>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const char* EARTH_FILE =
+        "<map name='test' version='2'>"
+        "  <options><terrain min_lod='2'/></options>"
+        "  <image name='one' driver='gdal'><url>one.tif</url></image>"
+        "  <image name='two' driver='gdal' Enabled='false'><url><![CDATA[two.tif]]></url></image>"
+        "  <elevation name='three' driver='gdal'><url>three.tif</url><shader><![CDATA[void f() { }]]></shader></elevation>"
+        "  <viewpoints><viewpoint heading='10' pitch='-45'>home</viewpoint></viewpoints>"
+        "</map>";
+
+    // Generates an earth file with many layers, similar to large generated files.
+    std::string makeLargeEarthFile(unsigned numLayers)
+    {
+        std::stringstream buf;
+        buf << "<map name='large' version='2'>\n";
+        for (unsigned i = 0; i < numLayers; ++i)
+        {
+            buf << "  <image name='layer" << i << "' driver='gdal' min_level='0' max_level='19' enabled='true'>\n"
+                << "    <url>data/layer" << i << ".tif</url>\n"
+                << "    <profile>global-geodetic</profile>\n"
+                << "    <cache_policy usage='read_write' max_age='86400'/>\n"
+                << "    <shader><![CDATA[ void layer" << i << "(inout vec4 c) { c.rgb *= 0.5; } ]]></shader>\n"
+                << "    <color_filters><gamma rgb='1.3'/></color_filters>\n"
+                << "  </image>\n";
+        }
+        buf << "</map>\n";
+        return buf.str();
+    }
+}
+
+TEST_CASE( "Config" ) {
+
+    SECTION("Child lookup and typed values") {
+        Config conf("layer");
+        conf.set("name", "one");
+        conf.set("min_level", 3);
+        conf.add("url", "a.tif");
+        conf.add("url", "b.tif");
+
+        REQUIRE(conf.hasChild("name"));
+        REQUIRE_FALSE(conf.hasChild("missing"));
+        REQUIRE(conf.child("url").value() == "a.tif");
+        REQUIRE(conf.child_ptr("missing") == 0L);
+
+        optional<int> minLevel;
+        REQUIRE(conf.get("min_level", minLevel));
+        REQUIRE(minLevel.get() == 3);
+
+        optional<int> maxLevel(19);
+        REQUIRE_FALSE(conf.get("max_level", maxLevel));
+        REQUIRE(maxLevel.get() == 19);
+
+        std::string name;
+        REQUIRE(conf.get("name", name));
+        REQUIRE(name == "one");
+
+        REQUIRE(conf.value<int>("min_level", 0) == 3);
+        REQUIRE(conf.value<int>("missing", 7) == 7);
+    }
+
+    SECTION("children_view iterates matching children without copying") {
+        Config conf("map");
+        conf.add("image", "a");
+        conf.add("elevation", "b");
+        conf.add("image", "c");
+
+        std::vector<const Config*> images;
+        for (const Config& image : conf.children_view("image"))
+            images.push_back(&image);
+
+        REQUIRE(images.size() == 2);
+        REQUIRE(images[0] == &conf.children().front());
+        REQUIRE(images[1] == &conf.children().back());
+        REQUIRE(images[1]->value() == "c");
+
+        REQUIRE(conf.children_view("missing").empty());
+        REQUIRE(conf.children("image").size() == 2);
+    }
+
+    SECTION("loadConfig matches the XmlDocument conversion") {
+        std::stringstream in1(EARTH_FILE), in2(EARTH_FILE);
+        osg::ref_ptr<XmlDocument> doc = XmlDocument::load(in1);
+        REQUIRE(doc.valid());
+
+        Config expected = doc->getConfig();
+        Config actual = XmlDocument::loadConfig(in2);
+
+        REQUIRE(actual.toJSON() == expected.toJSON());
+        REQUIRE(actual.child("map").child("image").value("name") == "one");
+        REQUIRE(actual.child("map").children("image").back().value("enabled") == "false");
+        REQUIRE(actual.child("map").child("elevation").value("shader") == "void f() { }");
+    }
+
+    SECTION("loadConfig returns an empty Config for bad XML") {
+        std::stringstream in("<map><image></map>");
+        REQUIRE(XmlDocument::loadConfig(in).empty());
+    }
+
+    SECTION("JSON round trip") {
+        Config a("image"), b("image");
+        a.set("name", "a");
+        b.set("name", "b");
+
+        Config conf("map");
+        conf.add(a);
+        conf.add(b);
+        conf.set("name", "test");
+
+        Config result = Config::readJSON(conf.toJSON());
+        REQUIRE(result.key() == "map");
+        REQUIRE(result.value("name") == "test");
+        REQUIRE(result.children("image").size() == 2);
+        REQUIRE(result.children("image").back().value("name") == "b");
+    }
+}
+
+// Not run by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE( "Config parsing benchmark", "[.][benchmark]" ) {
+
+    std::string xml = makeLargeEarthFile(10000);
+
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        std::stringstream in(xml);
+        osg::ref_ptr<XmlDocument> doc = XmlDocument::load(in);
+        Config conf = doc->getConfig();
+        REQUIRE(conf.child("map").children().size() > 10000u);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    Config conf;
+    {
+        std::stringstream in(xml);
+        conf = XmlDocument::loadConfig(in);
+        REQUIRE(conf.child("map").children().size() > 10000u);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    // typical options parsing: many gets on each layer
+    unsigned found = 0;
+    for (const Config& layer : conf.child("map").children_view("image"))
+    {
+        optional<std::string> name, driver, url, profile;
+        optional<int> minLevel, maxLevel;
+        optional<bool> enabled, visible;
+        found += layer.get("name", name);
+        found += layer.get("driver", driver);
+        found += layer.get("url", url);
+        found += layer.get("profile", profile);
+        found += layer.get("min_level", minLevel);
+        found += layer.get("max_level", maxLevel);
+        found += layer.get("enabled", enabled);
+        found += layer.get("visible", visible);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    REQUIRE(found == 10000u * 7u);
+
+    typedef std::chrono::duration<double, std::milli> ms;
+    std::cout
+        << "Earth file size: " << xml.size() / 1024 << " KB" << std::endl
+        << "  XmlDocument + getConfig: " << ms(t1 - t0).count() << " ms" << std::endl
+        << "  XmlDocument::loadConfig: " << ms(t2 - t1).count() << " ms" << std::endl
+        << "  Options lookups:         " << ms(t3 - t2).count() << " ms" << std::endl;
+}
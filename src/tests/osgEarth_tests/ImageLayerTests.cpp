@@ -25,6 +25,7 @@
 #include <osgEarth/ImageLayer>
 #include <osgEarth/Registry>
 #include <osgEarth/GDAL>
+#include <osgEarth/ImageUtils>
 
 using namespace osgEarth;
 
@@ -67,4 +68,62 @@ TEST_CASE("Attribution works")
 
     REQUIRE(status.isOK());
     REQUIRE(layer->getAttribution() == attribution);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Mipmaps are built level to level")
+{
+    SECTION("RGBA8")
+    {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(4, 2, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        for (int i = 0; i < 4 * 2 * 4; ++i)
+            image->data()[i] = (unsigned char)(i * 8);
+
+        ImageUtils::mipmapImageInPlace(image.get());
+        REQUIRE(image->getNumMipmapLevels() == 3);
+
+        // level 1 is 2x1; each texel averages a 2x2 block of level 0
+        const unsigned char* level1 = image->getMipmapData(1);
+        REQUIRE(level1[0] == (0 + 32 + 128 + 160 + 2) / 4);
+        REQUIRE(level1[4] == (64 + 96 + 192 + 224 + 2) / 4);
+
+        // level 2 is 1x1 and averages level 1
+        const unsigned char* level2 = image->getMipmapData(2);
+        REQUIRE(level2[0] == (level1[0] + level1[4] + level1[0] + level1[4] + 2) / 4);
+    }
+
+    SECTION("R32F")
+    {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(2, 2, 1, GL_RED, GL_FLOAT);
+        float* data = reinterpret_cast<float*>(image->data());
+        data[0] = 1.0f, data[1] = 2.0f, data[2] = 3.0f, data[3] = 6.0f;
+
+        osg::ref_ptr<const osg::Image> mipmapped = ImageUtils::mipmapImage(image.get());
+        REQUIRE(mipmapped->getNumMipmapLevels() == 2);
+        REQUIRE(*reinterpret_cast<const float*>(mipmapped->getMipmapData(1)) == 3.0f);
+    }
+
+    SECTION("Odd dimensions")
+    {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(5, 5, 1, GL_RED, GL_FLOAT);
+        float* data = reinterpret_cast<float*>(image->data());
+        for (int y = 0; y < 5; ++y)
+            for (int x = 0; x < 5; ++x)
+                data[y * 5 + x] = (float)(y * 5 + x);
+
+        ImageUtils::mipmapImageInPlace(image.get());
+        REQUIRE(image->getNumMipmapLevels() == 3);
+
+        // level 1 is 2x2; the last column and row fold into the last texels
+        const float* level1 = reinterpret_cast<const float*>(image->getMipmapData(1));
+        REQUIRE(level1[0] == (0.0f + 1.0f + 5.0f + 6.0f) / 4.0f);
+        REQUIRE(level1[1] == (2.0f + 3.0f + 4.0f + 7.0f + 8.0f + 9.0f) / 6.0f);
+        REQUIRE(level1[2] == (10.0f + 11.0f + 15.0f + 16.0f + 20.0f + 21.0f) / 6.0f);
+        REQUIRE(level1[3] == 18.0f);
+
+        // level 2 is 1x1
+        REQUIRE(*reinterpret_cast<const float*>(image->getMipmapData(2)) == 10.5f);
+    }
+}
@@ -0,0 +1,129 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Map>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/StringUtils>
+#include <thread>
+#include <chrono>
+
+using namespace osgEarth;
+
+namespace
+{
+    // Simulates an I/O-bound open, and optionally opens another layer
+    // first the way a layer opens a referenced feature source.
+    class SlowOpenLayer : public ElevationLayer
+    {
+    public:
+        META_Layer(osgEarth, SlowOpenLayer, ElevationLayer::Options, ElevationLayer, slow_open);
+
+        osg::ref_ptr<Layer> _dependency;
+        bool _dependencyWasOpen = false;
+
+    protected:
+        Status openImplementation() override
+        {
+            Status parent = ElevationLayer::openImplementation();
+            if (parent.isError())
+                return parent;
+
+            if (_dependency.valid())
+            {
+                _dependency->open();
+                _dependencyWasOpen = _dependency->isOpen();
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            setProfile(Profile::create("global-geodetic"));
+            return Status::OK();
+        }
+
+        GeoHeightField createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const override
+        {
+            return GeoHeightField::INVALID;
+        }
+    };
+}
+
+TEST_CASE("Map opens layers in parallel")
+{
+    osg::ref_ptr<Map> map = new Map();
+    map->setOpenLayersInParallel(true);
+    map->setOpenLayersThreads(4u);
+    REQUIRE(map->getOpenLayersThreads() == 4u);
+
+    LayerVector layers;
+    for (unsigned i = 0; i < 12; ++i)
+    {
+        SlowOpenLayer* layer = new SlowOpenLayer();
+        layer->setName(Stringify() << "layer" << i);
+        layers.push_back(layer);
+    }
+
+    // a later layer depends on an earlier one, and an earlier one on a later one.
+    SlowOpenLayer* dependentOnEarlier = static_cast<SlowOpenLayer*>(layers[9].get());
+    dependentOnEarlier->_dependency = layers[2].get();
+    SlowOpenLayer* dependentOnLater = static_cast<SlowOpenLayer*>(layers[1].get());
+    dependentOnLater->_dependency = layers[10].get();
+
+    map->addLayers(layers);
+
+    LayerVector result;
+    map->getLayers(result);
+    REQUIRE(result.size() == layers.size());
+
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        CHECK(result[i].get() == layers[i].get());
+        CHECK(result[i]->isOpen());
+    }
+
+    CHECK(dependentOnEarlier->_dependencyWasOpen);
+    CHECK(dependentOnLater->_dependencyWasOpen);
+}
+
+TEST_CASE("Map opens layers serially")
+{
+    osg::ref_ptr<Map> map = new Map();
+    map->setOpenLayersInParallel(false);
+
+    LayerVector layers;
+    for (unsigned i = 0; i < 4; ++i)
+        layers.push_back(new SlowOpenLayer());
+
+    map->addLayers(layers);
+
+    LayerVector result;
+    map->getLayers(result);
+    REQUIRE(result.size() == layers.size());
+
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        CHECK(result[i].get() == layers[i].get());
+        CHECK(result[i]->isOpen());
+    }
+}
@@ -34,7 +34,45 @@ namespace
             if (!osg::equivalent(a[i], b[i])) return false;
         return true;
     }
-                
+
+    // Transforms the input points twice, once with the built-in fast
+    // transformation kernels and once through PROJ.
+    bool transformFastAndProj(
+        const SpatialReference* from,
+        const SpatialReference* to,
+        const std::vector<osg::Vec3d>& input,
+        std::vector<osg::Vec3d>& fast,
+        std::vector<osg::Vec3d>& proj)
+    {
+        fast = input;
+        proj = input;
+        SpatialReference::setUseFastTransforms(true);
+        bool fastOK = from->transform(fast, to);
+        SpatialReference::setUseFastTransforms(false);
+        bool projForced = !from->hasFastTransform(to);
+        bool projOK = from->transform(proj, to);
+        SpatialReference::setUseFastTransforms(true);
+        return fastOK && projForced && projOK;
+    }
+
+    bool xy_eq(const std::vector<osg::Vec3d>& a, const std::vector<osg::Vec3d>& b, double eps) {
+        if (a.size() != b.size()) return false;
+        for(unsigned i=0; i<a.size(); ++i)
+            if (!osg::equivalent(a[i].x(), b[i].x(), eps) || !osg::equivalent(a[i].y(), b[i].y(), eps))
+                return false;
+        return true;
+    }
+
+    std::vector<osg::Vec3d> makeGrid(double west, double south, double east, double north, unsigned num) {
+        std::vector<osg::Vec3d> points;
+        for(unsigned r=0; r<num; ++r)
+            for(unsigned c=0; c<num; ++c)
+                points.push_back(osg::Vec3d(
+                    west + (east-west)*double(c)/double(num-1),
+                    south + (north-south)*double(r)/double(num-1),
+                    0.0));
+        return points;
+    }
 }
 
 TEST_CASE( "SpatialReferences are cached" ) {
@@ -197,4 +235,67 @@ TEST_CASE("getGeocentricSRS") {
 
     REQUIRE(ecef->transform(np_ecef, wgs84, temp));
     REQUIRE(vec_eq(temp, np_wgs84));
-}
\ No newline at end of file
+}
+
+TEST_CASE("Fast transforms match PROJ") {
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    std::vector<osg::Vec3d> fast, proj;
+
+    SECTION("WGS84 <-> Spherical Mercator") {
+        const SpatialReference* sm = SpatialReference::get("spherical-mercator");
+        std::vector<osg::Vec3d> geo = makeGrid(-180.0, -85.0, 180.0, 85.0, 25);
+
+        // make sure we're testing the built-in kernel and not PROJ twice
+        REQUIRE(sm->isSphericalMercator());
+        REQUIRE(wgs84->hasFastTransform(sm));
+        REQUIRE(sm->hasFastTransform(wgs84));
+
+        REQUIRE(transformFastAndProj(wgs84, sm, geo, fast, proj));
+        REQUIRE(xy_eq(fast, proj, 1e-6));
+
+        std::vector<osg::Vec3d> merc = fast;
+        REQUIRE(transformFastAndProj(sm, wgs84, merc, fast, proj));
+        REQUIRE(xy_eq(fast, proj, 1e-9));
+        REQUIRE(xy_eq(fast, geo, 1e-9));
+    }
+
+    SECTION("WGS84 <-> UTM") {
+        const SpatialReference* utm33n = SpatialReference::get("+proj=utm +zone=33 +datum=WGS84 +units=m +no_defs");
+        std::vector<osg::Vec3d> geo = makeGrid(9.0, 0.0, 21.0, 84.0, 25);
+
+        REQUIRE(wgs84->hasFastTransform(utm33n));
+        REQUIRE(utm33n->hasFastTransform(wgs84));
+
+        REQUIRE(transformFastAndProj(wgs84, utm33n, geo, fast, proj));
+        REQUIRE(xy_eq(fast, proj, 1e-4));
+
+        std::vector<osg::Vec3d> utm = fast;
+        REQUIRE(transformFastAndProj(utm33n, wgs84, utm, fast, proj));
+        REQUIRE(xy_eq(fast, proj, 1e-9));
+        REQUIRE(xy_eq(fast, geo, 1e-9));
+
+        const SpatialReference* utm33s = SpatialReference::get("+proj=utm +zone=33 +south +datum=WGS84 +units=m +no_defs");
+        geo = makeGrid(9.0, -80.0, 21.0, 0.0, 25);
+
+        REQUIRE(wgs84->hasFastTransform(utm33s));
+
+        REQUIRE(transformFastAndProj(wgs84, utm33s, geo, fast, proj));
+        REQUIRE(xy_eq(fast, proj, 1e-4));
+
+        utm = fast;
+        REQUIRE(transformFastAndProj(utm33s, wgs84, utm, fast, proj));
+        REQUIRE(xy_eq(fast, proj, 1e-9));
+    }
+
+    SECTION("WGS84 <-> ECEF") {
+        // the geocentric SRS bypasses PROJ; compare to PROJ's own geocentric conversion.
+        const SpatialReference* ecef = wgs84->getGeocentricSRS();
+        const SpatialReference* geocent = SpatialReference::get("+proj=geocent +datum=WGS84 +units=m +no_defs");
+        std::vector<osg::Vec3d> geo = makeGrid(-180.0, -90.0, 180.0, 90.0, 25);
+
+        std::vector<osg::Vec3d> a(geo), b(geo);
+        REQUIRE(wgs84->transform(a, ecef));
+        REQUIRE(wgs84->transform(b, geocent));
+        REQUIRE(xy_eq(a, b, 1e-4));
+    }
+}
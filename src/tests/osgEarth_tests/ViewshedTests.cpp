@@ -0,0 +1,119 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Viewshed>
+#include <osgEarth/Map>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/HeightFieldUtils>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Rolling hills computed from the coordinates, so no data files are needed.
+    class SyntheticElevationLayer : public ElevationLayer
+    {
+    public:
+        META_Layer(osgEarth, SyntheticElevationLayer, ElevationLayer::Options, ElevationLayer, synthetic_elevation);
+
+    protected:
+        Status openImplementation() override
+        {
+            Status parent = ElevationLayer::openImplementation();
+            if (parent.isError())
+                return parent;
+
+            setProfile(Profile::create("global-geodetic"));
+            return Status::OK();
+        }
+
+        GeoHeightField createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const override
+        {
+            const GeoExtent& extent = key.getExtent();
+            const unsigned size = 65u;
+
+            osg::ref_ptr<osg::HeightField> hf = HeightFieldUtils::createReferenceHeightField(
+                extent, size, size, 0u);
+
+            for (unsigned row = 0; row < size; ++row)
+            {
+                double lat = extent.yMin() + extent.height() * (double)row / (double)(size - 1);
+                for (unsigned col = 0; col < size; ++col)
+                {
+                    double lon = extent.xMin() + extent.width() * (double)col / (double)(size - 1);
+                    hf->setHeight(col, row, (float)(150.0 * sin(lon * 900.0) * cos(lat * 700.0) + 40.0 * sin(lat * 2300.0)));
+                }
+            }
+
+            return GeoHeightField(hf.get(), extent);
+        }
+    };
+}
+
+TEST_CASE("Viewshed")
+{
+    osg::ref_ptr<Map> map = new Map();
+    map->addLayer(new SyntheticElevationLayer());
+
+    Viewshed viewshed(map.get());
+    viewshed.setObserver(GeoPoint(map->getSRS(), 0.01, 0.01, 5.0, ALTMODE_RELATIVE));
+    viewshed.setRadius(2000.0);
+    viewshed.setResolution(50.0);
+
+    SECTION("Parallel and serial computations agree")
+    {
+        viewshed.setParallel(true);
+        Viewshed::Result parallel = viewshed.compute();
+
+        viewshed.setParallel(false);
+        Viewshed::Result serial = viewshed.compute();
+
+        REQUIRE(parallel.valid());
+        REQUIRE(serial.valid());
+        REQUIRE(parallel.getSize() == serial.getSize());
+        REQUIRE(parallel.getCells() == serial.getCells());
+
+        bool sameElevations = true;
+        for (unsigned row = 0; row < serial.getSize(); ++row)
+            for (unsigned col = 0; col < serial.getSize(); ++col)
+                if (parallel.getElevation(col, row) != serial.getElevation(col, row))
+                    sameElevations = false;
+        REQUIRE(sameElevations);
+
+        // the hills must hide something, or the comparison proves little
+        bool anyHidden = false;
+        for (auto cell : serial.getCells())
+            if (cell == Viewshed::VISIBILITY_HIDDEN)
+                anyHidden = true;
+        REQUIRE(anyHidden);
+    }
+
+    SECTION("No viewshed without elevation data")
+    {
+        Viewshed detached;
+        detached.setObserver(viewshed.getObserver());
+        REQUIRE(detached.compute().valid() == false);
+    }
+}